@@ -22,6 +22,7 @@
 
 // Qt
 #include <QMutex>
+#include <QAtomicInt>
 #include <QLinkedList>
 #include <QWaitCondition>
 
@@ -34,10 +35,15 @@
 #include "torctimer.h"
 #include "torcbuffer.h"
 #include "torcavutils.h"
+#include "torcprobecache.h"
 #include "audiooutputsettings.h"
 #include "audiowrapper.h"
 #include "audiodecoder.h"
 
+#if defined(Q_OS_LINUX)
+#include <time.h>
+#endif
+
 extern "C" {
 #include "libavformat/avformat.h"
 #include "libavdevice/avdevice.h"
@@ -319,6 +325,46 @@ class TorcPacketQueue
     QLinkedList<AVPacket*> m_queue;
 };
 
+/*! \brief Return the CPU time, in microseconds, consumed by the calling thread or -1 if unsupported.
+*/
+static qint64 ThreadCPUTime(void)
+{
+#if defined(Q_OS_LINUX)
+    struct timespec time;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) == 0)
+        return ((qint64)time.tv_sec * 1000000) + (time.tv_nsec / 1000);
+#endif
+    return -1;
+}
+
+/*! \class TorcDecoderStatistics
+ *  \brief Performance counters for a single decoder thread.
+*/
+class TorcDecoderStatistics
+{
+  public:
+    TorcDecoderStatistics()
+      : m_packets(0),
+        m_frames(0),
+        m_bytes(0),
+        m_waitTime(0),
+        m_cpuTime(-1),
+        m_startTime(0),
+        m_stopTime(0)
+    {
+    }
+
+    qint64  m_packets;
+    qint64  m_frames;
+    qint64  m_bytes;
+    qint64  m_waitTime;
+    qint64  m_cpuTime;
+    quint64 m_startTime;
+    quint64 m_stopTime;
+};
+
+#define STATISTICS_PUBLISH_INTERVAL 64 // packets
+
 class TorcDecoderThread : public TorcQThread
 {
   public:
@@ -330,13 +376,15 @@ class TorcDecoderThread : public TorcQThread
         m_state(TorcDecoder::None),
         m_requestedState(TorcDecoder::None),
         m_demuxerState(TorcDecoder::DemuxerReady),
-        m_internalBufferEmpty(true)
+        m_internalBufferEmpty(true),
+        m_statisticsLock(new QMutex())
     {
     }
 
     virtual ~TorcDecoderThread()
     {
         delete m_queue;
+        delete m_statisticsLock;
     }
 
     bool IsRunning(void)
@@ -393,10 +441,44 @@ class TorcDecoderThread : public TorcQThread
         Initialise();
         m_threadRunning = true;
         RunFunction();
+        PublishStatistics();
         m_threadRunning = false;
         Deinitialise();
     }
 
+    /*! \brief Count a packet (of Bytes bytes) processed by this thread.
+     *
+     * Counters are tallied locally by the owning thread and published periodically (and when the thread
+     * exits), so the hot path never takes a lock or touches memory shared with other threads.
+    */
+    void Counted(qint64 Bytes = 0)
+    {
+        m_tally.m_packets++;
+        m_tally.m_bytes += Bytes;
+        if ((m_tally.m_packets % STATISTICS_PUBLISH_INTERVAL) == 0)
+            PublishStatistics();
+    }
+
+    void Waited(qint64 Microseconds)
+    {
+        m_tally.m_waitTime += Microseconds;
+    }
+
+    /// Copy the local tally to the published statistics. Must be called from the owning thread.
+    void PublishStatistics(void)
+    {
+        m_tally.m_cpuTime = ThreadCPUTime();
+        QMutexLocker locker(m_statisticsLock);
+        m_published = m_tally;
+    }
+
+    /// Return the most recently published statistics. Thread safe.
+    TorcDecoderStatistics GetStatistics(void)
+    {
+        QMutexLocker locker(m_statisticsLock);
+        return m_published;
+    }
+
     void Start(void)
     {
     }
@@ -414,6 +496,11 @@ class TorcDecoderThread : public TorcQThread
     TorcDecoder::DecoderState  m_requestedState;
     TorcDecoder::DemuxerState  m_demuxerState;
     bool                       m_internalBufferEmpty;
+
+    // statistics
+    TorcDecoderStatistics      m_tally;      // owning thread only
+    TorcDecoderStatistics      m_published;  // protected by m_statisticsLock
+    QMutex                    *m_statisticsLock;
 };
 
 class TorcVideoThread : public TorcDecoderThread
@@ -517,6 +604,10 @@ class AudioDecoderPriv
         m_avFormatContext(NULL),
         m_createdAVFormatContext(false),
         m_pauseResult(0),
+        m_preroll(0),
+        m_deferredAudioSetup(0),
+        m_gapless(false),
+        m_audioPosition(0),
         m_demuxerThread(new TorcDemuxerThread(Parent)),
         m_audioResampleContext(NULL),
         m_audioResampleChannelLayout(0),
@@ -540,6 +631,10 @@ class AudioDecoderPriv
     AVFormatContext        *m_avFormatContext;
     bool                    m_createdAVFormatContext;
     int                     m_pauseResult;
+    QAtomicInt              m_preroll;
+    QAtomicInt              m_deferredAudioSetup;
+    bool                    m_gapless;
+    QAtomicInt              m_audioPosition; // ms
     TorcDemuxerThread      *m_demuxerThread;
 
     AVAudioResampleContext *m_audioResampleContext;
@@ -668,6 +763,8 @@ void AudioDecoder::SetDemuxerState(TorcDecoder::DemuxerState State)
 
 void AudioDecoder::Start(void)
 {
+    // the audio thread will now complete any deferred audio setup
+    m_priv->m_preroll.store(0);
     m_priv->m_demuxerThread->Unpause();
 }
 
@@ -754,6 +851,89 @@ int AudioDecoder::GetStreamCount(TorcStreamTypes Type)
     return result;
 }
 
+double AudioDecoder::GetDuration(void)
+{
+    return m_duration;
+}
+
+/*! \brief Return the playback position in seconds.
+ *
+ * This is the timestamp of the audio currently being played by the audio output, falling back to the
+ * most recently decoded audio if the output has not yet reported a time.
+*/
+double AudioDecoder::GetPosition(void)
+{
+    if (m_audio && !m_priv->m_preroll.load())
+    {
+        quint64 age  = 0;
+        qint64 time = m_audio->GetAudioTime(age);
+        if (time != (qint64)AV_NOPTS_VALUE && age)
+            return (double)time / 1000.0;
+    }
+
+    return (double)m_priv->m_audioPosition.load() / 1000.0;
+}
+
+/*! \brief Fill the packet queues while paused.
+ *
+ * The demuxer will read ahead until the queues are full or the end of the stream is reached, but the
+ * decoder threads are paused and the (shared) audio output is not configured until Start is called.
+ * Must be called before the decoder is opened.
+*/
+void AudioDecoder::Preroll(void)
+{
+    m_priv->m_preroll.store(1);
+}
+
+/*! \brief Hand the audio output over to the next decoder at the end of the stream.
+ *
+ * When set, the demuxer does not wait for the audio device to drain at the end of the stream and the
+ * audio output is not released when the audio thread exits, so the next decoder can continue feeding it
+ * (AudioOutput::Reconfigure is a no-op if the audio format has not changed).
+*/
+void AudioDecoder::SetGapless(bool Gapless)
+{
+    m_priv->m_gapless = Gapless;
+}
+
+/*! \brief Return throughput, decoded frame counts, wait times and per thread CPU usage.
+ *
+ * Times are in microseconds. Wait times are the time spent throttled by a full downstream consumer
+ * (video buffers, the audio device or the packet queues) and CPU times are -1 where unsupported.
+ * Counters are published by each thread periodically, so values for a running decoder may lag slightly.
+*/
+QVariantMap AudioDecoder::GetStatistics(void)
+{
+    TorcDemuxerThread *demuxer = m_priv->m_demuxerThread;
+    TorcDecoderStatistics demux    = demuxer->GetStatistics();
+    TorcDecoderStatistics audio    = demuxer->m_audioThread->GetStatistics();
+    TorcDecoderStatistics video    = demuxer->m_videoThread->GetStatistics();
+    TorcDecoderStatistics subtitle = demuxer->m_subtitleThread->GetStatistics();
+
+    quint64 start = demux.m_startTime;
+    quint64 stop  = demux.m_stopTime ? demux.m_stopTime : TorcCoreUtils::GetMicrosecondCount();
+    qint64  wall  = start ? (qint64)(stop - start) : 0;
+
+    QVariantMap result;
+    result.insert("uri",               m_uri);
+    result.insert("wallTime",          wall);
+    result.insert("demuxedBytes",      demux.m_bytes);
+    result.insert("demuxedPackets",    demux.m_packets);
+    result.insert("demuxerWaitTime",   demux.m_waitTime);
+    result.insert("demuxerCPUTime",    demux.m_cpuTime);
+    result.insert("audioPackets",      audio.m_packets);
+    result.insert("audioFrames",       audio.m_frames);
+    result.insert("audioWaitTime",     audio.m_waitTime);
+    result.insert("audioCPUTime",      audio.m_cpuTime);
+    result.insert("videoPackets",      video.m_packets);
+    result.insert("videoWaitTime",     video.m_waitTime);
+    result.insert("videoCPUTime",      video.m_cpuTime);
+    result.insert("subtitlePackets",   subtitle.m_packets);
+    result.insert("subtitleCPUTime",   subtitle.m_cpuTime);
+    result.insert("demuxedBytesPerSecond", wall > 0 ? (double)demux.m_bytes * 1000000.0 / wall : 0.0);
+    return result;
+}
+
 TorcPlayer* AudioDecoder::GetParent(void)
 {
     return m_parent;
@@ -842,6 +1022,7 @@ void AudioDecoder::DecodeVideoFrames(TorcVideoThread *Thread)
             // TODO make this sleep dynamic
             queue->m_lock->unlock();
             QThread::usleep(4000);
+            Thread->Waited(4000);
             yield = false;
             continue;
         }
@@ -880,6 +1061,7 @@ void AudioDecoder::DecodeVideoFrames(TorcVideoThread *Thread)
 
             if (packet)
             {
+                Thread->Counted();
                 ProcessVideoPacket(m_priv->m_avFormatContext, stream, packet);
                 av_free_packet(packet);
                 delete packet;
@@ -995,6 +1177,10 @@ void AudioDecoder::DecodeAudioFrames(TorcAudioThread *Thread)
             continue;
         }
 
+        // a queued decoder configures the audio output when it takes over
+        if (m_priv->m_deferredAudioSetup.testAndSetOrdered(1, 0))
+            SetupAudio(Thread);
+
         // wait for the audio device
         int fill = m_audio ? m_audio->GetFillStatus() : 0;
         Thread->m_internalBufferEmpty = fill < 2;
@@ -1002,6 +1188,7 @@ void AudioDecoder::DecodeAudioFrames(TorcAudioThread *Thread)
         {
             queue->m_lock->unlock();
             QThread::usleep(m_audioOut->m_bufferTime * 500);
+            Thread->Waited(m_audioOut->m_bufferTime * 500);
             yield = false;
             continue;
         }
@@ -1043,6 +1230,8 @@ void AudioDecoder::DecodeAudioFrames(TorcAudioThread *Thread)
 
             if (packet)
             {
+                Thread->Counted();
+
                 AVPacket temp;
                 av_init_packet(&temp);
                 temp.data = packet->data;
@@ -1202,6 +1391,11 @@ void AudioDecoder::DecodeAudioFrames(TorcAudioThread *Thread)
                     if (!FilterAudioFrames(pts))
                         m_audio->AddAudioData((char *)audiosamples, datasize, pts, frames);
 
+                    if (frames > 0)
+                        Thread->m_tally.m_frames += frames;
+
+                    m_priv->m_audioPosition.store((int)pts);
+
                     temp.data += used;
                     temp.size -= used;
 
@@ -1217,7 +1411,10 @@ void AudioDecoder::DecodeAudioFrames(TorcAudioThread *Thread)
     }
 
     *state = TorcDecoder::Stopped;
-    if (m_audio)
+
+    // leave the audio output running if the next decoder is taking over and never release it
+    // from a queued decoder that did not take over (it belongs to the current decoder)
+    if (m_audio && !m_priv->m_preroll.load() && (m_interruptDecoder || !m_priv->m_gapless))
         m_audio->SetAudioOutput(NULL);
     av_free(audiosamples);
     queue->Flush(true, false);
@@ -1384,6 +1581,8 @@ void AudioDecoder::DecodeSubtitles(TorcSubtitleThread *Thread)
             {
                 AVCodecID codecid = m_priv->m_avFormatContext->streams[packet->stream_index]->codec->codec_id;
 
+                Thread->Counted();
+
                 // teletext not supported (and may never be...)
                 if (codecid != AV_CODEC_ID_DVB_TELETEXT)
                     ProcessSubtitlePacket(m_priv->m_avFormatContext, m_priv->m_avFormatContext->streams[packet->stream_index], packet);
@@ -1464,6 +1663,13 @@ bool AudioDecoder::SelectStreams(void)
 
 void AudioDecoder::SetupAudio(TorcAudioThread *Thread)
 {
+    // don't reconfigure the audio output while the current decoder is still playing through it
+    if (m_priv->m_preroll.load())
+    {
+        m_priv->m_deferredAudioSetup.store(1);
+        return;
+    }
+
     QReadLocker locker(m_streamLock);
 
     if (!m_priv->m_avFormatContext || !m_audio || !Thread)
@@ -1956,6 +2162,14 @@ bool AudioDecoder::CreateAVFormatContext(TorcDemuxerThread *Thread)
             LOG(VB_GENERAL, LOG_ERR, "Failed to allocate format context.");
             return false;
         }
+
+        // bound stream probing as appropriate for the buffer type
+        int probesize = m_priv->m_buffer->BestProbeSize();
+        if (probesize > 0)
+            m_priv->m_avFormatContext->probesize = probesize;
+        qint64 analyzeduration = m_priv->m_buffer->BestAnalyzeDuration();
+        if (analyzeduration > 0)
+            m_priv->m_avFormatContext->max_analyze_duration = (int)analyzeduration;
     }
 
     // abort callback
@@ -2003,9 +2217,19 @@ bool AudioDecoder::CreateAVFormatContext(TorcDemuxerThread *Thread)
             return false;
         }
 
-        // Scan for streams
-        if ((err = avformat_find_stream_info(m_priv->m_avFormatContext, NULL)) < 0)
-            LOG(VB_GENERAL, LOG_WARNING, QString("Failed to find streams - error '%1'").arg(AVErrorToString(err)));
+        // Scan for streams, unless the results are already known
+        QString cachekey;
+        if (gLocalContext->GetSetting(TORC_AUDIO + "ProbeCache", true))
+            cachekey = TorcProbeCache::GetKey(m_priv->m_buffer);
+
+        if (!TorcProbeCache::Restore(cachekey, m_priv->m_avFormatContext))
+        {
+            uint streams = m_priv->m_avFormatContext->nb_streams;
+            if ((err = avformat_find_stream_info(m_priv->m_avFormatContext, NULL)) < 0)
+                LOG(VB_GENERAL, LOG_WARNING, QString("Failed to find streams - error '%1'").arg(AVErrorToString(err)));
+            else
+                TorcProbeCache::Store(cachekey, m_priv->m_avFormatContext, streams);
+        }
 
         // perform any post-initialisation
         m_priv->m_buffer->InitialiseAVContext(m_priv->m_avFormatContext);
@@ -2151,6 +2375,11 @@ void AudioDecoder::DemuxPackets(TorcDemuxerThread *Thread)
             }
 
             LOG(VB_PLAYBACK, LOG_INFO, "Demuxer started");
+            if (!Thread->m_tally.m_startTime)
+            {
+                Thread->m_tally.m_startTime = TorcCoreUtils::GetMicrosecondCount();
+                Thread->PublishStatistics();
+            }
             *state = TorcDecoder::Running;
             continue;
         }
@@ -2202,7 +2431,8 @@ void AudioDecoder::DemuxPackets(TorcDemuxerThread *Thread)
             m_seek = false;
         }
 
-        if (*state == TorcDecoder::Paused)
+        // when prerolling, keep reading into the queues until they are full
+        if (*state == TorcDecoder::Paused && !(m_priv->m_preroll.load() && !eof))
         {
             QThread::usleep(10000);
             continue;
@@ -2215,6 +2445,7 @@ void AudioDecoder::DemuxPackets(TorcDemuxerThread *Thread)
             Thread->m_audioThread->m_queue->m_wait->wakeAll();
             Thread->m_subtitleThread->m_queue->m_wait->wakeAll();
             QThread::usleep(50000);
+            Thread->Waited(50000);
             continue;
         }
 
@@ -2262,7 +2493,8 @@ void AudioDecoder::DemuxPackets(TorcDemuxerThread *Thread)
                  Thread->m_videoThread->m_queue->Length() +
                  Thread->m_subtitleThread->m_queue->Length()) == 0)
             {
-                if (!Thread->m_audioThread->m_internalBufferEmpty ||
+                // a gapless successor will keep the audio device fed, so don't wait for it to drain
+                if ((!Thread->m_audioThread->m_internalBufferEmpty && !m_priv->m_gapless) ||
                     !Thread->m_videoThread->m_internalBufferEmpty ||
                     !Thread->m_subtitleThread->m_internalBufferEmpty)
                 {
@@ -2382,6 +2614,8 @@ void AudioDecoder::DemuxPackets(TorcDemuxerThread *Thread)
             }
         }
 
+        Thread->Counted(packet->size);
+
         if (packet->stream_index == videoindex)
             Thread->m_videoThread->m_queue->Push(packet);
         else if (packet->stream_index == audioindex)
@@ -2401,6 +2635,8 @@ void AudioDecoder::DemuxPackets(TorcDemuxerThread *Thread)
     Thread->m_audioThread->Wait();
     Thread->m_subtitleThread->Wait();
 
+    Thread->m_tally.m_stopTime = TorcCoreUtils::GetMicrosecondCount();
+    Thread->PublishStatistics();
     *state = TorcDecoder::Stopped;
     LOG(VB_GENERAL, LOG_INFO, "Demuxer stopped");
 
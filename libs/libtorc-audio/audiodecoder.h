@@ -59,6 +59,11 @@ class TORC_AUDIO_PUBLIC AudioDecoder : public TorcDecoder
     QByteArray       GetSubtitleHeader  (int Index);
     int              GetCurrentStream   (TorcStreamTypes Type);
     int              GetStreamCount     (TorcStreamTypes Type);
+    double           GetDuration        (void);
+    double           GetPosition        (void);
+    void             Preroll            (void);
+    void             SetGapless         (bool Gapless);
+    QVariantMap      GetStatistics      (void);
     TorcPlayer*      GetParent          (void);
 
   protected:
@@ -27,13 +27,29 @@ extern "C" {
 #include "libavcodec/avcodec.h"
 }
 
+// an AC-3 frame is always wrapped in a 6144 byte IEC 61937 burst
+#define AC3_SPDIF_BURST_SIZE 6144
+
+/*! \class AudioOutputDigitalEncoder
+ *  \brief Encodes multichannel PCM to AC-3 and wraps it for S/PDIF output.
+ *
+ * Input samples and output bursts are held in buffers that are allocated once and only grow (by at
+ * least doubling) if an unusually large write does not fit. Both are consumed from a moving start offset
+ * and only compacted when the tail runs out of space, so the steady state involves no allocation and
+ * only small copies. All complete frames available after each
+ * call to Encode are encoded in one batch and the resulting bursts are collected by the S/PDIF muxer
+ * before being copied out together.
+*/
 AudioOutputDigitalEncoder::AudioOutputDigitalEncoder(void)
   : m_avContext(NULL),
+    m_frame(NULL),
     m_outBuffer(NULL),
     m_outSize(0),
     m_inBuffer(NULL),
     m_inSize(0),
+    m_outStart(0),
     m_outLength(0),
+    m_inStart(0),
     m_inLength(0),
     m_samplesPerFrame(0),
     m_spdifEncoder(NULL)
@@ -60,6 +76,9 @@ void AudioOutputDigitalEncoder::Dispose()
         av_freep(&m_avContext);
     }
 
+    if (m_frame)
+        avcodec_free_frame(&m_frame);
+
     if (m_outBuffer)
     {
         av_freep(&m_outBuffer);
@@ -72,30 +91,13 @@ void AudioOutputDigitalEncoder::Dispose()
         m_inSize = 0;
     }
 
+    m_inStart = m_inLength = m_outStart = m_outLength = 0;
+
     if (m_spdifEncoder)
         delete m_spdifEncoder;
     m_spdifEncoder = NULL;
 }
 
-void *AudioOutputDigitalEncoder::Reallocate(void *Pointer, size_t OldSize, size_t NewSize)
-{
-    if (!Pointer)
-        return NULL;
-
-    // av_realloc doesn't maintain 16 bytes alignment
-    void *newpointer = av_malloc(NewSize);
-    if (!newpointer)
-    {
-        av_free(Pointer);
-        return newpointer;
-    }
-
-    memcpy(newpointer, Pointer, OldSize);
-    av_free(Pointer);
-
-    return newpointer;
-}
-
 bool AudioOutputDigitalEncoder::Init(AVCodecID CodecId, int Bitrate, int Samplerate, int Channels)
 {
     AudioDecoder::InitialiseLibav();
@@ -159,6 +161,16 @@ bool AudioOutputDigitalEncoder::Init(AVCodecID CodecId, int Bitrate, int Sampler
         return false;
     }
 
+    if (!m_frame)
+        m_frame = avcodec_alloc_frame();
+
+    if (!m_frame || !m_inBuffer || !m_outBuffer)
+    {
+        Dispose();
+        LOG(VB_GENERAL, LOG_ERR, "Failed to allocate encoder buffers");
+        return false;
+    }
+
     m_samplesPerFrame  = m_avContext->frame_size * m_avContext->channels;
 
     LOG(VB_AUDIO, LOG_INFO, QString("DigitalEncoder::Init fs=%1, spf=%2")
@@ -167,101 +179,147 @@ bool AudioOutputDigitalEncoder::Init(AVCodecID CodecId, int Bitrate, int Sampler
     return true;
 }
 
-size_t AudioOutputDigitalEncoder::Encode(void *Buffer, int Length, AudioFormat Format)
+/*! \brief Make room for Required bytes in Buffer, starting at offset 0.
+ *
+ * The Length bytes of live data at Start are moved to the beginning of the buffer. If the buffer is
+ * too small it is replaced by one at least twice the size (so repeated growth is amortised).
+ * Returns false, leaving the buffer untouched, if the allocation fails.
+*/
+bool AudioOutputDigitalEncoder::Reserve(qint16 *&Buffer, size_t &Size, int &Start, int Length, size_t Required)
 {
-    // Check if there is enough space in incoming buffer
-    int required = m_inLength + Length / AudioOutputSettings::SampleSize(Format) * AudioOutputSettings::SampleSize(FORMAT_S16);
+    if (Required <= Size)
+    {
+        if (Start)
+            memmove(Buffer, (char*)Buffer + Start, Length);
+        Start = 0;
+        return true;
+    }
+
+    size_t newsize = qMax(Required, Size << 1);
+    newsize = ((newsize + INBUFSIZE - 1) / INBUFSIZE) * INBUFSIZE;
+
+    LOG(VB_AUDIO, LOG_INFO, QString("Growing encoder buffer from %1 to %2 bytes").arg(Size).arg(newsize));
 
-    if (required > (int)m_inSize)
+    // av_realloc doesn't maintain 16 byte alignment
+    qint16 *newbuffer = (qint16*)av_malloc(newsize);
+    if (!newbuffer)
     {
-        required = ((required / INBUFSIZE) + 1) * INBUFSIZE;
-        LOG(VB_AUDIO, LOG_INFO, QString("low mem, reallocating in buffer from %1 to %2")
-            .arg(m_inSize) .arg(required));
+        LOG(VB_GENERAL, LOG_ERR, QString("Failed to allocate %1 bytes for encoder buffer").arg(newsize));
+        return false;
+    }
 
-        int16_t *tmp = reinterpret_cast<int16_t*>(Reallocate(m_inBuffer, m_inSize, required));
-        if (!tmp)
-        {
-            m_inBuffer = NULL;
-            m_inSize = 0;
-            return m_outLength;
-        }
+    memcpy(newbuffer, (char*)Buffer + Start, Length);
+    av_free(Buffer);
+    Buffer = newbuffer;
+    Size   = newsize;
+    Start  = 0;
+    return true;
+}
 
-        m_inBuffer = tmp;
-        m_inSize = required;
+size_t AudioOutputDigitalEncoder::Encode(void *Buffer, int Length, AudioFormat Format)
+{
+    if (!m_inBuffer || !m_outBuffer || !m_frame || !m_samplesPerFrame || Length < 1)
+        return m_outLength;
+
+    int insamplesize  = AudioOutputSettings::SampleSize(Format);
+    int outsamplesize = AudioOutputSettings::SampleSize(FORMAT_S16);
+    int required      = Length / insamplesize * outsamplesize;
+
+    if (m_inStart + m_inLength + required > (int)m_inSize)
+    {
+        if (!Reserve(m_inBuffer, m_inSize, m_inStart, m_inLength, m_inLength + required))
+            return m_outLength;
     }
 
+    char *destination = (char*)m_inBuffer + m_inStart + m_inLength;
     if (Format != FORMAT_S16)
     {
-        m_inLength += AudioOutputUtil::FromFloat(FORMAT_S16, (char *)m_inBuffer + m_inLength, Buffer, Length);
+        m_inLength += AudioOutputUtil::FromFloat(FORMAT_S16, destination, Buffer, Length);
     }
     else
     {
-        memcpy((char*)m_inBuffer + m_inLength, Buffer, Length);
+        memcpy(destination, Buffer, Length);
         m_inLength += Length;
     }
 
-    int frames = m_inLength / sizeof(int16_t) / m_samplesPerFrame;
-    int i = 0;
-    AVFrame *frame = avcodec_alloc_frame();
+    EncodeFrames();
+    return m_outLength;
+}
+
+/*! \brief Encode every complete frame in the input buffer.
+ *
+ * Bursts accumulate in the S/PDIF muxer and are only copied to the output buffer when its internal
+ * buffer is nearly full or the batch is complete.
+*/
+bool AudioOutputDigitalEncoder::EncodeFrames(void)
+{
+    int framesize = m_samplesPerFrame * sizeof(int16_t);
+    int frames    = m_inLength / framesize;
+    bool result   = true;
 
-    while (i < frames)
+    if (frames && !m_spdifEncoder)
+        m_spdifEncoder = new AudioSPDIFEncoder("spdif", AV_CODEC_ID_AC3);
+
+    int i = 0;
+    for ( ; i < frames; ++i)
     {
-        AVPacket pkt;
-        av_init_packet(&pkt);
-        pkt.data          = (uint8_t*)m_encodebuffer;
-        pkt.size          = sizeof(m_encodebuffer);
-        frame->nb_samples = m_avContext->frame_size;
-        frame->data[0]    = (uint8_t *)(m_inBuffer + i * m_samplesPerFrame);
-        frame->pts        = AV_NOPTS_VALUE;
-        int got_packet    = 0;
-        int ret           = avcodec_encode_audio2(m_avContext, &pkt, frame, &got_packet);
-        int outsize       = pkt.size;
-
-        if (ret < 0)
+        AVPacket packet;
+        av_init_packet(&packet);
+        packet.data         = (uint8_t*)m_encodebuffer;
+        packet.size         = sizeof(m_encodebuffer);
+        m_frame->nb_samples = m_avContext->frame_size;
+        m_frame->data[0]    = (uint8_t*)m_inBuffer + m_inStart + i * framesize;
+        m_frame->pts        = AV_NOPTS_VALUE;
+        int gotpacket       = 0;
+
+        if (avcodec_encode_audio2(m_avContext, &packet, m_frame, &gotpacket) < 0)
         {
             LOG(VB_AUDIO, LOG_ERR, "AC-3 encode error");
-            return ret;
+            i++;
+            result = false;
+            break;
         }
 
-        av_free_packet(&pkt);
-        i++;
-        if (!got_packet)
+        if (!gotpacket)
             continue;
 
-        if (!m_spdifEncoder)
-            m_spdifEncoder = new AudioSPDIFEncoder("spdif", AV_CODEC_ID_AC3);
+        if (m_spdifEncoder->GetProcessedSize() + AC3_SPDIF_BURST_SIZE > MAX_AUDIO_FRAME_SIZE)
+            FlushSPDIF();
 
-        m_spdifEncoder->WriteFrame((uint8_t *)m_encodebuffer, outsize);
-        // Check if output buffer is big enough
-        required = m_outLength + m_spdifEncoder->GetProcessedSize();
-        if (required > (int)m_outSize)
+        m_spdifEncoder->WriteFrame((uint8_t*)m_encodebuffer, packet.size);
+        av_free_packet(&packet);
+    }
+
+    FlushSPDIF();
+
+    m_inStart  += i * framesize;
+    m_inLength -= i * framesize;
+    if (!m_inLength)
+        m_inStart = 0;
+
+    return result;
+}
+
+void AudioOutputDigitalEncoder::FlushSPDIF(void)
+{
+    if (!m_spdifEncoder)
+        return;
+
+    int size = m_spdifEncoder->GetProcessedSize();
+    if (size < 1)
+        return;
+
+    if (m_outStart + m_outLength + size > (int)m_outSize)
+    {
+        if (!Reserve(m_outBuffer, m_outSize, m_outStart, m_outLength, m_outLength + size))
         {
-            required = ((required / OUTBUFSIZE) + 1) * OUTBUFSIZE;
-            LOG(VB_AUDIO, LOG_WARNING, QString("low mem, reallocating out buffer from %1 to %2")
-                .arg(m_outSize) .arg(required));
-
-            int16_t *tmp = reinterpret_cast<int16_t*>(Reallocate(m_outBuffer, m_outSize, required));
-            if (!tmp)
-            {
-                m_outBuffer = NULL;
-                m_outSize = 0;
-                return m_outLength;
-            }
-
-            m_outBuffer = tmp;
-            m_outSize = required;
+            m_spdifEncoder->Reset();
+            return;
         }
-
-        int data_size = 0;
-        m_spdifEncoder->GetData((uint8_t *)m_outBuffer + m_outLength, data_size);
-        m_outLength += data_size;
-        m_inLength  -= m_samplesPerFrame * sizeof(int16_t);
     }
 
-    av_free(frame);
-
-    memmove(m_inBuffer, m_inBuffer + i * m_samplesPerFrame, m_inLength);
-    return m_outLength;
+    m_spdifEncoder->GetData((uint8_t*)m_outBuffer + m_outStart + m_outLength, size);
+    m_outLength += size;
 }
 
 size_t AudioOutputDigitalEncoder::GetFrames(void *Pointer, int MaxLength)
@@ -270,9 +328,9 @@ size_t AudioOutputDigitalEncoder::GetFrames(void *Pointer, int MaxLength)
     if (len != MaxLength)
         LOG(VB_AUDIO, LOG_INFO, "Getting less than requested");
 
-    memcpy(Pointer, m_outBuffer, len);
+    memcpy(Pointer, (char*)m_outBuffer + m_outStart, len);
     m_outLength -= len;
-    memmove(m_outBuffer, (char*)m_outBuffer + len, m_outLength);
+    m_outStart   = m_outLength ? m_outStart + len : 0;
 
     return len;
 }
@@ -284,5 +342,7 @@ int AudioOutputDigitalEncoder::Buffered(void) const
 
 void AudioOutputDigitalEncoder::Clear(void)
 {
-    m_inLength = m_outLength = 0;
+    m_inStart = m_inLength = m_outStart = m_outLength = 0;
+    if (m_spdifEncoder)
+        m_spdifEncoder->Reset();
 }
@@ -2,6 +2,7 @@
 #define AUDIOOUTPUTREENCODER_H
 
 // Torc
+#include "torcaudioexport.h"
 #include "audiooutputsettings.h"
 
 extern "C" {
@@ -13,7 +14,7 @@ extern "C" {
 
 class AudioSPDIFEncoder;
 
-class AudioOutputDigitalEncoder
+class TORC_AUDIO_PUBLIC AudioOutputDigitalEncoder
 {
   public:
     AudioOutputDigitalEncoder();
@@ -27,14 +28,19 @@ class AudioOutputDigitalEncoder
     void   Clear      (void);
 
   private:
-    void*  Reallocate (void *Pointer, size_t OldSize, size_t NewSize);
+    bool   EncodeFrames (void);
+    void   FlushSPDIF   (void);
+    static bool Reserve (qint16 *&Buffer, size_t &Size, int &Start, int Length, size_t Required);
 
     AVCodecContext    *m_avContext;
+    AVFrame           *m_frame;
     qint16            *m_outBuffer;
     size_t             m_outSize;
     qint16            *m_inBuffer;
     size_t             m_inSize;
+    int                m_outStart;
     int                m_outLength;
+    int                m_inStart;
     int                m_inLength;
     size_t             m_samplesPerFrame;
     qint16             m_encodebuffer[FF_MIN_BUFFER_SIZE];
@@ -23,12 +23,19 @@ AudioOutputNULL::~AudioOutputNULL()
 
 bool AudioOutputNULL::OpenDevice(void)
 {
-    LOG(VB_GENERAL, LOG_INFO, "Opening NULL audio device, will fail.");
+    // only succeed when explicitly requested (e.g. by a dummy/benchmark player), otherwise
+    // the NULL device is a fallback of last resort and should not mask a failed real device
+    bool requested = m_mainDevice.startsWith("null", Qt::CaseInsensitive);
+
+    if (requested)
+        LOG(VB_GENERAL, LOG_INFO, "Opening NULL audio device");
+    else
+        LOG(VB_GENERAL, LOG_INFO, "Opening NULL audio device, will fail.");
 
     m_fragmentSize = NULL_BUFFER_SIZE / 2;
     m_soundcardBufferSize = NULL_BUFFER_SIZE;
 
-    return false;
+    return requested;
 }
 
 void AudioOutputNULL::CloseDevice(void)
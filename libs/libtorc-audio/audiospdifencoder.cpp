@@ -56,7 +56,9 @@ AudioSPDIFEncoder::AudioSPDIFEncoder(QString Muxer, int CodecId)
     }
 
     m_formatContext->oformat = fmt;
-    m_formatContext->pb = avio_alloc_context(m_buffer, sizeof(m_buffer), 0,
+    // libav writes into a separate io buffer so that output from several frames can be
+    // accumulated in m_buffer before it is retrieved
+    m_formatContext->pb = avio_alloc_context(m_ioBuffer, sizeof(m_ioBuffer), 0,
                                   this, NULL, EncoderCallback, NULL);
     if (!m_formatContext->pb)
     {
@@ -106,6 +108,7 @@ void AudioSPDIFEncoder::WriteFrame(unsigned char *Data, int Size)
 
 /**
  * Retrieve encoded data and copy it in the provided buffer.
+ * Data from several calls to WriteFrame is accumulated until retrieved.
  * Return -1 if there is no data to retrieve.
  * On return, dest_size will contain the length of the data copied
  * Upon completion, the internal encoder buffer is emptied.
@@ -168,6 +171,12 @@ int AudioSPDIFEncoder::EncoderCallback(void *Object, unsigned char *Buffer, int
 {
     AudioSPDIFEncoder *enc = static_cast<AudioSPDIFEncoder*>(Object);
 
+    if (enc->m_size + Size > (long)sizeof(enc->m_buffer))
+    {
+        LOG(VB_AUDIO, LOG_ERR, "SPDIF buffer overflow - dropping data");
+        return Size;
+    }
+
     memcpy(enc->m_buffer + enc->m_size, Buffer, Size);
     enc->m_size += Size;
     return Size;
@@ -15,6 +15,8 @@ extern "C" {
 #include "libavcodec/audioconvert.h"
 }
 
+#define SPDIF_IO_BUFFER_SIZE 32768
+
 class TORC_AUDIO_PUBLIC AudioSPDIFEncoder
 {
   public:
@@ -37,6 +39,7 @@ class TORC_AUDIO_PUBLIC AudioSPDIFEncoder
     bool             m_complete;
     AVFormatContext *m_formatContext;
     AVStream        *m_stream;
+    unsigned char    m_ioBuffer[SPDIF_IO_BUFFER_SIZE];
     unsigned char    m_buffer[MAX_AUDIO_FRAME_SIZE];
     long             m_size;
 };
@@ -86,7 +86,7 @@ bool AudioWrapper::Initialise(void)
 {
     bool audiomuted  = m_parent->GetPlayerFlags() & TorcPlayer::AudioMuted;
     bool audioneeded = m_parent->GetDecoderFlags() & TorcDecoder::DecodeAudio;
-    //bool dummy = PlayerFlags  & TorcPlayer::AudioDummy;
+    bool dummy       = m_parent->GetPlayerFlags() & TorcPlayer::AudioDummy;
 
     if ((m_format == FORMAT_NONE) || (m_channels <= 0) || (m_samplerate <= 0))
         m_noAudioIn = m_noAudioOut = true;
@@ -95,13 +95,14 @@ bool AudioWrapper::Initialise(void)
 
     if (audioneeded && !m_audioOutput)
     {
-        AudioSettings aos = AudioSettings(m_mainDevice,
+        // a dummy player decodes and consumes audio without a real device (and hence without real time pacing)
+        AudioSettings aos = AudioSettings(dummy ? QString("NULL") : m_mainDevice,
                                           m_passthroughDevice,
                                           m_format, m_channels,
                                           m_codec, m_samplerate,
                                           AUDIOOUTPUT_VIDEO,
                                           m_controlsVolume,
-                                          m_passthrough);
+                                          dummy ? false : m_passthrough);
         if (m_noAudioIn)
             aos.m_openOnInit = false;
 
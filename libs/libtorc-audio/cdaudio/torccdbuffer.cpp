@@ -127,6 +127,17 @@ int TorcCDBuffer::BestBufferSize(void)
     return 0;
 }
 
+/// CD audio is always 16bit stereo PCM - there is nothing to be gained by spinning up the drive to probe it.
+int TorcCDBuffer::BestProbeSize(void)
+{
+    return 32768;
+}
+
+qint64 TorcCDBuffer::BestAnalyzeDuration(void)
+{
+    return 100000;
+}
+
 /*! \class TorcCDBufferFactory
  *  \brief A static class to create an audio CD input buffer.
 */
@@ -28,6 +28,8 @@ class TorcCDBuffer : public TorcBuffer
     bool       IsSequential         (void);
     qint64     BytesAvailable       (void);
     int        BestBufferSize       (void);
+    int        BestProbeSize        (void);
+    qint64     BestAnalyzeDuration  (void);
 
   private:
     AVInputFormat *m_input;
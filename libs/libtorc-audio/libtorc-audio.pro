@@ -54,10 +54,12 @@ HEADERS += audioplayer.h
 HEADERS += audiodecoder.h
 HEADERS += audiointerface.h
 HEADERS += torcavutils.h
+HEADERS += torcprobecache.h
 SOURCES += audioplayer.cpp
 SOURCES += audiodecoder.cpp
 SOURCES += audiointerface.cpp
 SOURCES += torcavutils.cpp
+SOURCES += torcprobecache.cpp
 
 contains(CONFIG_LIBCDIO_INDEV, yes) {
     DEPENDPATH += ./cdaudio
@@ -99,9 +101,13 @@ contains(CONFIG_OSS_OUTDEV, yes) {
     SOURCES += platforms/audiooutputoss.cpp
 }
 
+# the RAOP jitter buffer has no external dependencies and is also used by torc-utils
+DEPENDPATH += ./raop
+HEADERS += raop/torcraopjitterbuffer.h
+SOURCES += raop/torcraopjitterbuffer.cpp
+
 contains(CONFIG_LIBCRYPTO, yes) {
     contains(CONFIG_LIBDNS_SD, yes) {
-        DEPENDPATH += ./raop
         HEADERS += raop/torcraopdevice.h
         HEADERS += raop/torcraopbuffer.h
         HEADERS += raop/torcraopconnection.h
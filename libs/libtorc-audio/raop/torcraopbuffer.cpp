@@ -233,25 +233,18 @@ void* TorcRAOPBuffer::RequiredAVContext(void)
 
 int TorcRAOPBuffer::Read(quint8 *Buffer, qint32 BufferSize)
 {
-    int result = -1;
+    int result = 0;
+    int tries  = 0;
 
-    QByteArray *data = NULL;
-    int tries = 0;
-
-    // need to give TorcRAOPConnection time to recover from missed packets and other temporary interruptions
-    while (!(data = TorcRAOPDevice::Read(m_streamId)) && (tries++ < 100) && !m_avFormatContext->interrupt_callback.callback(m_avFormatContext->interrupt_callback.opaque))
-        QThread::usleep(50000);
-
-    if (!data)
-        return result;
-
-    if (BufferSize != data->size())
-        LOG(VB_GENERAL, LOG_WARNING, QString("Packet size %1 - expected %2").arg(data->size()).arg(BufferSize));
+    // need to give TorcRAOPConnection time to recover from missed packets and other temporary interruptions.
+    // Packets are ~8ms apart, so poll at a similar rate rather than adding latency.
+    while (!(result = TorcRAOPDevice::Read(m_streamId, Buffer, BufferSize)) && (tries++ < 500) &&
+           !m_avFormatContext->interrupt_callback.callback(m_avFormatContext->interrupt_callback.opaque))
+    {
+        QThread::usleep(10000);
+    }
 
-    memcpy(Buffer, data->data(), std::min(BufferSize, data->size()));
-    result = data->size();
-    delete data;
-    return result;
+    return result > 0 ? result : -1;
 }
 
 int TorcRAOPBuffer::Peek(quint8 *Buffer, qint32 BufferSize)
@@ -30,13 +30,15 @@
 #include "torclocalcontext.h"
 #include "torclogging.h"
 #include "torcdirectories.h"
+#include "torctimer.h"
+#include "torcraopjitterbuffer.h"
 #include "torcraopconnection.h"
 
 #include <openssl/pem.h>
 #include <openssl/aes.h>
 #include <arpa/inet.h>
 
-#define MAXPACKETSIZE       2048
+#define RESENDINTERVAL      (RAOP_RESENDRETRY / 4)
 #define DEFAULTSAMPLERATE   44100
 #define TIMINGREQUEST       0x52
 #define TIMINGRESPONSE      0x53
@@ -122,7 +124,7 @@ enum RAOPState
 class TorcRAOPConnectionPriv
 {
   public:
-    TorcRAOPConnectionPriv(QTcpSocket *Socket)
+    TorcRAOPConnectionPriv(QTcpSocket *Socket, int Reference)
       : m_socket(Socket),
         m_textStream(NULL),
         m_dataSocket(NULL),
@@ -131,31 +133,28 @@ class TorcRAOPConnectionPriv
         m_state(None),
         m_sampleRate(DEFAULTSAMPLERATE),
         m_textOutstanding(0),
+        m_jitterBuffer(Reference),
         m_packetQueueLock(new QMutex()),
         m_playerReadTimeout(0),
         m_playerReadTimeoutCount(0),
         m_clientSendTimeout(0),
         m_clientSendTimoutCount(0),
-        m_nextSequence(0),
-        m_resendSequence(0),
-        m_validTimestamp(0)
+        m_resendTimer(0),
+        m_resendSequence(0)
     {
+        m_datagram.resize(RAOP_MAXPACKETSIZE);
+        m_resendClock.Start();
     }
 
     ~TorcRAOPConnectionPriv()
     {
-        ClearPacketQueue();
         delete m_packetQueueLock;
     }
 
     void ClearPacketQueue(void)
     {
-        m_packetQueueLock->lock();
-        QMap<uint64_t,QByteArray*>::iterator it = m_packetQueue.begin();
-        for ( ; it != m_packetQueue.end(); ++it)
-            delete it.value();
-        m_packetQueue.clear();
-        m_packetQueueLock->unlock();
+        QMutexLocker locker(m_packetQueueLock);
+        m_jitterBuffer.Reset();
     }
 
     QByteArray                 m_macAddress;
@@ -173,16 +172,16 @@ class TorcRAOPConnectionPriv
     int                        m_textOutstanding;
     QMap<QString,QString>      m_textHeaders;
     QByteArray                 m_textContent;
-    QMap<uint64_t,QByteArray*> m_packetQueue;
+    QByteArray                 m_datagram;
+    TorcRAOPJitterBuffer       m_jitterBuffer;
     QMutex                    *m_packetQueueLock;
     int                        m_playerReadTimeout;
     int                        m_playerReadTimeoutCount;
     int                        m_clientSendTimeout;
     int                        m_clientSendTimoutCount;
-    uint16_t                   m_nextSequence;
+    int                        m_resendTimer;
+    TorcTimer                  m_resendClock;
     uint16_t                   m_resendSequence;
-    uint64_t                   m_validTimestamp;
-    QMap<uint16_t, uint64_t>   m_resends;
 };
 
 static inline uint64_t FramesToMs(uint64_t Timestamp, int Samplerate)
@@ -195,7 +194,7 @@ static inline uint64_t FramesToMs(uint64_t Timestamp, int Samplerate)
 TorcRAOPConnection::TorcRAOPConnection(QTcpSocket *Socket, int Reference, const QString &MACAddress)
   : QObject(NULL),
     m_reference(Reference),
-    m_priv(new TorcRAOPConnectionPriv(Socket))
+    m_priv(new TorcRAOPConnectionPriv(Socket, Reference))
 {
     QString macaddress = MACAddress;
     m_priv->m_macAddress = QByteArray::fromHex(macaddress.remove(':').toLatin1());
@@ -204,6 +203,9 @@ TorcRAOPConnection::TorcRAOPConnection(QTcpSocket *Socket, int Reference, const
 TorcRAOPConnection::~TorcRAOPConnection()
 {
     LOG(VB_GENERAL, LOG_INFO, IDENT + "Destroying RAOP connection");
+    LOG(VB_GENERAL, LOG_INFO, IDENT + QString("Received %1 packets (lost %2, late %3, dropped %4, underruns %5, final playout delay %6)")
+        .arg(m_priv->m_jitterBuffer.m_received).arg(m_priv->m_jitterBuffer.m_lost).arg(m_priv->m_jitterBuffer.m_late)
+        .arg(m_priv->m_jitterBuffer.m_dropped).arg(m_priv->m_jitterBuffer.m_underruns).arg(m_priv->m_jitterBuffer.m_playoutDelay));
     Close();
     delete m_priv;
 }
@@ -244,8 +246,11 @@ void TorcRAOPConnection::Close(void)
         killTimer(m_priv->m_playerReadTimeout);
     if (m_priv->m_clientSendTimeout)
         killTimer(m_priv->m_clientSendTimeout);
+    if (m_priv->m_resendTimer)
+        killTimer(m_priv->m_resendTimer);
     m_priv->m_playerReadTimeout = 0;
     m_priv->m_clientSendTimeout = 0;
+    m_priv->m_resendTimer       = 0;
 
     // delete main socket
     if (m_priv->m_socket)
@@ -284,31 +289,19 @@ QTcpSocket* TorcRAOPConnection::MasterSocket(void)
     return m_priv->m_socket;
 }
 
-QByteArray* TorcRAOPConnection::Read(void)
+/*! \brief Copy the next packet due for playback into Buffer.
+ *
+ * Returns the size of the packet, 0 if no packet is ready yet (buffering or waiting on a resend)
+ * or -1 on error.
+*/
+int TorcRAOPConnection::Read(quint8 *Buffer, qint32 BufferSize)
 {
-    QMutexLocker locker(m_priv->m_packetQueueLock);
+    if (!Buffer || BufferSize < 1)
+        return -1;
 
+    QMutexLocker locker(m_priv->m_packetQueueLock);
     m_priv->m_playerReadTimeoutCount = 0;
-
-    QByteArray* result = NULL;
-
-    if (m_priv->m_packetQueue.isEmpty())
-        return result;
-
-    QMap<uint64_t,QByteArray*>::iterator it = m_priv->m_packetQueue.begin();
-    result = it.value();
-
-    if (m_priv->m_validTimestamp && m_priv->m_validTimestamp <= it.key())
-    {
-        LOG(VB_GENERAL, LOG_INFO, IDENT + QString("Waiting on resend packet..."));
-        return NULL;
-    }
-
-    LOG(VB_GENERAL, LOG_DEBUG, IDENT + QString("Releasing %1, left %2")
-        .arg(it.key()).arg(m_priv->m_packetQueue.size()));
-
-    m_priv->m_packetQueue.erase(it);
-    return result;
+    return m_priv->m_jitterBuffer.Read(Buffer, BufferSize);
 }
 
 void TorcRAOPConnection::ReadText(void)
@@ -561,6 +554,10 @@ void TorcRAOPConnection::ProcessText(void)
         if (!m_priv->m_clientSendTimeout)
             m_priv->m_clientSendTimeout = startTimer(250, Qt::CoarseTimer);
 
+        // retries are driven by their own, finer grained timer
+        if (!m_priv->m_resendTimer)
+            m_priv->m_resendTimer = startTimer(RESENDINTERVAL, Qt::PreciseTimer);
+
         m_priv->m_peerAddress = m_priv->m_socket->peerAddress();
 
         if (m_priv->m_clientControlSocket)
@@ -646,7 +643,6 @@ void TorcRAOPConnection::ProcessText(void)
     {
         LOG(VB_GENERAL, LOG_INFO, IDENT + "Received 'FLUSH' request");
         m_priv->ClearPacketQueue();
-        m_priv->m_resends.clear();
         m_priv->m_state &= ~AudioData;
     }
     else if (option == "TEARDOWN")
@@ -665,35 +661,43 @@ void TorcRAOPConnection::ProcessText(void)
     m_priv->m_textStream->flush();
 }
 
-void TorcRAOPConnection::SendResend(quint64 Timestamp, quint16 Start, quint16 End)
+void TorcRAOPConnection::SendResend(quint16 Start, quint16 Count)
 {
-    if (!m_priv->m_clientControlSocket)
+    if (!m_priv->m_clientControlSocket || Count < 1)
         return;
 
-    int16_t missed = (End < Start) ? (int16_t)(((int32_t)End + UINT16_MAX + 1) - Start) : End - Start;
-
-    LOG(VB_GENERAL, LOG_INFO, IDENT + QString("Missed %1 packet(s): expected %2 got %3 ts:%4")
-        .arg(missed).arg(Start).arg(End).arg(Timestamp));
+    LOG(VB_GENERAL, LOG_INFO, IDENT + QString("Requesting %1 packet(s) from sequence %2").arg(Count).arg(Start));
 
     char req[8];
     req[0] = 0x80;
     req[1] = RANGERESEND | 0x80;
     *(uint16_t *)(req + 2) = htons(m_priv->m_resendSequence++);
     *(uint16_t *)(req + 4) = htons(Start);
-    *(uint16_t *)(req + 6) = htons(missed);
+    *(uint16_t *)(req + 6) = htons(Count);
 
-    if (m_priv->m_clientControlSocket->writeDatagram(req, sizeof(req), m_priv->m_peerAddress, m_priv->m_clientControlPort) == sizeof(req))
-    {
-        for (uint16_t count = 0; count < missed; count++)
-        {
-            LOG(VB_GENERAL, LOG_DEBUG, IDENT + QString("Sent resend for %1").arg(Start + count));
-            m_priv->m_resends.insert(Start + count, Timestamp);
-        }
-    }
-    else
-    {
+    if (m_priv->m_clientControlSocket->writeDatagram(req, sizeof(req), m_priv->m_peerAddress, m_priv->m_clientControlPort) != sizeof(req))
         LOG(VB_GENERAL, LOG_ERR, "Failed to send resend request.");
+}
+
+/*! \brief Send all resend requests queued by the jitter buffer.
+ *
+ * Adjacent gaps have already been merged into ranges, so a burst of lost packets
+ * results in a single request.
+*/
+void TorcRAOPConnection::SendResends(void)
+{
+    QVector<QPair<uint16_t,uint16_t> > resends;
+
+    {
+        QMutexLocker locker(m_priv->m_packetQueueLock);
+        if (m_priv->m_jitterBuffer.m_pendingResends.isEmpty())
+            return;
+
+        resends = m_priv->m_jitterBuffer.TakeResends(m_priv->m_resendClock.Elapsed());
     }
+
+    for (int i = 0; i < resends.size(); ++i)
+        SendResend(resends[i].first, resends[i].second);
 }
 
 void TorcRAOPConnection::timerEvent(QTimerEvent *Event)
@@ -713,6 +717,14 @@ void TorcRAOPConnection::timerEvent(QTimerEvent *Event)
             LOG(VB_GENERAL, LOG_WARNING, IDENT + "Waited 1 second for player to read data");
         }
     }
+    else if (Event->timerId() == m_priv->m_resendTimer)
+    {
+        {
+            QMutexLocker locker(m_priv->m_packetQueueLock);
+            m_priv->m_jitterBuffer.RetryResends(m_priv->m_resendClock.Elapsed());
+        }
+        SendResends();
+    }
     else if (Event->timerId() == m_priv->m_clientSendTimeout)
     {
         m_priv->m_clientSendTimoutCount++;
@@ -737,137 +749,99 @@ void TorcRAOPConnection::ReadData(void)
 
     m_priv->m_clientSendTimoutCount = 0;
 
-    QByteArray buffer;
+    char *buffer = m_priv->m_datagram.data();
     while (socket->hasPendingDatagrams() && socket->state() == QAbstractSocket::BoundState)
     {
-        qint64 size = socket->pendingDatagramSize();
-        buffer.resize(size);
-        if (socket->readDatagram(buffer.data(), size))
-        {
-            if ((uint8_t)buffer[0] != 0x80 && (uint8_t)buffer[0] != 0x90)
-                continue;
+        qint64 size = socket->readDatagram(buffer, RAOP_MAXPACKETSIZE);
+        if (size < 2)
+            continue;
 
-            uint8_t type = (uint8_t)buffer[1];
-            if (type != FIRSTSYNC && type != FIRSTAUDIO)
-                type &= ~0x80;
+        if ((uint8_t)buffer[0] != 0x80 && (uint8_t)buffer[0] != 0x90)
+            continue;
 
-            switch (type)
-            {
-                case SYNC:
-                case FIRSTSYNC:
-                    continue;
-                case FIRSTAUDIO:
-                case AUDIO:
-                case AUDIORESEND:
-                    break;
-                case TIMINGRESPONSE:
-                    continue;
-                default:
-                    LOG(VB_GENERAL, LOG_INFO, IDENT + QString("Unhandled packet type '0x%1'").arg(type, 0, 16));
-                    continue;
-            }
+        uint8_t type = (uint8_t)buffer[1];
+        if (type != FIRSTSYNC && type != FIRSTAUDIO)
+            type &= ~0x80;
 
-            // check we're ready for audio
-            if (!(m_priv->m_state & AESKey)      || !(m_priv->m_state & AESIV) ||
-                !(m_priv->m_state & AudioFormat) || !(m_priv->m_state & Transport))
-            {
-                LOG(VB_GENERAL, LOG_WARNING, IDENT + "Not ready to process audio data");
+        switch (type)
+        {
+            case SYNC:
+            case FIRSTSYNC:
                 continue;
-            }
-
-            // process data
-            int offset = 0;
-            if (type == AUDIORESEND)
-                offset += 4;
-
-            uint16_t thissequence  = ntohs(*(uint16_t *)(buffer.data() + offset + 2));
-            uint64_t thistimestamp = FramesToMs(ntohl(*(uint64_t*)(buffer.data() + offset + 4)), m_priv->m_sampleRate);
+            case FIRSTAUDIO:
+            case AUDIO:
+            case AUDIORESEND:
+                break;
+            case TIMINGRESPONSE:
+                continue;
+            default:
+                LOG(VB_GENERAL, LOG_INFO, IDENT + QString("Unhandled packet type '0x%1'").arg(type, 0, 16));
+                continue;
+        }
 
-            if (type == AUDIO || type == FIRSTAUDIO)
-            {
-                if (type == FIRSTAUDIO)
-                {
-                    m_priv->m_nextSequence = thissequence;
-                    m_priv->m_state |= AudioData;
-                }
+        // check we're ready for audio
+        if (!(m_priv->m_state & AESKey)      || !(m_priv->m_state & AESIV) ||
+            !(m_priv->m_state & AudioFormat) || !(m_priv->m_state & Transport))
+        {
+            LOG(VB_GENERAL, LOG_WARNING, IDENT + "Not ready to process audio data");
+            continue;
+        }
 
-                if ((m_priv->m_state & AudioData) && thissequence != m_priv->m_nextSequence)
-                    SendResend(thistimestamp, m_priv->m_nextSequence, thissequence);
+        // process data
+        int offset = 0;
+        if (type == AUDIORESEND)
+            offset += 4;
 
-                m_priv->m_nextSequence = thissequence + 1;
-                m_priv->m_state |= AudioData;
-            }
+        int length = size - offset - 12;
+        if (length < 16)
+            continue;
 
-            // resends
-            if (type == AUDIORESEND)
-            {
-                if (m_priv->m_resends.contains(thissequence))
-                {
-                    LOG(VB_GENERAL, LOG_DEBUG, IDENT + QString("Received resent packet (sequence %1)").arg(thissequence));
-                    m_priv->m_resends.remove(thissequence);
-                }
-                else
-                {
-                    LOG(VB_GENERAL, LOG_WARNING, IDENT + QString("Received unknown resend -late? (sequence %2)").arg(thissequence));
-                }
-            }
+        uint16_t thissequence  = ntohs(*(uint16_t *)(buffer + offset + 2));
+        uint64_t thistimestamp = FramesToMs(ntohl(*(uint32_t*)(buffer + offset + 4)), m_priv->m_sampleRate);
 
-            // set valid timestamp
-            if (m_priv->m_resends.isEmpty())
-            {
-                m_priv->m_validTimestamp = 0;
-            }
-            else if (type != AUDIORESEND)
-            {
-                uint64_t valid = UINT64_MAX;
-                QMutableMapIterator<uint16_t,uint64_t> it(m_priv->m_resends);
-                while (it.hasNext())
-                {
-                    it.next();
-                    if (thistimestamp - it.value() > 500)
-                    {
-                        LOG(VB_GENERAL, LOG_WARNING, IDENT + QString("Never received resend packet %1").arg(it.key()));
-                        m_priv->m_resends.remove(it.key());
-                    }
-                    else if (it.value() < valid)
-                    {
-                        valid = it.value();
-                    }
-                }
+        QMutexLocker locker(m_priv->m_packetQueueLock);
 
-                if (m_priv->m_resends.isEmpty())
-                {
-                    m_priv->m_validTimestamp = 0;
-                }
-                else
-                {
-                    m_priv->m_validTimestamp = valid;
-                    LOG(VB_GENERAL, LOG_DEBUG, IDENT + QString("%1 outstanding resends, latest ts %2")
-                        .arg(m_priv->m_resends.size()).arg(m_priv->m_validTimestamp));
-                }
-            }
+        TorcRAOPPacket *packet = NULL;
 
-            offset += 12;
-            char* data = buffer.data() + offset;
-            int length = buffer.size() - offset;
-            if (length < 16)
-                continue;
-
-            int aeslen = length & ~0xf;
-            unsigned char iv[16];
-            QByteArray *decrypted = new QByteArray(MAXPACKETSIZE, 0);
-            memcpy(iv, m_priv->m_AESIV.data(), sizeof(iv));
-            AES_cbc_encrypt((const unsigned char*)data, (unsigned char*)(decrypted->data()),
-                            aeslen, &m_priv->m_aesKey, iv, AES_DECRYPT);
-            memcpy(decrypted->data() + aeslen, data + aeslen, length - aeslen);
-
-            LOG(VB_GENERAL, LOG_DEBUG, IDENT + QString("Decoded %1 bytes, timestamp %2 sequence %3")
-                .arg(length).arg(thistimestamp).arg(thissequence));
+        if (type == FIRSTAUDIO)
+        {
+            m_priv->m_jitterBuffer.Start(thissequence);
+            m_priv->m_state |= AudioData;
+        }
 
-            m_priv->m_packetQueueLock->lock();
-            m_priv->m_packetQueue.insert(thistimestamp, decrypted);
-            m_priv->m_packetQueueLock->unlock();
+        if (type == AUDIORESEND)
+        {
+            packet = m_priv->m_jitterBuffer.Claim(thissequence);
+            if (packet)
+                LOG(VB_GENERAL, LOG_DEBUG, IDENT + QString("Received resent packet (sequence %1)").arg(thissequence));
+            else
+                LOG(VB_GENERAL, LOG_WARNING, IDENT + QString("Received unknown resend - late? (sequence %1)").arg(thissequence));
         }
+        else
+        {
+            packet = m_priv->m_jitterBuffer.Reserve(thissequence);
+            m_priv->m_state |= AudioData;
+        }
+
+        if (!packet)
+            continue;
+
+        // decrypt straight into the jitter buffer
+        char* data = buffer + offset + 12;
+        int aeslen = length & ~0xf;
+        unsigned char iv[16];
+        memcpy(iv, m_priv->m_AESIV.constData(), sizeof(iv));
+        AES_cbc_encrypt((const unsigned char*)data, (unsigned char*)packet->m_data,
+                        aeslen, &m_priv->m_aesKey, iv, AES_DECRYPT);
+        memcpy(packet->m_data + aeslen, data + aeslen, length - aeslen);
+        packet->m_size  = length;
+        packet->m_state = TorcRAOPPacket::Filled;
+        m_priv->m_jitterBuffer.m_received++;
+
+        LOG(VB_GENERAL, LOG_DEBUG, IDENT + QString("Decoded %1 bytes, timestamp %2 sequence %3")
+            .arg(length).arg(thistimestamp).arg(thissequence));
     }
 
+    // request any gaps found in this batch of datagrams
+    SendResends();
 }
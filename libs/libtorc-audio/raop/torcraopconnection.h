@@ -28,7 +28,7 @@ class TorcRAOPConnection : public QObject
   protected:
     static RSA*    LoadKey      (void);
     QTcpSocket*    MasterSocket (void);
-    QByteArray*    Read         (void);
+    int            Read         (quint8 *Buffer, qint32 BufferSize);
 
   protected:
     TorcRAOPConnection(QTcpSocket *Socket, int Reference, const QString &MACAddress);
@@ -38,7 +38,8 @@ class TorcRAOPConnection : public QObject
     void           Close        (void);
     void           ParseHeader  (const QByteArray &Line, bool First);
     void           ProcessText  (void);
-    void           SendResend   (quint64 Timestamp, quint16 Start, quint16 End);
+    void           SendResend   (quint16 Start, quint16 Count);
+    void           SendResends  (void);
     void           timerEvent   (QTimerEvent *Event);
 
   private:
@@ -47,16 +47,16 @@
 QMutex* TorcRAOPDevice::gTorcRAOPLock = new QMutex();
 TorcRAOPDevice* TorcRAOPDevice::gTorcRAOPDevice = NULL;
 
-QByteArray* TorcRAOPDevice::Read(int Reference)
+int TorcRAOPDevice::Read(int Reference, quint8 *Buffer, qint32 BufferSize)
 {
     if (Reference < 1)
-        return NULL;
+        return -1;
 
     QMutexLocker locker(gTorcRAOPLock);
 
     if (gTorcRAOPDevice)
-        return gTorcRAOPDevice->ReadPacket(Reference);
-    return NULL;
+        return gTorcRAOPDevice->ReadPacket(Reference, Buffer, BufferSize);
+    return -1;
 }
 
 TorcRAOPDevice::TorcRAOPDevice()
@@ -95,8 +95,8 @@ TorcRAOPDevice::TorcRAOPDevice()
     // listen for connections
     connect(this, SIGNAL(newConnection()), this, SLOT(NewConnection()));
 
-    // listen for events
-    gLocalContext->AddObserver(this);
+    // listen for network events
+    gLocalContext->AddObserver(this, QList<int>() << Torc::NetworkAvailable);
 
     // no network = no mac address (and no clients)
     if (TorcNetwork::IsAvailable())
@@ -305,15 +305,15 @@ bool TorcRAOPDevice::event(QEvent *Event)
     return false;
 }
 
-QByteArray* TorcRAOPDevice::ReadPacket(int Reference)
+int TorcRAOPDevice::ReadPacket(int Reference, quint8 *Buffer, qint32 BufferSize)
 {
     QMutexLocker locker(m_lock);
 
     QMap<int,TorcRAOPConnection*>::iterator it = m_connections.find(Reference);
     if (it != m_connections.end())
-        return it.value()->Read();
+        return it.value()->Read(Buffer, BufferSize);
 
-    return NULL;
+    return -1;
 }
 
 void TorcRAOPDevice::Enable(bool Enable)
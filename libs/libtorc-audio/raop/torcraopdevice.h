@@ -20,7 +20,7 @@ class TorcRAOPDevice : public QTcpServer
     static     QMutex*            gTorcRAOPLock;
     static     TorcRAOPDevice*    gTorcRAOPDevice;
 
-    static     QByteArray* Read   (int  Reference);
+    static     int         Read   (int  Reference, quint8 *Buffer, qint32 BufferSize);
 
   public:
     virtual    ~TorcRAOPDevice    ();
@@ -36,7 +36,7 @@ class TorcRAOPDevice : public QTcpServer
     bool        Open              (void);
     void        Close             (bool Suspend = false);
     bool        event             (QEvent *Event);
-    QByteArray* ReadPacket        (int Reference);
+    int         ReadPacket        (int Reference, quint8 *Buffer, qint32 BufferSize);
 
   private slots:
     void        Enable            (bool Enable);
@@ -0,0 +1,319 @@
+/* Class TorcRAOPJitterBuffer
+*
+* This file is part of the Torc project.
+*
+* Copyright (C) Mark Kendall 2013
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+* USA.
+*/
+
+// Torc
+#include "torclogging.h"
+#include "torcraopjitterbuffer.h"
+
+#define MINPLAYOUTDELAY     8
+#define DEFAULTPLAYOUTDELAY 32
+#define MAXPLAYOUTDELAY     (RAOP_RINGSIZE / 2)
+#define STABLEPACKETS       2000 // packets without loss before the playout delay is reduced
+
+#define IDENT (QString("%1: ").arg(m_reference))
+
+/*! \class TorcRAOPPacket
+ *  \brief A single, preallocated slot in the RAOP jitter buffer.
+*/
+TorcRAOPPacket::TorcRAOPPacket()
+  : m_state(Empty),
+    m_resends(0),
+    m_requested(0),
+    m_size(0)
+{
+}
+
+/*! \class TorcRAOPJitterBuffer
+ *  \brief A fixed size ring of audio packets indexed by RTP sequence number.
+ *
+ * Packets are decrypted directly into their slot, so no memory is allocated once the
+ * stream is running. Gaps in the sequence are marked as missing and collected into ranges that
+ * are requested from the client in a single pass (see TorcRAOPConnection::SendResends).
+ *
+ * Playback is held back by a playout delay (measured in packets) that grows whenever the reader
+ * underruns or a packet is lost and slowly shrinks again while the stream is stable.
+ *
+ * The buffer has no knowledge of time or sockets, so that it can be driven by a simulated stream
+ * (see 'torc-utils --raopjitterbuffer').
+ *
+ * \note The buffer is not thread safe - all access must be protected by the owner.
+*/
+TorcRAOPJitterBuffer::TorcRAOPJitterBuffer(int Reference)
+  : m_reference(Reference),
+    m_packets(new TorcRAOPPacket[RAOP_RINGSIZE]),
+    m_started(false),
+    m_buffering(true),
+    m_readSequence(0),
+    m_writeSequence(0),
+    m_playoutDelay(DEFAULTPLAYOUTDELAY),
+    m_stableCount(0),
+    m_received(0),
+    m_lost(0),
+    m_late(0),
+    m_dropped(0),
+    m_underruns(0)
+{
+    m_pendingResends.reserve(16);
+}
+
+TorcRAOPJitterBuffer::~TorcRAOPJitterBuffer()
+{
+    delete [] m_packets;
+}
+
+void TorcRAOPJitterBuffer::Reset(void)
+{
+    for (int i = 0; i < RAOP_RINGSIZE; ++i)
+    {
+        m_packets[i].m_state = TorcRAOPPacket::Empty;
+        m_packets[i].m_size  = 0;
+    }
+
+    m_pendingResends.clear();
+    m_started   = false;
+    m_buffering = true;
+}
+
+TorcRAOPPacket* TorcRAOPJitterBuffer::Slot(uint16_t Sequence)
+{
+    return &m_packets[Sequence & (RAOP_RINGSIZE - 1)];
+}
+
+int TorcRAOPJitterBuffer::Depth(void) const
+{
+    return (uint16_t)(m_writeSequence - m_readSequence);
+}
+
+bool TorcRAOPJitterBuffer::InWindow(uint16_t Sequence) const
+{
+    return (int16_t)(Sequence - m_readSequence) >= 0 && (int16_t)(m_writeSequence - Sequence) > 0;
+}
+
+void TorcRAOPJitterBuffer::Start(uint16_t Sequence)
+{
+    Reset();
+    m_started       = true;
+    m_readSequence  = Sequence;
+    m_writeSequence = Sequence;
+}
+
+/*! \brief Return a slot for the given live packet, marking any gap as missing.
+ *
+ * Returns NULL if the packet is too late to be played.
+*/
+TorcRAOPPacket* TorcRAOPJitterBuffer::Reserve(uint16_t Sequence)
+{
+    if (!m_started)
+        Start(Sequence);
+
+    int16_t gap = (int16_t)(Sequence - m_writeSequence);
+
+    // out of order or late
+    if (gap < 0)
+        return Claim(Sequence);
+
+    // discontinuity that cannot be recovered with resends
+    if (gap >= MAXPLAYOUTDELAY)
+    {
+        Start(Sequence);
+        gap = 0;
+    }
+
+    // the player is not keeping up - drop the oldest packets to make room for the gap and this
+    // packet, otherwise the gap would wrap onto slots that have not been read yet
+    while (Depth() + gap + 1 > RAOP_RINGSIZE)
+    {
+        Slot(m_readSequence)->m_state = TorcRAOPPacket::Empty;
+        m_readSequence++;
+        m_dropped++;
+    }
+
+    if (gap > 0)
+    {
+        for (uint16_t missing = m_writeSequence; missing != Sequence; ++missing)
+        {
+            TorcRAOPPacket *packet = Slot(missing);
+            packet->m_state     = TorcRAOPPacket::Missing;
+            packet->m_resends   = 0;
+            packet->m_requested = 0;
+        }
+
+        AddResend(m_writeSequence, gap);
+    }
+
+    m_writeSequence = Sequence + 1;
+    return Slot(Sequence);
+}
+
+/*! \brief Return the slot for a resent or reordered packet, if it is still wanted.
+*/
+TorcRAOPPacket* TorcRAOPJitterBuffer::Claim(uint16_t Sequence)
+{
+    if (m_started && InWindow(Sequence))
+    {
+        TorcRAOPPacket *packet = Slot(Sequence);
+        if (packet->m_state == TorcRAOPPacket::Missing)
+            return packet;
+    }
+
+    m_late++;
+    return NULL;
+}
+
+/*! \brief Copy the next packet due for playback into Buffer.
+ *
+ * Returns the size of the packet, 0 if no packet is ready yet (buffering or waiting on a resend)
+ * or -1 on error.
+*/
+int TorcRAOPJitterBuffer::Read(quint8 *Buffer, qint32 BufferSize)
+{
+    if (!Buffer || BufferSize < 1)
+        return -1;
+
+    if (!m_started)
+        return 0;
+
+    int depth = Depth();
+
+    if (m_buffering)
+    {
+        if (depth < m_playoutDelay)
+            return 0;
+
+        LOG(VB_GENERAL, LOG_DEBUG, IDENT + QString("Buffered %1 packets - starting playout").arg(depth));
+        m_buffering = false;
+    }
+
+    bool lost = false;
+
+    while (depth > 0)
+    {
+        TorcRAOPPacket *packet = Slot(m_readSequence);
+
+        if (packet->m_state == TorcRAOPPacket::Filled)
+        {
+            int size = packet->m_size;
+            if (size > BufferSize)
+            {
+                LOG(VB_GENERAL, LOG_WARNING, IDENT + QString("Packet size %1 - truncating to %2").arg(size).arg(BufferSize));
+                size = BufferSize;
+            }
+
+            memcpy(Buffer, packet->m_data, size);
+            packet->m_state = TorcRAOPPacket::Empty;
+            m_readSequence++;
+            Played();
+            return size;
+        }
+
+        // still time for the resend to arrive
+        if (packet->m_state == TorcRAOPPacket::Missing && depth <= m_playoutDelay)
+            return 0;
+
+        LOG(VB_GENERAL, LOG_WARNING, IDENT + QString("Never received packet %1").arg(m_readSequence));
+        packet->m_state = TorcRAOPPacket::Empty;
+        m_readSequence++;
+        m_lost++;
+        depth--;
+
+        if (!lost)
+            IncreaseDelay();
+        lost = true;
+    }
+
+    // underrun - rebuild the buffer with a larger playout delay
+    m_underruns++;
+    m_buffering = true;
+    IncreaseDelay();
+    LOG(VB_GENERAL, LOG_INFO, IDENT + QString("Buffer underrun - playout delay now %1 packets").arg(m_playoutDelay));
+    return 0;
+}
+
+void TorcRAOPJitterBuffer::AddResend(uint16_t Start, uint16_t Count)
+{
+    if (!m_pendingResends.isEmpty())
+    {
+        QPair<uint16_t,uint16_t> &last = m_pendingResends.last();
+        if ((uint16_t)(last.first + last.second) == Start)
+        {
+            last.second += Count;
+            return;
+        }
+    }
+
+    m_pendingResends.append(QPair<uint16_t,uint16_t>(Start, Count));
+}
+
+/*! \brief Queue resend requests for packets that are still missing RAOP_RESENDRETRY ms after they were last requested.
+ *
+ * Now is a monotonic time in milliseconds.
+*/
+void TorcRAOPJitterBuffer::RetryResends(int Now)
+{
+    if (!m_started)
+        return;
+
+    for (uint16_t sequence = m_readSequence; sequence != m_writeSequence; ++sequence)
+    {
+        TorcRAOPPacket *packet = Slot(sequence);
+        if (packet->m_state == TorcRAOPPacket::Missing && packet->m_resends < RAOP_MAXRESENDS &&
+            Now - packet->m_requested >= RAOP_RESENDRETRY)
+        {
+            AddResend(sequence, 1);
+        }
+    }
+}
+
+/*! \brief Return (and clear) the queued resend ranges, marking the packets as requested at time Now.
+*/
+QVector<QPair<uint16_t,uint16_t> > TorcRAOPJitterBuffer::TakeResends(int Now)
+{
+    QVector<QPair<uint16_t,uint16_t> > resends = m_pendingResends;
+    m_pendingResends.clear();
+
+    for (int i = 0; i < resends.size(); ++i)
+    {
+        for (uint16_t j = 0; j < resends[i].second; ++j)
+        {
+            TorcRAOPPacket *packet = Slot(resends[i].first + j);
+            packet->m_resends++;
+            packet->m_requested = Now;
+        }
+    }
+
+    return resends;
+}
+
+void TorcRAOPJitterBuffer::IncreaseDelay(void)
+{
+    m_stableCount  = 0;
+    m_playoutDelay = qMin(MAXPLAYOUTDELAY, m_playoutDelay + (m_playoutDelay >> 2) + 1);
+}
+
+void TorcRAOPJitterBuffer::Played(void)
+{
+    if (++m_stableCount > STABLEPACKETS)
+    {
+        m_stableCount  = 0;
+        m_playoutDelay = qMax(MINPLAYOUTDELAY, m_playoutDelay - 1);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef TORCRAOPJITTERBUFFER_H
+#define TORCRAOPJITTERBUFFER_H
+
+// Qt
+#include <QVector>
+#include <QPair>
+
+// Torc
+#include "torcaudioexport.h"
+
+#define RAOP_MAXPACKETSIZE  2048
+#define RAOP_RINGSIZE       512  // power of 2, ~4 seconds of 352 sample packets
+#define RAOP_RESENDRETRY    100  // ms before a missing packet is requested again
+#define RAOP_MAXRESENDS     3
+
+class TORC_AUDIO_PUBLIC TorcRAOPPacket
+{
+  public:
+    enum State
+    {
+        Empty,
+        Missing,
+        Filled
+    };
+
+    TorcRAOPPacket();
+
+    int          m_state;
+    int          m_resends;
+    int          m_requested;
+    int          m_size;
+    char         m_data[RAOP_MAXPACKETSIZE];
+};
+
+class TORC_AUDIO_PUBLIC TorcRAOPJitterBuffer
+{
+  public:
+    explicit TorcRAOPJitterBuffer(int Reference);
+    ~TorcRAOPJitterBuffer();
+
+    void            Reset          (void);
+    void            Start          (uint16_t Sequence);
+    TorcRAOPPacket* Reserve        (uint16_t Sequence);
+    TorcRAOPPacket* Claim          (uint16_t Sequence);
+    int             Read           (quint8 *Buffer, qint32 BufferSize);
+    void            RetryResends   (int Now);
+    QVector<QPair<uint16_t,uint16_t> > TakeResends (int Now);
+
+  protected:
+    TorcRAOPPacket* Slot           (uint16_t Sequence);
+    int             Depth          (void) const;
+    bool            InWindow       (uint16_t Sequence) const;
+    void            AddResend      (uint16_t Start, uint16_t Count);
+    void            IncreaseDelay  (void);
+    void            Played         (void);
+
+  public:
+    int                       m_reference;
+    TorcRAOPPacket           *m_packets;
+    bool                      m_started;
+    bool                      m_buffering;
+    uint16_t                  m_readSequence;
+    uint16_t                  m_writeSequence;
+    int                       m_playoutDelay;
+    int                       m_stableCount;
+    quint64                   m_received;
+    quint64                   m_lost;
+    quint64                   m_late;
+    quint64                   m_dropped;
+    quint64                   m_underruns;
+    QVector<QPair<uint16_t,uint16_t> > m_pendingResends;
+};
+
+#endif // TORCRAOPJITTERBUFFER_H
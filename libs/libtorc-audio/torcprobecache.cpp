@@ -0,0 +1,457 @@
+/* Class TorcProbeCache
+*
+* This file is part of the Torc project.
+*
+* Copyright (C) Mark Kendall 2013
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+* USA.
+*/
+
+// Qt
+#include <QFile>
+#include <QMutex>
+#include <QDataStream>
+#include <QVariant>
+#include <QRunnable>
+#include <QThreadPool>
+
+// Torc
+#include "torclocalcontext.h"
+#include "torcdirectories.h"
+#include "torclogging.h"
+#include "torcbuffer.h"
+#include "torcprobecache.h"
+
+#define PROBE_CACHE_VERSION     1
+#define PROBE_CACHE_MAX_ENTRIES 500
+#define PROBE_CACHE_FILE        QString("/probecache.dat")
+
+/*! \class TorcProbeCachePriv
+ *  \brief The in memory copy of the probe cache.
+ *
+ * Entries are kept in least recently used order and the whole cache is rewritten whenever a new
+ * entry is added. It is small (a few hundred bytes per entry) and only updated when an item is
+ * opened for the first time (or has changed). The file is written by TorcProbeCacheWriter on the
+ * global thread pool, so the demuxer never waits on disk I/O.
+*/
+class TorcProbeCachePriv
+{
+  public:
+    TorcProbeCachePriv()
+      : m_loaded(false),
+        m_saveQueued(false)
+    {
+    }
+
+    void Load(void)
+    {
+        if (m_loaded)
+            return;
+
+        m_loaded = true;
+        m_path   = GetTorcConfigDir() + PROBE_CACHE_FILE;
+
+        QFile file(m_path);
+        if (!file.open(QIODevice::ReadOnly))
+            return;
+
+        QDataStream stream(&file);
+        qint32 version = 0;
+        stream >> version;
+        if (version != PROBE_CACHE_VERSION)
+        {
+            LOG(VB_GENERAL, LOG_INFO, "Ignoring probe cache from a different version");
+            return;
+        }
+
+        stream >> m_order >> m_entries;
+
+        if (stream.status() != QDataStream::Ok || m_order.size() != m_entries.size())
+        {
+            LOG(VB_GENERAL, LOG_WARNING, "Probe cache is corrupt - ignoring");
+            m_order.clear();
+            m_entries.clear();
+            return;
+        }
+
+        LOG(VB_GENERAL, LOG_INFO, QString("Loaded %1 probe cache entries").arg(m_entries.size()));
+    }
+
+    void ScheduleSave(void);
+
+    QVariantMap Find(const QString &Key)
+    {
+        Load();
+
+        QMap<QString,QVariant>::const_iterator it = m_entries.constFind(Key);
+        if (it == m_entries.constEnd())
+            return QVariantMap();
+
+        m_order.removeOne(Key);
+        m_order.append(Key);
+        return it.value().toMap();
+    }
+
+    void Insert(const QString &Key, const QVariantMap &Entry)
+    {
+        Load();
+
+        m_order.removeOne(Key);
+        m_order.append(Key);
+        m_entries.insert(Key, Entry);
+
+        while (m_order.size() > PROBE_CACHE_MAX_ENTRIES)
+            m_entries.remove(m_order.takeFirst());
+
+        ScheduleSave();
+    }
+
+    bool         m_loaded;
+    bool         m_saveQueued;
+    QString      m_path;
+    QStringList  m_order;
+    QVariantMap  m_entries;
+};
+
+static QMutex             gProbeCacheLock;
+static QMutex             gProbeCacheFileLock;
+static TorcProbeCachePriv gProbeCache;
+
+/*! \class TorcProbeCacheWriter
+ *  \brief Write the probe cache to disk from the global thread pool.
+ *
+ * The cache is copied (cheaply - the containers are implicitly shared) when the writer runs, so any
+ * number of updates made while a write is queued are coalesced into a single write.
+*/
+class TorcProbeCacheWriter : public QRunnable
+{
+  public:
+    TorcProbeCacheWriter()
+      : QRunnable()
+    {
+        setAutoDelete(true);
+    }
+
+    void run(void)
+    {
+        QMutexLocker filelocker(&gProbeCacheFileLock);
+
+        QString path;
+        QStringList order;
+        QVariantMap entries;
+
+        {
+            QMutexLocker locker(&gProbeCacheLock);
+            gProbeCache.m_saveQueued = false;
+            path    = gProbeCache.m_path;
+            order   = gProbeCache.m_order;
+            entries = gProbeCache.m_entries;
+        }
+
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            LOG(VB_GENERAL, LOG_ERR, QString("Failed to open '%1' for writing").arg(path));
+            return;
+        }
+
+        QDataStream stream(&file);
+        stream << (qint32)PROBE_CACHE_VERSION << order << entries;
+    }
+};
+
+/// Queue a write of the cache. gProbeCacheLock must be held.
+void TorcProbeCachePriv::ScheduleSave(void)
+{
+    if (m_saveQueued)
+        return;
+
+    m_saveQueued = true;
+    QThreadPool::globalInstance()->start(new TorcProbeCacheWriter());
+}
+
+/*! \class TorcProbeCache
+ *  \brief A persistent cache of the stream parameters found by avformat_find_stream_info.
+ *
+ * avformat_find_stream_info may need to read and decode several megabytes of data to establish the
+ * codec parameters of each stream, which dominates the time to first frame for network sources and
+ * for some container formats. The results are cached against the URI, size and modification time
+ * of the media so that subsequent opens only need the container header.
+ *
+ * A cached entry is only used if the streams found when opening the container match those that were
+ * cached (in number, type and codec) and the restored parameters are sufficient to open each decoder.
+ * Otherwise the stream info is found as normal and the cache is updated.
+ *
+ * Media whose streams are only discovered while probing (e.g. MPEG-TS), or whose cached entry did not
+ * match, can never be restored. They are recorded as uncacheable rather than stored, so they are
+ * neither restored nor rewritten on every open.
+ *
+ * \note Sequential (live) sources, sources of unknown size and sources that cannot be versioned
+ * (see TorcBuffer::GetValidator) are never cached.
+*/
+
+/*! \brief Return the cache key for the media in Buffer or an empty string if it should not be cached.
+*/
+QString TorcProbeCache::GetKey(TorcBuffer *Buffer)
+{
+    if (!Buffer || Buffer->IsSequential())
+        return QString();
+
+    qint64 size = Buffer->GetSize();
+    if (size < 1)
+        return QString();
+
+    // without a modification time or ETag, a replaced file cannot be detected
+    QString validator = Buffer->GetValidator();
+    if (validator.isEmpty())
+        return QString();
+
+    return QString("%1|%2|%3").arg(Buffer->GetURI()).arg(size).arg(validator);
+}
+
+/*! \brief Restore cached stream parameters to an opened (but not yet probed) Context.
+ *
+ * \returns True if the cached parameters were applied and avformat_find_stream_info can be skipped.
+*/
+bool TorcProbeCache::Restore(const QString &Key, AVFormatContext *Context)
+{
+    if (Key.isEmpty() || !Context)
+        return false;
+
+    QVariantMap entry;
+    {
+        QMutexLocker locker(&gProbeCacheLock);
+        entry = gProbeCache.Find(Key);
+    }
+
+    if (entry.isEmpty() || entry.value("uncacheable").toBool())
+        return false;
+
+    QVariantList streams = entry.value("streams").toList();
+    if (streams.size() != (int)Context->nb_streams)
+    {
+        LOG(VB_GENERAL, LOG_INFO, "Probe cache stream count mismatch");
+        MarkUncacheable(Key);
+        return false;
+    }
+
+    // validate before touching anything
+    for (uint i = 0; i < Context->nb_streams; ++i)
+    {
+        AVCodecContext *codec = Context->streams[i]->codec;
+        QVariantMap cached    = streams[i].toMap();
+
+        if ((codec->codec_type != cached.value("type").toInt()) ||
+            (codec->codec_id != AV_CODEC_ID_NONE && codec->codec_id != cached.value("codec").toInt()))
+        {
+            LOG(VB_GENERAL, LOG_INFO, "Probe cache stream mismatch");
+            MarkUncacheable(Key);
+            return false;
+        }
+    }
+
+    for (uint i = 0; i < Context->nb_streams; ++i)
+    {
+        AVStream         *stream = Context->streams[i];
+        AVCodecContext    *codec = stream->codec;
+        QVariantMap       cached = streams[i].toMap();
+
+        if (codec->codec_id == AV_CODEC_ID_NONE)
+            codec->codec_id = (AVCodecID)cached.value("codec").toInt();
+        if (!codec->codec_tag)
+            codec->codec_tag = cached.value("tag").toUInt();
+        if (!codec->bit_rate)
+            codec->bit_rate = cached.value("bitrate").toInt();
+
+        if (codec->codec_type == AVMEDIA_TYPE_AUDIO)
+        {
+            if (!codec->sample_rate)
+                codec->sample_rate = cached.value("samplerate").toInt();
+            if (!codec->channels)
+                codec->channels = cached.value("channels").toInt();
+            if (!codec->channel_layout)
+                codec->channel_layout = cached.value("channellayout").toULongLong();
+            if (codec->sample_fmt == AV_SAMPLE_FMT_NONE)
+                codec->sample_fmt = (AVSampleFormat)cached.value("sampleformat").toInt();
+            if (!codec->block_align)
+                codec->block_align = cached.value("blockalign").toInt();
+        }
+        else if (codec->codec_type == AVMEDIA_TYPE_VIDEO)
+        {
+            if (!codec->width || !codec->height)
+            {
+                codec->width  = cached.value("width").toInt();
+                codec->height = cached.value("height").toInt();
+            }
+            if (codec->pix_fmt == AV_PIX_FMT_NONE)
+                codec->pix_fmt = (AVPixelFormat)cached.value("pixelformat").toInt();
+            if (!stream->sample_aspect_ratio.num)
+            {
+                stream->sample_aspect_ratio.num = cached.value("sarnum").toInt();
+                stream->sample_aspect_ratio.den = cached.value("sarden").toInt();
+            }
+            if (!stream->avg_frame_rate.num)
+            {
+                stream->avg_frame_rate.num = cached.value("fpsnum").toInt();
+                stream->avg_frame_rate.den = cached.value("fpsden").toInt();
+            }
+            if (!stream->r_frame_rate.num)
+            {
+                stream->r_frame_rate.num = cached.value("rfpsnum").toInt();
+                stream->r_frame_rate.den = cached.value("rfpsden").toInt();
+            }
+        }
+
+        if (!codec->time_base.num)
+        {
+            codec->time_base.num = cached.value("tbnum").toInt();
+            codec->time_base.den = cached.value("tbden").toInt();
+        }
+
+        QByteArray extradata = cached.value("extradata").toByteArray();
+        if (!codec->extradata && !extradata.isEmpty())
+        {
+            codec->extradata = (uint8_t*)av_mallocz(extradata.size() + FF_INPUT_BUFFER_PADDING_SIZE);
+            if (codec->extradata)
+            {
+                memcpy(codec->extradata, extradata.constData(), extradata.size());
+                codec->extradata_size = extradata.size();
+            }
+        }
+
+        if (stream->duration == (int64_t)AV_NOPTS_VALUE)
+            stream->duration = cached.value("duration").toLongLong();
+        if (stream->start_time == (int64_t)AV_NOPTS_VALUE)
+            stream->start_time = cached.value("start").toLongLong();
+    }
+
+    if (Context->duration == (int64_t)AV_NOPTS_VALUE)
+        Context->duration = entry.value("duration").toLongLong();
+    if (Context->start_time == (int64_t)AV_NOPTS_VALUE)
+        Context->start_time = entry.value("start").toLongLong();
+    if (!Context->bit_rate)
+        Context->bit_rate = entry.value("bitrate").toInt();
+
+    // finally, ensure every stream we may want to decode has what its decoder needs
+    for (uint i = 0; i < Context->nb_streams; ++i)
+    {
+        AVCodecContext *codec = Context->streams[i]->codec;
+        if (codec->codec_id == AV_CODEC_ID_NONE)
+            continue;
+
+        if ((codec->codec_type == AVMEDIA_TYPE_AUDIO && (!codec->sample_rate || !codec->channels)) ||
+            (codec->codec_type == AVMEDIA_TYPE_VIDEO && (!codec->width || !codec->height)))
+        {
+            LOG(VB_GENERAL, LOG_INFO, "Probe cache entry is incomplete");
+            MarkUncacheable(Key);
+            return false;
+        }
+    }
+
+    LOG(VB_GENERAL, LOG_INFO, "Restored stream parameters from probe cache");
+    return true;
+}
+
+/*! \brief Record that the media identified by Key cannot be restored from the cache.
+*/
+void TorcProbeCache::MarkUncacheable(const QString &Key)
+{
+    if (Key.isEmpty())
+        return;
+
+    QVariantMap entry;
+    entry.insert("uncacheable", true);
+
+    QMutexLocker locker(&gProbeCacheLock);
+    gProbeCache.Insert(Key, entry);
+}
+
+/*! \brief Add the stream parameters of a fully probed Context to the cache.
+ *
+ * StreamsBeforeProbe is the number of streams that were known before avformat_find_stream_info was
+ * called. If probing found more, the cached entry could never match the container header and the
+ * media is marked as uncacheable instead. Nothing is stored for media already marked as uncacheable.
+*/
+void TorcProbeCache::Store(const QString &Key, AVFormatContext *Context, uint StreamsBeforeProbe)
+{
+    if (Key.isEmpty() || !Context || !Context->nb_streams)
+        return;
+
+    {
+        QMutexLocker locker(&gProbeCacheLock);
+        if (gProbeCache.Find(Key).value("uncacheable").toBool())
+            return;
+    }
+
+    if (Context->nb_streams != StreamsBeforeProbe)
+    {
+        LOG(VB_GENERAL, LOG_INFO, "Streams found while probing - not caching");
+        MarkUncacheable(Key);
+        return;
+    }
+
+    QVariantList streams;
+    for (uint i = 0; i < Context->nb_streams; ++i)
+    {
+        AVStream      *stream = Context->streams[i];
+        AVCodecContext *codec = stream->codec;
+
+        QVariantMap cached;
+        cached.insert("type",          (int)codec->codec_type);
+        cached.insert("codec",         (int)codec->codec_id);
+        cached.insert("tag",           codec->codec_tag);
+        cached.insert("bitrate",       codec->bit_rate);
+        cached.insert("tbnum",         codec->time_base.num);
+        cached.insert("tbden",         codec->time_base.den);
+        cached.insert("duration",      (qint64)stream->duration);
+        cached.insert("start",         (qint64)stream->start_time);
+
+        if (codec->codec_type == AVMEDIA_TYPE_AUDIO)
+        {
+            cached.insert("samplerate",    codec->sample_rate);
+            cached.insert("channels",      codec->channels);
+            cached.insert("channellayout", (qulonglong)codec->channel_layout);
+            cached.insert("sampleformat",  (int)codec->sample_fmt);
+            cached.insert("blockalign",    codec->block_align);
+        }
+        else if (codec->codec_type == AVMEDIA_TYPE_VIDEO)
+        {
+            cached.insert("width",         codec->width);
+            cached.insert("height",        codec->height);
+            cached.insert("pixelformat",   (int)codec->pix_fmt);
+            cached.insert("sarnum",        stream->sample_aspect_ratio.num);
+            cached.insert("sarden",        stream->sample_aspect_ratio.den);
+            cached.insert("fpsnum",        stream->avg_frame_rate.num);
+            cached.insert("fpsden",        stream->avg_frame_rate.den);
+            cached.insert("rfpsnum",       stream->r_frame_rate.num);
+            cached.insert("rfpsden",       stream->r_frame_rate.den);
+        }
+
+        if (codec->extradata && codec->extradata_size > 0)
+            cached.insert("extradata", QByteArray((const char*)codec->extradata, codec->extradata_size));
+
+        streams.append(cached);
+    }
+
+    QVariantMap entry;
+    entry.insert("streams",  streams);
+    entry.insert("duration", (qint64)Context->duration);
+    entry.insert("start",    (qint64)Context->start_time);
+    entry.insert("bitrate",  Context->bit_rate);
+
+    QMutexLocker locker(&gProbeCacheLock);
+    gProbeCache.Insert(Key, entry);
+}
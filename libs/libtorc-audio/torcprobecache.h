@@ -0,0 +1,27 @@
+#ifndef TORCPROBECACHE_H
+#define TORCPROBECACHE_H
+
+// Qt
+#include <QString>
+
+// Torc
+#include "torcaudioexport.h"
+
+extern "C" {
+#include "libavformat/avformat.h"
+}
+
+class TorcBuffer;
+
+class TORC_AUDIO_PUBLIC TorcProbeCache
+{
+  public:
+    static QString GetKey   (TorcBuffer *Buffer);
+    static bool    Restore  (const QString &Key, AVFormatContext *Context);
+    static void    Store    (const QString &Key, AVFormatContext *Context, uint StreamsBeforeProbe);
+
+  private:
+    static void    MarkUncacheable (const QString &Key);
+};
+
+#endif // TORCPROBECACHE_H
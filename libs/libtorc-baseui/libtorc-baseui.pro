@@ -28,6 +28,7 @@ HEADERS += uitextrenderer.h
 HEADERS += uieffect.h
 HEADERS += uiwindow.h
 HEADERS += uiimageloader.h
+HEADERS += uiimagecache.h
 HEADERS += uiwidget.h
 HEADERS += uidisplay.h
 HEADERS += uidisplaybase.h
@@ -58,6 +59,7 @@ SOURCES += uieffect.cpp
 SOURCES += uiwindow.cpp
 SOURCES += uimedia.cpp
 SOURCES += uiimageloader.cpp
+SOURCES += uiimagecache.cpp
 SOURCES += uiwidget.cpp
 SOURCES += uidisplaybase.cpp
 SOURCES += uiperformance.cpp
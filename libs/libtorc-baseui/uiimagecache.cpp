@@ -0,0 +1,322 @@
+/* Class UIImageCache
+*
+* This file is part of the Torc project.
+*
+* Copyright (C) Mark Kendall 2013
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+* USA.
+*/
+
+// Qt
+#include <QDir>
+#include <QSet>
+#include <QHash>
+#include <QFile>
+#include <QCache>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QCryptographicHash>
+
+// Torc
+#include "torclocalcontext.h"
+#include "torcdirectories.h"
+#include "torcadminthread.h"
+#include "torclogging.h"
+#include "uiimagecache.h"
+
+// cache file header
+#define CACHE_MAGIC   0x54494331 // 'TIC1'
+#define CACHE_VERSION 1
+
+class UIImageCachePriv
+{
+  public:
+    UIImageCachePriv()
+      : m_diskSize(0),
+        m_maxDiskSize(0)
+    {
+        m_directory = GetTorcConfigDir() + "/cache/images/";
+        QDir().mkpath(m_directory);
+
+        int memory   = gLocalContext->GetSetting(TORC_GUI + "ImageCacheMemory", (int)32);
+        int disk     = gLocalContext->GetSetting(TORC_GUI + "ImageCacheDisk", (int)256);
+        m_maxDiskSize = (qint64)disk * 1024 * 1024;
+
+        // cost is in KB
+        m_memory.setMaxCost(memory * 1024);
+
+        // order existing files by last access, least recently used first
+        QMultiMap<qint64,QFileInfo> existing;
+        QFileInfoList files = QDir(m_directory).entryInfoList(QStringList("*.img"), QDir::Files);
+        foreach (const QFileInfo &file, files)
+            existing.insert(file.lastRead().toMSecsSinceEpoch(), file);
+
+        QMultiMap<qint64,QFileInfo>::const_iterator it = existing.constBegin();
+        for ( ; it != existing.constEnd(); ++it)
+        {
+            QString name = it.value().fileName();
+            m_diskFiles.insert(name, it.value().size());
+            m_diskOrder.append(name);
+            m_diskSize += it.value().size();
+        }
+
+        LOG(VB_GENERAL, LOG_INFO, QString("Image cache: %1 files (%2Mb of %3Mb) memory %4Mb")
+            .arg(m_diskFiles.size()).arg(m_diskSize / (1024 * 1024)).arg(disk).arg(memory));
+
+        Expire();
+    }
+
+    bool Get(const QString &FileName, const QSize &Size, QImage &Image)
+    {
+        QString key;
+        if (!GetKey(FileName, Size, key))
+            return false;
+
+        QString name;
+
+        {
+            QMutexLocker locker(&m_lock);
+
+            QImage *image = m_memory.object(key);
+            if (image)
+            {
+                Image = *image;
+                return true;
+            }
+
+            name = DiskName(key);
+            if (!m_diskFiles.contains(name))
+                return false;
+
+            m_diskOrder.removeOne(name);
+            m_diskOrder.append(name);
+        }
+
+        // N.B. the file may have been expired in the meantime
+        bool valid = Read(m_directory + name, Image);
+
+        QMutexLocker locker(&m_lock);
+
+        if (!valid)
+        {
+            if (m_diskFiles.contains(name))
+            {
+                m_diskOrder.removeOne(name);
+                m_diskSize -= m_diskFiles.take(name);
+                QFile::remove(m_directory + name);
+            }
+
+            return false;
+        }
+
+        m_memory.insert(key, new QImage(Image), qMax(1, Image.byteCount() / 1024));
+        return true;
+    }
+
+    void Add(const QString &FileName, const QSize &Size, const QImage &Image)
+    {
+        QString key;
+        if (Image.isNull() || !GetKey(FileName, Size, key))
+            return;
+
+        QImage image = Image.format() == QImage::Format_ARGB32_Premultiplied ? Image :
+                       Image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        QString name = DiskName(key);
+
+        {
+            QMutexLocker locker(&m_lock);
+            m_memory.insert(key, new QImage(image), qMax(1, image.byteCount() / 1024));
+
+            if (m_diskFiles.contains(name) || m_writing.contains(name))
+                return;
+            m_writing.insert(name);
+        }
+
+        qint64 size = Write(m_directory + name, image);
+
+        QMutexLocker locker(&m_lock);
+        m_writing.remove(name);
+        if (size > 0)
+        {
+            m_diskFiles.insert(name, size);
+            m_diskOrder.append(name);
+            m_diskSize += size;
+            Expire();
+        }
+    }
+
+  private:
+    bool GetKey(const QString &FileName, const QSize &Size, QString &Key)
+    {
+        // only local files are cached
+        QFileInfo info(FileName);
+        if (Size.isEmpty() || !info.isFile())
+            return false;
+
+        Key = info.absoluteFilePath() + "|" + QString::number(info.lastModified().toMSecsSinceEpoch()) +
+              "|" + QString::number(Size.width()) + "x" + QString::number(Size.height());
+        return true;
+    }
+
+    QString DiskName(const QString &Key)
+    {
+        return QCryptographicHash::hash(Key.toUtf8(), QCryptographicHash::Sha1).toHex() + ".img";
+    }
+
+    /// Remove least recently used files until the cache is within budget. The lock must be held.
+    void Expire(void)
+    {
+        while (m_diskSize > m_maxDiskSize && !m_diskOrder.isEmpty())
+        {
+            QString name = m_diskOrder.takeFirst();
+            m_diskSize -= m_diskFiles.take(name);
+            QFile::remove(m_directory + name);
+        }
+    }
+
+    /// Read an uncompressed image. No decoding or conversion is required.
+    static bool Read(const QString &Path, QImage &Image)
+    {
+        QFile file(Path);
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+
+        QDataStream stream(&file);
+        quint32 magic, version, width, height, stride;
+        stream >> magic >> version >> width >> height >> stride;
+
+        if (stream.status() != QDataStream::Ok || magic != CACHE_MAGIC || version != CACHE_VERSION ||
+            !width || !height || width > 16384 || height > 16384)
+        {
+            LOG(VB_GENERAL, LOG_WARNING, QString("Invalid image cache file '%1'").arg(Path));
+            return false;
+        }
+
+        QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+        if (image.isNull() || (quint32)image.bytesPerLine() != stride)
+            return false;
+
+        if (stream.readRawData((char*)image.bits(), image.byteCount()) != image.byteCount())
+            return false;
+
+        Image = image;
+        return true;
+    }
+
+    /// Write an image to Path (via a temporary file) and return the size on disk.
+    static qint64 Write(const QString &Path, const QImage &Image)
+    {
+        QString temp = Path + ".tmp";
+        QFile file(temp);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            LOG(VB_GENERAL, LOG_ERR, QString("Failed to open '%1' for writing").arg(temp));
+            return 0;
+        }
+
+        QDataStream stream(&file);
+        stream << (quint32)CACHE_MAGIC << (quint32)CACHE_VERSION << (quint32)Image.width()
+               << (quint32)Image.height() << (quint32)Image.bytesPerLine();
+        bool ok = stream.writeRawData((const char*)Image.constBits(), Image.byteCount()) == Image.byteCount();
+        qint64 size = file.size();
+        file.close();
+
+        QFile::remove(Path);
+        if (!ok || !QFile::rename(temp, Path))
+        {
+            QFile::remove(temp);
+            return 0;
+        }
+
+        return size;
+    }
+
+  private:
+    QMutex                  m_lock;
+    QString                 m_directory;
+    QCache<QString,QImage>  m_memory;
+    QHash<QString,qint64>   m_diskFiles;
+    QList<QString>          m_diskOrder;
+    QSet<QString>           m_writing;
+    qint64                  m_diskSize;
+    qint64                  m_maxDiskSize;
+};
+
+static QReadWriteLock    gImageCacheLock;
+static UIImageCachePriv *gImageCache = NULL;
+
+/*! \class UIImageCache
+ *  \brief A two tier cache of scaled images.
+ *
+ * UIImageCache stores decoded images (scaled or rendered to fit the size requested by the UI),
+ * keyed by the source file's path and modification time and the requested size. Changing the source
+ * file therefore invalidates any cached versions.
+ *
+ * The most recently used images are held in memory (ImageCacheMemory, default 32Mb). Images are
+ * also written to disk, in the 'cache/images' configuration subdirectory, as raw pre-multiplied ARGB
+ * data so that they can be loaded without decoding, scaling or format conversion. The least recently
+ * used files are removed when the disk cache exceeds ImageCacheDisk (default 256Mb).
+ *
+ * Only local files are cached. All methods are thread safe and are intended to be used from UIImageLoader.
+ * The cache is created and destroyed with the other admin objects and is unavailable outside of their lifetime.
+ *
+ * \note Usage order is only tracked in memory - on startup files are ordered by their last access time,
+ *       which may be coarse depending upon file system mount options.
+ *
+ * \sa UIImageLoader
+*/
+
+/// Retrieve a cached copy of FileName at Size.
+bool UIImageCache::GetImage(const QString &FileName, const QSize &Size, QImage &Image)
+{
+    QReadLocker locker(&gImageCacheLock);
+    return gImageCache ? gImageCache->Get(FileName, Size, Image) : false;
+}
+
+/// Cache Image, which is FileName decoded (and scaled if necessary) for Size.
+void UIImageCache::AddImage(const QString &FileName, const QSize &Size, const QImage &Image)
+{
+    QReadLocker locker(&gImageCacheLock);
+    if (gImageCache)
+        gImageCache->Add(FileName, Size, Image);
+}
+
+static class UIImageCacheObject : public TorcAdminObject
+{
+  public:
+    UIImageCacheObject()
+      : TorcAdminObject(TORC_ADMIN_LOW_PRIORITY)
+    {
+    }
+
+    void Create(void)
+    {
+        QWriteLocker locker(&gImageCacheLock);
+        if (!gImageCache)
+            gImageCache = new UIImageCachePriv();
+    }
+
+    void Destroy(void)
+    {
+        QWriteLocker locker(&gImageCacheLock);
+        delete gImageCache;
+        gImageCache = NULL;
+    }
+
+} UIImageCacheObject;
@@ -0,0 +1,16 @@
+#ifndef UIIMAGECACHE_H
+#define UIIMAGECACHE_H
+
+// Qt
+#include <QSize>
+#include <QImage>
+#include <QString>
+
+class UIImageCache
+{
+  public:
+    static bool     GetImage    (const QString &FileName, const QSize &Size, QImage &Image);
+    static void     AddImage    (const QString &FileName, const QSize &Size, const QImage &Image);
+};
+
+#endif // UIIMAGECACHE_H
@@ -25,6 +25,7 @@
 #include "torclogging.h"
 #include "torcbuffer.h"
 #include "uiimage.h"
+#include "uiimagecache.h"
 #include "uiimagetracker.h"
 #include "uiimageloader.h"
 
@@ -42,7 +43,11 @@
  *
  * Image format is currently restricted to png.
  *
+ * Decoded (and, if necessary, scaled or rendered) images are saved in UIImageCache at the requested
+ * size and subsequent loads are serviced from the cache without reading or decoding the original file.
+ *
  * \sa UIImageTracker
+ * \sa UIImageCache
  * \sa UIShapeRenderer
  * \sa UITextRenderer
  *
@@ -101,6 +106,13 @@ void UIImageLoader::run(void)
             return;
         }
 
+        QImage cached;
+        if (UIImageCache::GetImage(filename, m_image->GetMaxSize(), cached))
+        {
+            m_parent->ImageCompleted(m_image, new QImage(cached));
+            return;
+        }
+
         // load it
         QScopedPointer<TorcBuffer> file(TorcBuffer::Create(filename, m_image->GetAbort()));
         if (!file.data())
@@ -138,7 +150,13 @@ void UIImageLoader::run(void)
     if (image->isNull())
         LOG(VB_GENERAL, LOG_WARNING, QString("Failed to load '%1'").arg(filename));
     else if (image->width() > m_image->GetMaxSize().width() || image->height() > m_image->GetMaxSize().height())
-        *image = image->scaled(m_image->GetMaxSize(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    {
+        *image = image->scaled(m_image->GetMaxSize(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+                       .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+
+    if (!filename.isEmpty() && !image->isNull())
+        UIImageCache::AddImage(filename, m_image->GetMaxSize(), *image);
 
     m_parent->ImageCompleted(m_image, image);
 }
@@ -346,7 +346,8 @@ TorcHTTPServer::TorcHTTPServer()
     m_connectionPool.setMaxThreadCount(50);
 
     // listen for host name updates
-    gLocalContext->AddObserver(this);
+    gLocalContext->AddObserver(this, QList<int>() << Torc::NetworkAvailable << Torc::NetworkUnavailable
+                                                  << Torc::NetworkChanged << Torc::NetworkHostNamesChanged);
 
     // and start
     // NB this will start and stop purely on the basis of the setting, irrespective
@@ -24,11 +24,14 @@
 #include <QUrl>
 #include <QTimer>
 #include <QtEndian>
+#include <QJsonArray>
 #include <QTextStream>
 #include <QJsonDocument>
+#include <QCoreApplication>
 #include <QCryptographicHash>
 
 // Torc
+#include "torclocalcontext.h"
 #include "torclogging.h"
 #include "torcnetwork.h"
 #include "torcnetworkedcontext.h"
@@ -42,6 +45,13 @@
 #include "utf8/checked.h"
 #include "utf8/unchecked.h"
 
+// the maximum number of requests sent in a single JSON-RPC batch
+#define MAX_BATCH_SIZE 32
+
+// upper bounds (in milliseconds) of the round trip latency histogram. The last bucket is unbounded.
+static const int gLatencyBuckets[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000 };
+#define LATENCY_BUCKETS ((int)(sizeof(gLatencyBuckets) / sizeof(gLatencyBuckets[0])) + 1)
+
 /*! \class TorcWebSocket
  *  \brief Overlays the Websocket protocol over a QTcpSocket
  *
@@ -58,8 +68,12 @@
  * \todo Limit frame size for reading
  * \todo Fix testsuite partial failures (fail fast on invalid UTF-8)
  * \todo Add timeout for response to upgrade request
- * \todo Fix deletion handling when there is no parent thread
- * \todo Add support for batched RPC calls
+ * Any number of requests may be outstanding at once. Responses are matched to requests by ID and requests
+ * issued within the same event loop iteration are sent as a single JSON-RPC batch. The round trip time
+ * for each request is recorded in a latency histogram (see GetLatency).
+ *
+ * A TorcWebSocket runs either in its own TorcWebSocketThread (which exits when the socket is closed)
+ * or in a shared thread managed by TorcWebSocketPool (the Disconnected signal is emitted instead).
 */
 
 TorcWebSocket::TorcWebSocket(TorcQThread *Parent, TorcHTTPRequest *Request, QTcpSocket *Socket)
@@ -89,8 +103,14 @@ TorcWebSocket::TorcWebSocket(TorcQThread *Parent, TorcHTTPRequest *Request, QTcp
     m_bufferedPayloadOpCode(OpContinuation),
     m_closeReceived(false),
     m_closeSent(false),
-    m_currentRequestID(1)
+    m_currentRequestID(1),
+    m_latencyHistogram(LATENCY_BUCKETS, 0),
+    m_latencyCount(0),
+    m_latencyTotal(0),
+    m_latencyMax(0)
 {
+    m_latencyTimer.start();
+
     if (Request->GetMethod().startsWith(QStringLiteral("echo"), Qt::CaseInsensitive))
     {
         m_echoTest = true;
@@ -135,8 +155,14 @@ TorcWebSocket::TorcWebSocket(TorcQThread *Parent, const QHostAddress &Address, q
     m_bufferedPayloadOpCode(OpContinuation),
     m_closeReceived(false),
     m_closeSent(false),
-    m_currentRequestID(1)
+    m_currentRequestID(1),
+    m_latencyHistogram(LATENCY_BUCKETS, 0),
+    m_latencyCount(0),
+    m_latencyTotal(0),
+    m_latencyMax(0)
 {
+    m_latencyTimer.start();
+
 }
 
 TorcWebSocket::~TorcWebSocket()
@@ -152,6 +178,9 @@ TorcWebSocket::~TorcWebSocket()
             HandleCancelRequest(m_currentRequests.begin().value());
     }
 
+    // send anything still queued
+    SendBatch();
+
     InitiateClose(CloseGoingAway, QString("WebSocket exiting normally"));
 
     CloseSocket();
@@ -474,6 +503,10 @@ void TorcWebSocket::Start(void)
     connect(this, SIGNAL(NewRequest(TorcRPCRequest*)),       this, SLOT(HandleRemoteRequest(TorcRPCRequest*)));
     connect(this, SIGNAL(RequestCancelled(TorcRPCRequest*)), this, SLOT(HandleCancelRequest(TorcRPCRequest*)));
 
+    // a dedicated thread exits when the socket is closed
+    if (m_parent)
+        connect(this, SIGNAL(Disconnected()), m_parent, SLOT(quit()));
+
     // server side:)
     if (m_serverSide)
     {
@@ -481,8 +514,7 @@ void TorcWebSocket::Start(void)
         {
             connect(m_socket, SIGNAL(readyRead()), this, SLOT(ReadyRead()));
             connect(m_socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(Error(QAbstractSocket::SocketError)));
-            if (m_parent)
-                connect(m_socket, SIGNAL(disconnected()), m_parent, SLOT(quit()));
+            connect(m_socket, SIGNAL(disconnected()), this, SIGNAL(Disconnected()));
 
             m_upgradeRequest->Respond(m_socket, &m_abort);
 
@@ -503,8 +535,7 @@ void TorcWebSocket::Start(void)
         connect(m_socket, SIGNAL(connected()), this, SLOT(Connected()));
         connect(m_socket, SIGNAL(readyRead()), this, SLOT(ReadyRead()));
         connect(m_socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(Error(QAbstractSocket::SocketError)));
-        if (m_parent)
-            connect(m_socket, SIGNAL(disconnected()), m_parent, SLOT(quit()));
+        connect(m_socket, SIGNAL(disconnected()), this, SIGNAL(Disconnected()));
 
         m_socket->connectToHost(m_address, m_port);
         return;
@@ -512,8 +543,7 @@ void TorcWebSocket::Start(void)
 
     // failed
     LOG(VB_GENERAL, LOG_ERR, "Failed to start Websocket");
-    if (m_parent)
-        m_parent->quit();
+    emit Disconnected();
 }
 
 ///\brief Receives notifications when a property for a subscribed service has changed.
@@ -567,6 +597,9 @@ void TorcWebSocket::RemoteRequest(TorcRPCRequest *Request)
  * the parent deletes the thread. In this case it is highly likely the Request will leak.
  * Hence we default to waiting for a short period to allow the call to complete.
  *
+ * Sockets managed by TorcWebSocketPool run in long lived threads and will always process the
+ * cancellation, so there is no need to wait (pass a Wait of 0).
+ *
  * \note We assume the request will only ever be referenced by its owner and by TorcWebSocket.
 */
 void TorcWebSocket::CancelRequest(TorcRPCRequest *Request, int Wait /* = 1000 ms*/)
@@ -613,6 +646,44 @@ void TorcWebSocket::WaitForNotifications(void)
         LOG(VB_GENERAL, LOG_ERR, "Outstanding notifications even after waiting 1000ms");
 }
 
+/*! \brief Disconnect all signals and delete this socket.
+ *
+ * \note This must be called in the socket's thread (see TorcWebSocketPool::ReleaseSocket).
+*/
+void TorcWebSocket::Release(void)
+{
+    disconnect();
+    deleteLater();
+}
+
+/*! \brief Return the round trip latency statistics for requests sent over this socket.
+ *
+ * 'histogram' contains the number of responses received within each of the limits listed in 'limits'
+ * (in milliseconds) and one final entry for slower responses.
+ *
+ * \note This method is thread safe.
+*/
+QVariantMap TorcWebSocket::GetLatency(void)
+{
+    QVariantList limits;
+    for (int i = 0; i < LATENCY_BUCKETS - 1; ++i)
+        limits.append(gLatencyBuckets[i]);
+
+    QMutexLocker locker(&m_latencyLock);
+
+    QVariantList histogram;
+    for (int i = 0; i < m_latencyHistogram.size(); ++i)
+        histogram.append(m_latencyHistogram.at(i));
+
+    QVariantMap result;
+    result.insert("count",     m_latencyCount);
+    result.insert("average",   m_latencyCount ? (double)m_latencyTotal / m_latencyCount / 1000.0 : 0.0);
+    result.insert("max",       (double)m_latencyMax / 1000.0);
+    result.insert("limits",    limits);
+    result.insert("histogram", histogram);
+    return result;
+}
+
 /*! \brief Thread safe Remote Procedure Call implementation.
 */
 void TorcWebSocket::HandleRemoteRequest(TorcRPCRequest *Request)
@@ -638,6 +709,7 @@ void TorcWebSocket::HandleRemoteRequest(TorcRPCRequest *Request)
 
             Request->SetID(id);
             m_currentRequests.insert(id, Request);
+            m_requestSentTimes.insert(id, m_latencyTimer.nsecsElapsed() / 1000);
 
             // start a timer for this request
             m_requestTimers.insert(startTimer(10000, Qt::CoarseTimer), id);
@@ -652,7 +724,7 @@ void TorcWebSocket::HandleRemoteRequest(TorcRPCRequest *Request)
         if (m_subProtocol == SubProtocolNone)
             LOG(VB_GENERAL, LOG_ERR, "No protocol specified for remote procedure call");
         else
-            SendFrame(m_subProtocolFrameFormat, Request->SerialiseRequest(m_subProtocol));
+            QueuePayload(Request->SerialiseRequest(m_subProtocol));
     }
 
     // notifications are fire and forget, so downref immediately
@@ -672,13 +744,8 @@ void TorcWebSocket::HandleCancelRequest(TorcRPCRequest *Request)
         int id = Request->GetID();
         if (m_currentRequests.contains(id))
         {
-            // cancel the timer
-            int timer = m_requestTimers.key(id);
-            killTimer(timer);
-            m_requestTimers.remove(timer);
-
-            // cancel the request
-            m_currentRequests.remove(id);
+            // cancel the timer and the request
+            RemoveRequest(id, false);
             Request->DownRef();
         }
         else
@@ -1187,7 +1254,12 @@ void TorcWebSocket::Error(QAbstractSocket::SocketError SocketError)
     if (m_socket)
     {
         LOG(VB_GENERAL, LOG_ERR, QString("WebSocket error: %1 ('%2')").arg(m_socket->error()).arg(m_socket->errorString()));
+
+        // a socket that never connected will not signal disconnection
+        bool connected = m_socket->state() == QAbstractSocket::ConnectedState;
         CloseSocket();
+        if (!connected)
+            emit Disconnected();
     }
 }
 
@@ -1217,6 +1289,7 @@ bool TorcWebSocket::event(QEvent *Event)
                     request->NotifyParent();
 
                     m_currentRequests.remove(requestid);
+                    m_requestSentTimes.remove(requestid);
                     request->DownRef();
                 }
 
@@ -1437,13 +1510,50 @@ void TorcWebSocket::InitiateClose(CloseCode Close, const QString &Reason)
     }
 }
 
+/*! \brief Returns true if Array contains only JSON-RPC responses (i.e. the reply to a batch of our requests).
+*/
+static bool IsResponseBatch(const QJsonArray &Array)
+{
+    if (Array.isEmpty())
+        return false;
+
+    QJsonArray::const_iterator it = Array.begin();
+    for ( ; it != Array.end(); ++it)
+        if (!(*it).isObject() || (*it).toObject().contains("method"))
+            return false;
+
+    return true;
+}
+
 void TorcWebSocket::ProcessPayload(const QByteArray &Payload)
 {
     if (m_subProtocol == SubProtocolJSONRPC)
     {
-        // NB there is no method to support SENDING batched requests (hence
-        // we should only receive batched requests from 3rd parties) and hence there
-        // is no support for handling batched responses.
+        // the response to a batch of our requests is split and each response handled individually. Batched
+        // requests (from 3rd parties) are handled by TorcRPCRequest.
+        int start = 0;
+        while (start < Payload.size() && (Payload.at(start) == ' ' || Payload.at(start) == '\t' || Payload.at(start) == '\r' || Payload.at(start) == '\n'))
+            start++;
+
+        if (start < Payload.size() && Payload.at(start) == '[')
+        {
+            QJsonDocument doc = QJsonDocument::fromJson(Payload);
+            if (doc.isArray() && IsResponseBatch(doc.array()))
+            {
+                QJsonArray array = doc.array();
+                QJsonArray::const_iterator it = array.begin();
+                for ( ; it != array.end(); ++it)
+                {
+                    TorcRPCRequest *response = new TorcRPCRequest((*it).toObject(), this);
+                    if (response->GetID() > -1)
+                        HandleResponse(response);
+                    response->DownRef();
+                }
+
+                return;
+            }
+        }
+
         TorcRPCRequest *request = new TorcRPCRequest(m_subProtocol, Payload, this);
 
         // if the request has data, we need to send it (it was a request!)
@@ -1454,100 +1564,181 @@ void TorcWebSocket::ProcessPayload(const QByteArray &Payload)
         // if the request has an id, we need to process it
         else if (request->GetID() > -1)
         {
-            int id = request->GetID();
-            if (m_currentRequests.contains(id))
+            HandleResponse(request);
+        }
+
+        request->DownRef();
+    }
+}
+
+/*! \brief Match a response to the outstanding request with the same ID and notify the requestor.
+*/
+void TorcWebSocket::HandleResponse(TorcRPCRequest *Response)
+{
+    int id = Response->GetID();
+    if (m_currentRequests.contains(id))
+    {
+        TorcRPCRequest *requestor = m_currentRequests.value(id);
+        requestor->AddState(TorcRPCRequest::ReplyReceived);
+
+        if (Response->GetState() & TorcRPCRequest::Errored)
+        {
+            requestor->AddState(TorcRPCRequest::Errored);
+        }
+        else
+        {
+            QString method = requestor->GetMethod();
+            // is this a successful response to a subscription request?
+            if (method.endsWith("/Subscribe"))
             {
-                TorcRPCRequest *requestor = m_currentRequests.value(id);
-                requestor->AddState(TorcRPCRequest::ReplyReceived);
+                method.chop(9);
+                QObject *parent = requestor->GetParent();
 
-                if (request->GetState() & TorcRPCRequest::Errored)
+                if (parent->metaObject()->indexOfSlot(QMetaObject::normalizedSignature("ServiceNotification(QString)")) < 0)
                 {
-                    requestor->AddState(TorcRPCRequest::Errored);
+                    LOG(VB_GENERAL, LOG_ERR, QString("Cannot monitor subscription to '%1' for object '%2' - no notification slot").arg(method).arg(parent->objectName()));
                 }
-                else
+                else if (Response->GetReply().type() == QVariant::Map)
                 {
-                    QString method = requestor->GetMethod();
-                    // is this a successful response to a subscription request?
-                    if (method.endsWith("/Subscribe"))
+                    // listen for destroyed signals to ensure the subscriptions are cleaned up
+                    connect(parent, SIGNAL(destroyed(QObject*)), this, SLOT(SubscriberDeleted(QObject*)));
+
+                    QVariantMap map = Response->GetReply().toMap();
+                    if (map.contains("properties") && map.value("properties").type() == QVariant::List)
                     {
-                        method.chop(9);
-                        QObject *parent = requestor->GetParent();
+                        QVariantList properties = map.value("properties").toList();
 
-                        if (parent->metaObject()->indexOfSlot(QMetaObject::normalizedSignature("ServiceNotification(QString)")) < 0)
-                        {
-                            LOG(VB_GENERAL, LOG_ERR, QString("Cannot monitor subscription to '%1' for object '%2' - no notification slot").arg(method).arg(parent->objectName()));
-                        }
-                        else if (request->GetReply().type() == QVariant::Map)
+                        // add each notification/parent pair to the subscriber list
+                        QVariantList::const_iterator it = properties.begin();
+                        for ( ; it != properties.end(); ++it)
                         {
-                            // listen for destroyed signals to ensure the subscriptions are cleaned up
-                            connect(parent, SIGNAL(destroyed(QObject*)), this, SLOT(SubscriberDeleted(QObject*)));
-
-                            QVariantMap map = request->GetReply().toMap();
-                            if (map.contains("properties") && map.value("properties").type() == QVariant::List)
+                            if (it->type() == QVariant::Map)
                             {
-                                QVariantList properties = map.value("properties").toList();
-
-                                // add each notification/parent pair to the subscriber list
-                                QVariantList::const_iterator it = properties.begin();
-                                for ( ; it != properties.end(); ++it)
+                                QVariantMap property = it->toMap();
+                                if (property.contains("notification"))
                                 {
-                                    if (it->type() == QVariant::Map)
+                                    QString service = method + property.value("notification").toString();
+                                    if (m_subscribers.contains(service, parent))
                                     {
-                                        QVariantMap property = it->toMap();
-                                        if (property.contains("notification"))
-                                        {
-                                            QString service = method + property.value("notification").toString();
-                                            if (m_subscribers.contains(service, parent))
-                                            {
-                                                LOG(VB_GENERAL, LOG_WARNING, QString("Object '%1' already has subscription to '%2'").arg(parent->objectName()).arg(service));
-                                            }
-                                            else
-                                            {
-                                                m_subscribers.insertMulti(service, parent);
-                                                LOG(VB_GENERAL, LOG_INFO, QString("Object '%1' subscribed to '%2'").arg(parent->objectName()).arg(service));
-                                            }
-                                        }
+                                        LOG(VB_GENERAL, LOG_WARNING, QString("Object '%1' already has subscription to '%2'").arg(parent->objectName()).arg(service));
+                                    }
+                                    else
+                                    {
+                                        m_subscribers.insertMulti(service, parent);
+                                        LOG(VB_GENERAL, LOG_INFO, QString("Object '%1' subscribed to '%2'").arg(parent->objectName()).arg(service));
                                     }
                                 }
                             }
                         }
                     }
-                    // or a successful unsubscribe?
-                    else if (method.endsWith("/Unsubscribe"))
-                    {
-                        method.chop(11);
-                        QObject *parent = requestor->GetParent();
-
-                        // iterate over our subscriber list and remove anything that starts with method and points to parent
-                        QStringList remove;
-
-                        QMap<QString,QObject*>::const_iterator it = m_subscribers.begin();
-                        for ( ; it != m_subscribers.end(); ++it)
-                            if (it.value() == parent && it.key().startsWith(method))
-                                remove.append(it.key());
+                }
+            }
+            // or a successful unsubscribe?
+            else if (method.endsWith("/Unsubscribe"))
+            {
+                method.chop(11);
+                QObject *parent = requestor->GetParent();
 
-                        foreach (QString signature, remove)
-                        {
-                            LOG(VB_GENERAL, LOG_INFO, QString("Object '%1' unsubscribed from '%2'").arg(parent->objectName()).arg(signature));
-                            m_subscribers.remove(signature, parent);
-                        }
+                // iterate over our subscriber list and remove anything that starts with method and points to parent
+                QStringList remove;
 
-                        // and disconnect the destroyed signal if we have no more subscriptions for this object
-                        if (!m_subscribers.values().contains(parent))
-                            (void)disconnect(parent, 0, this, 0);
-                    }
+                QMap<QString,QObject*>::const_iterator it = m_subscribers.begin();
+                for ( ; it != m_subscribers.end(); ++it)
+                    if (it.value() == parent && it.key().startsWith(method))
+                        remove.append(it.key());
 
-                    requestor->SetReply(request->GetReply());
+                foreach (QString signature, remove)
+                {
+                    LOG(VB_GENERAL, LOG_INFO, QString("Object '%1' unsubscribed from '%2'").arg(parent->objectName()).arg(signature));
+                    m_subscribers.remove(signature, parent);
                 }
 
-                requestor->NotifyParent();
-                m_currentRequests.remove(id);
-                requestor->DownRef();
+                // and disconnect the destroyed signal if we have no more subscriptions for this object
+                if (!m_subscribers.values().contains(parent))
+                    (void)disconnect(parent, 0, this, 0);
             }
+
+            requestor->SetReply(Response->GetReply());
         }
 
-        request->DownRef();
+        requestor->NotifyParent();
+        RemoveRequest(id, true);
+        requestor->DownRef();
+    }
+}
+
+/*! \brief Queue a serialised request for sending.
+ *
+ * Requests made within the same event loop iteration are sent together as a JSON-RPC batch (up to
+ * MAX_BATCH_SIZE requests), reducing the number of frames and round trips.
+*/
+void TorcWebSocket::QueuePayload(const QByteArray &Payload)
+{
+    if (m_batch.isEmpty())
+        QMetaObject::invokeMethod(this, "SendBatch", Qt::QueuedConnection);
+
+    m_batch.append(Payload);
+
+    if (m_batch.size() >= MAX_BATCH_SIZE)
+        SendBatch();
+}
+
+void TorcWebSocket::SendBatch(void)
+{
+    if (m_batch.isEmpty())
+        return;
+
+    if (m_batch.size() == 1)
+    {
+        SendFrame(m_subProtocolFrameFormat, m_batch.first());
     }
+    else
+    {
+        LOG(VB_NETWORK, LOG_DEBUG, QString("Sending batch of %1 requests").arg(m_batch.size()));
+
+        QByteArray batch("[");
+        for (int i = 0; i < m_batch.size(); ++i)
+        {
+            if (i)
+                batch.append(',');
+            batch.append(m_batch.at(i));
+        }
+        batch.append(']');
+        SendFrame(m_subProtocolFrameFormat, batch);
+    }
+
+    m_batch.clear();
+}
+
+/*! \brief Stop tracking the request identified by ID, recording its round trip time if Completed.
+*/
+void TorcWebSocket::RemoveRequest(int ID, bool Completed)
+{
+    int timer = m_requestTimers.key(ID, 0);
+    if (timer)
+    {
+        killTimer(timer);
+        m_requestTimers.remove(timer);
+    }
+
+    m_currentRequests.remove(ID);
+
+    if (!m_requestSentTimes.contains(ID))
+        return;
+
+    qint64 latency = (m_latencyTimer.nsecsElapsed() / 1000) - m_requestSentTimes.take(ID);
+    if (!Completed)
+        return;
+
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && latency > (qint64)gLatencyBuckets[bucket] * 1000)
+        bucket++;
+
+    QMutexLocker locker(&m_latencyLock);
+    m_latencyHistogram[bucket]++;
+    m_latencyCount++;
+    m_latencyTotal += latency;
+    m_latencyMax = qMax(m_latencyMax, latency);
 }
 
 TorcWebSocketThread::TorcWebSocketThread(TorcHTTPRequest *Request, QTcpSocket *Socket)
@@ -1594,3 +1785,140 @@ void TorcWebSocketThread::Shutdown(void)
     quit();
     wait();
 }
+
+/*! \class TorcWebSocketPoolThread
+ *  \brief A long lived thread shared by a number of TorcWebSocket's.
+*/
+class TorcWebSocketPoolThread : public TorcQThread
+{
+  public:
+    explicit TorcWebSocketPoolThread(int Index)
+      : TorcQThread(QString("WebSocket%1").arg(Index)),
+        m_sockets(0)
+    {
+    }
+
+    void Start(void)
+    {
+    }
+
+    void Finish(void)
+    {
+        // release and delete any sockets released during shutdown
+        QCoreApplication::sendPostedEvents();
+        QCoreApplication::sendPostedEvents(NULL, QEvent::DeferredDelete);
+    }
+
+    int m_sockets;
+};
+
+static QMutex gWebSocketPoolLock;
+static QList<TorcWebSocketPoolThread*> gWebSocketPool;
+static QHash<TorcWebSocket*,TorcWebSocketPoolThread*> gWebSocketPoolSockets;
+
+/// Return the least loaded pool thread, creating the pool if necessary. The lock must be held.
+static TorcWebSocketPoolThread* GetPoolThread(void)
+{
+    if (gWebSocketPool.isEmpty())
+    {
+        int count = qBound(1, gLocalContext->GetSetting(TORC_CORE + "PeerThreads", (int)2), 16);
+        for (int i = 0; i < count; ++i)
+        {
+            TorcWebSocketPoolThread *thread = new TorcWebSocketPoolThread(i);
+            thread->start();
+            gWebSocketPool.append(thread);
+        }
+
+        LOG(VB_GENERAL, LOG_INFO, QString("Started %1 peer WebSocket threads").arg(count));
+    }
+
+    TorcWebSocketPoolThread *result = gWebSocketPool.first();
+    foreach (TorcWebSocketPoolThread *thread, gWebSocketPool)
+        if (thread->m_sockets < result->m_sockets)
+            result = thread;
+
+    result->m_sockets++;
+    return result;
+}
+
+/*! \class TorcWebSocketPool
+ *  \brief Run peer TorcWebSocket's on a small, shared pool of threads.
+ *
+ * Creating a thread for every peer connection does not scale and means that closing a connection
+ * requires the caller to wait for the thread to exit. Sockets created by TorcWebSocketPool are
+ * instead assigned to the least loaded of PeerThreads (default 2) threads, which live until
+ * Shutdown is called.
+ *
+ * The owner should listen for TorcWebSocket::Disconnected and call ReleaseSocket when the socket
+ * is no longer needed. Sockets must not be deleted directly.
+*/
+
+/// Create a server side socket for the upgraded connection Socket. Socket is moved to the socket's thread.
+TorcWebSocket* TorcWebSocketPool::CreateSocket(TorcHTTPRequest *Request, QTcpSocket *Socket)
+{
+    QMutexLocker locker(&gWebSocketPoolLock);
+
+    TorcWebSocketPoolThread *thread = GetPoolThread();
+    TorcWebSocket *socket = new TorcWebSocket(NULL, Request, Socket);
+    socket->moveToThread(thread);
+    if (Socket)
+        Socket->moveToThread(thread);
+    gWebSocketPoolSockets.insert(socket, thread);
+    return socket;
+}
+
+/// Create a client socket connecting to Address on Port.
+TorcWebSocket* TorcWebSocketPool::CreateSocket(const QHostAddress &Address, quint16 Port, bool Authenticate, TorcWebSocket::WSSubProtocol Protocol)
+{
+    QMutexLocker locker(&gWebSocketPoolLock);
+
+    TorcWebSocketPoolThread *thread = GetPoolThread();
+    TorcWebSocket *socket = new TorcWebSocket(NULL, Address, Port, Authenticate, Protocol);
+    socket->moveToThread(thread);
+    gWebSocketPoolSockets.insert(socket, thread);
+    return socket;
+}
+
+/// Start Socket from within its own thread. Connect to its signals before calling this.
+void TorcWebSocketPool::StartSocket(TorcWebSocket *Socket)
+{
+    if (Socket)
+        QMetaObject::invokeMethod(Socket, "Start", Qt::QueuedConnection);
+}
+
+/*! \brief Disconnect Socket and delete it from within its own thread.
+ *
+ * This does not block. The release is queued behind any requests and notifications already queued to
+ * the socket, so they are still processed (and released) first.
+*/
+void TorcWebSocketPool::ReleaseSocket(TorcWebSocket *Socket)
+{
+    if (!Socket)
+        return;
+
+    QMetaObject::invokeMethod(Socket, "Release", Qt::QueuedConnection);
+
+    QMutexLocker locker(&gWebSocketPoolLock);
+    TorcWebSocketPoolThread *thread = gWebSocketPoolSockets.take(Socket);
+    if (thread)
+        thread->m_sockets--;
+}
+
+/// Stop and delete the pool threads. All sockets should have been released.
+void TorcWebSocketPool::Shutdown(void)
+{
+    QMutexLocker locker(&gWebSocketPoolLock);
+
+    if (!gWebSocketPoolSockets.isEmpty())
+        LOG(VB_GENERAL, LOG_WARNING, QString("%1 peer WebSockets not released").arg(gWebSocketPoolSockets.size()));
+
+    while (!gWebSocketPool.isEmpty())
+    {
+        TorcWebSocketPoolThread *thread = gWebSocketPool.takeFirst();
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+
+    gWebSocketPoolSockets.clear();
+}
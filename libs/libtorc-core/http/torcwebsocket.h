@@ -3,9 +3,14 @@
 
 // Qt
 #include <QUrl>
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+#include <QVariant>
 #include <QObject>
 #include <QTcpSocket>
 #include <QHostAddress>
+#include <QElapsedTimer>
 
 // Torc
 #include "torccoreexport.h"
@@ -97,6 +102,7 @@ class TORC_CORE_PUBLIC TorcWebSocket : public QObject
 
   signals:
     void            ConnectionEstablished (void);
+    void            Disconnected          (void);
     void            NewRequest            (TorcRPCRequest *Request);
     void            RequestCancelled      (TorcRPCRequest *Request);
 
@@ -109,6 +115,7 @@ class TORC_CORE_PUBLIC TorcWebSocket : public QObject
     void            RemoteRequest         (TorcRPCRequest *Request);
     void            CancelRequest         (TorcRPCRequest *Request, int Wait = 1000 /*ms*/);
     void            WaitForNotifications  (void);
+    QVariantMap     GetLatency            (void);
 
   protected slots:
     void            ReadyRead             (void);
@@ -118,6 +125,8 @@ class TORC_CORE_PUBLIC TorcWebSocket : public QObject
     void            HandleRemoteRequest   (TorcRPCRequest *Request);
     void            HandleCancelRequest   (TorcRPCRequest *Request);
     void            SubscriberDeleted     (QObject *Subscriber);
+    void            SendBatch             (void);
+    void            Release               (void);
 
   protected:
     bool            event                 (QEvent *Event);
@@ -130,6 +139,9 @@ class TORC_CORE_PUBLIC TorcWebSocket : public QObject
     void            HandleCloseRequest    (QByteArray &Close);
     void            InitiateClose         (CloseCode Close, const QString &Reason);
     void            ProcessPayload        (const QByteArray &Payload);
+    void            HandleResponse        (TorcRPCRequest *Response);
+    void            QueuePayload          (const QByteArray &Payload);
+    void            RemoveRequest         (int ID, bool Completed);
 
   private:
     enum ReadState
@@ -175,6 +187,15 @@ class TORC_CORE_PUBLIC TorcWebSocket : public QObject
     QMap<int,TorcRPCRequest*> m_currentRequests;
     QMap<int,int>    m_requestTimers;
     QAtomicInt       m_outstandingNotifications;
+    QList<QByteArray> m_batch;
+
+    QElapsedTimer    m_latencyTimer;
+    QHash<int,qint64> m_requestSentTimes;
+    QMutex           m_latencyLock;
+    QVector<quint32> m_latencyHistogram;
+    quint32          m_latencyCount;
+    qint64           m_latencyTotal;
+    qint64           m_latencyMax;
 
     QMultiMap<QString,QObject*> m_subscribers;   // client side
 };
@@ -198,4 +219,14 @@ class TORC_CORE_PUBLIC TorcWebSocketThread : public TorcQThread
     TorcWebSocket      *m_webSocket;
 };
 
+class TORC_CORE_PUBLIC TorcWebSocketPool
+{
+  public:
+    static TorcWebSocket* CreateSocket  (TorcHTTPRequest *Request, QTcpSocket *Socket);
+    static TorcWebSocket* CreateSocket  (const QHostAddress &Address, quint16 Port, bool Authenticate = false, TorcWebSocket::WSSubProtocol Protocol = TorcWebSocket::SubProtocolJSONRPC);
+    static void           StartSocket   (TorcWebSocket *Socket);
+    static void           ReleaseSocket (TorcWebSocket *Socket);
+    static void           Shutdown      (void);
+};
+
 #endif // TORCWEBSOCKET_H
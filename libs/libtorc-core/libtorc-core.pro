@@ -30,6 +30,7 @@ HEADERS += torclocalcontext.h
 HEADERS += torcnetworkedcontext.h
 HEADERS += torcsqlitedb.h
 HEADERS += torcdb.h
+HEADERS += torcdbwriter.h
 HEADERS += torcdirectories.h
 HEADERS += torcreferencecounted.h
 HEADERS += torccoreutils.h
@@ -50,6 +51,9 @@ HEADERS += torcdecoder.h
 HEADERS += torcnetwork.h
 HEADERS += torcnetworkbuffer.h
 HEADERS += torcnetworkrequest.h
+HEADERS += torcnetworkcache.h
+HEADERS += torcnetworkworker.h
+HEADERS += torcsegmenteddownload.h
 HEADERS += torcsetting.h
 HEADERS += torcmime.h
 HEADERS += torcrpcrequest.h
@@ -81,6 +85,7 @@ SOURCES += torcnetworkedcontext.cpp
 SOURCES += torctimer.cpp
 SOURCES += torcsqlitedb.cpp
 SOURCES += torcdb.cpp
+SOURCES += torcdbwriter.cpp
 SOURCES += torcdirectories.cpp
 SOURCES += torccoreutils.cpp
 SOURCES += torcreferencecounted.cpp
@@ -100,6 +105,9 @@ SOURCES += torcdecoder.cpp
 SOURCES += torcnetwork.cpp
 SOURCES += torcnetworkbuffer.cpp
 SOURCES += torcnetworkrequest.cpp
+SOURCES += torcnetworkcache.cpp
+SOURCES += torcnetworkworker.cpp
+SOURCES += torcsegmenteddownload.cpp
 SOURCES += torcsetting.cpp
 SOURCES += torcmime.cpp
 SOURCES += torcrpcrequest.cpp
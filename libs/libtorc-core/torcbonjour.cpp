@@ -21,7 +21,9 @@
 #include <QCoreApplication>
 #include <QSocketNotifier>
 #include <QtEndian>
+#include <QTimer>
 #include <QMutex>
+#include <QHash>
 #include <QMap>
 
 // Torc
@@ -40,6 +42,9 @@
 // DNS Service Discovery
 #include <dns_sd.h>
 
+// delay (in milliseconds) used to coalesce discovery notifications
+#define COALESCE_INTERVAL 250
+
 TorcBonjour* gBonjour = NULL;                               //!< Global TorcBonjour singleton
 QMutex*      gBonjourLock = new QMutex(QMutex::Recursive);  //!< Lock around access to gBonjour
 
@@ -102,7 +107,7 @@ class TorcBonjourService
         m_fd(-1),
         m_socketNotifier(NULL)
     {
-        // the default constructor only exists to keep QMap happy - it should never be used
+        // the default constructor only exists to keep QHash happy - it should never be used
         LOG(VB_GENERAL, LOG_WARNING, "Invalid TorcBonjourService object");
     }
 
@@ -222,11 +227,170 @@ class TorcBonjourService
     QSocketNotifier *m_socketNotifier;
 };
 
+/*! \class TorcBonjourServiceTable
+ *  \brief A table of TorcBonjourService's indexed by reference, socket, DNSServiceRef, name and host lookup.
+ *
+ * Bonjour callbacks identify a service by its DNSServiceRef, socket or name and Qt identifies host
+ * lookups by id. Each of these is indexed so that callbacks do not need to search (or copy) the
+ * complete table.
+ *
+ * \note The table is not thread safe - the owner must serialise access.
+*/
+class TorcBonjourServiceTable
+{
+  public:
+    TorcBonjourServiceTable()
+    {
+    }
+
+    static QByteArray Key(const QByteArray &Name, const QByteArray &Type, const QByteArray &Domain, uint32_t InterfaceIndex)
+    {
+        QByteArray key(Name);
+        key.append('\0').append(Type).append('\0').append(Domain).append('\0').append(QByteArray::number(InterfaceIndex));
+        return key;
+    }
+
+    static QByteArray Key(const TorcBonjourService &Service)
+    {
+        return Key(Service.m_name, Service.m_type, Service.m_domain, Service.m_interfaceIndex);
+    }
+
+    /// Add Service using Reference (or the next unused reference) and return the reference used.
+    quint32 Insert(const TorcBonjourService &Service, quint32 Reference = 0)
+    {
+        quint32 reference = Reference;
+        while (!reference || m_services.contains(reference))
+            reference++;
+
+        m_services.insert(reference, Service);
+        if (Service.m_dnssRef)
+            m_serviceRefs.insert(Service.m_dnssRef, reference);
+        if (Service.m_serviceType == TorcBonjourService::Resolve)
+            m_names.insert(Key(Service), reference);
+        return reference;
+    }
+
+    /// Release the resources used by the service but retain its details.
+    void Deregister(quint32 Reference)
+    {
+        QHash<quint32,TorcBonjourService>::iterator it = m_services.find(Reference);
+        if (it == m_services.end())
+            return;
+
+        if ((*it).m_dnssRef)
+            m_serviceRefs.remove((*it).m_dnssRef);
+        if ((*it).m_fd != -1)
+            m_sockets.remove((*it).m_fd);
+        if ((*it).m_lookupID != -1)
+            m_lookups.remove((*it).m_lookupID);
+
+        (*it).Deregister();
+        (*it).m_fd = -1;
+    }
+
+    /// Release the resources used by the service and remove it.
+    void Remove(quint32 Reference)
+    {
+        if (!m_services.contains(Reference))
+            return;
+
+        Deregister(Reference);
+        TorcBonjourService service = m_services.take(Reference);
+        if (service.m_serviceType == TorcBonjourService::Resolve)
+            m_names.remove(Key(service));
+    }
+
+    /// Remove all services.
+    void Clear(void)
+    {
+        QList<quint32> references = m_services.keys();
+        foreach (quint32 reference, references)
+            Deregister(reference);
+
+        m_services.clear();
+        m_serviceRefs.clear();
+        m_sockets.clear();
+        m_names.clear();
+        m_lookups.clear();
+    }
+
+    bool Contains(quint32 Reference) const
+    {
+        return m_services.contains(Reference);
+    }
+
+    TorcBonjourService& Get(quint32 Reference)
+    {
+        return m_services[Reference];
+    }
+
+    QList<quint32> References(void) const
+    {
+        return m_services.keys();
+    }
+
+    void SetFileDescriptor(quint32 Reference, int FileDescriptor, QObject *Object)
+    {
+        if (!m_services.contains(Reference))
+            return;
+
+        m_services[Reference].SetFileDescriptor(FileDescriptor, Object);
+        if (FileDescriptor != -1)
+            m_sockets.insert(FileDescriptor, Reference);
+    }
+
+    void SetLookup(quint32 Reference, int LookupID)
+    {
+        if (!m_services.contains(Reference))
+            return;
+
+        TorcBonjourService &service = m_services[Reference];
+        if (service.m_lookupID != -1)
+            m_lookups.remove(service.m_lookupID);
+        service.m_lookupID = LookupID;
+        if (LookupID != -1)
+            m_lookups.insert(LookupID, Reference);
+    }
+
+    quint32 BySocket(int Socket) const
+    {
+        return m_sockets.value(Socket, 0);
+    }
+
+    quint32 ByServiceRef(DNSServiceRef Reference) const
+    {
+        return m_serviceRefs.value(Reference, 0);
+    }
+
+    quint32 ByName(const TorcBonjourService &Service) const
+    {
+        return m_names.value(Key(Service), 0);
+    }
+
+    quint32 ByLookup(int LookupID) const
+    {
+        return m_lookups.value(LookupID, 0);
+    }
+
+  private:
+    QHash<quint32,TorcBonjourService> m_services;
+    QHash<DNSServiceRef,quint32>      m_serviceRefs;
+    QHash<int,quint32>                m_sockets;
+    QHash<QByteArray,quint32>         m_names;
+    QHash<int,quint32>                m_lookups;
+};
+
 /*! \class TorcBonjourPriv
  *  \brief Private implementation of Bonjour service registration and browsing.
  *
+ * Discovered services are notified (as Torc::ServiceDiscovered and Torc::ServiceWentAway events) in batches.
+ * Changes are held for up to COALESCE_INTERVAL milliseconds (or until Bonjour indicates that no more browse
+ * results are immediately pending) and only the most recent change for each service is delivered. Bursts of
+ * browse results, which are common on busy networks, therefore result in one event per service.
+ *
  * \sa TorcBonjour
  * \sa TorcBonjourService
+ * \sa TorcBonjourServiceTable
  * \sa TorcNetworkedContext
  * \sa TorcRAOPDevice
 */
@@ -237,7 +401,8 @@ class TorcBonjourPriv
       : m_parent(Parent),
         m_suspended(false),
         m_serviceLock(new QMutex(QMutex::Recursive)),
-        m_discoveredLock(new QMutex(QMutex::Recursive))
+        m_discoveredLock(new QMutex(QMutex::Recursive)),
+        m_flushScheduled(false)
     {
         // the Avahi compatability layer on *nix will spam us with warnings
         qputenv("AVAHI_COMPAT_NOWARN", "1");
@@ -250,22 +415,15 @@ class TorcBonjourPriv
         // deregister any outstanding services (should be empty)
         {
             QMutexLocker locker(m_serviceLock);
-            if (!m_suspended)
-            {
-                QMap<quint32,TorcBonjourService>::iterator it = m_services.begin();
-                for (; it != m_services.end(); ++it)
-                    (*it).Deregister();
-            }
-            m_services.clear();
+            m_services.Clear();
         }
 
         // deallocate resolve queries
         {
             QMutexLocker locker(m_discoveredLock);
-            QMap<quint32,TorcBonjourService>::iterator it = m_discoveredServices.begin();
-            for (; it != m_discoveredServices.end(); ++it)
-                (*it).Deregister();
-            m_discoveredServices.clear();
+            m_discoveredServices.Clear();
+            m_pendingEvents.clear();
+            m_pendingOrder.clear();
         }
 
         // delete locks
@@ -304,18 +462,9 @@ class TorcBonjourPriv
             QMutexLocker locker(m_serviceLock);
 
             // close the services but retain the necessary details
-            QMap<quint32,TorcBonjourService> services;
-            QMap<quint32,TorcBonjourService>::iterator it = m_services.begin();
-            for (; it != m_services.end(); ++it)
-            {
-                TorcBonjourService service((*it).m_serviceType, NULL, (*it).m_name, (*it).m_type);
-                service.m_txt  = (*it).m_txt;
-                service.m_port = (*it).m_port;
-                (*it).Deregister();
-                services.insert(it.key(), service);
-            }
-
-            m_services = services;
+            QList<quint32> references = m_services.References();
+            foreach (quint32 reference, references)
+                m_services.Deregister(reference);
         }
     }
 
@@ -339,16 +488,17 @@ class TorcBonjourPriv
 
             m_suspended = false;
 
-            QMap<quint32,TorcBonjourService> services = m_services;
-            m_services.clear();
-
-            QMap<quint32,TorcBonjourService>::iterator it = services.begin();
-            for (; it != services.end(); ++it)
+            // re-create each service using its existing reference
+            QList<quint32> references = m_services.References();
+            foreach (quint32 reference, references)
             {
-                if ((*it).m_serviceType == TorcBonjourService::Service)
-                    (void)Register((*it).m_port, (*it).m_type, (*it).m_name, (*it).m_txt, it.key());
+                TorcBonjourService service = m_services.Get(reference);
+                m_services.Remove(reference);
+
+                if (service.m_serviceType == TorcBonjourService::Service)
+                    (void)Register(service.m_port, service.m_type, service.m_name, service.m_txt, reference);
                 else
-                    (void)Browse((*it).m_type, it.key());
+                    (void)Browse(service.m_type, reference);
             }
         }
     }
@@ -382,11 +532,7 @@ class TorcBonjourPriv
             TorcBonjourService service(TorcBonjourService::Service, NULL, Name, Type);
             service.m_txt  = Txt;
             service.m_port = Port;
-            quint32 reference = Reference;
-            // find a unique reference
-            while (!reference || m_services.contains(reference))
-                reference++;
-            m_services.insert(reference, service);
+            quint32 reference = m_services.Insert(service, Reference);
 
             LOG(VB_GENERAL, LOG_ERR, "Bonjour service registration deferred until Bonjour resumed");
             return reference;
@@ -419,14 +565,11 @@ class TorcBonjourPriv
         else
         {
             QMutexLocker locker(m_serviceLock);
-            quint32 reference = Reference;
-            while (!reference || m_services.contains(reference))
-                reference++;
             TorcBonjourService service(TorcBonjourService::Service, dnssref, Name, Type);
             service.m_txt  = Txt;
             service.m_port = Port;
-            m_services.insert(reference, service);
-            m_services[reference].SetFileDescriptor(DNSServiceRefSockFD(dnssref), m_parent);
+            quint32 reference = m_services.Insert(service, Reference);
+            m_services.SetFileDescriptor(reference, DNSServiceRefSockFD(dnssref), m_parent);
             return reference;
         }
 
@@ -452,10 +595,7 @@ class TorcBonjourPriv
             QMutexLocker locker(m_serviceLock);
 
             TorcBonjourService service(TorcBonjourService::Browse, NULL, dummy, Type);
-            quint32 reference = Reference;
-            while (!reference || m_services.contains(reference))
-                reference++;
-            m_services.insert(reference, service);
+            quint32 reference = m_services.Insert(service, Reference);
 
             LOG(VB_GENERAL, LOG_ERR, "Bonjour browse request deferred until Bonjour resumed");
             return reference;
@@ -474,12 +614,9 @@ class TorcBonjourPriv
         else
         {
             QMutexLocker locker(m_serviceLock);
-            quint32 reference = Reference;
-            while (!reference || m_services.contains(reference))
-                reference++;
             TorcBonjourService service(TorcBonjourService::Browse, dnssref, dummy, Type);
-            m_services.insert(reference, service);
-            m_services[reference].SetFileDescriptor(DNSServiceRefSockFD(dnssref), m_parent);
+            quint32 reference = m_services.Insert(service, Reference);
+            m_services.SetFileDescriptor(reference, DNSServiceRefSockFD(dnssref), m_parent);
             return reference;
         }
 
@@ -501,11 +638,10 @@ class TorcBonjourPriv
 
         {
             QMutexLocker locker(m_serviceLock);
-            if (m_services.contains(Reference))
+            if (m_services.Contains(Reference))
             {
-                type = m_services[Reference].m_type;
-                m_services[Reference].Deregister();
-                m_services.remove(Reference);
+                type = m_services.Get(Reference).m_type;
+                m_services.Remove(Reference);
             }
         }
 
@@ -518,16 +654,10 @@ class TorcBonjourPriv
         // Remove any resolve requests associated with this type
         {
             QMutexLocker locker(m_discoveredLock);
-            QMutableMapIterator<quint32,TorcBonjourService> it(m_discoveredServices);
-            while (it.hasNext())
-            {
-                it.next();
-                if (it.value().m_type == type)
-                {
-                    it.value().Deregister();
-                    it.remove();
-                }
-            }
+            QList<quint32> references = m_discoveredServices.References();
+            foreach (quint32 reference, references)
+                if (m_discoveredServices.Get(reference).m_type == type)
+                    m_discoveredServices.Remove(reference);
         }
     }
 
@@ -543,38 +673,42 @@ class TorcBonjourPriv
         {
             // match Socket to an announced service
             QMutexLocker lock(m_serviceLock);
-            QMap<quint32,TorcBonjourService>::iterator it = m_services.begin();
-            for ( ; it != m_services.end(); ++it)
+            quint32 reference = m_services.BySocket(Socket);
+            if (reference)
             {
-                if ((*it).m_fd == Socket)
-                {
-                    DNSServiceErrorType res = DNSServiceProcessResult((*it).m_dnssRef);
-                    if (kDNSServiceErr_NoError != res)
-                        LOG(VB_GENERAL, LOG_ERR, QString("Read Error: %1").arg(res));
-                    return;
-                }
+                ProcessResult(m_services.Get(reference).m_dnssRef);
+                return;
             }
         }
 
         {
             // match Socket to a discovered service
             QMutexLocker lock(m_discoveredLock);
-            QMap<quint32,TorcBonjourService>::iterator it = m_discoveredServices.begin();
-            for ( ; it != m_discoveredServices.end(); ++it)
+            quint32 reference = m_discoveredServices.BySocket(Socket);
+            if (reference)
             {
-                if ((*it).m_fd == Socket)
-                {
-                    DNSServiceErrorType res = DNSServiceProcessResult((*it).m_dnssRef);
-                    if (kDNSServiceErr_NoError != res)
-                        LOG(VB_GENERAL, LOG_ERR, QString("Read Error: %1").arg(res));
-                    return;
-                }
+                ProcessResult(m_discoveredServices.Get(reference).m_dnssRef);
+                return;
             }
         }
 
         LOG(VB_GENERAL, LOG_WARNING, "Read request on unknown socket");
     }
 
+    void ProcessResult(DNSServiceRef Reference)
+    {
+        DNSServiceErrorType res = DNSServiceProcessResult(Reference);
+        if (kDNSServiceErr_NoError != res)
+            LOG(VB_GENERAL, LOG_ERR, QString("Read Error: %1").arg(res));
+    }
+
+    bool IsKnownBrowser(DNSServiceRef Reference)
+    {
+        QMutexLocker locker(m_serviceLock);
+        quint32 reference = m_services.ByServiceRef(Reference);
+        return reference && m_services.Get(reference).m_serviceType == TorcBonjourService::Browse;
+    }
+
 /*! \fn    TorcBonjourPriv::AddBrowseResult
  *  \brief Handle newly discovered service.
  *
@@ -584,42 +718,21 @@ class TorcBonjourPriv
     void AddBrowseResult(DNSServiceRef Reference,
                          const TorcBonjourService &Service)
     {
+        // validate against known browsers
+        if (!IsKnownBrowser(Reference))
         {
-            // validate against known browsers
-            QMutexLocker locker(m_serviceLock);
-            bool found = false;
-            QMap<quint32,TorcBonjourService>::iterator it = m_services.begin();
-            for ( ; it != m_services.end(); ++it)
-            {
-                if ((*it).m_dnssRef == Reference)
-                {
-                    found = true;
-                    break;
-                }
-            }
-
-            if (!found)
-            {
-                LOG(VB_GENERAL, LOG_INFO, "Browser result for unknown browser");
-                return;
-            }
+            LOG(VB_GENERAL, LOG_INFO, "Browser result for unknown browser");
+            return;
         }
 
         {
             // have we already seen this service?
             QMutexLocker locker(m_discoveredLock);
-            QMap<quint32,TorcBonjourService>::iterator it = m_discoveredServices.begin();
-            for( ; it != m_discoveredServices.end(); ++it)
+            if (m_discoveredServices.ByName(Service))
             {
-                if ((*it).m_name == Service.m_name &&
-                    (*it).m_type == Service.m_type &&
-                    (*it).m_domain == Service.m_domain &&
-                    (*it).m_interfaceIndex == Service.m_interfaceIndex)
-                {
-                    LOG(VB_NETWORK, LOG_INFO, QString("Service '%1' already discovered - ignoring")
-                        .arg(Service.m_name.data()));
-                    return;
-                }
+                LOG(VB_NETWORK, LOG_INFO, QString("Service '%1' already discovered - ignoring")
+                    .arg(Service.m_name.data()));
+                return;
             }
 
             // kick off resolve
@@ -639,12 +752,9 @@ class TorcBonjourPriv
             {
                 // add it to our list
                 TorcBonjourService service = Service;
-                quint32 ref = 1;
-                while (m_discoveredServices.contains(ref))
-                    ref++;
                 service.m_dnssRef = reference;
-                m_discoveredServices.insert(ref, service);
-                m_discoveredServices[ref].SetFileDescriptor(DNSServiceRefSockFD(reference), m_parent);
+                quint32 ref = m_discoveredServices.Insert(service);
+                m_discoveredServices.SetFileDescriptor(ref, DNSServiceRefSockFD(reference), m_parent);
                 LOG(VB_NETWORK, LOG_INFO, QString("Resolving '%1'").arg(service.m_name.data()));
             }
         }
@@ -656,54 +766,33 @@ class TorcBonjourPriv
     void RemoveBrowseResult(DNSServiceRef Reference,
                             const TorcBonjourService &Service)
     {
+        // validate against known browsers
+        if (!IsKnownBrowser(Reference))
         {
-            // validate against known browsers
-            QMutexLocker locker(m_serviceLock);
-            bool found = false;
-            QMap<quint32,TorcBonjourService>::iterator it = m_services.begin();
-            for ( ; it != m_services.end(); ++it)
-            {
-                if ((*it).m_dnssRef == Reference)
-                {
-                    found = true;
-                    break;
-                }
-            }
-
-            if (!found)
-            {
-                LOG(VB_GENERAL, LOG_INFO, "Browser result for unknown browser");
-                return;
-            }
+            LOG(VB_GENERAL, LOG_INFO, "Browser result for unknown browser");
+            return;
         }
 
         {
             // validate against known services
             QMutexLocker locker(m_discoveredLock);
-            QMutableMapIterator<quint32,TorcBonjourService> it(m_discoveredServices);
-            while (it.hasNext())
-            {
-                it.next();
-                if (it.value().m_type == Service.m_type &&
-                    it.value().m_name == Service.m_name &&
-                    it.value().m_domain == Service.m_domain &&
-                    it.value().m_interfaceIndex == Service.m_interfaceIndex)
-                {
-                    QVariantMap data;
-                    data.insert("name", it.value().m_name.data());
-                    data.insert("type", it.value().m_type.data());
-                    data.insert("txtrecords", it.value().m_txt);
-                    data.insert("host", it.value().m_host);
-                    TorcEvent event(Torc::ServiceWentAway, data);
-                    gLocalContext->Notify(event);
-
-                    LOG(VB_GENERAL, LOG_INFO, QString("Service '%1' on '%2' went away")
-                        .arg(it.value().m_type.data())
-                        .arg(it.value().m_host.isEmpty() ? it.value().m_name.data() : it.value().m_host.data()));
-                    it.value().Deregister();
-                    it.remove();
-                }
-            }
+            quint32 reference = m_discoveredServices.ByName(Service);
+            if (!reference)
+                return;
+
+            TorcBonjourService &service = m_discoveredServices.Get(reference);
+
+            QVariantMap data;
+            data.insert("name", service.m_name.data());
+            data.insert("type", service.m_type.data());
+            data.insert("txtrecords", service.m_txt);
+            data.insert("host", service.m_host);
+            QueueEvent(TorcBonjourServiceTable::Key(service), Torc::ServiceWentAway, data);
+
+            LOG(VB_GENERAL, LOG_INFO, QString("Service '%1' on '%2' went away")
+                .arg(service.m_type.data())
+                .arg(service.m_host.isEmpty() ? service.m_name.data() : service.m_host.data()));
+            m_discoveredServices.Remove(reference);
         }
     }
 
@@ -725,95 +814,143 @@ class TorcBonjourPriv
 
         {
             QMutexLocker locker(m_discoveredLock);
-            QMap<quint32,TorcBonjourService>::iterator it = m_discoveredServices.begin();
-            for( ; it != m_discoveredServices.end(); ++it)
+            quint32 reference = m_discoveredServices.ByServiceRef(Reference);
+            if (!reference)
+                return;
+
+            TorcBonjourService &service = m_discoveredServices.Get(reference);
+
+            if (ErrorType != kDNSServiceErr_NoError)
             {
-                if ((*it).m_dnssRef == Reference)
-                {
-                    if (ErrorType != kDNSServiceErr_NoError)
-                    {
-                        LOG(VB_GENERAL, LOG_ERR, QString("Failed to resolve '%1' (Error %2)").arg((*it).m_name.data()).arg(ErrorType));
-                        return;
-                    }
-
-                    uint16_t port = ntohs(Port);
-                    (*it).m_host = HostTarget;
-                    (*it).m_port = port;
-                    LOG(VB_NETWORK, LOG_INFO, QString("%1 (%2) resolved to %3:%4")
-                        .arg((*it).m_name.data()).arg((*it).m_type.data()).arg(HostTarget).arg(port));
-                    QString name(HostTarget);
-                    (*it).m_lookupID = QHostInfo::lookupHost(name, m_parent, SLOT(HostLookup(QHostInfo)));
-                    (*it).m_txt      = QByteArray((const char *)TxtRecord, TxtLen);
-                }
+                LOG(VB_GENERAL, LOG_ERR, QString("Failed to resolve '%1' (Error %2)").arg(service.m_name.data()).arg(ErrorType));
+                return;
             }
+
+            uint16_t port = ntohs(Port);
+            service.m_host = HostTarget;
+            service.m_port = port;
+            service.m_txt  = QByteArray((const char *)TxtRecord, TxtLen);
+            LOG(VB_NETWORK, LOG_INFO, QString("%1 (%2) resolved to %3:%4")
+                .arg(service.m_name.data()).arg(service.m_type.data()).arg(HostTarget).arg(port));
+
+            // a repeat resolution replaces any outstanding lookup
+            if (service.m_lookupID != -1)
+                QHostInfo::abortHostLookup(service.m_lookupID);
+
+            QString name(HostTarget);
+            m_discoveredServices.SetLookup(reference, QHostInfo::lookupHost(name, m_parent, SLOT(HostLookup(QHostInfo))));
         }
     }
 
 /*! \fn    TorcBonjourPriv::HostLookup
  *  \brief Handle host lookup responses from Qt.
  *
- * If the service is fully resolved to one or more IP addresses, notify the new
- * service with a Torc::ServiceDiscovered event.
+ * If the service is fully resolved to one or more IP addresses, queue a Torc::ServiceDiscovered
+ * event for the service.
 */
     void HostLookup(const QHostInfo &HostInfo)
     {
         // search for the lookup id
         {
             QMutexLocker locker(m_discoveredLock);
-            QMap<quint32,TorcBonjourService>::iterator it = m_discoveredServices.begin();
-            for ( ; it != m_discoveredServices.end(); ++it)
+            quint32 reference = m_discoveredServices.ByLookup(HostInfo.lookupId());
+            if (!reference)
+                return;
+
+            m_discoveredServices.SetLookup(reference, -1);
+            TorcBonjourService &service = m_discoveredServices.Get(reference);
+
+            // igore if errored
+            if (HostInfo.error() != QHostInfo::NoError)
             {
-                if ((*it).m_lookupID == HostInfo.lookupId())
-                {
-                    (*it).m_lookupID = -1;
-
-                    // igore if errored
-                    if (HostInfo.error() != QHostInfo::NoError)
-                    {
-                        LOG(VB_GENERAL, LOG_ERR, QString("Lookup failed for '%1' with error '%2'").arg(HostInfo.hostName()).arg(HostInfo.errorString()));
-                        return;
-                    }
-
-                    (*it).m_ipAddresses = HostInfo.addresses();
-                    LOG(VB_GENERAL, LOG_INFO, QString("Service '%1' on '%2:%3' resolved to %4 address(es) on interface %5")
-                        .arg((*it).m_type.data())
-                        .arg((*it).m_host.data())
-                        .arg((*it).m_port)
-                        .arg((*it).m_ipAddresses.size())
-                        .arg((*it).m_interfaceIndex));
-
-                    QStringList addresses;
-
-                    foreach (QHostAddress address, (*it).m_ipAddresses)
-                    {
-                        LOG(VB_NETWORK, LOG_INFO, address.toString());
-                        addresses << address.toString();
-                    }
-
-                    if (!addresses.isEmpty())
-                    {
-                        QVariantMap data;
-                        data.insert("name", (*it).m_name.data());
-                        data.insert("type", (*it).m_type.data());
-                        data.insert("port", (*it).m_port);
-                        data.insert("addresses", addresses);
-                        data.insert("txtrecords", (*it).m_txt);
-                        data.insert("host", (*it).m_host.data());
-                        TorcEvent event(Torc::ServiceDiscovered, data);
-                        gLocalContext->Notify(event);
-                    }
-                }
+                LOG(VB_GENERAL, LOG_ERR, QString("Lookup failed for '%1' with error '%2'").arg(HostInfo.hostName()).arg(HostInfo.errorString()));
+                return;
+            }
+
+            service.m_ipAddresses = HostInfo.addresses();
+            LOG(VB_GENERAL, LOG_INFO, QString("Service '%1' on '%2:%3' resolved to %4 address(es) on interface %5")
+                .arg(service.m_type.data())
+                .arg(service.m_host.data())
+                .arg(service.m_port)
+                .arg(service.m_ipAddresses.size())
+                .arg(service.m_interfaceIndex));
+
+            QStringList addresses;
+
+            foreach (QHostAddress address, service.m_ipAddresses)
+            {
+                LOG(VB_NETWORK, LOG_INFO, address.toString());
+                addresses << address.toString();
+            }
+
+            if (!addresses.isEmpty())
+            {
+                QVariantMap data;
+                data.insert("name", service.m_name.data());
+                data.insert("type", service.m_type.data());
+                data.insert("port", service.m_port);
+                data.insert("addresses", addresses);
+                data.insert("txtrecords", service.m_txt);
+                data.insert("host", service.m_host.data());
+                QueueEvent(TorcBonjourServiceTable::Key(service), Torc::ServiceDiscovered, data);
             }
         }
     }
 
+/*! \fn    TorcBonjourPriv::FlushEvents
+ *  \brief Deliver any queued discovery events.
+*/
+    void FlushEvents(void)
+    {
+        QList<QPair<int,QVariantMap> > events;
+
+        {
+            QMutexLocker locker(m_discoveredLock);
+            m_flushScheduled = false;
+
+            if (m_pendingOrder.isEmpty())
+                return;
+
+            foreach (const QByteArray &key, m_pendingOrder)
+                events.append(m_pendingEvents.value(key));
+            m_pendingEvents.clear();
+            m_pendingOrder.clear();
+        }
+
+        LOG(VB_NETWORK, LOG_DEBUG, QString("Delivering %1 Bonjour service updates").arg(events.size()));
+
+        for (int i = 0; i < events.size(); ++i)
+        {
+            TorcEvent event(events.at(i).first, events.at(i).second);
+            gLocalContext->Notify(event);
+        }
+    }
+
+  private:
+    /// Queue Event for the service identified by Key, replacing any earlier undelivered event. m_discoveredLock must be held.
+    void QueueEvent(const QByteArray &Key, int Event, const QVariantMap &Data)
+    {
+        if (!m_pendingEvents.contains(Key))
+            m_pendingOrder.append(Key);
+        m_pendingEvents.insert(Key, qMakePair(Event, Data));
+
+        if (!m_flushScheduled)
+        {
+            m_flushScheduled = true;
+            QTimer::singleShot(COALESCE_INTERVAL, m_parent, SLOT(FlushEvents()));
+        }
+    }
+
   private:
     TorcBonjour                     *m_parent;
     bool                             m_suspended;
     QMutex                          *m_serviceLock;
-    QMap<quint32,TorcBonjourService> m_services;
+    TorcBonjourServiceTable          m_services;
     QMutex                          *m_discoveredLock;
-    QMap<quint32,TorcBonjourService> m_discoveredServices;
+    TorcBonjourServiceTable          m_discoveredServices;
+    bool                             m_flushScheduled;
+    QHash<QByteArray,QPair<int,QVariantMap> > m_pendingEvents;
+    QList<QByteArray>                m_pendingOrder;
 };
 
 /*! \fn    BonjourRegisterCallback
@@ -871,10 +1008,9 @@ void BonjourBrowseCallback(DNSServiceRef Ref, DNSServiceFlags Flags,
     else
         bonjour->RemoveBrowseResult(Ref, service);
 
+    // deliver any queued changes once the current burst of results is complete
     if (!(Flags & kDNSServiceFlagsMoreComing))
-    {
-        // TODO
-    }
+        bonjour->FlushEvents();
 }
 
 /*! \fn    BonjourResolveCallback
@@ -991,7 +1127,7 @@ TorcBonjour::TorcBonjour()
   : QObject(NULL), m_priv(new TorcBonjourPriv(this))
 {
     // listen for network enabled/disabled events
-    gLocalContext->AddObserver(this);
+    gLocalContext->AddObserver(this, QList<int>() << Torc::NetworkEnabled << Torc::NetworkDisabled);
 }
 
 TorcBonjour::~TorcBonjour()
@@ -1080,6 +1216,18 @@ void TorcBonjour::HostLookup(const QHostInfo &HostInfo)
         m_priv->HostLookup(HostInfo);
 }
 
+/*! \fn    TorcBonjour::FlushEvents
+ *  \brief Deliver queued service discovery events.
+ *
+ * TorcBonjourPriv does not inherit QObject hence needs TorcBonjour to handle
+ * slots and events.
+*/
+void TorcBonjour::FlushEvents(void)
+{
+    if (m_priv)
+        m_priv->FlushEvents();
+}
+
 /*! \fn TorcBonjour::event
  *  \brief Implements QObject::event
  *
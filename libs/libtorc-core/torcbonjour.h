@@ -33,6 +33,7 @@ class TORC_CORE_PUBLIC TorcBonjour : public QObject
     void    SuspendPriv     (bool Suspend);
     void    socketReadyRead (int Socket);
     void    HostLookup      (const QHostInfo &HostInfo);
+    void    FlushEvents     (void);
 
   protected:
     TorcBonjour();
@@ -20,6 +20,10 @@
 * USA.
 */
 
+// Qt
+#include <QFileInfo>
+#include <QDateTime>
+
 // Torc
 #include "torclogging.h"
 #include "torcbuffer.h"
@@ -137,6 +141,27 @@ void* TorcBuffer::RequiredAVFormat(bool& BufferRequired)
     return NULL;
 }
 
+/*! \brief The maximum number of bytes libav should read when probing streams.
+ *
+ * Reimplement this method to bound the time spent in avformat_find_stream_info for slow or
+ * high latency sources. A value of 0 (the default) uses the libav default.
+*/
+int TorcBuffer::BestProbeSize(void)
+{
+    return 0;
+}
+
+/*! \brief The maximum duration (in microseconds) libav should analyse when probing streams.
+ *
+ * A value of 0 (the default) uses the libav default.
+ *
+ * \sa BestProbeSize
+*/
+qint64 TorcBuffer::BestAnalyzeDuration(void)
+{
+    return 0;
+}
+
 /*! \fn    TorcBuffer::StaticRead
  *  \brief Read from the buffer Object.
  *
@@ -348,6 +373,21 @@ QString TorcBuffer::GetPath(void)
     return m_path;
 }
 
+/*! \fn    TorcBuffer::GetValidator
+ *  \brief Get a string that changes whenever the content of this buffer changes.
+ *
+ * The default implementation returns the modification time of the file at GetPath, if it exists.
+ * Reimplement this for buffers whose content is not a local file. An empty string indicates that
+ * the content cannot be identified (and hence must not be cached).
+*/
+QString TorcBuffer::GetValidator(void)
+{
+    QFileInfo info(GetPath());
+    if (info.exists())
+        return QString::number(info.lastModified().toMSecsSinceEpoch());
+    return QString();
+}
+
 /*! \fn    TorcBuffer::GetURI
  *  \brief Get the URI for this buffer.
 */
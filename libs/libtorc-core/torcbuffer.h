@@ -58,12 +58,15 @@ class TORC_CORE_PUBLIC TorcBuffer
     virtual bool       IsSequential       (void) = 0;
     virtual qint64     BytesAvailable     (void) = 0;
     virtual int        BestBufferSize     (void) = 0;
+    virtual int        BestProbeSize      (void);
+    virtual qint64     BestAnalyzeDuration(void);
     virtual QByteArray ReadAll            (int Timeout = 0);
     virtual bool       Pause              (void);
     virtual bool       Unpause            (void);
     virtual bool       TogglePause        (void);
     virtual QString    GetFilteredUri     (void);
     virtual QString    GetPath            (void);
+    virtual QString    GetValidator       (void);
     QString            GetURI             (void);
     bool               GetPaused          (void);
     void*              GetParent          (void);
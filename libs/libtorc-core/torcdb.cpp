@@ -349,16 +349,11 @@ void TorcDB::SetSetting(const QString &Name, const QString &Value)
     }
 
     QSqlQuery query(db);
-    query.prepare("DELETE FROM settings where name=:NAME;");
-    query.bindValue(":NAME", Name);
-    if (query.exec())
-        DebugError(&query);
-
-    query.prepare("INSERT INTO settings (name, value) "
+    query.prepare("INSERT OR REPLACE INTO settings (name, value) "
                   "VALUES (:NAME, :VALUE);");
     query.bindValue(":NAME", Name);
     query.bindValue(":VALUE", Value);
-    if (query.exec())
+    if (!query.exec())
         DebugError(&query);
 }
 
@@ -381,15 +376,74 @@ void TorcDB::SetPreference(const QString &Name, const QString &Value)
     }
 
     QSqlQuery query(db);
-    query.prepare("DELETE FROM preferences where name=:NAME;");
-    query.bindValue(":NAME", Name);
-    if (query.exec())
-        DebugError(&query);
-
-    query.prepare("INSERT INTO preferences (name, value) "
+    query.prepare("INSERT OR REPLACE INTO preferences (name, value) "
                   "VALUES (:NAME, :VALUE);");
     query.bindValue(":NAME", Name);
     query.bindValue(":VALUE", Value);
-    if (query.exec())
+    if (!query.exec())
         DebugError(&query);
 }
+
+/*! \fn    TorcDB::SetSettings
+ *  \brief Set multiple settings and preferences within a single transaction.
+ *
+ * \returns False if the changes could not be written, in which case none are applied.
+ *
+ * \sa SetSetting
+ * \sa SetPreference
+ * \sa TorcDBWriter
+*/
+bool TorcDB::SetSettings(const QMap<QString,QString> &Settings, const QMap<QString,QString> &Preferences)
+{
+    QSqlDatabase db = QSqlDatabase::database(GetThreadConnection());
+    DebugError(&db);
+    if (!db.isValid() || !db.isOpen())
+    {
+        LOG(VB_GENERAL, LOG_ERR, "Failed to open database connection.");
+        return false;
+    }
+
+    if (!db.transaction())
+    {
+        DebugError(&db);
+        return false;
+    }
+
+    bool ok = true;
+
+    QSqlQuery settings(db);
+    settings.prepare("INSERT OR REPLACE INTO settings (name, value) "
+                     "VALUES (:NAME, :VALUE);");
+    QMap<QString,QString>::const_iterator it = Settings.constBegin();
+    for ( ; ok && it != Settings.constEnd(); ++it)
+    {
+        settings.bindValue(":NAME", it.key());
+        settings.bindValue(":VALUE", it.value());
+        if (!settings.exec())
+        {
+            DebugError(&settings);
+            ok = false;
+        }
+    }
+
+    QSqlQuery preferences(db);
+    preferences.prepare("INSERT OR REPLACE INTO preferences (name, value) "
+                        "VALUES (:NAME, :VALUE);");
+    for (it = Preferences.constBegin(); ok && it != Preferences.constEnd(); ++it)
+    {
+        preferences.bindValue(":NAME", it.key());
+        preferences.bindValue(":VALUE", it.value());
+        if (!preferences.exec())
+        {
+            DebugError(&preferences);
+            ok = false;
+        }
+    }
+
+    if (ok && db.commit())
+        return true;
+
+    DebugError(&db);
+    db.rollback();
+    return false;
+}
@@ -20,6 +20,7 @@ class TorcDB
     void         LoadPreferences        (QMap<QString,QString> &Preferences);
     void         SetSetting             (const QString &Name, const QString &Value);
     void         SetPreference          (const QString &Name, const QString &Value);
+    bool         SetSettings            (const QMap<QString,QString> &Settings, const QMap<QString,QString> &Preferences);
 
   protected:
     virtual bool InitDatabase           (void) = 0;
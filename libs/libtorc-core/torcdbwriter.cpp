@@ -0,0 +1,260 @@
+/* Class TorcDBWriter
+*
+* This file is part of the Torc project.
+*
+* Copyright (C) Mark Kendall 2013
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+* USA.
+*/
+
+// Qt
+#include <QStringList>
+#include <QTimerEvent>
+
+// Torc
+#include "torclogging.h"
+#include "torcsqlitedb.h"
+#include "torcdbwriter.h"
+
+// changes are written at most this often (in milliseconds)
+#define FLUSH_INTERVAL 500
+// failed writes are retried with an increasing interval, up to FLUSH_INTERVAL << MAX_RETRY_SHIFT (32 seconds)
+#define MAX_RETRY_SHIFT 6
+
+/// Return Changes to Pending, unless a newer value has been queued since.
+static void Requeue(QMap<QString,QString> &Pending, const QMap<QString,QString> &Changes)
+{
+    QMap<QString,QString>::const_iterator it = Changes.constBegin();
+    for ( ; it != Changes.constEnd(); ++it)
+        if (!Pending.contains(it.key()))
+            Pending.insert(it.key(), it.value());
+}
+
+/*! \class TorcDBWriter
+ *  \brief Write settings and preferences to the database in the background.
+ *
+ * Changes are queued (replacing any earlier, unwritten value for the same name) and written in a single
+ * transaction, FLUSH_INTERVAL milliseconds after the first change. Callers therefore never wait for the database.
+ *
+ * If the transaction fails (e.g. the database is busy or the disk is full), the changes are queued again
+ * (without replacing any newer values) and retried with an increasing interval. Any changes that are still
+ * unsaved when the writer is destroyed are logged by name.
+ *
+ * SetSetting and SetPreference are thread safe. All database access happens in the TorcDBWriterThread.
+ *
+ * \sa TorcDBWriterThread
+ * \sa TorcDB::SetSettings
+*/
+TorcDBWriter::TorcDBWriter()
+  : QObject(),
+    m_database(NULL),
+    m_flushPending(false),
+    m_flushTimer(0),
+    m_failures(0)
+{
+}
+
+TorcDBWriter::~TorcDBWriter()
+{
+    QMutexLocker locker(&m_lock);
+    if (!m_settings.isEmpty())
+        LOG(VB_GENERAL, LOG_ERR, QString("Settings not saved: %1").arg(QStringList(m_settings.keys()).join(", ")));
+    if (!m_preferences.isEmpty())
+        LOG(VB_GENERAL, LOG_ERR, QString("Preferences not saved: %1").arg(QStringList(m_preferences.keys()).join(", ")));
+}
+
+void TorcDBWriter::SetDatabase(TorcDB *Database)
+{
+    m_database = Database;
+}
+
+void TorcDBWriter::SetSetting(const QString &Name, const QString &Value)
+{
+    if (Name.isEmpty())
+        return;
+
+    QMutexLocker locker(&m_lock);
+    m_settings.insert(Name, Value);
+    Schedule();
+}
+
+void TorcDBWriter::SetPreference(const QString &Name, const QString &Value)
+{
+    if (Name.isEmpty())
+        return;
+
+    QMutexLocker locker(&m_lock);
+    m_preferences.insert(Name, Value);
+    Schedule();
+}
+
+/// Start the flush timer in the writer's thread. The lock must be held.
+void TorcDBWriter::Schedule(void)
+{
+    if (m_flushPending)
+        return;
+
+    m_flushPending = true;
+    QMetaObject::invokeMethod(this, "StartFlushTimer", Qt::QueuedConnection);
+}
+
+void TorcDBWriter::StartFlushTimer(void)
+{
+    if (!m_flushTimer)
+        m_flushTimer = startTimer(FLUSH_INTERVAL << qMin(m_failures, MAX_RETRY_SHIFT));
+}
+
+void TorcDBWriter::timerEvent(QTimerEvent *Event)
+{
+    if (Event->timerId() == m_flushTimer)
+        Flush();
+}
+
+/*! \brief Write all outstanding changes in a single transaction.
+ *
+ * On failure the changes are queued again and the write is rescheduled.
+*/
+void TorcDBWriter::Flush(void)
+{
+    if (m_flushTimer)
+        killTimer(m_flushTimer);
+    m_flushTimer = 0;
+
+    QMap<QString,QString> settings;
+    QMap<QString,QString> preferences;
+
+    {
+        QMutexLocker locker(&m_lock);
+        m_flushPending = false;
+        settings    = m_settings;
+        preferences = m_preferences;
+        m_settings.clear();
+        m_preferences.clear();
+    }
+
+    if (settings.isEmpty() && preferences.isEmpty())
+        return;
+
+    if (!m_database)
+    {
+        LOG(VB_GENERAL, LOG_ERR, QString("No database - discarding settings: %1")
+            .arg(QStringList(settings.keys() + preferences.keys()).join(", ")));
+        return;
+    }
+
+    LOG(VB_GENERAL, LOG_DEBUG, QString("Writing %1 settings and %2 preferences").arg(settings.size()).arg(preferences.size()));
+    if (m_database->SetSettings(settings, preferences))
+    {
+        m_failures = 0;
+        return;
+    }
+
+    m_failures++;
+    LOG(VB_GENERAL, LOG_WARNING, QString("Failed to write %1 settings and %2 preferences (attempt %3) - will retry")
+        .arg(settings.size()).arg(preferences.size()).arg(m_failures));
+
+    QMutexLocker locker(&m_lock);
+    Requeue(m_settings, settings);
+    Requeue(m_preferences, preferences);
+    Schedule();
+}
+
+/*! \class TorcDBWriterThread
+ *  \brief Owns the settings database and writes changes to it.
+ *
+ * The database is opened in exclusive locking mode and hence must be accessed from a single connection.
+ * TorcDBWriterThread opens the database, loads the stored settings and preferences (see WaitForDatabase)
+ * and then writes any changes submitted via its TorcDBWriter. Outstanding changes are written before the
+ * thread exits.
+ *
+ * \sa TorcDBWriter
+ * \sa TorcLocalContext
+*/
+TorcDBWriterThread::TorcDBWriterThread(const QString &DatabaseName)
+  : TorcQThread("DBWriter"),
+    m_databaseName(DatabaseName),
+    m_database(NULL),
+    m_writer(new TorcDBWriter()),
+    m_ready(false),
+    m_valid(false)
+{
+    m_writer->moveToThread(this);
+}
+
+TorcDBWriterThread::~TorcDBWriterThread()
+{
+    // N.B. the database should have been closed in Finish
+    delete m_database;
+    m_database = NULL;
+
+    delete m_writer;
+    m_writer = NULL;
+}
+
+/*! \brief Wait for the database to be opened and return the stored settings and preferences.
+ *
+ * \returns False if the database could not be opened.
+*/
+bool TorcDBWriterThread::WaitForDatabase(QMap<QString,QString> &Settings, QMap<QString,QString> &Preferences)
+{
+    QMutexLocker locker(&m_readyLock);
+    while (!m_ready)
+        m_readyCondition.wait(&m_readyLock);
+
+    Settings    = m_settings;
+    Preferences = m_preferences;
+    m_settings.clear();
+    m_preferences.clear();
+    return m_valid;
+}
+
+TorcDBWriter* TorcDBWriterThread::Writer(void)
+{
+    return m_writer;
+}
+
+void TorcDBWriterThread::Start(void)
+{
+    TorcSQLiteDB *database = new TorcSQLiteDB(m_databaseName);
+
+    QMutexLocker locker(&m_readyLock);
+
+    if (database->IsValid())
+    {
+        database->LoadSettings(m_settings);
+        database->LoadPreferences(m_preferences);
+        m_database = database;
+        m_writer->SetDatabase(m_database);
+        m_valid = true;
+    }
+    else
+    {
+        delete database;
+    }
+
+    m_ready = true;
+    m_readyCondition.wakeAll();
+}
+
+void TorcDBWriterThread::Finish(void)
+{
+    // write any outstanding changes and close the database from this thread
+    m_writer->Flush();
+    m_writer->SetDatabase(NULL);
+
+    delete m_database;
+    m_database = NULL;
+}
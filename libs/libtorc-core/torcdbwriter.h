@@ -0,0 +1,72 @@
+#ifndef TORCDBWRITER_H
+#define TORCDBWRITER_H
+
+// Qt
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QWaitCondition>
+
+// Torc
+#include "torcqthread.h"
+
+class TorcDB;
+
+class TorcDBWriter : public QObject
+{
+    Q_OBJECT
+
+  public:
+    TorcDBWriter();
+    virtual ~TorcDBWriter();
+
+    void    SetDatabase             (TorcDB *Database);
+    void    SetSetting              (const QString &Name, const QString &Value);
+    void    SetPreference           (const QString &Name, const QString &Value);
+
+  public slots:
+    void    Flush                   (void);
+
+  protected:
+    void    timerEvent              (QTimerEvent *Event);
+
+  private slots:
+    void    StartFlushTimer         (void);
+
+  private:
+    void    Schedule                (void);
+
+  private:
+    TorcDB                *m_database;
+    QMutex                 m_lock;
+    QMap<QString,QString>  m_settings;
+    QMap<QString,QString>  m_preferences;
+    bool                   m_flushPending;
+    int                    m_flushTimer;
+    int                    m_failures;
+};
+
+class TorcDBWriterThread : public TorcQThread
+{
+  public:
+    explicit TorcDBWriterThread(const QString &DatabaseName);
+    virtual ~TorcDBWriterThread();
+
+    bool               WaitForDatabase (QMap<QString,QString> &Settings, QMap<QString,QString> &Preferences);
+    TorcDBWriter*      Writer          (void);
+    void               Start           (void);
+    void               Finish          (void);
+
+  private:
+    QString                m_databaseName;
+    TorcDB                *m_database;
+    TorcDBWriter          *m_writer;
+    QMutex                 m_readyLock;
+    QWaitCondition         m_readyCondition;
+    bool                   m_ready;
+    bool                   m_valid;
+    QMap<QString,QString>  m_settings;
+    QMap<QString,QString>  m_preferences;
+};
+
+#endif // TORCDBWRITER_H
@@ -111,6 +111,27 @@ TorcDecoder::~TorcDecoder()
  *
  * \fn TorcDecoder::GetCurrentStream
  * \return The current stream number for the given type in the current program.
+ *
+ * \fn TorcDecoder::GetDuration
+ * \return The duration of the current program in seconds or 0 if unknown.
+ *
+ * \fn TorcDecoder::GetPosition
+ * \return The playback position in seconds.
+ *
+ * \fn TorcDecoder::Preroll
+ * \brief Start demuxing into the decoder's internal queues without starting playback.
+ *
+ * Used to prepare the next item in a queue so that it can be started without delay. Must be called
+ * before Open. The audio output is not configured until the decoder is started.
+ *
+ * \fn TorcDecoder::SetGapless
+ * \brief Indicate that playback will continue with another decoder when this one ends.
+ *
+ * A gapless decoder will not wait for the audio device to drain at the end of the stream and
+ * will leave the audio output open for the next decoder to reuse.
+ *
+ * \fn TorcDecoder::GetStatistics
+ * \return Performance counters (throughput, decoded frames, wait and CPU times) for the current stream.
 */
 
 /*! \brief Create a decoder object to handle the object described by URI.
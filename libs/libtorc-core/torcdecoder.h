@@ -3,6 +3,7 @@
 
 // Qt
 #include <QString>
+#include <QVariant>
 
 // Torc
 #include "torccoreexport.h"
@@ -64,6 +65,11 @@ class TORC_CORE_PUBLIC TorcDecoder
     virtual void         Seek             (void) = 0;
     virtual int          GetCurrentStream (TorcStreamTypes Type) = 0;
     virtual int          GetStreamCount   (TorcStreamTypes Type) = 0;
+    virtual double       GetDuration      (void) = 0;
+    virtual double       GetPosition      (void) = 0;
+    virtual void         Preroll          (void) = 0;
+    virtual void         SetGapless       (bool Gapless) = 0;
+    virtual QVariantMap  GetStatistics    (void) = 0;
     virtual TorcPlayer*  GetParent        (void) = 0;
 };
 
@@ -28,10 +28,11 @@
  *
  * TorcEvent is used to send Torc::Actions events to other objects.
  * For a simple event message, the constructor requires only a Torc event
- * type. For more complicated events, add additional data with a QVariantMap.
+ * type. For more complicated events, add additional data with a QVariantMap. The data is read only,
+ * so that it can be shared between all of the recipients of an event without being copied.
  *
  * To listen for Torc events, an object must be a QObject subclass and reimplement QObject::event.
- * It can then call gLocalContext->AddObserver(this) and remember
+ * It can then call gLocalContext->AddObserver(this) (optionally listing the events it handles) and remember
  * to call gLocalContext->RemoveObserver(this) when event notification is no longer
  * required.
  *
@@ -66,13 +67,13 @@ TorcEvent::~TorcEvent()
 }
 
 /// \brief Return the Torc action associated with this event.
-int TorcEvent::GetEvent(void)
+int TorcEvent::GetEvent(void) const
 {
     return m_event;
 }
 
-/// \brief Return a reference to the Data contained within this event.
-QVariantMap& TorcEvent::Data(void)
+/// \brief Return a reference to the (read only) Data contained within this event.
+const QVariantMap& TorcEvent::Data(void) const
 {
     return m_data;
 }
@@ -82,6 +83,9 @@ QVariantMap& TorcEvent::Data(void)
  * TorcObservable will iterate over the list of 'listening' objects and send events
  * to each using QCoreApplication::postEvent. postEvent will however take ownership of the
  * event object, hence we need to create a copy for each message.
+ *
+ * \note The copy shares this event's data (QVariantMap is implicitly shared and the data is never
+ *       modified), so copying is cheap regardless of the size of the data.
 */
 TorcEvent* TorcEvent::Copy(void) const
 {
@@ -15,15 +15,15 @@ class TORC_CORE_PUBLIC TorcEvent : public QEvent
     TorcEvent(int Event, const QVariantMap Data = QVariantMap());
     virtual ~TorcEvent();
 
-    int          GetEvent (void);
-    QVariantMap& Data     (void);
-    TorcEvent*   Copy     (void) const;
+    int                GetEvent (void) const;
+    const QVariantMap& Data     (void) const;
+    TorcEvent*         Copy     (void) const;
 
     static       Type      TorcEventType;
 
   private:
-    int         m_event;
-    QVariantMap m_data;
+    int               m_event;
+    const QVariantMap m_data;
 };
 
 #endif // TORCEVENT_H
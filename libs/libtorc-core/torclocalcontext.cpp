@@ -26,7 +26,6 @@
 // Qt
 #include <QCoreApplication>
 #include <QReadWriteLock>
-#include <QSqlDatabase>
 #include <QThreadPool>
 #include <QDateTime>
 #include <QMutex>
@@ -40,7 +39,7 @@
 #include "torclogging.h"
 #include "torclanguage.h"
 #include "torcexitcodes.h"
-#include "torcsqlitedb.h"
+#include "torcdbwriter.h"
 #include "torcadminthread.h"
 #include "torcplugin.h"
 #include "torcpower.h"
@@ -78,7 +77,7 @@ class TorcLocalContextPriv
     QString GetUuid              (void);
 
     Torc::ApplicationFlags m_flags;
-    TorcSQLiteDB         *m_sqliteDB;
+    TorcDBWriterThread   *m_dbThread;
     QString               m_dbName;
     QMap<QString,QString> m_localSettings;
     QReadWriteLock       *m_localSettingsLock;
@@ -94,7 +93,7 @@ class TorcLocalContextPriv
 
 TorcLocalContextPriv::TorcLocalContextPriv(Torc::ApplicationFlags ApplicationFlags, TorcCommandLine *CommandLine)
   : m_flags(ApplicationFlags),
-    m_sqliteDB(NULL),
+    m_dbThread(NULL),
     m_dbName(QString("")),
     m_localSettingsLock(new QReadWriteLock(QReadWriteLock::Recursive)),
     m_preferencesLock(new QReadWriteLock(QReadWriteLock::Recursive)),
@@ -148,9 +147,14 @@ TorcLocalContextPriv::~TorcLocalContextPriv()
         gRootSetting = NULL;
     }
 
-    // delete the database connection(s)
-    delete m_sqliteDB;
-    m_sqliteDB = NULL;
+    // write any outstanding changes and close the database
+    if (m_dbThread)
+    {
+        m_dbThread->quit();
+        m_dbThread->wait();
+        delete m_dbThread;
+        m_dbThread = NULL;
+    }
 
     // delete settings lock
     delete m_localSettingsLock;
@@ -190,22 +194,15 @@ bool TorcLocalContextPriv::Init(void)
         if (m_dbName.isEmpty())
             m_dbName = configdir + "/" + QCoreApplication::applicationName() + "-settings.sqlite";
 
-        m_sqliteDB = new TorcSQLiteDB(m_dbName);
+        // the database is owned by its own thread, which also writes any changes
+        m_dbThread = new TorcDBWriterThread(m_dbName);
+        m_dbThread->start();
 
-        if (!m_sqliteDB || (m_sqliteDB && !m_sqliteDB->IsValid()))
+        // Load the settings and preferences
+        QWriteLocker settingslocker(m_localSettingsLock);
+        QWriteLocker preferenceslocker(m_preferencesLock);
+        if (!m_dbThread->WaitForDatabase(m_localSettings, m_preferences))
             return false;
-
-        // Load the settings
-        {
-            QWriteLocker locker(m_localSettingsLock);
-            m_sqliteDB->LoadSettings(m_localSettings);
-        }
-
-        // Load preferences
-        {
-            QWriteLocker locker(m_preferencesLock);
-            m_sqliteDB->LoadPreferences(m_preferences);
-        }
     }
     else
     {
@@ -258,16 +255,26 @@ QString TorcLocalContextPriv::GetSetting(const QString &Name,
             return m_localSettings.value(Name);
     }
 
-    SetSetting(Name, DefaultValue);
-    return DefaultValue;
+    // N.B. defaults are cached but not saved
+    QWriteLocker locker(m_localSettingsLock);
+    if (!m_localSettings.contains(Name))
+        m_localSettings.insert(Name, DefaultValue);
+    return m_localSettings.value(Name);
 }
 
+/*! \brief Update the setting Name.
+ *
+ * The in memory copy is updated immediately and the change is written to the database in the background.
+*/
 void TorcLocalContextPriv::SetSetting(const QString &Name, const QString &Value)
 {
-    QWriteLocker locker(m_localSettingsLock);
-    if (m_sqliteDB)
-        m_sqliteDB->SetSetting(Name, Value);
-    m_localSettings[Name] = Value;
+    {
+        QWriteLocker locker(m_localSettingsLock);
+        m_localSettings[Name] = Value;
+    }
+
+    if (m_dbThread)
+        m_dbThread->Writer()->SetSetting(Name, Value);
 }
 
 QString TorcLocalContextPriv::GetPreference(const QString &Name, const QString &DefaultValue)
@@ -277,21 +284,28 @@ QString TorcLocalContextPriv::GetPreference(const QString &Name, const QString &
 
         if (m_preferences.contains(Name))
             return m_preferences.value(Name);
-
-        if (m_preferences.contains(Name))
-            return m_preferences.value(Name);
     }
 
-    SetPreference(Name, DefaultValue);
-    return DefaultValue;
+    // N.B. defaults are cached but not saved
+    QWriteLocker locker(m_preferencesLock);
+    if (!m_preferences.contains(Name))
+        m_preferences.insert(Name, DefaultValue);
+    return m_preferences.value(Name);
 }
 
+/*! \brief Update the preference Name.
+ *
+ * The in memory copy is updated immediately and the change is written to the database in the background.
+*/
 void TorcLocalContextPriv::SetPreference(const QString &Name, const QString &Value)
 {
-    QWriteLocker locker(m_preferencesLock);
-    if (m_sqliteDB)
-        m_sqliteDB->SetPreference(Name, Value);
-    m_preferences[Name] = Value;
+    {
+        QWriteLocker locker(m_preferencesLock);
+        m_preferences[Name] = Value;
+    }
+
+    if (m_dbThread)
+        m_dbThread->Writer()->SetPreference(Name, Value);
 }
 
 QString TorcLocalContextPriv::GetUuid(void)
@@ -540,10 +554,13 @@ TorcLanguage* TorcLocalContext::GetLanguage(void)
     return m_priv->m_language;
 }
 
+/*! \brief Close any database connections opened by the current thread.
+ *
+ * \note The settings database is only accessed from its own thread (see TorcDBWriterThread), which
+ *       closes its connection when it exits. There is currently nothing to do for other threads.
+*/
 void TorcLocalContext::CloseDatabaseConnections(void)
 {
-    if (m_priv && m_priv->m_sqliteDB)
-        m_priv->m_sqliteDB->CloseThreadConnection();
 }
 
 /*! \brief Register a non-Torc QThread for logging and database access.
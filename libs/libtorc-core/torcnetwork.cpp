@@ -25,6 +25,7 @@
 #include "torclogging.h"
 #include "torcadminthread.h"
 #include "http/torchttprequest.h"
+#include "torcnetworkworker.h"
 #include "torcnetwork.h"
 #include "torccoreutils.h"
 
@@ -92,10 +93,14 @@ bool TorcNetwork::Get(TorcNetworkRequest* Request)
 {
     QMutexLocker locker(gNetworkLock);
 
-    if (gNetwork->IsOnline() && IsAllowedOutbound())
+    if (gNetwork && gNetwork->IsOnline() && IsAllowedOutbound())
     {
-        emit gNetwork->NewRequest(Request);
-        return true;
+        TorcNetworkWorker *worker = gNetwork->GetWorker(Request);
+        if (worker)
+        {
+            emit worker->NewRequest(Request);
+            return true;
+        }
     }
 
     return false;
@@ -104,16 +109,16 @@ bool TorcNetwork::Get(TorcNetworkRequest* Request)
 void TorcNetwork::Cancel(TorcNetworkRequest *Request)
 {
     QMutexLocker locker(gNetworkLock);
-    if (gNetwork)
-        emit gNetwork->CancelRequest(Request);
+    if (gNetwork && Request && Request->m_worker > -1 && Request->m_worker < gNetwork->m_threads.size())
+        emit gNetwork->m_threads.at(Request->m_worker)->Worker()->CancelRequest(Request);
 }
 
 void TorcNetwork::Poke(TorcNetworkRequest *Request)
 {
     QMutexLocker locker(gNetworkLock);
 
-    if (gNetwork)
-        emit gNetwork->PokeRequest(Request);
+    if (gNetwork && Request && Request->m_worker > -1 && Request->m_worker < gNetwork->m_threads.size())
+        emit gNetwork->m_threads.at(Request->m_worker)->Worker()->PokeRequest(Request);
 }
 
 /*! \brief Queue an asynchronous HTTP request.
@@ -141,10 +146,14 @@ bool TorcNetwork::GetAsynchronous(TorcNetworkRequest *Request, QObject *Parent)
 
     QMutexLocker locker(gNetworkLock);
 
-    if (gNetwork->IsOnline() && gNetwork->IsAllowedOutbound())
+    if (gNetwork && gNetwork->IsOnline() && gNetwork->IsAllowedOutbound())
     {
-        emit gNetwork->NewAsyncRequest(Request, Parent);
-        return true;
+        TorcNetworkWorker *worker = gNetwork->GetWorker(Request);
+        if (worker)
+        {
+            emit worker->NewAsyncRequest(Request, Parent);
+            return true;
+        }
     }
 
     return false;
@@ -314,17 +323,32 @@ QString ConfigurationTypeToString(QNetworkConfiguration::Type Type)
 }
 
 /*! \class TorcNetwork
- *  \brief Subclass of QNetworkAccessManager for sending network requests and monitoring the network state.
+ *  \brief Send network requests and monitor the network state.
+ *
+ * Requests are serviced by a small pool of TorcNetworkWorkers, each with its own QNetworkAccessManager
+ * and thread. Worker 0 handles general (non-streamed) requests and owns the HTTP cache. Streamed requests
+ * are assigned to the remaining NetworkThreads (default 2) workers by host, so that requests to the same
+ * server share connections and a slow server only affects the streams that use it. Streamed requests are
+ * also given a higher priority, both within the network stack and for the threads that service them.
  *
  * \todo Check whether authenticationRequired signal is being emitted.
 */
 TorcNetwork::TorcNetwork()
-  : QNetworkAccessManager(),
+  : QObject(),
     m_online(false),
     m_manager(new QNetworkConfigurationManager(this))
 {
     LOG(VB_GENERAL, LOG_INFO, "Opening network access manager");
 
+    // a general purpose (cached) worker and at least one worker for streamed requests
+    int streams = qBound(1, gLocalContext->GetSetting(TORC_CORE + "NetworkThreads", (int)2), 8);
+    for (int i = 0; i <= streams; ++i)
+    {
+        TorcNetworkThread *thread = new TorcNetworkThread(i, i == 0);
+        thread->start(i == 0 ? QThread::InheritPriority : QThread::HighPriority);
+        m_threads.append(thread);
+    }
+
     // create settings and establish correct behaviour
     m_networkGroup   = new TorcSettingGroup(gRootSetting, tr("Network"));
     m_networkAllowed = new TorcSetting(m_networkGroup, SETTING_NETWORKALLOWED,
@@ -368,27 +392,24 @@ TorcNetwork::TorcNetwork()
     connect(m_manager, SIGNAL(updateCompleted()),
             this,      SLOT(UpdateCompleted()));
 
-    connect(this, SIGNAL(NewRequest(TorcNetworkRequest*)),    this, SLOT(GetSafe(TorcNetworkRequest*)));
-    connect(this, SIGNAL(CancelRequest(TorcNetworkRequest*)), this, SLOT(CancelSafe(TorcNetworkRequest*)));
-    connect(this, SIGNAL(PokeRequest(TorcNetworkRequest*)),   this, SLOT(PokeSafe(TorcNetworkRequest*)));
-    connect(this, SIGNAL(NewAsyncRequest(TorcNetworkRequest*,QObject*)), this, SLOT(GetAsynchronousSafe(TorcNetworkRequest*,QObject*)));
-
-    // direct connection for authentication requests
-    connect(this, SIGNAL(authenticationRequired(QNetworkReply*,QAuthenticator*)), this, SLOT(Authenticate(QNetworkReply*,QAuthenticator*)), Qt::DirectConnection);
-
     // hide the network group if there is nothing to change
     m_networkGroup->SetActive(gLocalContext->FlagIsSet(Torc::Network));
 
     // set initial state
-    setConfiguration(m_manager->defaultConfiguration());
     SetAllowed(m_networkAllowed->IsActive() && m_networkAllowed->GetValue().toBool());
     UpdateConfiguration(true);
 }
 
 TorcNetwork::~TorcNetwork()
 {
-    // release any outstanding requests
-    CloseConnections();
+    // stop the workers - which releases any outstanding requests
+    foreach (TorcNetworkThread *thread, m_threads)
+    {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+    m_threads.clear();
 
     // remove settings
     if (m_networkAllowedInbound)
@@ -468,93 +489,11 @@ void TorcNetwork::SetAllowed(bool Allow)
         CloseConnections();
 
     gLocalContext->NotifyEvent(Allow ? Torc::NetworkEnabled : Torc::NetworkDisabled);
-    setNetworkAccessible(Allow ? Accessible : NotAccessible);
+    foreach (TorcNetworkThread *thread, m_threads)
+        QMetaObject::invokeMethod(thread->Worker(), "SetAccessible", Qt::QueuedConnection, Q_ARG(bool, Allow));
     LOG(VB_GENERAL, LOG_INFO, QString("Network access %1").arg(Allow ? "allowed" : "not allowed"));
 }
 
-void TorcNetwork::GetSafe(TorcNetworkRequest* Request)
-{
-    if (Request && m_online)
-    {
-        Request->UpRef();
-
-        // some servers require a recognised user agent...
-        Request->m_request.setRawHeader("User-Agent", DEFAULT_USER_AGENT);
-
-        QNetworkReply* reply = NULL;
-
-        if (Request->m_type == QNetworkAccessManager::GetOperation)
-            reply = get(Request->m_request);
-        else if (Request->m_type == QNetworkAccessManager::HeadOperation)
-            reply = head(Request->m_request);
-
-        if (!reply)
-        {
-            Request->DownRef();
-            LOG(VB_GENERAL, LOG_ERR, "Unknown request type");
-            return;
-        }
-
-        // join the dots
-        connect(reply, SIGNAL(readyRead()), this, SLOT(ReadyRead()));
-        connect(reply, SIGNAL(finished()),  this, SLOT(Finished()));
-        connect(reply, SIGNAL(downloadProgress(qint64, qint64)), this, SLOT(DownloadProgress(qint64,qint64)));
-        connect(reply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(Error(QNetworkReply::NetworkError)));
-        connect(reply, SIGNAL(sslErrors(const QList<QSslError> & )), this, SLOT(SSLErrors(const QList<QSslError> & )));
-
-        m_requests.insert(reply, Request);
-        m_reverseRequests.insert(Request, reply);
-    }
-}
-
-void TorcNetwork::CancelSafe(TorcNetworkRequest *Request)
-{
-    if (m_reverseRequests.contains(Request))
-    {
-        QNetworkReply* reply = m_reverseRequests.take(Request);
-        m_requests.remove(reply);
-        LOG(VB_NETWORK, LOG_INFO, QString("Cancelling '%1'").arg(reply->request().url().toString()));
-        reply->abort();
-        reply->deleteLater();
-        Request->DownRef();
-
-        if (m_asynchronousRequests.contains(Request))
-        {
-            QObject *parent = m_asynchronousRequests.take(Request);
-            if (!QMetaObject::invokeMethod(parent, "RequestReady", Qt::AutoConnection, Q_ARG(TorcNetworkRequest*, Request)))
-                LOG(VB_GENERAL, LOG_ERR, "Error sending RequestReady");
-        }
-    }
-    else
-    {
-        LOG(VB_GENERAL, LOG_ERR, "Trying to cancel unknown network request");
-    }
-}
-
-void TorcNetwork::PokeSafe(TorcNetworkRequest *Request)
-{
-    if (m_reverseRequests.contains(Request))
-        Request->Write(m_reverseRequests.value(Request));
-}
-
-void TorcNetwork::GetAsynchronousSafe(TorcNetworkRequest *Request, QObject *Parent)
-{
-    if (!Request || !Parent)
-        return;
-
-    if (m_asynchronousRequests.contains(Request))
-    {
-        LOG(VB_GENERAL, LOG_ERR, "Asynchronous request is already queued - ignoring");
-        return;
-    }
-
-    if (m_online)
-    {
-        m_asynchronousRequests.insert(Request, Parent);
-        GetSafe(Request);
-    }
-}
-
 void TorcNetwork::ConfigurationAdded(const QNetworkConfiguration &Config)
 {
     UpdateConfiguration();
@@ -580,188 +519,29 @@ void TorcNetwork::UpdateCompleted(void)
     UpdateConfiguration();
 }
 
-bool TorcNetwork::CheckHeaders(TorcNetworkRequest *Request, QNetworkReply *Reply)
-{
-    if (!Request || !Reply)
-        return false;
-
-    QVariant status = Reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
-    if (!status.isValid())
-        return true;
-
-    int httpstatus    = status.toInt();
-    int contentlength = 0;
-
-    // content length
-    QVariant length = Reply->header(QNetworkRequest::ContentLengthHeader);
-    if (length.isValid())
-    {
-        int size = length.toInt();
-        if (size > 0)
-            contentlength = size;
-    }
-
-    // content type
-    QVariant contenttype = Reply->header(QNetworkRequest::ContentTypeHeader);
-
-    if (Request->m_type == QNetworkAccessManager::HeadOperation)
-    {
-        // NB the following assumes the head request is checking for byte serving support
-
-        // some servers (yes - I'm talking to you Dropbox) don't allow HEAD requests for
-        // some files (secure redirections?). Furthermore they don't return a valid Allow list
-        // in the response, or in response to an OPTIONS request. We could go around in circles
-        // trying to check support in a number of ways, but just cut to the chase and issue
-        // a test range request (as they do actually support range requests)
-        if (httpstatus == HTTP_MethodNotAllowed)
-        {
-            // delete the reply and try again as a GET request with range
-            m_reverseRequests.remove(Request);
-            m_requests.remove(Reply);
-            Request->m_request.setUrl(Reply->request().url());
-            Request->m_type = QNetworkAccessManager::GetOperation;
-            Request->SetRange(0, 10);
-            Reply->abort();
-            Reply->deleteLater();
-            GetSafe(Request);
-            Request->DownRef();
-            return false;
-        }
-    }
-
-    Request->m_httpStatus = httpstatus;
-    Request->m_contentLength = contentlength;
-    Request->m_contentType = contenttype.isValid() ? contenttype.toString().toLower() : QString();
-    Request->m_byteServingAvailable = Reply->rawHeader("Accept-Ranges").toLower().contains("bytes") && contentlength > 0;
-    return true;
-}
-
-bool TorcNetwork::Redirected(TorcNetworkRequest *Request, QNetworkReply *Reply)
-{
-    if (!Request || !Reply)
-        return false;
-
-    QUrl newurl = Reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
-    QUrl oldurl = Request->m_request.url();
-
-    if (!newurl.isEmpty() && newurl != oldurl)
-    {
-        // redirected
-        if (newurl.isRelative())
-            newurl = oldurl.resolved(newurl);
-
-        LOG(VB_GENERAL, LOG_INFO, QString("Redirected from '%1' to '%2'").arg(oldurl.toString()).arg(newurl.toString()));
-        if (Request->m_redirectionCount++ < DEFAULT_MAX_REDIRECTIONS)
-        {
-            // delete the reply and create a new one
-            m_reverseRequests.remove(Request);
-            m_requests.remove(Reply);
-            Reply->abort();
-            Reply->deleteLater();
-            Request->m_request.setUrl(newurl);
-            GetSafe(Request);
-            Request->DownRef();
-            return true;
-        }
-        else
-        {
-            LOG(VB_GENERAL, LOG_WARNING, "Max redirections exceeded");
-        }
-    }
-
-    return false;
-}
-
-void TorcNetwork::ReadyRead(void)
-{
-    QNetworkReply *reply = dynamic_cast<QNetworkReply*>(sender());
-
-    if (reply && m_requests.contains(reply))
-    {
-        TorcNetworkRequest* request = m_requests.value(reply);
-        if (!request->m_started)
-        {
-            // check for redirection
-            if (Redirected(request, reply))
-                return;
-
-            // no need to check return value for GET requests
-            (void)CheckHeaders(request, reply);
-
-            // we need to set the buffer size after the download has started as Qt will ignore
-            // the set value if it doesn't yet know the expected size. Not ideal...
-            if (request->m_bufferSize)
-                reply->setReadBufferSize(request->m_bufferSize);
-
-            LOG(VB_GENERAL, LOG_INFO, "Download started");
-            request->m_started = true;
-        }
-
-        request->Write(reply);
-    }
-}
-
-void TorcNetwork::Finished(void)
-{
-    QNetworkReply *reply = dynamic_cast<QNetworkReply*>(sender());
-
-    if (reply && m_requests.contains(reply))
-    {
-        TorcNetworkRequest *request = m_requests.value(reply);
-
-        if (request->m_type == QNetworkAccessManager::HeadOperation)
-        {
-            // head requests never trigger a read request (no content), so check redirection on completion
-            if (Redirected(request, reply))
-                return;
-
-            // a false return value indicates the request has been resent (perhaps in another form)
-            if (!CheckHeaders(request, reply))
-                return;
-        }
-
-        request->m_replyFinished = true;
-
-        // we need to manage async requests
-        if (m_asynchronousRequests.contains(request))
-            CancelSafe(request);
-    }
-}
-
-void TorcNetwork::Error(QNetworkReply::NetworkError Code)
-{
-    QNetworkReply *reply = dynamic_cast<QNetworkReply*>(sender());
-
-    if (reply && m_requests.contains(reply))
-        if (Code != QNetworkReply::OperationCanceledError)
-            LOG(VB_GENERAL, LOG_ERR, QString("Network error '%1'").arg(reply->errorString()));
-}
-
-void TorcNetwork::SSLErrors(const QList<QSslError> &Errors)
+/*! \brief Select the worker for Request.
+ *
+ * General requests share the cached worker. Streamed requests are distributed by host across the
+ * remaining workers.
+*/
+TorcNetworkWorker* TorcNetwork::GetWorker(TorcNetworkRequest *Request)
 {
-    QNetworkReply *reply = dynamic_cast<QNetworkReply*>(sender());
-    if (reply)
-    {
-        // log the errors
-        foreach(QSslError error, Errors)
-            LOG(VB_GENERAL, LOG_WARNING, QString("SSL Error: %1").arg(error.errorString()));
-
-        // and ignore them for now!
-        reply->ignoreSslErrors();
-    }
-}
+    if (!Request || m_threads.isEmpty())
+        return NULL;
 
-void TorcNetwork::DownloadProgress(qint64 Received, qint64 Total)
-{
-    QNetworkReply *reply = dynamic_cast<QNetworkReply*>(sender());
+    int index = 0;
+    if (Request->m_bufferSize && m_threads.size() > 1)
+        index = 1 + (qHash(Request->m_request.url().host()) % (m_threads.size() - 1));
 
-    if (reply && m_requests.contains(reply))
-        m_requests.value(reply)->DownloadProgress(Received, Total);
+    Request->m_worker = index;
+    return m_threads.at(index)->Worker();
 }
 
-void TorcNetwork::Authenticate(QNetworkReply *Reply, QAuthenticator *Authenticator)
+///\brief Cancel all current network requests in each of the workers.
+void TorcNetwork::CloseConnections(void)
 {
-    LOG(VB_GENERAL, LOG_INFO, "Authentication required");
+    foreach (TorcNetworkThread *thread, m_threads)
+        QMetaObject::invokeMethod(thread->Worker(), "CloseConnections", Qt::QueuedConnection);
 }
 
 ///\brief Receives host name updates from QHostInfo
@@ -774,30 +554,6 @@ void TorcNetwork::NewHostName(const QHostInfo &Info)
     }
 }
 
-/*! \brief Cancel all current network requests.
- *
- * This method can be called when the TorcNetwork singleton is being destroyed, when network access has
- * been disallowed or when the network is down. It is reasonable to expect outstanding requests in the latter 2
- * cases but well behaved clients should have cancelled any requests in the first case. Hence we warn in this
- * instance.
- *
- * \note Command line applications currently do not run an admin thread and call QCoreApplication::quit to
- * close the application. In this specific case, the main event loop is no longer running when clients call
- * TorcNetwork::Cancel, the CancelRequest signal is never sent/received and requests may still be outstanding.
-*/
-void TorcNetwork::CloseConnections(void)
-{
-    if (!m_requests.isEmpty())
-        LOG(VB_GENERAL, LOG_WARNING, QString("%1 outstanding network requests").arg(m_requests.size()));
-
-    while (!m_requests.isEmpty())
-        CancelSafe(*m_requests.begin());
-
-    m_requests.clear();
-    m_reverseRequests.clear();
-    m_asynchronousRequests.clear();
-}
-
 void TorcNetwork::UpdateConfiguration(bool Creating)
 {
     QNetworkConfiguration configuration = m_manager->defaultConfiguration();
@@ -21,12 +21,14 @@
 #define DEFAULT_USER_AGENT           QByteArray("Wget/1.12 (linux-gnu))")
 
 class TorcNetworkRequest;
+class TorcNetworkWorker;
+class TorcNetworkThread;
 
 #define SETTING_NETWORKALLOWED         QString(TORC_CORE + "AllowNetwork")
 #define SETTING_NETWORKALLOWEDINBOUND  QString(TORC_CORE + "AllowInboundNetwork")
 #define SETTING_NETWORKALLOWEDOUTBOUND QString(TORC_CORE + "AllowOutboundNetwork")
 
-class TORC_CORE_PUBLIC TorcNetwork : QNetworkAccessManager
+class TORC_CORE_PUBLIC TorcNetwork : public QObject
 {
     friend class TorcNetworkObject;
 
@@ -53,12 +55,6 @@ class TORC_CORE_PUBLIC TorcNetwork : QNetworkAccessManager
     static bool IsExternal          (const QHostAddress &Address, bool IncludeLinkLocal = false);
     static bool IsGlobal            (const QHostAddress &Address);
 
-  signals:
-    void        NewRequest          (TorcNetworkRequest* Request);
-    void        CancelRequest       (TorcNetworkRequest* Request);
-    void        PokeRequest         (TorcNetworkRequest* Request);
-    void        NewAsyncRequest     (TorcNetworkRequest* Request, QObject *Parent);
-
   protected slots:
     // QNetworkConfigurationManager
     void    ConfigurationAdded      (const QNetworkConfiguration &Config);
@@ -67,26 +63,12 @@ class TORC_CORE_PUBLIC TorcNetwork : QNetworkAccessManager
     void    OnlineStateChanged      (bool  Online);
     void    UpdateCompleted         (void);
 
-    // QNetworkReply
-    void    ReadyRead               (void);
-    void    Finished                (void);
-    void    Error                   (QNetworkReply::NetworkError Code);
-    void    SSLErrors               (const QList<QSslError> &Errors);
-    void    DownloadProgress        (qint64 Received, qint64 Total);
-
-    // QNetworkAccessManager
-    void    Authenticate            (QNetworkReply* Reply, QAuthenticator* Authenticator);
-
     // QHostInfo
     void    NewHostName             (const QHostInfo &Info);
 
   private slots:
     // Torc
     void    SetAllowed              (bool Allow);
-    void    GetSafe                 (TorcNetworkRequest* Request);
-    void    CancelSafe              (TorcNetworkRequest* Request);
-    void    PokeSafe                (TorcNetworkRequest* Request);
-    void    GetAsynchronousSafe     (TorcNetworkRequest* Request, QObject *Parent);
 
   public:
     virtual ~TorcNetwork();
@@ -101,8 +83,7 @@ class TORC_CORE_PUBLIC TorcNetwork : QNetworkAccessManager
     bool    IsAllowedInboundPriv    (void);
     bool    IsAllowedOutboundPriv   (void);
     bool    IsOwnAddressPriv        (const QHostAddress &Address);
-    bool    CheckHeaders            (TorcNetworkRequest* Request, QNetworkReply *Reply);
-    bool    Redirected              (TorcNetworkRequest* Request, QNetworkReply *Reply);
+    TorcNetworkWorker* GetWorker    (TorcNetworkRequest* Request);
 
     void    CloseConnections        (void);
     void    UpdateConfiguration     (bool Creating = false);
@@ -116,13 +97,10 @@ class TORC_CORE_PUBLIC TorcNetwork : QNetworkAccessManager
     TorcSetting                     *m_networkAllowedInbound;
     TorcSetting                     *m_networkAllowedOutbound;
     QNetworkConfigurationManager    *m_manager;
+    QList<TorcNetworkThread*>        m_threads;
     QNetworkConfiguration            m_configuration;
     QNetworkInterface                m_interface;
     QStringList                      m_hostNames;
-
-    QMap<QNetworkReply*,TorcNetworkRequest*> m_requests;
-    QMap<TorcNetworkRequest*,QNetworkReply*> m_reverseRequests;
-    QMap<TorcNetworkRequest*,QObject*>       m_asynchronousRequests;
 };
 
 extern TORC_CORE_PUBLIC TorcNetwork *gNetwork;
@@ -21,16 +21,50 @@
 */
 
 // Torc
+#include "torclocalcontext.h"
 #include "torclogging.h"
 #include "torccoreutils.h"
 #include "torctimer.h"
+#include "torcsegmenteddownload.h"
 #include "torcnetworkbuffer.h"
 
+#include <errno.h>
+
+// probing limits - live streams are probed less aggressively as every byte read adds to start up latency
+#define STREAMED_PROBE_SIZE         (256 * 1024)
+#define STREAMED_ANALYZE_DURATION   1000000
+#define BUFFERED_PROBE_SIZE         (1024 * 1024)
+#define BUFFERED_ANALYZE_DURATION   2500000
+// the number of previous range requests retained for seeking back into
+#define MAX_PARKED_REQUESTS         2
+// how long to wait for a short forward seek to become available in the current request
+#define SEEK_WAIT_TIMEOUT           2000
+// only use segmented downloads for files larger than this
+#define SEGMENTED_MIN_SIZE          (8 * 1024 * 1024)
+
+/*! \class TorcNetworkBuffer
+ *  \brief A TorcBuffer for http, https and ftp resources.
+ *
+ * Media files that support byte serving are downloaded as streams (see TorcNetworkRequest).
+ *
+ * Seeks within, or a short distance beyond, the currently buffered data are handled by the current request.
+ * Longer seeks issue a new HTTP range request for the new position, which then reads ahead from that position.
+ * The previous request is not cancelled immediately but retained (up to MAX_PARKED_REQUESTS)
+ * together with its buffered data, so that demuxers that probe back and forth across a file (e.g.
+ * to read the moov atom at the end of an MP4 file) can return to an earlier position without
+ * another request.
+ *
+ * If NetworkSegmentedDownload is enabled, larger byte serving files are instead retrieved by TorcSegmentedDownload,
+ * using up to NetworkConnections concurrent range requests. If the server does not honour the range
+ * requests, the buffer falls back to a single (non-seekable) request.
+*/
+
 TorcNetworkBuffer::TorcNetworkBuffer(void *Parent, const QString &URI, bool Media, int *Abort)
   : TorcBuffer(Parent, URI, Abort),
     m_media(Media),
     m_type(Media ? Buffered : Unbuffered),
-    m_request(NULL)
+    m_request(NULL),
+    m_segmented(NULL)
 {
 }
 
@@ -53,7 +87,7 @@ bool TorcNetworkBuffer::Open(void)
     }
 
     // close existing connections just in case
-    if (m_request)
+    if (m_request || m_segmented)
     {
         LOG(VB_GENERAL, LOG_INFO, "Connection already open - closing before re-opening");
         Close();
@@ -66,6 +100,7 @@ bool TorcNetworkBuffer::Open(void)
     // and finally try and open
     m_state = Status_Opening;
     int buffersize = DEFAULT_STREAMED_BUFFER_SIZE;
+    qint64 size = -1;
 
     // can we use byte serving/streamed download for media files
     if (m_media && m_type == Buffered && QString::compare(url.scheme(), "ftp", Qt::CaseInsensitive) != 0)
@@ -89,8 +124,9 @@ bool TorcNetworkBuffer::Open(void)
                 }
 
                 // restrict the buffer size for small files
-                if (test->GetSize() > 0)
-                    buffersize = qMax(qint64(1024 * 1024), qMin((qint64)buffersize, test->GetSize()));
+                size = test->GetSize();
+                if (size > 0)
+                    buffersize = qMax(qint64(1024 * 1024), qMin((qint64)buffersize, size));
             }
 
             TorcNetwork::Cancel(test);
@@ -99,6 +135,25 @@ bool TorcNetworkBuffer::Open(void)
         test->DownRef();
     }
 
+    // use multiple connections for larger files
+    if (m_type == Streamed && size >= SEGMENTED_MIN_SIZE &&
+        gLocalContext->GetSetting(TORC_CORE + "NetworkSegmentedDownload", (bool)false))
+    {
+        int connections = gLocalContext->GetSetting(TORC_CORE + "NetworkConnections", (int)4);
+        m_segmented = new TorcSegmentedDownload(url, size, connections, m_abort);
+
+        if (m_segmented->Start(0))
+        {
+            LOG(VB_GENERAL, LOG_INFO, QString("Using segmented download (up to %1 connections)").arg(connections));
+            m_state = Status_Opened;
+            return TorcBuffer::Open();
+        }
+
+        LOG(VB_GENERAL, LOG_WARNING, "Failed to start segmented download");
+        delete m_segmented;
+        m_segmented = NULL;
+    }
+
     QNetworkRequest request(url);
     m_request = new TorcNetworkRequest(request, QNetworkAccessManager::GetOperation,
                                        m_type == Unbuffered ? 0 : buffersize, m_abort);
@@ -136,6 +191,16 @@ void TorcNetworkBuffer::Close(void)
     }
     m_request = NULL;
 
+    delete m_segmented;
+    m_segmented = NULL;
+
+    while (!m_parkedRequests.isEmpty())
+    {
+        TorcNetworkRequest *request = m_parkedRequests.takeFirst();
+        TorcNetwork::Cancel(request);
+        request->DownRef();
+    }
+
     m_state = Status_Closed;
 }
 
@@ -143,6 +208,37 @@ int TorcNetworkBuffer::Read(quint8 *Buffer, qint32 BufferSize)
 {
     int result = -1;
 
+    if (m_state == Status_Opened && m_segmented)
+    {
+        result = m_segmented->Read((char*)Buffer, BufferSize, NETWORK_TIMEOUT);
+        if (result != -EPROTONOSUPPORT)
+            return result;
+
+        // range requests are not honoured - revert to a single, unseekable, request.
+        // N.B. this is only possible if nothing has been read yet
+        qint64 position = m_segmented->GetPosition();
+        delete m_segmented;
+        m_segmented = NULL;
+
+        if (position > 0)
+            return -ECONNABORTED;
+
+        LOG(VB_GENERAL, LOG_WARNING, "Segmented download failed - reverting to a single connection");
+        m_type    = Buffered;
+        m_request = new TorcNetworkRequest(QNetworkRequest(QUrl(m_uri)), QNetworkAccessManager::GetOperation,
+                                           DEFAULT_STREAMED_BUFFER_SIZE, m_abort);
+        m_request->SetReadSize(DEFAULT_STREAMED_READ_SIZE);
+
+        if (!TorcNetwork::Get(m_request))
+        {
+            m_request->DownRef();
+            m_request = NULL;
+        }
+
+        if (!m_request)
+            return -ECONNABORTED;
+    }
+
     if (m_state == Status_Opened && m_request && m_type != Unbuffered)
         if ((result = m_request->Read((char*)Buffer, BufferSize, NETWORK_TIMEOUT)) > -1)
             return result;
@@ -155,6 +251,9 @@ int TorcNetworkBuffer::Read(quint8 *Buffer, qint32 BufferSize)
 
 int TorcNetworkBuffer::Peek(quint8 *Buffer, qint32 BufferSize)
 {
+    if (m_state == Status_Opened && m_segmented)
+        return m_segmented->Read((char*)Buffer, BufferSize, NETWORK_TIMEOUT, true);
+
     if (m_state == Status_Opened && m_request && m_type != Unbuffered)
         return m_request->Peek((char*)Buffer, BufferSize, NETWORK_TIMEOUT);
 
@@ -168,6 +267,22 @@ int64_t TorcNetworkBuffer::Seek(int64_t Offset, int Whence)
 
     int whence = Whence & ~AVSEEK_FORCE;
 
+    if (m_segmented && m_state == Status_Opened)
+    {
+        if (AVSEEK_SIZE == whence)
+            return m_segmented->GetSize();
+
+        qint64 newoffset = Offset;
+        if (SEEK_CUR == whence)
+            newoffset = m_segmented->GetPosition() + Offset;
+        else if (SEEK_END == whence)
+            newoffset = m_segmented->GetSize() + Offset;
+        else if (SEEK_SET != whence)
+            return -1;
+
+        return m_segmented->Seek(newoffset);
+    }
+
     if (m_request && m_state == Status_Opened )
     {
         if (AVSEEK_SIZE == whence)
@@ -183,35 +298,75 @@ int64_t TorcNetworkBuffer::Seek(int64_t Offset, int Whence)
             else if (SEEK_END == whence)
                 newoffset = m_request->GetSize() + Offset;
 
-            if (m_request->Seek(newoffset) > -1)
+            if (m_request->Seek(newoffset, SEEK_WAIT_TIMEOUT) > -1)
                 return m_request->GetPosition();
 
-            QNetworkRequest request(m_request->GetFinalURL());
-            int buffersize = qMax(qint64(1024 * 1024), qMin((qint64)DEFAULT_STREAMED_BUFFER_SIZE, m_request->GetSize() - newoffset));
-            TorcNetworkRequest *seek = new TorcNetworkRequest(request, QNetworkAccessManager::GetOperation, buffersize, m_abort);
-            seek->SetRange(newoffset);
-
-            if (TorcNetwork::Get(seek))
+            // check whether a previous request has the data buffered
+            for (int i = 0; i < m_parkedRequests.size(); ++i)
             {
-                if (seek->WaitForStart(NETWORK_TIMEOUT))
+                TorcNetworkRequest *parked = m_parkedRequests.at(i);
+                if (parked->Seek(newoffset) > -1)
                 {
-                    TorcNetwork::Cancel(m_request);
-                    m_request->DownRef();
-                    m_request = seek;
+                    LOG(VB_NETWORK, LOG_DEBUG, QString("Seek to %1 serviced by previous request").arg(newoffset));
+                    m_parkedRequests.removeAt(i);
+                    ParkRequest(m_request);
+                    m_request = parked;
                     return m_request->GetPosition();
                 }
+            }
 
-                TorcNetwork::Cancel(seek);
+            TorcNetworkRequest *seek = CreateRangeRequest(m_request->GetFinalURL(), newoffset, m_request->GetSize());
+            if (seek)
+            {
+                ParkRequest(m_request);
+                m_request = seek;
+                return m_request->GetPosition();
             }
 
             LOG(VB_GENERAL, LOG_INFO, "Seek failed");
-            seek->DownRef();
         }
     }
 
     return -1;
 }
 
+/// Create a streamed request for URL starting at Offset and wait for it to start.
+TorcNetworkRequest* TorcNetworkBuffer::CreateRangeRequest(const QUrl &URL, qint64 Offset, qint64 Size)
+{
+    QNetworkRequest request(URL);
+    int buffersize = qMax(qint64(1024 * 1024), qMin((qint64)DEFAULT_STREAMED_BUFFER_SIZE, Size - Offset));
+    TorcNetworkRequest *result = new TorcNetworkRequest(request, QNetworkAccessManager::GetOperation, buffersize, m_abort);
+    result->SetReadSize(DEFAULT_STREAMED_READ_SIZE);
+    result->SetRange(Offset);
+
+    if (TorcNetwork::Get(result))
+    {
+        if (result->WaitForStart(NETWORK_TIMEOUT))
+            return result;
+
+        TorcNetwork::Cancel(result);
+    }
+
+    result->DownRef();
+    return NULL;
+}
+
+/// Retain Request for later seeks, cancelling the least recently used request if necessary.
+void TorcNetworkBuffer::ParkRequest(TorcNetworkRequest *Request)
+{
+    if (!Request)
+        return;
+
+    m_parkedRequests.prepend(Request);
+
+    while (m_parkedRequests.size() > MAX_PARKED_REQUESTS)
+    {
+        TorcNetworkRequest *request = m_parkedRequests.takeLast();
+        TorcNetwork::Cancel(request);
+        request->DownRef();
+    }
+}
+
 QByteArray TorcNetworkBuffer::ReadAll(int Timeout)
 {
     if (m_request)
@@ -229,15 +384,19 @@ int TorcNetworkBuffer::Write(quint8 *Buffer, qint32 BufferSize)
 
 qint64 TorcNetworkBuffer::GetSize(void)
 {
+    if (m_segmented)
+        return m_segmented->GetSize();
     if (m_request)
-        m_request->GetSize();
+        return m_request->GetSize();
     return -1;
 }
 
 qint64 TorcNetworkBuffer::GetPosition(void)
 {
+    if (m_segmented)
+        return m_segmented->GetPosition();
     if (m_request)
-        m_request->GetPosition();
+        return m_request->GetPosition();
     return -1;
 }
 
@@ -248,6 +407,8 @@ bool TorcNetworkBuffer::IsSequential(void)
 
 qint64 TorcNetworkBuffer::BytesAvailable(void)
 {
+    if (m_segmented)
+        return m_segmented->BytesAvailable();
     if (m_request)
         return m_request->BytesAvailable();
     return -1;
@@ -258,11 +419,28 @@ int TorcNetworkBuffer::BestBufferSize(void)
     return DEFAULT_STREAMED_READ_SIZE;
 }
 
+int TorcNetworkBuffer::BestProbeSize(void)
+{
+    return m_type == Streamed ? STREAMED_PROBE_SIZE : BUFFERED_PROBE_SIZE;
+}
+
+qint64 TorcNetworkBuffer::BestAnalyzeDuration(void)
+{
+    return m_type == Streamed ? STREAMED_ANALYZE_DURATION : BUFFERED_ANALYZE_DURATION;
+}
+
 QString TorcNetworkBuffer::GetPath(void)
 {
     return m_path;
 }
 
+QString TorcNetworkBuffer::GetValidator(void)
+{
+    if (m_request && !m_segmented)
+        return m_request->GetValidator();
+    return QString();
+}
+
 class TorcNetworkBufferFactory : public TorcBufferFactory
 {
     void Score(const QString &URI, const QUrl &URL, int &Score, const bool &Media)
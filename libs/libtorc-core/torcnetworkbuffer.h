@@ -9,6 +9,8 @@
 #include "torcbuffer.h"
 #include "torcnetwork.h"
 
+class TorcSegmentedDownload;
+
 class TORC_CORE_PUBLIC TorcNetworkBuffer : public TorcBuffer
 {
   public:
@@ -35,12 +37,21 @@ class TORC_CORE_PUBLIC TorcNetworkBuffer : public TorcBuffer
     bool     IsSequential    (void);
     qint64   BytesAvailable  (void);
     int      BestBufferSize  (void);
+    int      BestProbeSize   (void);
+    qint64   BestAnalyzeDuration (void);
     QString  GetPath         (void);
+    QString  GetValidator    (void);
+
+  private:
+    void     ParkRequest     (TorcNetworkRequest *Request);
+    TorcNetworkRequest* CreateRangeRequest (const QUrl &URL, qint64 Offset, qint64 Size);
 
   private:
     bool                     m_media;
     Type                     m_type;
     TorcNetworkRequest      *m_request;
+    QList<TorcNetworkRequest*> m_parkedRequests;
+    TorcSegmentedDownload   *m_segmented;
 };
 
 #endif // TORCNETWORKBUFFER_H
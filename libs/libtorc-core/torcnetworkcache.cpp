@@ -0,0 +1,146 @@
+/* Class TorcNetworkCache
+*
+* This file is part of the Torc project.
+*
+* Copyright (C) Mark Kendall 2013
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+* USA.
+*/
+
+// Qt
+#include <QDir>
+
+// Torc
+#include "torclocalcontext.h"
+#include "torcdirectories.h"
+#include "torclogging.h"
+#include "torcnetworkcache.h"
+
+// QAbstractNetworkCache::clear is a public slot
+#define BLACKLIST QString("clear")
+
+/*! \class TorcNetworkCache
+ *  \brief A persistent HTTP cache for TorcNetwork.
+ *
+ * TorcNetworkCache is a QNetworkDiskCache, stored in the 'cache/network' configuration subdirectory and
+ * limited to NetworkCacheSize (default 50Mb). QNetworkAccessManager handles the Cache-Control, Expires,
+ * ETag and Last-Modified headers, serving fresh responses from the cache and revalidating stale responses
+ * with conditional requests.
+ *
+ * Streamed (media) downloads and range requests are never cached (see TorcNetworkWorker::GetSafe).
+ *
+ * Hit and miss counts are available via the 'cache' service (GetStatistics).
+ *
+ * \note QNetworkDiskCache is not thread safe and GetStatistics is called from HTTP server threads. The
+ *       current size is therefore recorded (in kilobytes) by the owning network thread whenever the cache
+ *       changes and GetStatistics never touches the underlying cache.
+*/
+TorcNetworkCache::TorcNetworkCache()
+  : QNetworkDiskCache(),
+    TorcHTTPService(this, "cache", "cache", TorcNetworkCache::staticMetaObject, BLACKLIST),
+    m_hits(0),
+    m_misses(0),
+    m_sizeKb(0),
+    m_maxSize(0)
+{
+    QString directory = GetTorcConfigDir() + "/cache/network";
+    QDir().mkpath(directory);
+    setCacheDirectory(directory);
+
+    int size = gLocalContext->GetSetting(TORC_CORE + "NetworkCacheSize", (int)50);
+    m_maxSize = (qint64)size * 1024 * 1024;
+    setMaximumCacheSize(m_maxSize);
+    UpdateSize();
+
+    LOG(VB_GENERAL, LOG_INFO, QString("Network cache: %1Kb used of %2Mb").arg(m_sizeKb.fetchAndAddOrdered(0)).arg(size));
+}
+
+TorcNetworkCache::~TorcNetworkCache()
+{
+    int hits   = m_hits.fetchAndAddOrdered(0);
+    int misses = m_misses.fetchAndAddOrdered(0);
+    if (hits + misses)
+        LOG(VB_GENERAL, LOG_INFO, QString("Network cache: %1 hits, %2 misses").arg(hits).arg(misses));
+}
+
+QString TorcNetworkCache::GetUIName(void)
+{
+    return tr("Network cache");
+}
+
+void TorcNetworkCache::SubscriberDeleted(QObject *Subscriber)
+{
+    TorcHTTPService::HandleSubscriberDeleted(Subscriber);
+}
+
+/// Record whether a cacheable request was answered from the cache.
+void TorcNetworkCache::RecordRequest(bool Hit)
+{
+    if (Hit)
+        m_hits.ref();
+    else
+        m_misses.ref();
+}
+
+void TorcNetworkCache::insert(QIODevice *Device)
+{
+    QNetworkDiskCache::insert(Device);
+    UpdateSize();
+}
+
+bool TorcNetworkCache::remove(const QUrl &Url)
+{
+    bool result = QNetworkDiskCache::remove(Url);
+    UpdateSize();
+    return result;
+}
+
+void TorcNetworkCache::clear(void)
+{
+    QNetworkDiskCache::clear();
+    UpdateSize();
+}
+
+qint64 TorcNetworkCache::expire(void)
+{
+    qint64 size = QNetworkDiskCache::expire();
+    m_sizeKb.fetchAndStoreOrdered((int)(size / 1024));
+    return size;
+}
+
+/// Record the current size of the cache. This must be called from the thread that owns the cache.
+void TorcNetworkCache::UpdateSize(void)
+{
+    m_sizeKb.fetchAndStoreOrdered((int)(cacheSize() / 1024));
+}
+
+/*! \brief Return hit, miss and size statistics for the cache.
+ *
+ * \note This is safe to call from any thread.
+*/
+QVariantMap TorcNetworkCache::GetStatistics(void)
+{
+    int hits   = m_hits.fetchAndAddOrdered(0);
+    int misses = m_misses.fetchAndAddOrdered(0);
+
+    QVariantMap result;
+    result.insert("hits",    hits);
+    result.insert("misses",  misses);
+    result.insert("hitRate", (hits + misses) ? (double)hits / (hits + misses) : 0.0);
+    result.insert("size",    (qint64)m_sizeKb.fetchAndAddOrdered(0) * 1024);
+    result.insert("maxSize", m_maxSize);
+    return result;
+}
@@ -0,0 +1,48 @@
+#ifndef TORCNETWORKCACHE_H
+#define TORCNETWORKCACHE_H
+
+// Qt
+#include <QAtomicInt>
+#include <QNetworkDiskCache>
+
+// Torc
+#include "torccoreexport.h"
+#include "http/torchttpservice.h"
+
+class TORC_CORE_PUBLIC TorcNetworkCache : public QNetworkDiskCache, public TorcHTTPService
+{
+    Q_OBJECT
+    Q_CLASSINFO("Version",       "1.0.0")
+    Q_CLASSINFO("GetStatistics", "type=statistics")
+
+  public:
+    TorcNetworkCache();
+    virtual ~TorcNetworkCache();
+
+    QString      GetUIName         (void);
+    void         RecordRequest     (bool Hit);
+
+    // QNetworkDiskCache
+    void         insert            (QIODevice *Device);
+    bool         remove            (const QUrl &Url);
+    void         clear             (void);
+
+  public slots:
+    void         SubscriberDeleted (QObject *Subscriber);
+
+    QVariantMap  GetStatistics     (void);
+
+  protected:
+    qint64       expire            (void);
+
+  private:
+    void         UpdateSize        (void);
+
+  private:
+    QAtomicInt   m_hits;
+    QAtomicInt   m_misses;
+    QAtomicInt   m_sizeKb;
+    qint64       m_maxSize;
+};
+
+#endif // TORCNETWORKCACHE_H
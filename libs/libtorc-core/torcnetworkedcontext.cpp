@@ -61,7 +61,7 @@ TorcNetworkService::TorcNetworkService(const QString &Name, const QString &UUID,
     m_abort(0),
     m_getPeerDetailsRPC(NULL),
     m_getPeerDetails(NULL),
-    m_webSocketThread(NULL),
+    m_webSocket(NULL),
     m_retryScheduled(false),
     m_retryInterval(10000)
 {
@@ -93,9 +93,11 @@ TorcNetworkService::~TorcNetworkService()
     // cancel any outstanding requests
     m_abort = 1;
 
-    if (m_getPeerDetailsRPC && m_webSocketThread)
+    // N.B. don't wait for the socket thread - the request is reference counted and no longer has a parent
+    if (m_getPeerDetailsRPC && m_webSocket)
     {
-        m_webSocketThread->Socket()->CancelRequest(m_getPeerDetailsRPC);
+        m_getPeerDetailsRPC->SetParent(NULL);
+        m_webSocket->CancelRequest(m_getPeerDetailsRPC, 0);
         m_getPeerDetailsRPC->DownRef();
         m_getPeerDetailsRPC = NULL;
     }
@@ -107,12 +109,11 @@ TorcNetworkService::~TorcNetworkService()
         m_getPeerDetails = NULL;
     }
 
-    // delete websocket
-    if (m_webSocketThread)
+    // release websocket
+    if (m_webSocket)
     {
-        m_webSocketThread->Shutdown();
-        delete m_webSocketThread;
-        m_webSocketThread = NULL;
+        TorcWebSocketPool::ReleaseSocket(m_webSocket);
+        m_webSocket = NULL;
     }
 }
 
@@ -149,7 +150,7 @@ void TorcNetworkService::Connect(void)
     }
 
     // already connected
-    if (m_webSocketThread)
+    if (m_webSocket)
     {
         // notify the parent that the connection is complete
         if (gNetworkedContext)
@@ -178,11 +179,11 @@ void TorcNetworkService::Connect(void)
 
     LOG(VB_GENERAL, LOG_INFO, QString("Trying to connect to %1").arg(m_debugString));
 
-    m_webSocketThread = new TorcWebSocketThread(m_addresses.at(m_preferredAddressIndex), port, true);
-    connect(m_webSocketThread,           SIGNAL(Finished()),              this, SLOT(Disconnected()));
-    connect(m_webSocketThread->Socket(), SIGNAL(ConnectionEstablished()), this, SLOT(Connected()));
+    m_webSocket = TorcWebSocketPool::CreateSocket(m_addresses.at(m_preferredAddressIndex), port, true);
+    connect(m_webSocket, SIGNAL(Disconnected()),          this, SLOT(Disconnected()));
+    connect(m_webSocket, SIGNAL(ConnectionEstablished()), this, SLOT(Connected()));
 
-    m_webSocketThread->start();
+    TorcWebSocketPool::StartSocket(m_webSocket);
 }
 
 QString TorcNetworkService::GetName(void)
@@ -233,7 +234,7 @@ bool TorcNetworkService::GetConnected(void)
 void TorcNetworkService::Connected(void)
 {
     TorcWebSocket *socket = static_cast<TorcWebSocket*>(sender());
-    if (m_webSocketThread && m_webSocketThread->Socket() == socket)
+    if (m_webSocket && m_webSocket == socket)
     {
         LOG(VB_GENERAL, LOG_INFO, QString("Connection established with %1").arg(m_debugString));
         Connect();
@@ -246,14 +247,12 @@ void TorcNetworkService::Connected(void)
 
 void TorcNetworkService::Disconnected(void)
 {
-    QThread *thread = static_cast<QThread*>(sender());
-    if (m_webSocketThread && m_webSocketThread == thread)
+    TorcWebSocket *socket = static_cast<TorcWebSocket*>(sender());
+    if (m_webSocket && m_webSocket == socket)
     {
         LOG(VB_GENERAL, LOG_INFO, QString("Connection with %1 closed").arg(m_debugString));
-        m_webSocketThread->quit();
-        m_webSocketThread->wait();
-        delete m_webSocketThread;
-        m_webSocketThread = NULL;
+        TorcWebSocketPool::ReleaseSocket(m_webSocket);
+        m_webSocket = NULL;
 
         // try and reconnect. If this is a discovered service, the socket was probably closed
         // deliberately and this object is about to be deleted anyway.
@@ -423,7 +422,7 @@ void TorcNetworkService::QueryPeerDetails(void)
 {
     // this is a private method only called from Connect. No need to validate m_addresses or current details.
 
-    if (!m_webSocketThread)
+    if (!m_webSocket)
     {
         if (m_getPeerDetails)
         {
@@ -464,7 +463,7 @@ void TorcNetworkService::CreateSocket(TorcHTTPRequest *Request, QTcpSocket *Sock
         return;
 
     // guard against incorrect use
-    if (m_webSocketThread)
+    if (m_webSocket)
     {
         LOG(VB_GENERAL, LOG_ERR, "Already have websocket - deleting new request");
         delete Request;
@@ -477,12 +476,11 @@ void TorcNetworkService::CreateSocket(TorcHTTPRequest *Request, QTcpSocket *Sock
     }
 
     // create the socket
-    m_webSocketThread = new TorcWebSocketThread(Request, Socket);
-    Socket->moveToThread(m_webSocketThread);
-    connect(m_webSocketThread,           SIGNAL(Finished()),              this, SLOT(Disconnected()));
-    connect(m_webSocketThread->Socket(), SIGNAL(ConnectionEstablished()), this, SLOT(Connected()));
+    m_webSocket = TorcWebSocketPool::CreateSocket(Request, Socket);
+    connect(m_webSocket, SIGNAL(Disconnected()),          this, SLOT(Disconnected()));
+    connect(m_webSocket, SIGNAL(ConnectionEstablished()), this, SLOT(Connected()));
 
-    m_webSocketThread->start();
+    TorcWebSocketPool::StartSocket(m_webSocket);
 }
 
 void TorcNetworkService::RemoteRequest(TorcRPCRequest *Request)
@@ -490,8 +488,8 @@ void TorcNetworkService::RemoteRequest(TorcRPCRequest *Request)
     if (!Request)
         return;
 
-    if (m_webSocketThread && m_webSocketThread->Socket())
-        m_webSocketThread->Socket()->RemoteRequest(Request);
+    if (m_webSocket)
+        m_webSocket->RemoteRequest(Request);
     else
         LOG(VB_GENERAL, LOG_ERR, "Cannot fulfill remote request - not connected");
 }
@@ -501,8 +499,9 @@ void TorcNetworkService::CancelRequest(TorcRPCRequest *Request)
     if (!Request)
         return;
 
-    if (m_webSocketThread && m_webSocketThread->Socket())
-        m_webSocketThread->Socket()->CancelRequest(Request);
+    // N.B. any wait is performed by the caller (see TorcNetworkedContext::CancelRequest)
+    if (m_webSocket)
+        m_webSocket->CancelRequest(Request, 0);
     else
         LOG(VB_GENERAL, LOG_ERR, "Cannot cancel request - not connected");
 }
@@ -516,6 +515,8 @@ QVariant TorcNetworkService::ToMap(void)
     result.insert("uiAddress", uiAddress);
     result.insert("address",   TorcNetwork::IPAddressToLiteral(m_addresses[m_preferredAddressIndex], 0));
     result.insert("host",      host);
+    if (m_webSocket)
+        result.insert("latency", m_webSocket->GetLatency());
     return result;
 }
 
@@ -583,8 +584,8 @@ TorcNetworkedContext::TorcNetworkedContext()
     m_discoveredServicesLock(new QReadWriteLock(QReadWriteLock::Recursive)),
     m_bonjourBrowserReference(0)
 {
-    // listen for events
-    gLocalContext->AddObserver(this);
+    // listen for service discovery events
+    gLocalContext->AddObserver(this, QList<int>() << Torc::ServiceDiscovered << Torc::ServiceWentAway);
 
     // connect signals
     connect(this, SIGNAL(NewRequest(QString,TorcRPCRequest*)), this, SLOT(HandleNewRequest(QString,TorcRPCRequest*)));
@@ -612,13 +613,14 @@ TorcNetworkedContext::TorcNetworkedContext()
         TorcSSDP::Search(TORC_ROOT_UPNP_DEVICE, this);
     }
 
-    TorcUPNPDescription upnp(QString("uuid:%1").arg(gLocalContext->GetUuid()), TORC_ROOT_UPNP_DEVICE, "LOCATION", 1000);
+    // the location is completed with the local address and web server port by TorcSSDP
+    TorcUPNPDescription upnp(QString("uuid:%1").arg(gLocalContext->GetUuid()), TORC_ROOT_UPNP_DEVICE, TORC_ROOT_UPNP_LOCATION, 1000);
     TorcSSDP::Announce(upnp);
 }
 
 TorcNetworkedContext::~TorcNetworkedContext()
 {
-    TorcUPNPDescription upnp(QString("uuid:%1").arg(gLocalContext->GetUuid()), TORC_ROOT_UPNP_DEVICE, "LOCATION", 1000);
+    TorcUPNPDescription upnp(QString("uuid:%1").arg(gLocalContext->GetUuid()), TORC_ROOT_UPNP_DEVICE, TORC_ROOT_UPNP_LOCATION, 1000);
     TorcSSDP::CancelAnnounce(upnp);
 
     // stoplistening
@@ -642,6 +644,9 @@ TorcNetworkedContext::~TorcNetworkedContext()
         while (!m_discoveredServices.isEmpty())
             delete m_discoveredServices.takeLast();
     }
+
+    // and stop the peer socket threads
+    TorcWebSocketPool::Shutdown();
 }
 
 QString TorcNetworkedContext::GetUIName(void)
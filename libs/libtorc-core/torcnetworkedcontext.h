@@ -13,7 +13,7 @@
 
 class TorcRPCRequest;
 class TorcNetworkRequest;
-class TorcWebSocketThread;
+class TorcWebSocket;
 class TorcHTTPRequest;
 class QTcpSocket;
 
@@ -105,7 +105,7 @@ class TORC_CORE_PUBLIC TorcNetworkService : public QObject
     int                     m_abort;
     TorcRPCRequest         *m_getPeerDetailsRPC;
     TorcNetworkRequest     *m_getPeerDetails;
-    TorcWebSocketThread    *m_webSocketThread;
+    TorcWebSocket          *m_webSocket;
     bool                    m_retryScheduled;
     int                     m_retryInterval;
 };
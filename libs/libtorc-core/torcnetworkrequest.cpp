@@ -29,6 +29,11 @@
 
 #include <errno.h>
 
+// the maximum distance beyond the downloaded data that Seek will wait for
+#define SEEK_WAIT_DISTANCE (512 * 1024)
+// the longest a reader will wait before re-checking the abort signal
+#define WAIT_INTERVAL      50
+
 /*! \class TorcNetworkRequest
  *  \brief A wrapper around QNetworkRequest
  *
@@ -47,12 +52,18 @@
  * For non-streamed requests, the complete download is copied to the internal buffer and can be
  * retrieved via ReadAll. Take care when downloading files of an unknown size.
  *
- * \todo Complete streamed support for seeking and peeking
+ * Readers block on a wait condition that is signalled by TorcNetwork (via WakeReaders) whenever
+ * new data is written, the download starts or the reply is finished. Read returns as soon as
+ * the lesser of the requested size and the preferred read size (SetReadSize) is available, so
+ * small reads (e.g. when probing) are not delayed waiting for a full buffer.
+ *
+ * \todo Complete streamed support for peeking
  * \todo Add user messaging for network errors
 */
 
 TorcNetworkRequest::TorcNetworkRequest(const QNetworkRequest Request, QNetworkAccessManager::Operation Type, int BufferSize, int *Abort)
   : m_type(Type),
+    m_worker(-1),
     m_abort(Abort),
     m_started(false),
     m_positionInFile(0),
@@ -116,12 +127,26 @@ bool TorcNetworkRequest::WaitForStart(int Timeout)
 {
     m_readTimer->Restart();
 
-    while (!m_started && !m_replyFinished && !(*m_abort))
-        QThread::usleep(50000);
+    QMutexLocker locker(&m_waitLock);
+    while (!m_started && !m_replyFinished && !(*m_abort) && (m_readTimer->Elapsed() < Timeout))
+        m_waitCondition.wait(&m_waitLock, WAIT_INTERVAL);
 
     return m_started || m_replyFinished;
 }
 
+/*! \brief Wake any thread waiting for data or a change in state.
+ *
+ * This is called by TorcNetwork once new data has been written or the request's state has changed.
+ * The lock is held whilst signalling, so a reader that has checked its wait condition cannot
+ * miss the wake up.
+*/
+void TorcNetworkRequest::WakeReaders(void)
+{
+    m_waitLock.lock();
+    m_waitCondition.wakeAll();
+    m_waitLock.unlock();
+}
+
 int TorcNetworkRequest::Peek(char *Buffer, qint32 BufferSize, int Timeout)
 {
     return Read(Buffer, BufferSize, Timeout, true);
@@ -130,15 +155,39 @@ int TorcNetworkRequest::Peek(char *Buffer, qint32 BufferSize, int Timeout)
 /*! \fn TorcNetworkRequest::Seek
  * If this is a streamed download, attempt to seek within the range
  * of what is currently buffered.
+ *
+ * If Timeout is non-zero and Offset is a short distance beyond what has already been downloaded,
+ * wait (for up to Timeout milliseconds) for the download to catch up. This is usually much quicker
+ * than issuing a new range request.
 */
-qint64 TorcNetworkRequest::Seek(qint64 Offset)
+qint64 TorcNetworkRequest::Seek(qint64 Offset, int Timeout)
 {
     // unbuffered
     if (!m_bufferSize)
         return -1;
 
+    // beyond currently downloaded but within a 'reasonable' distance
+    if (Timeout > 0 && Offset > (m_positionInFile + BytesAvailable()) &&
+        Offset - m_positionInFile <= qMin(m_writeBufferSize, SEEK_WAIT_DISTANCE))
+    {
+        m_readTimer->Restart();
+
+        QMutexLocker locker(&m_waitLock);
+        while ((Offset > (m_positionInFile + BytesAvailable())) && !(*m_abort) && (m_readTimer->Elapsed() < Timeout) &&
+               !(m_replyFinished && m_replyBytesAvailable == 0))
+        {
+            if (m_replyBytesAvailable && m_writeTimer->Elapsed() > 100)
+            {
+                locker.unlock();
+                gNetwork->Poke(this);
+                locker.relock();
+            }
+
+            m_waitCondition.wait(&m_waitLock, WAIT_INTERVAL);
+        }
+    }
+
     // beyond currently downloaded
-    // TODO wait if within a 'reasonable' distance
     if (Offset > (m_positionInFile + BytesAvailable()))
         return -1;
 
@@ -168,11 +217,22 @@ int TorcNetworkRequest::Read(char *Buffer, qint32 BufferSize, int Timeout, bool
 
     m_readTimer->Restart();
 
-    while ((BytesAvailable() < m_readSize) && !(*m_abort) && (m_readTimer->Elapsed() < Timeout) && !(m_replyFinished && m_replyBytesAvailable == 0))
+    // return as soon as enough data is available for this read
+    int wanted = qMax(1, qMin(m_readSize, (int)BufferSize));
+
     {
-        if (m_replyBytesAvailable && m_writeTimer->Elapsed() > 100)
-            gNetwork->Poke(this);
-        QThread::usleep(50000);
+        QMutexLocker locker(&m_waitLock);
+        while ((BytesAvailable() < wanted) && !(*m_abort) && (m_readTimer->Elapsed() < Timeout) && !(m_replyFinished && m_replyBytesAvailable == 0))
+        {
+            if (m_replyBytesAvailable && m_writeTimer->Elapsed() > 100)
+            {
+                locker.unlock();
+                gNetwork->Poke(this);
+                locker.relock();
+            }
+
+            m_waitCondition.wait(&m_waitLock, WAIT_INTERVAL);
+        }
     }
 
     if (*m_abort)
@@ -287,7 +347,7 @@ void TorcNetworkRequest::SetReadSize(int Size)
     m_readSize = Size;
 }
 
-void TorcNetworkRequest::SetRange(int Start, int End)
+void TorcNetworkRequest::SetRange(qint64 Start, qint64 End)
 {
     if (m_rangeStart != 0 || m_rangeEnd != 0)
     {
@@ -325,6 +385,16 @@ bool TorcNetworkRequest::CanByteServe(void)
     return m_byteServingAvailable;
 }
 
+bool TorcNetworkRequest::IsFinished(void)
+{
+    return m_replyFinished;
+}
+
+int TorcNetworkRequest::GetStatus(void)
+{
+    return m_httpStatus;
+}
+
 QUrl TorcNetworkRequest::GetFinalURL(void)
 {
     return m_request.url();
@@ -335,6 +405,15 @@ QString TorcNetworkRequest::GetContentType(void)
     return m_contentType;
 }
 
+/*! \brief Return the ETag (or, failing that, the Last-Modified date) of the reply.
+ *
+ * This identifies the version of the remote content and is empty if the server provided neither.
+*/
+QString TorcNetworkRequest::GetValidator(void)
+{
+    return m_validator;
+}
+
 QByteArray& TorcNetworkRequest::GetBuffer(void)
 {
     return m_buffer;
@@ -347,8 +426,11 @@ QByteArray TorcNetworkRequest::ReadAll(int Timeout)
 
     m_readTimer->Restart();
 
-    while (!(*m_abort) && (m_readTimer->Elapsed() < Timeout) && !m_replyFinished)
-        QThread::usleep(50000);
+    {
+        QMutexLocker locker(&m_waitLock);
+        while (!(*m_abort) && (m_readTimer->Elapsed() < Timeout) && !m_replyFinished)
+            m_waitCondition.wait(&m_waitLock, WAIT_INTERVAL);
+    }
 
     if (*m_abort)
         return QByteArray();
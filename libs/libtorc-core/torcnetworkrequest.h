@@ -2,7 +2,9 @@
 #define TORCNETWORKREQUEST_H
 
 // Qt
+#include <QMutex>
 #include <QMetaType>
+#include <QWaitCondition>
 
 // Torc
 #include "torcnetwork.h"
@@ -10,6 +12,7 @@
 class TorcNetworkRequest : public TorcReferenceCounter
 {
     friend class TorcNetwork;
+    friend class TorcNetworkWorker;
 
   public:
     TorcNetworkRequest(const QNetworkRequest Request, QNetworkAccessManager::Operation Type, int BufferSize, int *Abort);
@@ -17,22 +20,26 @@ class TorcNetworkRequest : public TorcReferenceCounter
     bool            WaitForStart      (int Timeout);
     int             Peek              (char* Buffer, qint32 BufferSize, int Timeout);
     int             Read              (char* Buffer, qint32 BufferSize, int Timeout, bool Peek = false);
-    qint64          Seek              (qint64 Offset);
+    qint64          Seek              (qint64 Offset, int Timeout = 0);
     QByteArray&     GetBuffer         (void);
     QByteArray      ReadAll           (int Timeout);
     int             BytesAvailable    (void);
     qint64          GetSize           (void);
     qint64          GetPosition       (void);
     void            SetReadSize       (int Size);
-    void            SetRange          (int Start, int End = 0);
+    void            SetRange          (qint64 Start, qint64 End = 0);
     void            DownloadProgress  (qint64 Received, qint64 Total);
     bool            CanByteServe      (void);
+    bool            IsFinished        (void);
+    int             GetStatus         (void);
     QUrl            GetFinalURL       (void);
     QString         GetContentType    (void);
+    QString         GetValidator      (void);
 
   protected:
     virtual ~TorcNetworkRequest();
     void            Write             (QNetworkReply *Reply);
+    void            WakeReaders       (void);
 
   private:
     bool            WritePriv         (QNetworkReply *Reply, char* Buffer, int Size);
@@ -40,6 +47,7 @@ class TorcNetworkRequest : public TorcReferenceCounter
   protected:
     // internal state/type
     QNetworkAccessManager::Operation m_type;
+    int             m_worker;
     int            *m_abort;
     bool            m_started;
     qint64          m_positionInFile;
@@ -55,6 +63,8 @@ class TorcNetworkRequest : public TorcReferenceCounter
     int             m_redirectionCount;
     TorcTimer      *m_readTimer;
     TorcTimer      *m_writeTimer;
+    QMutex          m_waitLock;
+    QWaitCondition  m_waitCondition;
 
     // QNetworkReply state
     bool            m_replyFinished;
@@ -64,11 +74,12 @@ class TorcNetworkRequest : public TorcReferenceCounter
 
     // request/reply details
     QNetworkRequest m_request;
-    int             m_rangeStart;
-    int             m_rangeEnd;
+    qint64          m_rangeStart;
+    qint64          m_rangeEnd;
     int             m_httpStatus;
     qint64          m_contentLength;
     QString         m_contentType;
+    QString         m_validator;
     bool            m_byteServingAvailable;
 };
 
@@ -0,0 +1,463 @@
+/* Class TorcNetworkWorker
+*
+* This file is part of the Torc project.
+*
+* Copyright (C) Mark Kendall 2013
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+* USA.
+*/
+
+// Torc
+#include "torclogging.h"
+#include "http/torchttprequest.h"
+#include "torcnetworkcache.h"
+#include "torcnetworkrequest.h"
+#include "torcnetworkworker.h"
+
+/*! \class TorcNetworkWorker
+ *  \brief A QNetworkAccessManager that services TorcNetworkRequests within its own thread.
+ *
+ * TorcNetwork owns a small pool of workers, each running in a TorcNetworkThread, so that network
+ * I/O is never serialised behind the admin thread's event loop and a slow server cannot delay
+ * other requests.
+ *
+ * Requests are queued to a worker via its NewRequest, CancelRequest, PokeRequest and NewAsyncRequest
+ * signals. A request remains with the same worker for its lifetime (including redirections).
+ *
+ * \note Only one worker has a TorcNetworkCache, as QNetworkDiskCache is not thread safe.
+ *
+ * \sa TorcNetwork
+ * \sa TorcNetworkThread
+*/
+TorcNetworkWorker::TorcNetworkWorker(int Index, bool Cached)
+  : QNetworkAccessManager(),
+    m_index(Index),
+    m_cache(NULL)
+{
+    connect(this, SIGNAL(NewRequest(TorcNetworkRequest*)),    this, SLOT(GetSafe(TorcNetworkRequest*)));
+    connect(this, SIGNAL(CancelRequest(TorcNetworkRequest*)), this, SLOT(CancelSafe(TorcNetworkRequest*)));
+    connect(this, SIGNAL(PokeRequest(TorcNetworkRequest*)),   this, SLOT(PokeSafe(TorcNetworkRequest*)));
+    connect(this, SIGNAL(NewAsyncRequest(TorcNetworkRequest*,QObject*)), this, SLOT(GetAsynchronousSafe(TorcNetworkRequest*,QObject*)));
+
+    // direct connection for authentication requests
+    connect(this, SIGNAL(authenticationRequired(QNetworkReply*,QAuthenticator*)), this, SLOT(Authenticate(QNetworkReply*,QAuthenticator*)), Qt::DirectConnection);
+
+    if (Cached)
+    {
+        // N.B. takes ownership of the cache
+        m_cache = new TorcNetworkCache();
+        setCache(m_cache);
+    }
+}
+
+TorcNetworkWorker::~TorcNetworkWorker()
+{
+    // release any outstanding requests
+    CloseConnections();
+}
+
+void TorcNetworkWorker::SetAccessible(bool Accessible)
+{
+    setNetworkAccessible(Accessible ? QNetworkAccessManager::Accessible : QNetworkAccessManager::NotAccessible);
+}
+
+void TorcNetworkWorker::GetSafe(TorcNetworkRequest* Request)
+{
+    if (Request)
+    {
+        Request->UpRef();
+
+        // some servers require a recognised user agent...
+        Request->m_request.setRawHeader("User-Agent", DEFAULT_USER_AGENT);
+
+        // streamed requests are time sensitive
+        if (Request->m_bufferSize)
+            Request->m_request.setPriority(QNetworkRequest::HighPriority);
+
+        // never cache streamed or partial downloads
+        if (Request->m_bufferSize || Request->m_request.hasRawHeader("Range"))
+        {
+            Request->m_request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::AlwaysNetwork);
+            Request->m_request.setAttribute(QNetworkRequest::CacheSaveControlAttribute, false);
+        }
+
+        QNetworkReply* reply = NULL;
+
+        if (Request->m_type == QNetworkAccessManager::GetOperation)
+            reply = get(Request->m_request);
+        else if (Request->m_type == QNetworkAccessManager::HeadOperation)
+            reply = head(Request->m_request);
+
+        if (!reply)
+        {
+            Request->DownRef();
+            LOG(VB_GENERAL, LOG_ERR, "Unknown request type");
+            return;
+        }
+
+        // join the dots
+        connect(reply, SIGNAL(readyRead()), this, SLOT(ReadyRead()));
+        connect(reply, SIGNAL(finished()),  this, SLOT(Finished()));
+        connect(reply, SIGNAL(downloadProgress(qint64, qint64)), this, SLOT(DownloadProgress(qint64,qint64)));
+        connect(reply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(Error(QNetworkReply::NetworkError)));
+        connect(reply, SIGNAL(sslErrors(const QList<QSslError> & )), this, SLOT(SSLErrors(const QList<QSslError> & )));
+
+        m_requests.insert(reply, Request);
+        m_reverseRequests.insert(Request, reply);
+    }
+}
+
+void TorcNetworkWorker::CancelSafe(TorcNetworkRequest *Request)
+{
+    if (m_reverseRequests.contains(Request))
+    {
+        QNetworkReply* reply = m_reverseRequests.take(Request);
+        m_requests.remove(reply);
+        LOG(VB_NETWORK, LOG_INFO, QString("Cancelling '%1'").arg(reply->request().url().toString()));
+        reply->abort();
+        reply->deleteLater();
+        Request->DownRef();
+
+        if (m_asynchronousRequests.contains(Request))
+        {
+            QObject *parent = m_asynchronousRequests.take(Request);
+            if (!QMetaObject::invokeMethod(parent, "RequestReady", Qt::AutoConnection, Q_ARG(TorcNetworkRequest*, Request)))
+                LOG(VB_GENERAL, LOG_ERR, "Error sending RequestReady");
+        }
+    }
+    else
+    {
+        LOG(VB_GENERAL, LOG_ERR, "Trying to cancel unknown network request");
+    }
+}
+
+void TorcNetworkWorker::PokeSafe(TorcNetworkRequest *Request)
+{
+    if (m_reverseRequests.contains(Request))
+    {
+        Request->Write(m_reverseRequests.value(Request));
+        Request->WakeReaders();
+    }
+}
+
+void TorcNetworkWorker::GetAsynchronousSafe(TorcNetworkRequest *Request, QObject *Parent)
+{
+    if (!Request || !Parent)
+        return;
+
+    if (m_asynchronousRequests.contains(Request))
+    {
+        LOG(VB_GENERAL, LOG_ERR, "Asynchronous request is already queued - ignoring");
+        return;
+    }
+
+    m_asynchronousRequests.insert(Request, Parent);
+    GetSafe(Request);
+}
+
+bool TorcNetworkWorker::CheckHeaders(TorcNetworkRequest *Request, QNetworkReply *Reply)
+{
+    if (!Request || !Reply)
+        return false;
+
+    QVariant status = Reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+    if (!status.isValid())
+        return true;
+
+    int httpstatus       = status.toInt();
+    qint64 contentlength = 0;
+
+    // content length
+    QVariant length = Reply->header(QNetworkRequest::ContentLengthHeader);
+    if (length.isValid())
+    {
+        qint64 size = length.toLongLong();
+        if (size > 0)
+            contentlength = size;
+    }
+
+    // for partial content, use the complete length (e.g. 'bytes 1000-1999/5000') if known
+    if (httpstatus == HTTP_PartialContent)
+    {
+        QByteArray range = Reply->rawHeader("Content-Range");
+        int index = range.lastIndexOf('/');
+        if (index > -1)
+        {
+            bool ok = false;
+            qint64 size = range.mid(index + 1).trimmed().toLongLong(&ok);
+            if (ok && size > 0)
+                contentlength = size;
+        }
+    }
+
+    // content type
+    QVariant contenttype = Reply->header(QNetworkRequest::ContentTypeHeader);
+
+    if (Request->m_type == QNetworkAccessManager::HeadOperation)
+    {
+        // NB the following assumes the head request is checking for byte serving support
+
+        // some servers (yes - I'm talking to you Dropbox) don't allow HEAD requests for
+        // some files (secure redirections?). Furthermore they don't return a valid Allow list
+        // in the response, or in response to an OPTIONS request. We could go around in circles
+        // trying to check support in a number of ways, but just cut to the chase and issue
+        // a test range request (as they do actually support range requests)
+        if (httpstatus == HTTP_MethodNotAllowed)
+        {
+            // delete the reply and try again as a GET request with range
+            m_reverseRequests.remove(Request);
+            m_requests.remove(Reply);
+            Request->m_request.setUrl(Reply->request().url());
+            Request->m_type = QNetworkAccessManager::GetOperation;
+            Request->SetRange(0, 10);
+            Reply->abort();
+            Reply->deleteLater();
+            GetSafe(Request);
+            Request->DownRef();
+            return false;
+        }
+    }
+
+    Request->m_httpStatus = httpstatus;
+    Request->m_contentLength = contentlength;
+    Request->m_contentType = contenttype.isValid() ? contenttype.toString().toLower() : QString();
+
+    // content version
+    QByteArray validator = Reply->rawHeader("ETag");
+    if (validator.isEmpty())
+        validator = Reply->rawHeader("Last-Modified");
+    Request->m_validator = QString::fromLatin1(validator.trimmed());
+
+    Request->m_byteServingAvailable = (httpstatus == HTTP_PartialContent ||
+                                       Reply->rawHeader("Accept-Ranges").toLower().contains("bytes")) && contentlength > 0;
+    return true;
+}
+
+bool TorcNetworkWorker::Redirected(TorcNetworkRequest *Request, QNetworkReply *Reply)
+{
+    if (!Request || !Reply)
+        return false;
+
+    QUrl newurl = Reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
+    QUrl oldurl = Request->m_request.url();
+
+    if (!newurl.isEmpty() && newurl != oldurl)
+    {
+        // redirected
+        if (newurl.isRelative())
+            newurl = oldurl.resolved(newurl);
+
+        LOG(VB_GENERAL, LOG_INFO, QString("Redirected from '%1' to '%2'").arg(oldurl.toString()).arg(newurl.toString()));
+        if (Request->m_redirectionCount++ < DEFAULT_MAX_REDIRECTIONS)
+        {
+            // delete the reply and create a new one
+            m_reverseRequests.remove(Request);
+            m_requests.remove(Reply);
+            Reply->abort();
+            Reply->deleteLater();
+            Request->m_request.setUrl(newurl);
+            GetSafe(Request);
+            Request->DownRef();
+            return true;
+        }
+        else
+        {
+            LOG(VB_GENERAL, LOG_WARNING, "Max redirections exceeded");
+        }
+    }
+
+    return false;
+}
+
+void TorcNetworkWorker::ReadyRead(void)
+{
+    QNetworkReply *reply = dynamic_cast<QNetworkReply*>(sender());
+
+    if (reply && m_requests.contains(reply))
+    {
+        TorcNetworkRequest* request = m_requests.value(reply);
+        if (!request->m_started)
+        {
+            // check for redirection
+            if (Redirected(request, reply))
+                return;
+
+            // no need to check return value for GET requests
+            (void)CheckHeaders(request, reply);
+
+            // we need to set the buffer size after the download has started as Qt will ignore
+            // the set value if it doesn't yet know the expected size. Not ideal...
+            if (request->m_bufferSize)
+                reply->setReadBufferSize(request->m_bufferSize);
+
+            LOG(VB_GENERAL, LOG_INFO, "Download started");
+            request->m_started = true;
+        }
+
+        request->Write(reply);
+        request->WakeReaders();
+    }
+}
+
+void TorcNetworkWorker::Finished(void)
+{
+    QNetworkReply *reply = dynamic_cast<QNetworkReply*>(sender());
+
+    if (reply && m_requests.contains(reply))
+    {
+        TorcNetworkRequest *request = m_requests.value(reply);
+
+        if (request->m_type == QNetworkAccessManager::HeadOperation)
+        {
+            // head requests never trigger a read request (no content), so check redirection on completion
+            if (Redirected(request, reply))
+                return;
+
+            // a false return value indicates the request has been resent (perhaps in another form)
+            if (!CheckHeaders(request, reply))
+                return;
+        }
+
+        request->m_replyFinished = true;
+        request->WakeReaders();
+
+        if (m_cache && request->m_type == QNetworkAccessManager::GetOperation && !request->m_bufferSize &&
+            reply->request().attribute(QNetworkRequest::CacheSaveControlAttribute, true).toBool())
+        {
+            m_cache->RecordRequest(reply->attribute(QNetworkRequest::SourceIsFromCacheAttribute).toBool());
+        }
+
+        // we need to manage async requests
+        if (m_asynchronousRequests.contains(request))
+            CancelSafe(request);
+    }
+}
+
+void TorcNetworkWorker::Error(QNetworkReply::NetworkError Code)
+{
+    QNetworkReply *reply = dynamic_cast<QNetworkReply*>(sender());
+
+    if (reply && m_requests.contains(reply))
+        if (Code != QNetworkReply::OperationCanceledError)
+            LOG(VB_GENERAL, LOG_ERR, QString("Network error '%1'").arg(reply->errorString()));
+}
+
+void TorcNetworkWorker::SSLErrors(const QList<QSslError> &Errors)
+{
+    QNetworkReply *reply = dynamic_cast<QNetworkReply*>(sender());
+    if (reply)
+    {
+        // log the errors
+        foreach(QSslError error, Errors)
+            LOG(VB_GENERAL, LOG_WARNING, QString("SSL Error: %1").arg(error.errorString()));
+
+        // and ignore them for now!
+        reply->ignoreSslErrors();
+    }
+}
+
+void TorcNetworkWorker::DownloadProgress(qint64 Received, qint64 Total)
+{
+    QNetworkReply *reply = dynamic_cast<QNetworkReply*>(sender());
+
+    if (reply && m_requests.contains(reply))
+        m_requests.value(reply)->DownloadProgress(Received, Total);
+}
+
+void TorcNetworkWorker::Authenticate(QNetworkReply *Reply, QAuthenticator *Authenticator)
+{
+    LOG(VB_GENERAL, LOG_INFO, "Authentication required");
+}
+
+/*! \brief Cancel all current network requests.
+ *
+ * This method can be called when the worker is being destroyed, when network access has
+ * been disallowed or when the network is down. It is reasonable to expect outstanding requests in the latter 2
+ * cases but well behaved clients should have cancelled any requests in the first case. Hence we warn in this
+ * instance.
+*/
+void TorcNetworkWorker::CloseConnections(void)
+{
+    if (!m_requests.isEmpty())
+        LOG(VB_GENERAL, LOG_WARNING, QString("%1 outstanding network requests (worker %2)").arg(m_requests.size()).arg(m_index));
+
+    while (!m_requests.isEmpty())
+        CancelSafe(*m_requests.begin());
+
+    m_requests.clear();
+    m_reverseRequests.clear();
+    m_asynchronousRequests.clear();
+}
+
+/*! \class TorcNetworkThread
+ *  \brief Runs a TorcNetworkWorker in its own thread.
+ *
+ * The worker (and hence the QNetworkAccessManager and its internal objects) is created and deleted
+ * within the thread. Worker blocks until the worker has been created.
+*/
+TorcNetworkThread::TorcNetworkThread(int Index, bool Cached)
+  : TorcQThread(QString("Network%1").arg(Index)),
+    m_index(Index),
+    m_cached(Cached),
+    m_worker(NULL),
+    m_ready(false)
+{
+}
+
+TorcNetworkThread::~TorcNetworkThread()
+{
+    // N.B. the worker should have been deleted in Finish
+    delete m_worker;
+    m_worker = NULL;
+}
+
+/// Return the worker, waiting for the thread to create it if necessary.
+TorcNetworkWorker* TorcNetworkThread::Worker(void)
+{
+    QMutexLocker locker(&m_readyLock);
+    while (!m_ready)
+        m_readyCondition.wait(&m_readyLock);
+
+    return m_worker;
+}
+
+void TorcNetworkThread::Start(void)
+{
+    LOG(VB_GENERAL, LOG_INFO, "Network thread starting");
+
+    TorcNetworkWorker *worker = new TorcNetworkWorker(m_index, m_cached);
+
+    QMutexLocker locker(&m_readyLock);
+    m_worker = worker;
+    m_ready  = true;
+    m_readyCondition.wakeAll();
+}
+
+void TorcNetworkThread::Finish(void)
+{
+    // delete the worker (and any outstanding replies) in its own thread
+    TorcNetworkWorker *worker = NULL;
+
+    {
+        QMutexLocker locker(&m_readyLock);
+        worker   = m_worker;
+        m_worker = NULL;
+    }
+
+    delete worker;
+
+    LOG(VB_GENERAL, LOG_INFO, "Network thread stopping");
+}
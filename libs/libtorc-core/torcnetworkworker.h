@@ -0,0 +1,84 @@
+#ifndef TORCNETWORKWORKER_H
+#define TORCNETWORKWORKER_H
+
+// Qt
+#include <QMutex>
+#include <QtNetwork>
+#include <QWaitCondition>
+
+// Torc
+#include "torcqthread.h"
+
+class TorcNetworkRequest;
+class TorcNetworkCache;
+
+class TorcNetworkWorker : public QNetworkAccessManager
+{
+    Q_OBJECT
+
+  public:
+    TorcNetworkWorker(int Index, bool Cached);
+    virtual ~TorcNetworkWorker();
+
+  signals:
+    void    NewRequest              (TorcNetworkRequest* Request);
+    void    CancelRequest           (TorcNetworkRequest* Request);
+    void    PokeRequest             (TorcNetworkRequest* Request);
+    void    NewAsyncRequest         (TorcNetworkRequest* Request, QObject *Parent);
+
+  public slots:
+    void    SetAccessible           (bool Accessible);
+    void    CloseConnections        (void);
+
+  protected slots:
+    // QNetworkReply
+    void    ReadyRead               (void);
+    void    Finished                (void);
+    void    Error                   (QNetworkReply::NetworkError Code);
+    void    SSLErrors               (const QList<QSslError> &Errors);
+    void    DownloadProgress        (qint64 Received, qint64 Total);
+
+    // QNetworkAccessManager
+    void    Authenticate            (QNetworkReply* Reply, QAuthenticator* Authenticator);
+
+  private slots:
+    void    GetSafe                 (TorcNetworkRequest* Request);
+    void    CancelSafe              (TorcNetworkRequest* Request);
+    void    PokeSafe                (TorcNetworkRequest* Request);
+    void    GetAsynchronousSafe     (TorcNetworkRequest* Request, QObject *Parent);
+
+  protected:
+    bool    CheckHeaders            (TorcNetworkRequest* Request, QNetworkReply *Reply);
+    bool    Redirected              (TorcNetworkRequest* Request, QNetworkReply *Reply);
+
+  private:
+    int                              m_index;
+    TorcNetworkCache                *m_cache;
+
+    QMap<QNetworkReply*,TorcNetworkRequest*> m_requests;
+    QMap<TorcNetworkRequest*,QNetworkReply*> m_reverseRequests;
+    QMap<TorcNetworkRequest*,QObject*>       m_asynchronousRequests;
+};
+
+class TorcNetworkThread : public TorcQThread
+{
+    Q_OBJECT
+
+  public:
+    TorcNetworkThread(int Index, bool Cached);
+    virtual ~TorcNetworkThread();
+
+    TorcNetworkWorker* Worker       (void);
+    void               Start        (void);
+    void               Finish       (void);
+
+  private:
+    int                m_index;
+    bool               m_cached;
+    TorcNetworkWorker *m_worker;
+    QMutex             m_readyLock;
+    QWaitCondition     m_readyCondition;
+    bool               m_ready;
+};
+
+#endif // TORCNETWORKWORKER_H
@@ -31,7 +31,8 @@
  *  \brief TorcObservable will send event notifcations to registered 'listeners'.
  *
  * Classes that inherit from TorcObserval can notify registered listeners of important
- * events via the Notify method.
+ * events via the Notify method. Listeners may register for all events or for a specific
+ * list of events.
  *
  * This should only be used by classes that expect a more complex interaction with dependent objects. For
  * simple use cases (i.e. a small number of events and/or a small number of listeners), direct eventing or
@@ -47,28 +48,55 @@ TorcObservable::~TorcObservable()
     delete m_observerLock;
 }
 
-///brief Register the given object to receive events.
-void TorcObservable::AddObserver(QObject *Observer)
+/*! \brief Register the given object to receive events.
+ *
+ * If Events is empty, Observer receives every event. Otherwise it only receives the listed events,
+ * which avoids waking the observer's thread for events it will ignore. Calling AddObserver again
+ * replaces the existing registration.
+*/
+void TorcObservable::AddObserver(QObject *Observer, const QList<int> &Events)
 {
+    if (!Observer)
+        return;
+
     QMutexLocker locker(m_observerLock);
-    if (!Observer || m_observers.contains(Observer))
+    RemoveObserver(Observer);
+
+    if (Events.isEmpty())
+    {
+        m_observers.append(Observer);
         return;
-    m_observers.append(Observer);
+    }
+
+    foreach (int event, Events)
+        if (!m_eventObservers.contains(event, Observer))
+            m_eventObservers.insert(event, Observer);
 }
 
 ///brief Deregister the given object.
 void TorcObservable::RemoveObserver(QObject *Observer)
 {
     QMutexLocker locker(m_observerLock);
-    while (m_observers.contains(Observer))
-        m_observers.removeOne(Observer);
+    m_observers.removeAll(Observer);
+
+    QMutableHashIterator<int,QObject*> it(m_eventObservers);
+    while (it.hasNext())
+        if (it.next().value() == Observer)
+            it.remove();
 }
 
-///Brief Send the given event to each registered listener/observer.
+/*! \brief Send the given event to each registered listener/observer.
+ *
+ * Each observer receives its own (cheap) copy of Event - the event data is shared.
+*/
 void TorcObservable::Notify(const TorcEvent &Event)
 {
     QMutexLocker locker(m_observerLock);
 
     foreach (QObject* observer, m_observers)
         QCoreApplication::postEvent(observer, Event.Copy());
+
+    QMultiHash<int,QObject*>::const_iterator it = m_eventObservers.constFind(Event.GetEvent());
+    for ( ; it != m_eventObservers.constEnd() && it.key() == Event.GetEvent(); ++it)
+        QCoreApplication::postEvent(it.value(), Event.Copy());
 }
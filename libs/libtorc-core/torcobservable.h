@@ -5,6 +5,10 @@
 #include "torccoreexport.h"
 #include "torcevent.h"
 
+// Qt
+#include <QHash>
+#include <QList>
+
 class QObject;
 class QMutex;
 
@@ -14,13 +18,14 @@ class TORC_CORE_PUBLIC TorcObservable
     TorcObservable();
     virtual ~TorcObservable();
 
-    void            AddObserver    (QObject* Observer);
+    void            AddObserver    (QObject* Observer, const QList<int> &Events = QList<int>());
     void            RemoveObserver (QObject* Observer);
     void            Notify         (const TorcEvent &Event);
 
   private:
     QMutex         *m_observerLock;
     QList<QObject*> m_observers;
+    QMultiHash<int,QObject*> m_eventObservers;
 };
 
 #endif // TORCOBSERVABLE_H
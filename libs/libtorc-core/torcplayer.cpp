@@ -38,6 +38,7 @@
 #define DECODER_START_TIMEOUT 20000
 #define DECODER_STOP_TIMEOUT  3000
 #define DECODER_PAUSE_TIMEOUT 1000
+#define DEFAULT_GAPLESS_PREROLL 10
 
 TorcSetting* TorcPlayer::gAudioSettings = NULL;
 TorcSetting* TorcPlayer::gVideoSettings = NULL;
@@ -97,6 +98,10 @@ class TorcPlayerSettings : public TorcAdminObject
   * \brief The base media player class for Torc.
   *
   * TorcPlayer is the base media player implementation.
+  *
+  * A single item may be queued (QueueMedia) to follow the current one. Its decoder is opened and
+  * prerolled a configurable number of seconds (CORE_GaplessPreroll, default 10) before the current
+  * item ends and is started as soon as the current decoder stops, without closing the audio device.
  */
 
 TorcPlayer* TorcPlayer::Create(QObject* Parent, int PlaybackFlags, int DecoderFlags)
@@ -177,6 +182,10 @@ TorcPlayer::TorcPlayer(QObject *Parent, int PlaybackFlags, int DecoderFlags)
     m_nextDecoder(NULL),
     m_nextDecoderPlay(false),
     m_nextDecoderStartTimer(0),
+    m_queuedUri(QString()),
+    m_nextDecoderGapless(false),
+    m_nextDecoderPrerolled(false),
+    m_gaplessPreroll(DEFAULT_GAPLESS_PREROLL),
     m_oldDecoder(NULL),
     m_oldDecoderStopTimer(0)
 {
@@ -189,6 +198,8 @@ TorcPlayer::TorcPlayer(QObject *Parent, int PlaybackFlags, int DecoderFlags)
         qRegisterMetaType<TorcPlayer::PlayerState>("TorcPlayer::PlayerState");
         registered = true;
     }
+
+    m_gaplessPreroll = gLocalContext->GetSetting(TORC_CORE + "GaplessPreroll", (int)DEFAULT_GAPLESS_PREROLL);
 }
 
 TorcPlayer::~TorcPlayer()
@@ -214,9 +225,12 @@ void TorcPlayer::Teardown(void)
     // reset state
     m_uri       = QString();
     m_nextUri   = QString();
+    m_queuedUri = QString();
     m_nextState = None;
     m_speed     = 0.0;
     m_switching = false;
+    m_nextDecoderGapless   = false;
+    m_nextDecoderPrerolled = false;
 }
 
 void TorcPlayer::Reset(void)
@@ -320,6 +334,20 @@ bool TorcPlayer::PlayMedia(const QString &URI, bool StartPaused)
         return false;
     }
 
+    // an explicit request overrides anything queued
+    m_queuedUri = QString();
+    if (m_nextDecoderGapless)
+    {
+        if (m_decoder)
+            m_decoder->SetGapless(false);
+        delete m_nextDecoder;
+        m_nextDecoder          = NULL;
+        m_nextUri              = QString();
+        m_nextDecoderGapless   = false;
+        m_nextDecoderPrerolled = false;
+        KillTimer(m_nextDecoderStartTimer);
+    }
+
     if (!m_decoder)
         SetState(Opening);
 
@@ -352,6 +380,107 @@ bool TorcPlayer::PlayMedia(const QString &URI, bool StartPaused)
     return true;
 }
 
+/*! \brief Queue URI to be played, without a gap, when the current item finishes.
+ *
+ * If nothing is playing, this is equivalent to PlayMedia.
+*/
+bool TorcPlayer::QueueMedia(const QString &URI)
+{
+    if (thread() != QThread::currentThread())
+    {
+        QVariantMap data;
+        data.insert("uri", URI);
+        data.insert("queue", true);
+        TorcEvent *event = new TorcEvent(Torc::PlayMedia, data);
+        QCoreApplication::postEvent(m_parent, event);
+        return true;
+    }
+
+    if (URI.isEmpty())
+        return false;
+
+    if (!m_decoder || m_state == Stopped || m_state == Errored)
+        return PlayMedia(URI, false);
+
+    // replace anything already queued
+    if (m_nextDecoderGapless)
+    {
+        m_decoder->SetGapless(false);
+        delete m_nextDecoder;
+        m_nextDecoder          = NULL;
+        m_nextUri              = QString();
+        m_nextDecoderGapless   = false;
+        m_nextDecoderPrerolled = false;
+        KillTimer(m_nextDecoderStartTimer);
+    }
+
+    LOG(VB_GENERAL, LOG_INFO, QString("Queued '%1'").arg(URI));
+    m_queuedUri = URI;
+    return true;
+}
+
+/*! \brief Open the decoder for the queued item if the current item is close to finishing.
+*/
+void TorcPlayer::OpenQueuedDecoder(void)
+{
+    if (m_queuedUri.isEmpty() || m_nextDecoder || m_switching || !m_decoder || m_state != Playing)
+        return;
+
+    double duration = m_decoder->GetDuration();
+    if (duration <= 0.0 || (duration - m_decoder->GetPosition()) > m_gaplessPreroll)
+        return;
+
+    QString uri = m_queuedUri;
+    m_queuedUri = QString();
+
+    m_nextDecoder = TorcDecoder::Create(m_decoderFlags, uri, this);
+    if (m_nextDecoder)
+        m_nextDecoder->Preroll();
+
+    if (!m_nextDecoder || !m_nextDecoder->Open())
+    {
+        LOG(VB_GENERAL, LOG_ERR, QString("Failed to open decoder for queued item '%1'").arg(uri));
+        delete m_nextDecoder;
+        m_nextDecoder = NULL;
+        return;
+    }
+
+    LOG(VB_GENERAL, LOG_INFO, QString("Opened decoder for queued item '%1'").arg(uri));
+    m_nextUri              = uri;
+    m_nextDecoderPlay      = true;
+    m_nextDecoderGapless   = true;
+    m_nextDecoderPrerolled = false;
+    StartTimer(m_nextDecoderStartTimer, DECODER_START_TIMEOUT);
+}
+
+/*! \brief Replace the (stopped) current decoder with the prerolled queued decoder.
+*/
+bool TorcPlayer::StartQueuedDecoder(void)
+{
+    if (!m_nextDecoder || !m_nextDecoderGapless || m_nextDecoder->GetState() != TorcDecoder::Paused)
+        return false;
+
+    TorcDecoder *finished = m_decoder;
+
+    m_decoder              = m_nextDecoder;
+    m_uri                  = m_nextUri;
+    m_nextDecoder          = NULL;
+    m_nextUri              = QString();
+    m_nextDecoderGapless   = false;
+    m_nextDecoderPrerolled = false;
+    KillTimer(m_nextDecoderStartTimer);
+
+    // start the new decoder before tearing down the old one
+    SetState(Starting);
+    m_decoder->Start();
+    StartTimer(m_playTimer, DECODER_PAUSE_TIMEOUT);
+
+    delete finished;
+
+    LOG(VB_GENERAL, LOG_INFO, QString("Started queued item '%1'").arg(m_uri));
+    return true;
+}
+
 bool TorcPlayer::IsSwitching(void)
 {
     return m_switching;
@@ -520,8 +649,21 @@ bool TorcPlayer::Refresh(quint64 TimeNow, const QSizeF &Size, bool Visible)
         if (state == TorcDecoder::Errored ||
             state == TorcDecoder::Stopped)
         {
+            if (m_nextDecoderGapless && m_decoder)
+                m_decoder->SetGapless(false);
             DestroyNextDecoder();
         }
+        else if (m_nextDecoderGapless)
+        {
+            // the queued decoder waits, prerolled, until the current decoder finishes
+            if (state == TorcDecoder::Paused && !m_nextDecoderPrerolled)
+            {
+                KillTimer(m_nextDecoderStartTimer);
+                if (m_decoder)
+                    m_decoder->SetGapless(true);
+                m_nextDecoderPrerolled = true;
+            }
+        }
         else if (state > TorcDecoder::Opening && !m_oldDecoder)
         {
             m_oldDecoder = m_decoder;
@@ -572,10 +714,26 @@ bool TorcPlayer::Refresh(quint64 TimeNow, const QSizeF &Size, bool Visible)
     // check for playback completion
     if (m_decoder->GetState() == TorcDecoder::Stopped)
     {
+        if (StartQueuedDecoder())
+            return true;
+
+        // the queued decoder is not ready yet - fall back to a normal switch
+        if (m_nextDecoderGapless)
+        {
+            m_nextDecoderGapless = false;
+            m_switching          = true;
+            StartTimer(m_nextDecoderStartTimer, DECODER_START_TIMEOUT);
+        }
+
+        m_lastStatistics = m_decoder->GetStatistics();
         SetState(Stopped);
         delete m_decoder;
         m_decoder = NULL;
     }
+    else
+    {
+        OpenQueuedDecoder();
+    }
 
     // update state
     if (m_nextState != None)
@@ -651,6 +809,8 @@ void TorcPlayer::DestroyNextDecoder(void)
     delete m_nextDecoder;
     m_nextDecoder = NULL;
     m_switching = false;
+    m_nextDecoderGapless   = false;
+    m_nextDecoderPrerolled = false;
     KillTimer(m_nextDecoderStartTimer);
 
     if (!m_decoder)
@@ -686,6 +846,15 @@ int TorcPlayer::GetDecoderFlags(void)
     return m_decoderFlags;
 }
 
+/*! \brief Return the performance counters for the current decoder (or the last decoder to finish).
+*/
+QVariantMap TorcPlayer::GetStatistics(void)
+{
+    if (m_decoder)
+        return m_decoder->GetStatistics();
+    return m_lastStatistics;
+}
+
 PlayerFactory* PlayerFactory::gPlayerFactory = NULL;
 
 PlayerFactory::PlayerFactory()
@@ -830,6 +999,12 @@ bool TorcPlayerInterface::HandleEvent(QEvent *Event)
         case Torc::PlayMedia:
             if (data.contains("uri"))
             {
+                if (data.value("queue", false).toBool() && m_player)
+                {
+                    m_player->QueueMedia(data.value("uri").toString());
+                    break;
+                }
+
                 bool paused = data.value("paused", false).toBool();
                 SetURI(data.value("uri").toString());
                 PlayMedia(paused);
@@ -28,7 +28,8 @@ class TORC_CORE_PUBLIC TorcPlayer : public QObject
         NoFlags      = (0 << 0),
         AudioMuted   = (1 << 0),
         AudioDummy   = (1 << 1),
-        UserFacing   = (1 << 2)
+        UserFacing   = (1 << 2),
+        Benchmark    = (1 << 3)
     };
 
     enum PlayerState
@@ -90,9 +91,11 @@ class TORC_CORE_PUBLIC TorcPlayer : public QObject
     void            SendUserMessage        (const QString &Message);
     int             GetPlayerFlags         (void);
     int             GetDecoderFlags        (void);
+    virtual QVariantMap GetStatistics      (void);
 
   public slots:
     virtual bool    PlayMedia              (const QString &URI, bool StartPaused);
+    bool            QueueMedia             (const QString &URI);
     bool            Play                   (void);
     bool            Stop                   (void);
     bool            Pause                  (void);
@@ -118,6 +121,8 @@ class TORC_CORE_PUBLIC TorcPlayer : public QObject
     void            KillTimer              (int &Timer);
     void            DestroyNextDecoder     (void);
     void            DestroyOldDecoder      (void);
+    void            OpenQueuedDecoder      (void);
+    bool            StartQueuedDecoder     (void);
     virtual bool    event                  (QEvent* Event);
 
   protected:
@@ -141,10 +146,16 @@ class TORC_CORE_PUBLIC TorcPlayer : public QObject
     bool            m_nextDecoderPlay;
     int             m_nextDecoderStartTimer;
 
+    QString         m_queuedUri;
+    bool            m_nextDecoderGapless;
+    bool            m_nextDecoderPrerolled;
+    int             m_gaplessPreroll;
+
     TorcDecoder    *m_oldDecoder;
     int             m_oldDecoderStopTimer;
 
     QSet<PlayerProperty> m_supportedProperties;
+    QVariantMap     m_lastStatistics;
 
 };
 
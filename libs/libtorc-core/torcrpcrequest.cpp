@@ -73,13 +73,16 @@ TorcRPCRequest::TorcRPCRequest(const QString &Method)
 }
 
 /*! \brief Creates a request from the given QJsonObject
+ *
+ * Parent is the connection the request was received on (and is used to handle subscriptions and
+ * notifications). It is not notified of completion.
 */
-TorcRPCRequest::TorcRPCRequest(const QJsonObject &Object)
+TorcRPCRequest::TorcRPCRequest(const QJsonObject &Object, QObject *Parent)
   : m_notification(true),
     m_state(None),
     m_id(-1),
     m_method(),
-    m_parent(NULL),
+    m_parent(Parent),
     m_parentLock(new QMutex()),
     m_validParent(false)
 {
@@ -175,8 +178,8 @@ TorcRPCRequest::TorcRPCRequest(TorcWebSocket::WSSubProtocol Protocol, const QByt
                     continue;
                 }
 
-                // process this object
-                TorcRPCRequest *request = new TorcRPCRequest((*it).toObject());
+                // process this object - in the context of the same connection
+                TorcRPCRequest *request = new TorcRPCRequest((*it).toObject(), m_parent);
 
                 if (!request->GetData().isEmpty())
                 {
@@ -54,7 +54,9 @@ class TORC_CORE_PUBLIC TorcRPCRequest : public TorcReferenceCounter
     QByteArray&         GetData                (void);
 
   private:
-    TorcRPCRequest(const QJsonObject &Object);
+    friend class TorcWebSocket;
+
+    TorcRPCRequest(const QJsonObject &Object, QObject *Parent);
     ~TorcRPCRequest();
 
     void                ParseJSONObject        (const QJsonObject &Object);
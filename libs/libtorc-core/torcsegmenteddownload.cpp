@@ -0,0 +1,379 @@
+/* Class TorcSegmentedDownload
+*
+* This file is part of the Torc project.
+*
+* Copyright (C) Mark Kendall 2013
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+* USA.
+*/
+
+// Qt
+#include <QHash>
+#include <QMutex>
+
+// Torc
+#include "torclogging.h"
+#include "torcnetwork.h"
+#include "http/torchttprequest.h"
+#include "torcsegmenteddownload.h"
+
+#include <errno.h>
+
+#define MIN_SEGMENT_SIZE      (256 * 1024)
+#define MAX_SEGMENT_SIZE      (4 * 1024 * 1024)
+#define DEFAULT_SEGMENT_SIZE  (1024 * 1024)
+#define DEFAULT_CONNECTIONS   2
+// segments completing faster/slower than this are grown/shrunk
+#define FAST_SEGMENT_TIME     1000
+#define SLOW_SEGMENT_TIME     4000
+// how long to wait for a seek a short distance ahead
+#define SEEK_WAIT_TIMEOUT     2000
+
+/*! \class TorcSegment
+ *  \brief A single range request within a TorcSegmentedDownload.
+*/
+class TorcSegment
+{
+  public:
+    TorcSegment(TorcNetworkRequest *Request, qint64 Start, qint64 End)
+      : m_request(Request),
+        m_start(Start),
+        m_end(End),
+        m_checked(false),
+        m_complete(false)
+    {
+        m_timer.Start();
+    }
+
+    ~TorcSegment()
+    {
+        TorcNetwork::Cancel(m_request);
+        m_request->DownRef();
+    }
+
+    qint64 Length(void)
+    {
+        return m_end - m_start + 1;
+    }
+
+    bool Consumed(void)
+    {
+        return m_request->GetPosition() > m_end;
+    }
+
+    TorcNetworkRequest *m_request;
+    qint64              m_start;
+    qint64              m_end;
+    bool                m_checked;
+    bool                m_complete;
+    TorcTimer           m_timer;
+};
+
+/*! \class TorcSegmentStatistics
+ *  \brief Throughput achieved for an individual source (host).
+*/
+class TorcSegmentStatistics
+{
+  public:
+    TorcSegmentStatistics()
+      : m_bytes(0),
+        m_segments(0),
+        m_peakRate(0.0),
+        m_segmentSize(DEFAULT_SEGMENT_SIZE),
+        m_connections(DEFAULT_CONNECTIONS)
+    {
+    }
+
+    qint64 m_bytes;
+    int    m_segments;
+    double m_peakRate;
+    int    m_segmentSize;
+    int    m_connections;
+};
+
+static QMutex gSegmentStatisticsLock;
+static QHash<QString,TorcSegmentStatistics> gSegmentStatistics;
+
+/*! \class TorcSegmentedDownload
+ *  \brief Download a byte serving resource using multiple concurrent range requests.
+ *
+ * The file is split into segments, each of which is retrieved by its own TorcNetworkRequest. Up to
+ * m_connections segments are downloaded ahead of the current segment, and the segments are consumed
+ * in order, so the reader sees a single contiguous stream.
+ *
+ * The segment size is adjusted so that each request takes between 1 and 4 seconds, to amortise the cost
+ * of each request on high latency links. The number of connections is increased whilst doing so improves
+ * the aggregate throughput (up to MaxConnections) and decreased when it does not.
+ *
+ * The throughput achieved for each source (host) is retained for the lifetime of the application and
+ * is used to tune later downloads from the same source.
+ *
+ * \note The number of segments held (consumed or not) is limited to m_connections + 1, which bounds the
+ *       memory used to roughly (MaxConnections + 1) * 5Mb.
+ *
+ * \sa TorcNetworkBuffer
+*/
+TorcSegmentedDownload::TorcSegmentedDownload(const QUrl &URL, qint64 Size, int MaxConnections, int *Abort)
+  : m_url(URL),
+    m_size(Size),
+    m_abort(Abort),
+    m_position(0),
+    m_nextStart(0),
+    m_segmentSize(DEFAULT_SEGMENT_SIZE),
+    m_connections(DEFAULT_CONNECTIONS),
+    m_maxConnections(qMax(1, MaxConnections)),
+    m_bytes(0),
+    m_windowBytes(0),
+    m_windowSegments(0),
+    m_lastRate(0.0)
+{
+    // start from the last known good values for this source
+    {
+        QMutexLocker locker(&gSegmentStatisticsLock);
+        if (gSegmentStatistics.contains(m_url.authority()))
+        {
+            TorcSegmentStatistics &stats = gSegmentStatistics[m_url.authority()];
+            m_segmentSize = stats.m_segmentSize;
+            m_connections = stats.m_connections;
+        }
+    }
+
+    m_connections = qMin(m_connections, m_maxConnections);
+    m_timer.Start();
+    m_windowTimer.Start();
+}
+
+TorcSegmentedDownload::~TorcSegmentedDownload()
+{
+    Cancel();
+
+    QMutexLocker locker(&gSegmentStatisticsLock);
+    TorcSegmentStatistics &stats = gSegmentStatistics[m_url.authority()];
+    stats.m_segmentSize = m_segmentSize;
+    stats.m_connections = m_connections;
+
+    if (m_bytes > 0)
+    {
+        LOG(VB_NETWORK, LOG_INFO, QString("Segmented download from '%1': %2KB in %3 segments, peak %4KB/s (%5 connections, %6KB segments)")
+            .arg(m_url.authority()).arg(stats.m_bytes / 1024).arg(stats.m_segments).arg((int)(stats.m_peakRate / 1024))
+            .arg(m_connections).arg(m_segmentSize / 1024));
+    }
+}
+
+/// Start downloading from Position, discarding any existing segments.
+bool TorcSegmentedDownload::Start(qint64 Position)
+{
+    Cancel();
+
+    m_position  = Position;
+    m_nextStart = Position;
+    Schedule();
+
+    if (m_segments.isEmpty())
+        return Position >= m_size;
+
+    return m_segments.first()->m_request->WaitForStart(NETWORK_TIMEOUT);
+}
+
+/*! \brief Read from the current segment, moving to the next segment as each is exhausted.
+ *
+ * Returns -EPROTONOSUPPORT if the server does not honour range requests.
+*/
+int TorcSegmentedDownload::Read(char *Buffer, qint32 BufferSize, int Timeout, bool Peek)
+{
+    if (!Buffer)
+        return -1;
+
+    while (!m_segments.isEmpty())
+    {
+        Schedule();
+
+        TorcSegment *current = m_segments.first();
+
+        if (current->Consumed())
+        {
+            delete m_segments.takeFirst();
+            continue;
+        }
+
+        if (!current->m_checked)
+        {
+            if (!current->m_request->WaitForStart(Timeout))
+                return -ECONNABORTED;
+
+            if (current->m_request->GetStatus() != HTTP_PartialContent)
+            {
+                LOG(VB_GENERAL, LOG_ERR, QString("Range request returned status %1").arg(current->m_request->GetStatus()));
+                return -EPROTONOSUPPORT;
+            }
+
+            current->m_checked = true;
+        }
+
+        int result = current->m_request->Read(Buffer, BufferSize, Timeout, Peek);
+        if (result > 0 && !Peek)
+            m_position += result;
+
+        // premature end of segment
+        if (result == 0)
+        {
+            LOG(VB_GENERAL, LOG_ERR, QString("Segment %1-%2 ended early").arg(current->m_start).arg(current->m_end));
+            return -ECONNABORTED;
+        }
+
+        return result;
+    }
+
+    return 0;
+}
+
+/*! \brief Seek to Offset.
+ *
+ * If Offset has already been requested, earlier segments are discarded and the segment containing Offset
+ * becomes current. Otherwise all segments are discarded and the download restarted from Offset.
+*/
+qint64 TorcSegmentedDownload::Seek(qint64 Offset)
+{
+    if (Offset < 0 || Offset > m_size)
+        return -1;
+
+    for (int i = 0; i < m_segments.size(); ++i)
+    {
+        TorcSegment *segment = m_segments.at(i);
+        if (Offset < segment->m_start || Offset > segment->m_end)
+            continue;
+
+        if (segment->m_request->Seek(Offset, SEEK_WAIT_TIMEOUT) < 0)
+            break;
+
+        while (i-- > 0)
+            delete m_segments.takeFirst();
+
+        m_position = Offset;
+        return Offset;
+    }
+
+    if (!Start(Offset))
+        return -1;
+
+    return Offset;
+}
+
+qint64 TorcSegmentedDownload::GetSize(void)
+{
+    return m_size;
+}
+
+qint64 TorcSegmentedDownload::GetPosition(void)
+{
+    return m_position;
+}
+
+int TorcSegmentedDownload::BytesAvailable(void)
+{
+    if (m_segments.isEmpty())
+        return 0;
+    return m_segments.first()->m_request->BytesAvailable();
+}
+
+/// Check for completed segments and start new segments ahead of the read position.
+void TorcSegmentedDownload::Schedule(void)
+{
+    foreach (TorcSegment *segment, m_segments)
+        if (!segment->m_complete && segment->m_request->IsFinished())
+            SegmentComplete(segment);
+
+    while (m_segments.size() < m_connections + 1 && m_nextStart < m_size && !(*m_abort))
+    {
+        qint64 start  = m_nextStart;
+        qint64 end    = qMin(start + m_segmentSize, m_size) - 1;
+        int    length = end - start + 1;
+
+        // N.B. TorcNetworkRequest reserves 1/8th of its buffer for seeking backwards - the complete
+        // segment must fit in the remainder so that the download is never throttled.
+        int buffersize = length + (length >> 2);
+
+        QNetworkRequest request(m_url);
+        TorcNetworkRequest *segment = new TorcNetworkRequest(request, QNetworkAccessManager::GetOperation, buffersize, m_abort);
+        segment->SetReadSize(DEFAULT_STREAMED_READ_SIZE);
+        segment->SetRange(start, end);
+
+        if (!TorcNetwork::Get(segment))
+        {
+            segment->DownRef();
+            break;
+        }
+
+        m_segments.append(new TorcSegment(segment, start, end));
+        m_nextStart = end + 1;
+    }
+}
+
+void TorcSegmentedDownload::Cancel(void)
+{
+    while (!m_segments.isEmpty())
+        delete m_segments.takeFirst();
+}
+
+/*! \brief Update statistics for a completed segment and adapt the segment size and number of connections.
+*/
+void TorcSegmentedDownload::SegmentComplete(TorcSegment *Segment)
+{
+    Segment->m_complete = true;
+
+    if (Segment->m_request->GetStatus() != HTTP_PartialContent)
+        return;
+
+    int elapsed = qMax(1, Segment->m_timer.Elapsed());
+    qint64 length = Segment->Length();
+    m_bytes       += length;
+    m_windowBytes += length;
+    m_windowSegments++;
+
+    // aim for requests that are long enough to amortise the request latency
+    if (elapsed < FAST_SEGMENT_TIME && length >= m_segmentSize)
+        m_segmentSize = qMin(m_segmentSize << 1, MAX_SEGMENT_SIZE);
+    else if (elapsed > SLOW_SEGMENT_TIME)
+        m_segmentSize = qMax(m_segmentSize >> 1, MIN_SEGMENT_SIZE);
+
+    double peak = 0.0;
+
+    // and add connections while the aggregate throughput improves
+    if (m_windowSegments >= m_connections)
+    {
+        double rate = (double)m_windowBytes * 1000.0 / qMax(1, m_windowTimer.Elapsed());
+
+        if (rate > m_lastRate * 1.1 && m_connections < m_maxConnections)
+            m_connections++;
+        else if (rate < m_lastRate * 0.9 && m_connections > 1)
+            m_connections--;
+
+        LOG(VB_NETWORK, LOG_DEBUG, QString("Throughput %1KB/s - %2 connections, %3KB segments")
+            .arg((int)(rate / 1024)).arg(m_connections).arg(m_segmentSize / 1024));
+
+        m_lastRate = rate;
+        peak = rate;
+        m_windowBytes    = 0;
+        m_windowSegments = 0;
+        m_windowTimer.Restart();
+    }
+
+    QMutexLocker locker(&gSegmentStatisticsLock);
+    TorcSegmentStatistics &stats = gSegmentStatistics[m_url.authority()];
+    stats.m_bytes += length;
+    stats.m_segments++;
+    stats.m_peakRate = qMax(stats.m_peakRate, peak);
+}
@@ -0,0 +1,51 @@
+#ifndef TORCSEGMENTEDDOWNLOAD_H
+#define TORCSEGMENTEDDOWNLOAD_H
+
+// Qt
+#include <QUrl>
+#include <QList>
+
+// Torc
+#include "torctimer.h"
+
+class TorcSegment;
+
+class TorcSegmentedDownload
+{
+  public:
+    TorcSegmentedDownload(const QUrl &URL, qint64 Size, int MaxConnections, int *Abort);
+    ~TorcSegmentedDownload();
+
+    bool            Start             (qint64 Position);
+    int             Read              (char *Buffer, qint32 BufferSize, int Timeout, bool Peek = false);
+    qint64          Seek              (qint64 Offset);
+    qint64          GetSize           (void);
+    qint64          GetPosition       (void);
+    int             BytesAvailable    (void);
+
+  private:
+    void            Schedule          (void);
+    void            Cancel            (void);
+    void            SegmentComplete   (TorcSegment *Segment);
+
+  private:
+    QUrl                m_url;
+    qint64              m_size;
+    int                *m_abort;
+    qint64              m_position;
+    qint64              m_nextStart;
+    QList<TorcSegment*> m_segments;
+    int                 m_segmentSize;
+    int                 m_connections;
+    int                 m_maxConnections;
+
+    // statistics
+    qint64              m_bytes;
+    TorcTimer           m_timer;
+    qint64              m_windowBytes;
+    TorcTimer           m_windowTimer;
+    int                 m_windowSegments;
+    double              m_lastRate;
+};
+
+#endif // TORCSEGMENTEDDOWNLOAD_H
@@ -20,10 +20,18 @@
 * USA.
 */
 
+// Qt
+#include <QMultiHash>
+#include <QReadWriteLock>
+
 // Torc
 #include "torclocalcontext.h"
 #include "torcsetting.h"
 
+// all settings, indexed by name
+static QReadWriteLock                    gSettingIndexLock;
+static QMultiHash<QString,TorcSetting*> gSettingIndex;
+
 /*! \class TorcSetting
  *  \brief A wrapper around a database setting.
  *
@@ -43,6 +51,12 @@
  * setting behaviour and allow the setting structure to be presented and manipulated by
  * an appropriate user facing interface.
  *
+ * Settings are read far more often than they are changed and are read from many threads. Hence
+ * the value is held as an immutable snapshot that SetValue replaces atomically and GetValue reads
+ * without taking a lock. A replaced snapshot is retired rather than deleted, as a reader may still be
+ * copying it, and retired snapshots are deleted as soon as no reader is active (see Reclaim).
+ * All settings are indexed by name, so FindChild does not need to search the tree.
+ *
  * \sa TorcUISetting
  */
 
@@ -61,49 +75,69 @@ TorcSetting::TorcSetting(TorcSetting *Parent, const QString &DBName, const QStri
     m_isActive(false),
     m_active(0),
     m_activeThreshold(1),
-    m_childrenLock(new QMutex(QMutex::Recursive))
+    m_childrenLock(new QMutex(QMutex::Recursive)),
+    m_valueLock(new QMutex()),
+    m_readers(0),
+    m_retiredCount(0),
+    m_removed(false)
 {
     setObjectName(DBName);
 
-    if (m_parent)
-        m_parent->AddChild(this);
-
     QVariant::Type type = m_default.type();
+    QVariant value;
 
     if (type == QVariant::Int && m_type == Integer)
     {
-        m_value = m_persistent ? gLocalContext->GetSetting(m_dbName, (int)m_default.toInt()) : m_default.toInt();
+        value = m_persistent ? gLocalContext->GetSetting(m_dbName, (int)m_default.toInt()) : m_default.toInt();
     }
     else if (type == QVariant::Bool && m_type == Checkbox)
     {
-        m_value = m_persistent ? gLocalContext->GetSetting(m_dbName, (bool)m_default.toBool()) : m_default.toBool();
+        value = m_persistent ? gLocalContext->GetSetting(m_dbName, (bool)m_default.toBool()) : m_default.toBool();
     }
     else if (type == QVariant::String)
     {
-        m_value = m_persistent ? gLocalContext->GetSetting(m_dbName, (QString)m_default.toString()) : m_default.toString();
+        value = m_persistent ? gLocalContext->GetSetting(m_dbName, (QString)m_default.toString()) : m_default.toString();
     }
     else if (type == QVariant::StringList)
     {
         if (m_persistent)
         {
-            QString value = gLocalContext->GetSetting(m_dbName, (QString)m_default.toString());
-            m_value = QVariant(value.split(","));
+            QString string = gLocalContext->GetSetting(m_dbName, (QString)m_default.toString());
+            value = QVariant(string.split(","));
         }
         else
         {
-            m_value = m_default.toStringList();
+            value = m_default.toStringList();
         }
     }
     else
     {
         if (type != QVariant::Invalid)
             LOG(VB_GENERAL, LOG_ERR, QString("Unsupported setting data type for %1 (%2)").arg(m_dbName).arg(type));
-        m_value = QVariant();
     }
+
+    m_value.storeRelease(new QVariant(value));
+
+    {
+        QWriteLocker locker(&gSettingIndexLock);
+        gSettingIndex.insert(m_dbName, this);
+    }
+
+    if (m_parent)
+        m_parent->AddChild(this);
 }
 
 TorcSetting::~TorcSetting()
 {
+    {
+        QWriteLocker locker(&gSettingIndexLock);
+        gSettingIndex.remove(m_dbName, this);
+    }
+
+    delete m_value.load();
+    qDeleteAll(m_retired);
+
+    delete m_valueLock;
     delete m_childrenLock;
 }
 
@@ -188,31 +222,64 @@ void TorcSetting::RemoveChild(TorcSetting *Child)
 
 void TorcSetting::Remove(void)
 {
+    {
+        QWriteLocker locker(&gSettingIndexLock);
+        gSettingIndex.remove(m_dbName, this);
+        m_removed = true;
+    }
+
     if (m_parent)
         m_parent->RemoveChild(this);
 
     emit Removed();
 }
 
+/*! \brief Find the setting named Child that is a child (or, if Recursive, any descendant) of this setting.
+ *
+ * If more than one descendant matches, the one closest to this setting is returned.
+*/
 TorcSetting* TorcSetting::FindChild(const QString &Child, bool Recursive /*=false*/)
 {
-    QMutexLocker locker(m_childrenLock);
+    QReadLocker locker(&gSettingIndexLock);
 
-    foreach (TorcSetting* setting, m_children)
-        if (setting->objectName() == Child)
-            return setting;
+    TorcSetting *result = NULL;
+    int depth = -1;
 
-    if (Recursive)
+    QMultiHash<QString,TorcSetting*>::const_iterator it = gSettingIndex.constFind(Child);
+    for ( ; it != gSettingIndex.constEnd() && it.key() == Child; ++it)
     {
-        foreach (TorcSetting* setting, m_children)
+        int distance = it.value()->Depth(this);
+        if (distance < 1 || (!Recursive && distance > 1))
+            continue;
+
+        if (!result || distance < depth)
         {
-            TorcSetting *result = setting->FindChild(Child, true);
-            if (result)
-                return result;
+            result = it.value();
+            depth  = distance;
         }
     }
 
-    return NULL;
+    return result;
+}
+
+/*! \brief Return the number of generations between this setting and Ancestor (or -1 if Ancestor is not an ancestor).
+ *
+ * Settings that have been removed (or whose ancestors have been removed) are no longer part of the tree.
+ * \note gSettingIndexLock must be held.
+*/
+int TorcSetting::Depth(TorcSetting *Ancestor)
+{
+    int depth = 0;
+    TorcSetting *setting = this;
+    while (setting && !setting->m_removed)
+    {
+        if (setting == Ancestor)
+            return depth;
+        setting = setting->m_parent;
+        depth++;
+    }
+
+    return -1;
 }
 
 QSet<TorcSetting*> TorcSetting::GetChildren(void)
@@ -323,16 +390,23 @@ void TorcSetting::SetFalse(void)
 
 void TorcSetting::SetValue(const QVariant &Value)
 {
-    if (m_value == Value)
-        return;
+    {
+        QMutexLocker locker(m_valueLock);
 
-    m_value = Value;
+        if (*m_value.loadAcquire() == Value)
+            return;
+
+        // publish the new value. The old value may still be in use by a reader.
+        m_retired.append(m_value.fetchAndStoreOrdered(new QVariant(Value)));
+        m_retiredCount.fetchAndStoreOrdered(m_retired.size());
+        Reclaim();
+    }
 
     QVariant::Type type = m_default.type();
 
     if (type == QVariant::Int)
     {
-        int value = m_value.toInt();
+        int value = Value.toInt();
         if (value >= m_begin && value <= m_end)
         {
             if (m_persistent)
@@ -342,7 +416,7 @@ void TorcSetting::SetValue(const QVariant &Value)
     }
     else if (type == QVariant::Bool)
     {
-        bool value = m_value.toBool();
+        bool value = Value.toBool();
         if (m_persistent)
             gLocalContext->SetSetting(m_dbName, (bool)value);
 
@@ -350,14 +424,14 @@ void TorcSetting::SetValue(const QVariant &Value)
     }
     else if (type == QVariant::String)
     {
-        QString value = m_value.toString();
+        QString value = Value.toString();
         if (m_persistent)
             gLocalContext->SetSetting(m_dbName, value);
         emit ValueChanged(value);
     }
     else if (type == QVariant::StringList)
     {
-        QStringList value = m_value.toStringList();
+        QStringList value = Value.toStringList();
         if (m_persistent)
             gLocalContext->SetSetting(m_dbName, value.join(","));
         emit ValueChanged(value);
@@ -391,9 +465,38 @@ void TorcSetting::SetHelpText(const QString &HelpText)
     m_helpText = HelpText;
 }
 
+/// Return the current value. This is lock free.
 QVariant TorcSetting::GetValue(void)
 {
-    return m_value;
+    m_readers.ref();
+    QVariant result(*m_value.loadAcquire());
+
+    // the last active reader cleans up any values replaced while it was reading, unless a writer is busy
+    if (!m_readers.deref() && m_retiredCount.loadAcquire() > 0 && m_valueLock->tryLock())
+    {
+        Reclaim();
+        m_valueLock->unlock();
+    }
+
+    return result;
+}
+
+/*! \brief Delete retired values if no reader can still be using them.
+ *
+ * A reader registers in m_readers before loading m_value. Once a value has been replaced, only readers
+ * that were already registered can hold it. Hence if there are no registered readers, no retired value
+ * is in use (and none can be loaded again).
+ *
+ * \note m_valueLock must be held.
+*/
+void TorcSetting::Reclaim(void)
+{
+    if (m_retired.isEmpty() || m_readers.fetchAndAddOrdered(0))
+        return;
+
+    qDeleteAll(m_retired);
+    m_retired.clear();
+    m_retiredCount.fetchAndStoreOrdered(0);
 }
 
 /*! \class TorcSettingGroup
@@ -5,6 +5,8 @@
 #include <QSet>
 #include <QMutex>
 #include <QVariant>
+#include <QAtomicInt>
+#include <QAtomicPointer>
 #include <QStringList>
 #include <QAbstractListModel>
 
@@ -92,6 +94,10 @@ class TORC_CORE_PUBLIC TorcSetting : public QAbstractListModel, public TorcRefer
   protected:
     virtual               ~TorcSetting();
 
+  private:
+    int                    Depth                (TorcSetting *Ancestor);
+    void                   Reclaim              (void);
+
   protected:
     TorcSetting           *m_parent;
     Type                   m_type;
@@ -100,7 +106,7 @@ class TORC_CORE_PUBLIC TorcSetting : public QAbstractListModel, public TorcRefer
     QString                m_uiName;
     QString                m_description;
     QString                m_helpText;
-    QVariant               m_value;
+    QAtomicPointer<const QVariant> m_value;
     QVariant               m_default;
 
     // Integer
@@ -114,6 +120,11 @@ class TORC_CORE_PUBLIC TorcSetting : public QAbstractListModel, public TorcRefer
     int                    m_activeThreshold;
     QList<TorcSetting*>    m_children;
     QMutex                *m_childrenLock;
+    QMutex                *m_valueLock;
+    QAtomicInt             m_readers;
+    QList<const QVariant*> m_retired;
+    QAtomicInt             m_retiredCount;
+    bool                   m_removed;
 };
 
 class TORC_CORE_PUBLIC TorcSettingGroup : public TorcSetting
@@ -33,7 +33,8 @@
  * All Sql specific code resides in TorcDB. TorcSQLiteDB applies SQLite specifics
  * when creating the database and upon first use after startup.
  *
- * \todo Check the exclusive lock handling. It's unclear whether this will lock out other threads.
+ * The database is opened in exclusive locking mode, which locks out other processes AND other connections
+ * within this process. Hence it must only be accessed from a single thread (see TorcDBWriterThread).
  *
  * \sa TorcDB
 */
@@ -99,6 +100,16 @@ bool TorcSQLiteDB::InitDatabase(void)
                "  value VARCHAR(16000) NOT NULL );");
     DebugError(&query);
 
+    // Ensure names are unique (keeping the most recent value) so that values can be replaced in a single statement
+    query.exec("DELETE FROM settings WHERE rowid NOT IN (SELECT MAX(rowid) FROM settings GROUP BY name);");
+    DebugError(&query);
+    query.exec("CREATE UNIQUE INDEX IF NOT EXISTS settings_name ON settings (name);");
+    DebugError(&query);
+    query.exec("DELETE FROM preferences WHERE rowid NOT IN (SELECT MAX(rowid) FROM preferences GROUP BY name);");
+    DebugError(&query);
+    query.exec("CREATE UNIQUE INDEX IF NOT EXISTS preferences_name ON preferences (name);");
+    DebugError(&query);
+
     // Check the creation date for existing installations
     query.exec("SELECT value FROM settings where name='DB_DateCreated'");
     DebugError(&query);
@@ -126,9 +137,11 @@ bool TorcSQLiteDB::InitDatabase(void)
     DebugError(&query);
     query.exec("PRAGMA temp_store = MEMORY");
     DebugError(&query);
-    query.exec("PRAGMA journal_mode = OFF");
+    // N.B. writes are batched by TorcDBWriter, so a write ahead log is cheap and survives a crash.
+    // In exclusive locking mode, no shared memory index is needed.
+    query.exec("PRAGMA journal_mode = WAL");
     DebugError(&query);
-    query.exec("PRAGMA synchronous = OFF");
+    query.exec("PRAGMA synchronous = NORMAL");
     DebugError(&query);
 
     m_databaseValid = true;
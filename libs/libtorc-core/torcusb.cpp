@@ -68,7 +68,7 @@ TorcUSBDevice::TorcUSBDevice(const QString &Path, int Vendor, int Product, TorcU
 {
 }
 
-TorcUSBDevice TorcUSBDevice::FromMap(QVariantMap &Map)
+TorcUSBDevice TorcUSBDevice::FromMap(const QVariantMap &Map)
 {
     TorcUSBDevice result(Map.value("path").toString(),
                          Map.value("vendorid").toInt(),
@@ -218,7 +218,7 @@ TorcUSB::TorcUSB()
 {
     m_priv = TorcUSBPriv::Create(this);
     // listen for refresh events
-    gLocalContext->AddObserver(this);
+    gLocalContext->AddObserver(this, QList<int>() << Torc::USBRescan << Torc::USBDeviceAdded << Torc::USBDeviceRemoved);
 }
 
 TorcUSB::~TorcUSB()
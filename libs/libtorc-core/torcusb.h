@@ -37,7 +37,7 @@ class TORC_CORE_PUBLIC TorcUSBDevice
 
     QVariantMap            ToMap             (void);
 
-    static TorcUSBDevice   FromMap           (QVariantMap &Map);
+    static TorcUSBDevice   FromMap           (const QVariantMap &Map);
     static QString         ClassToString     (Classes Class);
     static Classes         ClassFromString   (const QString &String);
     static bool            IgnoreClass       (Classes Class);
@@ -23,6 +23,8 @@
 // Qt
 #include <QHostAddress>
 #include <QUdpSocket>
+#include <QVector>
+#include <QSet>
 
 // Torc
 #include "torclocalcontext.h"
@@ -31,16 +33,297 @@
 #include "torcadminthread.h"
 #include "torcnetwork.h"
 #include "torcqthread.h"
+#include "http/torchttprequest.h"
+#include "http/torchttpserver.h"
 #include "torcupnp.h"
 #include "torcssdp.h"
 
+#include <string.h>
+
+// device expiry is tracked in a wheel of 64 x 30 second slots (32 minutes)
+#define EXPIRY_WHEEL_SIZE     64
+#define EXPIRY_WHEEL_INTERVAL 30000
+// the largest datagram we expect (the buffer will grow if needed)
+#define DEFAULT_DATAGRAM_SIZE 2048
+// our announcements are valid for 30 minutes and are refreshed within the second quarter of that period
+#define ANNOUNCE_MAX_AGE      1800
+#define ANNOUNCE_REFRESH_MIN  (ANNOUNCE_MAX_AGE * 1000 / 4)
+#define ANNOUNCE_REFRESH_MAX  (ANNOUNCE_MAX_AGE * 1000 / 2)
+// new announcements are sent after a random delay of up to 100ms and repeated once
+#define ANNOUNCE_DELAY        100
+#define ANNOUNCE_REPEATS      2
+#define ANNOUNCE_RETRY        2000 // ms between attempts while the location is unknown
+// the maximum MX (response delay) we honour for M-SEARCH requests (seconds)
+#define SEARCH_MAX_MX         5
+#define SEARCH_MAX_RESPONSES  64
+
+/*! \class TorcSSDPMessage
+ *  \brief A lightweight parser for raw SSDP datagrams.
+ *
+ * The start line and headers are located in place, without copying the datagram or creating a
+ * string per line. Only the headers used by TorcSSDPPriv are recorded, as pointers into the datagram,
+ * and values are only converted to QStrings on request.
+ *
+ * \note The datagram must outlive the message.
+*/
+class TorcSSDPMessage
+{
+  public:
+    enum MessageType
+    {
+        Unknown = 0,
+        Response,
+        Notify,
+        Search
+    };
+
+    enum Header
+    {
+        CacheControl = 0,
+        Location,
+        NT,
+        NTS,
+        ST,
+        USN,
+        MAN,
+        MX,
+        HeaderCount
+    };
+
+    TorcSSDPMessage()
+      : m_type(Unknown)
+    {
+        for (int i = 0; i < HeaderCount; ++i)
+        {
+            m_values[i]  = NULL;
+            m_lengths[i] = 0;
+        }
+    }
+
+    /// Parse Size bytes of Data. Returns false if this is not a recognised SSDP message.
+    bool Parse(const char *Data, int Size)
+    {
+        static const struct { const char *name; int length; } headers[HeaderCount] =
+        {
+            { "cache-control", 13 },
+            { "location",       8 },
+            { "nt",             2 },
+            { "nts",            3 },
+            { "st",             2 },
+            { "usn",            3 },
+            { "man",            3 },
+            { "mx",             2 }
+        };
+
+        if (!Data || Size < 1)
+            return false;
+
+        const char *end  = Data + Size;
+        const char *line = Data;
+        bool first = true;
+
+        while (line < end)
+        {
+            const char *eol  = (const char*)memchr(line, '\n', end - line);
+            const char *next = eol ? eol + 1 : end;
+            const char *stop = eol ? eol : end;
+            if (stop > line && *(stop - 1) == '\r')
+                stop--;
+
+            if (first)
+            {
+                int length = stop - line;
+                if (length >= 5 && !qstrnicmp(line, "HTTP/", 5))
+                    m_type = Response;
+                else if (length >= 7 && !qstrnicmp(line, "NOTIFY ", 7))
+                    m_type = Notify;
+                else if (length >= 9 && !qstrnicmp(line, "M-SEARCH ", 9))
+                    m_type = Search;
+                else
+                    return false;
+
+                first = false;
+            }
+            else if (stop == line)
+            {
+                // end of headers
+                break;
+            }
+            else
+            {
+                const char *colon = (const char*)memchr(line, ':', stop - line);
+                if (colon)
+                {
+                    const char *nameend = colon;
+                    while (nameend > line && IsSpace(*(nameend - 1)))
+                        nameend--;
+
+                    const char *value = colon + 1;
+                    const char *valueend = stop;
+                    while (value < valueend && IsSpace(*value))
+                        value++;
+                    while (valueend > value && IsSpace(*(valueend - 1)))
+                        valueend--;
+
+                    int namelength = nameend - line;
+                    for (int i = 0; i < HeaderCount; ++i)
+                    {
+                        if (namelength == headers[i].length && !qstrnicmp(line, headers[i].name, namelength))
+                        {
+                            m_values[i]  = value;
+                            m_lengths[i] = valueend - value;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            line = next;
+        }
+
+        return m_type != Unknown;
+    }
+
+    MessageType GetType(void) const
+    {
+        return m_type;
+    }
+
+    bool Has(Header Name) const
+    {
+        return m_values[Name] != NULL;
+    }
+
+    QString Value(Header Name) const
+    {
+        return m_values[Name] ? QString::fromUtf8(m_values[Name], m_lengths[Name]) : QString();
+    }
+
+    /// Case insensitive comparison of the value of header Name with Value.
+    bool Equals(Header Name, const char *Value) const
+    {
+        int length = qstrlen(Value);
+        return m_values[Name] && m_lengths[Name] == length && !qstrnicmp(m_values[Name], Value, length);
+    }
+
+    /// Return the value of header Name as an unsigned integer, or -1.
+    int Integer(Header Name) const
+    {
+        if (!m_values[Name] || m_lengths[Name] < 1)
+            return -1;
+
+        int result = 0;
+        for (int i = 0; i < m_lengths[Name]; ++i)
+        {
+            char digit = m_values[Name][i];
+            if (digit < '0' || digit > '9' || result > 100000)
+                return -1;
+            result = result * 10 + (digit - '0');
+        }
+
+        return result;
+    }
+
+    /// Return the max-age directive from the cache-control header, in seconds, or -1.
+    int MaxAge(void) const
+    {
+        // NB this ignores the date header - just assume it is correct
+        const char *value = m_values[CacheControl];
+        const char *end   = value + m_lengths[CacheControl];
+
+        for ( ; value && (end - value) > 7; ++value)
+        {
+            if (qstrnicmp(value, "max-age", 7))
+                continue;
+
+            value += 7;
+            while (value < end && (IsSpace(*value) || *value == '='))
+                value++;
+
+            int seconds = -1;
+            while (value < end && *value >= '0' && *value <= '9')
+                seconds = (seconds < 0 ? 0 : seconds * 10) + (*value++ - '0');
+            return seconds;
+        }
+
+        return -1;
+    }
+
+  private:
+    static bool IsSpace(char Character)
+    {
+        return Character == ' ' || Character == '\t';
+    }
+
+  private:
+    MessageType m_type;
+    const char *m_values[HeaderCount];
+    int         m_lengths[HeaderCount];
+};
+
+/*! \class TorcSSDPTarget
+ *  \brief A single notification type (NT/ST) and USN pair for an announced device.
+ *
+ * Each announced device is advertised as several targets (the root device, its UUID and its type), each
+ * of which is refreshed on its own schedule.
+*/
+class TorcSSDPTarget
+{
+  public:
+    TorcSSDPTarget()
+      : m_next(0),
+        m_repeats(0)
+    {
+    }
+
+    TorcSSDPTarget(const QString &Type, const QString &USN, const QString &Location)
+      : m_type(Type),
+        m_usn(USN),
+        m_location(Location),
+        m_next(0),
+        m_repeats(ANNOUNCE_REPEATS)
+    {
+    }
+
+    bool operator == (const TorcSSDPTarget &Other) const
+    {
+        return m_type == Other.m_type && m_usn == Other.m_usn;
+    }
+
+    QString m_type;
+    QString m_usn;
+    QString m_location;
+    qint64  m_next;
+    int     m_repeats;
+};
+
+/*! \class TorcSSDPResponse
+ *  \brief A scheduled response to one or more M-SEARCH requests from a single client.
+*/
+class TorcSSDPResponse
+{
+  public:
+    QHostAddress          m_address;
+    quint16               m_port;
+    qint64                m_due;
+    QList<TorcSSDPTarget> m_targets;
+};
+
 /*! \class TorcSSDPPriv
  *  \brief The internal handler for all Simple Service Discovery Protocol messaging
  *
+ * Announced devices are advertised with ssdp:alive notifications, sent after a random delay of up to
+ * 100ms and repeated once. Each notification is then refreshed at a random point between a quarter and
+ * half of the advertised max-age, so that refreshes are spread across the period rather than sent in
+ * bursts. M-SEARCH requests are answered after a random delay within the requested MX period and all
+ * responses due to a single client are sent together. At most SEARCH_MAX_RESPONSES clients are
+ * waiting for a response at any time - further searches are ignored until responses have been sent.
+ *
+ * The location of an announced device may be given as a path on the local web server, in which case the
+ * LOCATION URL is completed with the address of the network interface and the current web server port
+ * when each message is sent. Nothing is sent for such devices while the web server is not listening.
+ *
  * \todo Revisit behaviour for search and announce wrt network availability and network allowed inbound/outbound
- * \todo Actually announce (with random 0-100ms delay) plus retry
- * \todo Schedule announce refreshes (half of cache-control)
- * \todo Respond to search requests
  * \todo Correct handling of multiple responses (i.e. via both IPv4 and IPv6)
 */
 
@@ -59,6 +342,15 @@ class TorcSSDPPriv
     void         Read                 (QUdpSocket *Socket);
     void         ProcessDevice        (const QString &USN, const QString &Type, const QString &Location, qint64 Expires, bool Add);
     void         Refresh              (void);
+    void         ProcessSchedule      (void);
+
+  protected:
+    void         ScheduleExpiry       (const QString &USN, qint64 Expires);
+    void         ProcessSearch        (const TorcSSDPMessage &Message, const QHostAddress &Address, quint16 Port);
+    bool         Notify               (const TorcSSDPTarget &Target, bool Alive);
+    QByteArray   Location             (const TorcSSDPTarget &Target, bool IPv6);
+    void         Respond              (const TorcSSDPResponse &Response);
+    void         Send                 (QUdpSocket *Socket, const QByteArray &Datagram, const QHostAddress &Address, quint16 Port);
 
   protected:
     TorcSSDP                          *m_parent;
@@ -73,6 +365,15 @@ class TorcSSDPPriv
     QUdpSocket                        *m_ipv6LinkMulticastSocket;
     QHash<QString,TorcUPNPDescription> m_discoveredDevices;
     QMultiHash<QString,QObject*>       m_searchRequests;
+    QVector<QSet<QString> >            m_expiryWheel;
+    qint64                             m_expiryWheelTime;
+    QByteArray                         m_datagram;
+    quint64                            m_datagramsProcessed;
+    quint64                            m_datagramsDropped;
+    QList<TorcUPNPDescription>         m_announcements;
+    QList<TorcSSDPTarget>              m_targets;
+    QList<TorcSSDPResponse>            m_responses;
+    QByteArray                         m_serverName;
 };
 
 TorcSSDP* gSSDP = NULL;
@@ -89,7 +390,12 @@ TorcSSDPPriv::TorcSSDPPriv(TorcSSDP *Parent)
     m_ipv6LinkGroupBaseAddress("FF02::C"),
     m_ipv6LinkGroupAddress(m_ipv6LinkGroupBaseAddress),
     m_ipv6LinkSearchSocket(NULL),
-    m_ipv6LinkMulticastSocket(NULL)
+    m_ipv6LinkMulticastSocket(NULL),
+    m_expiryWheel(EXPIRY_WHEEL_SIZE),
+    m_expiryWheelTime(QDateTime::currentMSecsSinceEpoch()),
+    m_datagram(DEFAULT_DATAGRAM_SIZE, 0),
+    m_datagramsProcessed(0),
+    m_datagramsDropped(0)
 {
     if (TorcNetwork::IsAvailable())
         Start();
@@ -179,8 +485,21 @@ void TorcSSDPPriv::Start(void)
     foreach (QNetworkAddressEntry entry, entries)
         m_addressess << entry.ip();
 
+    m_expiryWheelTime = QDateTime::currentMSecsSinceEpoch();
+    m_serverName = QString("%1 UPnP/1.0").arg(TorcHTTPServer::PlatformName()).toUtf8();
     m_started = true;
 
+    // (re-)announce our own devices
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (int i = 0; i < m_targets.size(); ++i)
+    {
+        m_targets[i].m_next    = now + qrand() % ANNOUNCE_DELAY;
+        m_targets[i].m_repeats = ANNOUNCE_REPEATS;
+    }
+
+    if (!m_targets.isEmpty())
+        m_parent->Schedule(ANNOUNCE_DELAY);
+
     // search is evented from TorcSSDP parent..
 }
 
@@ -204,11 +523,23 @@ void TorcSSDPPriv::Stop(void)
     }
 
     m_discoveredDevices.clear();
+    m_responses.clear();
+
+    // tell others that our devices are going away (if we still can)
+    if (m_started)
+        foreach (const TorcSSDPTarget &target, m_targets)
+            Notify(target, false/*byebye*/);
+    for (int i = 0; i < m_expiryWheel.size(); ++i)
+        m_expiryWheel[i].clear();
 
     m_addressess.clear();
 
     if (m_started)
+    {
         LOG(VB_GENERAL, LOG_INFO, "Stopping SSDP discovery");
+        LOG(VB_NETWORK, LOG_INFO, QString("SSDP datagrams: %1 processed, %2 dropped")
+            .arg(m_datagramsProcessed).arg(m_datagramsDropped));
+    }
     m_started = false;
 
     if (m_ipv4SearchSocket)
@@ -305,106 +636,360 @@ void TorcSSDPPriv::CancelSearch(const QString &Type, QObject *Owner)
     }
 }
 
+/// Create the notification targets for Description (a root device).
+static QList<TorcSSDPTarget> GetTargets(const TorcUPNPDescription &Description)
+{
+    QList<TorcSSDPTarget> targets;
+    QString usn = Description.GetUSN();
+    targets << TorcSSDPTarget("upnp:rootdevice", usn + "::upnp:rootdevice", Description.GetLocation());
+    targets << TorcSSDPTarget(usn, usn, Description.GetLocation());
+    targets << TorcSSDPTarget(Description.GetType(), usn + "::" + Description.GetType(), Description.GetLocation());
+    return targets;
+}
+
 void TorcSSDPPriv::Announce(const TorcUPNPDescription &Description)
 {
-    LOG(VB_GENERAL, LOG_INFO, "ANNOUNCE " + Description.GetType());
+    if (Description.GetUSN().isEmpty() || Description.GetType().isEmpty() || m_announcements.contains(Description))
+        return;
+
+    LOG(VB_GENERAL, LOG_INFO, "Announcing " + Description.GetType());
+    m_announcements.append(Description);
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QList<TorcSSDPTarget> targets = GetTargets(Description);
+    for (int i = 0; i < targets.size(); ++i)
+    {
+        targets[i].m_next = now + qrand() % ANNOUNCE_DELAY;
+        m_targets.append(targets[i]);
+    }
+
+    if (m_started)
+        m_parent->Schedule(ANNOUNCE_DELAY);
 }
 
 void TorcSSDPPriv::CancelAnnounce(const TorcUPNPDescription &Description)
 {
-    LOG(VB_GENERAL, LOG_INFO, "CANCEL ANNOUNCE " + Description.GetType());
+    if (!m_announcements.removeOne(Description))
+        return;
+
+    LOG(VB_GENERAL, LOG_INFO, "Cancelling announcement for " + Description.GetType());
+
+    QList<TorcSSDPTarget> targets = GetTargets(Description);
+    foreach (const TorcSSDPTarget &target, targets)
+    {
+        m_targets.removeOne(target);
+        if (m_started)
+            Notify(target, false/*byebye*/);
+    }
+
+    // and don't respond to outstanding searches
+    for (int i = 0; i < m_responses.size(); ++i)
+        foreach (const TorcSSDPTarget &target, targets)
+            m_responses[i].m_targets.removeOne(target);
 }
 
-qint64 GetExpiryTime(const QString &Expires)
+/*! \brief Schedule responses to an M-SEARCH request.
+ *
+ * Responses are delayed by a random period within the requested MX time (limited to SEARCH_MAX_MX seconds),
+ * as required by the UPnP device architecture. If a response to the same client is already scheduled,
+ * the new targets are added to it and all are sent together.
+*/
+void TorcSSDPPriv::ProcessSearch(const TorcSSDPMessage &Message, const QHostAddress &Address, quint16 Port)
 {
-    // NB this ignores the date header - just assume it is correct
-    int index = Expires.indexOf("max-age", 0, Qt::CaseInsensitive);
-    if (index > -1)
+    if (!m_started || m_targets.isEmpty() || !Message.Equals(TorcSSDPMessage::MAN, "\"ssdp:discover\""))
+        return;
+
+    QString searchtarget = Message.Value(TorcSSDPMessage::ST);
+    if (searchtarget.isEmpty())
+        return;
+
+    bool all = searchtarget == "ssdp:all";
+    QList<TorcSSDPTarget> matches;
+    foreach (const TorcSSDPTarget &target, m_targets)
+        if (all || target.m_type == searchtarget)
+            matches << target;
+
+    if (matches.isEmpty())
+        return;
+
+    // unicast searches have no MX and are answered immediately
+    int mx = Message.Integer(TorcSSDPMessage::MX);
+    int delay = mx > 0 ? qrand() % (qMin(mx, SEARCH_MAX_MX) * 1000) : 0;
+    qint64 due = QDateTime::currentMSecsSinceEpoch() + delay;
+
+    LOG(VB_NETWORK, LOG_DEBUG, QString("M-SEARCH for '%1' from %2:%3 - responding in %4ms")
+        .arg(searchtarget).arg(Address.toString()).arg(Port).arg(delay));
+
+    for (int i = 0; i < m_responses.size(); ++i)
+    {
+        TorcSSDPResponse &response = m_responses[i];
+        if (response.m_port == Port && response.m_address == Address)
+        {
+            foreach (const TorcSSDPTarget &target, matches)
+                if (!response.m_targets.contains(target))
+                    response.m_targets.append(target);
+            if (due < response.m_due)
+                response.m_due = due;
+            m_parent->Schedule(response.m_due - QDateTime::currentMSecsSinceEpoch());
+            return;
+        }
+    }
+
+    if (m_responses.size() >= SEARCH_MAX_RESPONSES)
+    {
+        LOG(VB_NETWORK, LOG_DEBUG, QString("Too many pending search responses - ignoring M-SEARCH from %1").arg(Address.toString()));
+        return;
+    }
+
+    TorcSSDPResponse response;
+    response.m_address = Address;
+    response.m_port    = Port;
+    response.m_due     = due;
+    response.m_targets = matches;
+    m_responses.append(response);
+    m_parent->Schedule(delay);
+}
+
+/*! \brief Send any notifications and responses that are due and schedule the next.
+*/
+void TorcSSDPPriv::ProcessSchedule(void)
+{
+    if (!m_started)
+        return;
+
+    qint64 now  = QDateTime::currentMSecsSinceEpoch();
+    qint64 next = -1;
+
+    for (int i = 0; i < m_targets.size(); ++i)
+    {
+        TorcSSDPTarget &target = m_targets[i];
+        if (target.m_next <= now)
+        {
+            // try again shortly if the web server is not yet listening, otherwise repeat new
+            // announcements shortly afterwards, then refresh at a random point in the period
+            if (!Notify(target, true/*alive*/))
+                target.m_next = now + ANNOUNCE_RETRY;
+            else if (target.m_repeats > 1)
+            {
+                target.m_repeats--;
+                target.m_next = now + 1000 + qrand() % 1000;
+            }
+            else
+            {
+                target.m_repeats = 0;
+                target.m_next = now + ANNOUNCE_REFRESH_MIN + qrand() % (ANNOUNCE_REFRESH_MAX - ANNOUNCE_REFRESH_MIN);
+            }
+        }
+
+        if (next < 0 || target.m_next < next)
+            next = target.m_next;
+    }
+
+    QList<TorcSSDPResponse>::iterator it = m_responses.begin();
+    while (it != m_responses.end())
+    {
+        if ((*it).m_due <= now)
+        {
+            Respond(*it);
+            it = m_responses.erase(it);
+            continue;
+        }
+
+        if (next < 0 || (*it).m_due < next)
+            next = (*it).m_due;
+        ++it;
+    }
+
+    if (next > -1)
+        m_parent->Schedule(next - now);
+}
+
+/*! \brief Return the LOCATION URL for Target when sent via IPv4 or IPv6.
+ *
+ * An absolute location is returned unchanged. A path is completed with the first local address of the
+ * appropriate protocol and the web server port. An empty result means the location is not (yet) known.
+*/
+QByteArray TorcSSDPPriv::Location(const TorcSSDPTarget &Target, bool IPv6)
+{
+    if (!Target.m_location.startsWith("/"))
+        return Target.m_location.toUtf8();
+
+    int port = TorcHTTPServer::GetPort();
+    if (port < 1)
+        return QByteArray();
+
+    QAbstractSocket::NetworkLayerProtocol protocol = IPv6 ? QAbstractSocket::IPv6Protocol : QAbstractSocket::IPv4Protocol;
+    foreach (QHostAddress address, m_addressess)
+    {
+        if (address.protocol() != protocol || address.isLoopback())
+            continue;
+
+        address.setScopeId(QString());
+        QString host = IPv6 ? "[" + address.toString() + "]" : address.toString();
+        return QString("http://%1:%2%3").arg(host).arg(port).arg(Target.m_location).toUtf8();
+    }
+
+    return QByteArray();
+}
+
+/*! \brief Multicast an ssdp:alive or ssdp:byebye notification for Target.
+ *
+ * \returns False if nothing was sent because the location of Target is not yet known.
+*/
+bool TorcSSDPPriv::Notify(const TorcSSDPTarget &Target, bool Alive)
+{
+    bool sent = false;
+    QByteArray notify("NOTIFY * HTTP/1.1\r\n");
+    QByteArray headers;
+    headers += "NT: " + Target.m_type.toUtf8() + "\r\n";
+    headers += "NTS: " + QByteArray(Alive ? "ssdp:alive" : "ssdp:byebye") + "\r\n";
+    headers += "USN: " + Target.m_usn.toUtf8() + "\r\n\r\n";
+
+    for (int i = 0; i < 2; ++i)
     {
-        int index2 = Expires.indexOf("=", index);
-        if (index2 > -1)
+        bool ipv6 = i > 0;
+        QUdpSocket *socket = ipv6 ? m_ipv6LinkSearchSocket : m_ipv4SearchSocket;
+        if (!socket)
+            continue;
+
+        QByteArray message = notify + (ipv6 ? "HOST: [FF02::C]:1900\r\n" : "HOST: 239.255.255.250:1900\r\n");
+        if (Alive)
         {
-            int seconds = Expires.mid(index2 + 1).toInt();
-            return QDateTime::currentMSecsSinceEpoch() + 1000 * seconds;
+            QByteArray location = Location(Target, ipv6);
+            if (location.isEmpty())
+                continue;
+
+            message += "CACHE-CONTROL: max-age=" + QByteArray::number(ANNOUNCE_MAX_AGE) + "\r\n";
+            message += "LOCATION: " + location + "\r\n";
+            message += "SERVER: " + m_serverName + "\r\n";
         }
+
+        Send(socket, message + headers, ipv6 ? m_ipv6LinkGroupAddress : m_ipv4GroupAddress, 1900);
+        sent = true;
+    }
+
+    return sent;
+}
+
+/// Send a unicast response for each target in Response.
+void TorcSSDPPriv::Respond(const TorcSSDPResponse &Response)
+{
+    bool ipv6 = Response.m_address.protocol() == QAbstractSocket::IPv6Protocol;
+    QUdpSocket *socket = ipv6 ? m_ipv6LinkSearchSocket : m_ipv4SearchSocket;
+    if (!socket)
+        return;
+
+    QByteArray date = QDateTime::currentDateTimeUtc().toString(TorcHTTPRequest::DateFormat).toLatin1();
+
+    foreach (const TorcSSDPTarget &target, Response.m_targets)
+    {
+        QByteArray location = Location(target, ipv6);
+        if (location.isEmpty())
+            continue;
+
+        QByteArray response("HTTP/1.1 200 OK\r\n");
+        response += "CACHE-CONTROL: max-age=" + QByteArray::number(ANNOUNCE_MAX_AGE) + "\r\n";
+        response += "DATE: " + date + "\r\n";
+        response += "EXT:\r\n";
+        response += "LOCATION: " + location + "\r\n";
+        response += "SERVER: " + m_serverName + "\r\n";
+        response += "ST: " + target.m_type.toUtf8() + "\r\n";
+        response += "USN: " + target.m_usn.toUtf8() + "\r\n\r\n";
+        Send(socket, response, Response.m_address, Response.m_port);
     }
 
-    return -1;
+    LOG(VB_NETWORK, LOG_DEBUG, QString("Sent %1 search responses to %2:%3")
+        .arg(Response.m_targets.size()).arg(Response.m_address.toString()).arg(Response.m_port));
+}
+
+void TorcSSDPPriv::Send(QUdpSocket *Socket, const QByteArray &Datagram, const QHostAddress &Address, quint16 Port)
+{
+    if (!Socket || !Socket->isValid() || Socket->state() != QAbstractSocket::BoundState)
+        return;
+
+    if (Socket->writeDatagram(Datagram, Address, Port) != Datagram.size())
+        LOG(VB_GENERAL, LOG_ERR, QString("Error sending SSDP datagram (%1)").arg(Socket->errorString()));
 }
 
+/*! \brief Read and process all pending datagrams from Socket.
+ *
+ * Datagrams are read into a persistent buffer and parsed in place (see TorcSSDPMessage). Strings are
+ * only created for the headers of relevant messages.
+*/
 void TorcSSDPPriv::Read(QUdpSocket *Socket)
 {
     while (Socket && Socket->hasPendingDatagrams())
     {
         QHostAddress address;
         quint16 port;
-        QByteArray datagram;
-        datagram.resize(Socket->pendingDatagramSize());
-        Socket->readDatagram(datagram.data(), datagram.size(), &address, &port);
+
+        qint64 size = Socket->pendingDatagramSize();
+        if (size > m_datagram.size())
+            m_datagram.resize(size);
+
+        qint64 read = Socket->readDatagram(m_datagram.data(), m_datagram.size(), &address, &port);
+        if (read < 1)
+        {
+            m_datagramsDropped++;
+            continue;
+        }
 
         // filter out our own announcements
         if ((m_ipv4SearchSocket && (port == m_ipv4SearchSocket->localPort())) || (m_ipv6LinkSearchSocket && (port == m_ipv6LinkSearchSocket->localPort())))
+        {
             if (m_addressess.contains(address))
+            {
+                m_datagramsDropped++;
                 continue;
+            }
+        }
 
-        // use a QString for greater flexibility in splitting and searching text
-        QString data(datagram);
-        LOG(VB_NETWORK, LOG_DEBUG, "Raw datagram:\r\n" + data);
+        LOG(VB_NETWORK, LOG_DEBUG, "Raw datagram:\r\n" + QString::fromUtf8(m_datagram.constData(), read));
 
-        // split data into lines
-        QStringList lines = data.split("\r\n", QString::SkipEmptyParts);
-        if (!lines.isEmpty())
+        TorcSSDPMessage message;
+        if (!message.Parse(m_datagram.constData(), read))
         {
-            QMap<QString,QString> headers;
-
-            // pull out type
-            QString type = lines.takeFirst().trimmed();
+            m_datagramsDropped++;
+            continue;
+        }
 
-            // process headers
-            while (!lines.isEmpty())
-            {
-                QString header = lines.takeFirst();
-                int index = header.indexOf(':');
-                if (index > -1)
-                    headers.insert(header.left(index).trimmed().toLower(), header.mid(index + 1).trimmed());
-            }
+        m_datagramsProcessed++;
 
-            if (type.startsWith("HTTP", Qt::CaseInsensitive))
+        if (message.GetType() == TorcSSDPMessage::Response)
+        {
+            int maxage = message.MaxAge();
+            if (maxage > 0)
             {
-                // response
-                if (headers.contains("cache-control"))
-                {
-                    qint64 expires = GetExpiryTime(headers.value("cache-control"));
-                    if (expires > 0)
-                        ProcessDevice(headers.value("usn"), headers.value("st"), headers.value("location"), expires, true/*add*/);
-                }
+                ProcessDevice(message.Value(TorcSSDPMessage::USN), message.Value(TorcSSDPMessage::ST),
+                              message.Value(TorcSSDPMessage::Location),
+                              QDateTime::currentMSecsSinceEpoch() + 1000 * (qint64)maxage, true/*add*/);
             }
-            else if (type.startsWith("NOTIFY", Qt::CaseInsensitive))
+        }
+        else if (message.GetType() == TorcSSDPMessage::Notify)
+        {
+            // notfification ssdp:alive or ssdp:bye
+            if (message.Has(TorcSSDPMessage::NTS))
             {
-                // notfification ssdp:alive or ssdp:bye
-                if (headers.contains("nts"))
+                if (message.Equals(TorcSSDPMessage::NTS, "ssdp:alive"))
                 {
-                    bool add = headers["nts"] == "ssdp:alive";
-
-                    if (add)
-                    {
-                        if (headers.contains("cache-control"))
-                        {
-                            qint64 expires = GetExpiryTime(headers.value("cache-control"));
-                            if (expires > 0)
-                                ProcessDevice(headers.value("usn"), headers.value("nt"), headers.value("location"), expires, true/*add*/);
-                        }
-                    }
-                    else
+                    int maxage = message.MaxAge();
+                    if (maxage > 0)
                     {
-                        ProcessDevice(headers.value("usn"), headers.value("nt"), headers.value("location"), 1, false/*remove*/);
+                        ProcessDevice(message.Value(TorcSSDPMessage::USN), message.Value(TorcSSDPMessage::NT),
+                                      message.Value(TorcSSDPMessage::Location),
+                                      QDateTime::currentMSecsSinceEpoch() + 1000 * (qint64)maxage, true/*add*/);
                     }
                 }
+                else
+                {
+                    ProcessDevice(message.Value(TorcSSDPMessage::USN), message.Value(TorcSSDPMessage::NT),
+                                  message.Value(TorcSSDPMessage::Location), 1, false/*remove*/);
+                }
             }
-            else if (type.startsWith("M-SEARCH", Qt::CaseInsensitive))
-            {
-                // search
-            }
+        }
+        else if (message.GetType() == TorcSSDPMessage::Search)
+        {
+            ProcessSearch(message, address, port);
         }
     }
 }
@@ -425,6 +1010,8 @@ void TorcSSDPPriv::ProcessDevice(const QString &USN, const QString &Type, const
             if (desc.GetLocation() == Location && desc.GetType() == Type)
             {
                 notify = false;
+                desc.SetExpiry(Expires);
+                ScheduleExpiry(USN, Expires);
             }
             else
             {
@@ -432,6 +1019,7 @@ void TorcSSDPPriv::ProcessDevice(const QString &USN, const QString &Type, const
                 // One uses a 'upnp' sub-directory and the other 'dslforum' - and the xml is different.
                 (void)m_discoveredDevices.remove(USN);
                 m_discoveredDevices.insert(USN, TorcUPNPDescription(USN, Type, Location, Expires));
+                ScheduleExpiry(USN, Expires);
                 LOG(VB_NETWORK, LOG_DEBUG, "Updated USN: " + USN);
             }
         }
@@ -444,6 +1032,7 @@ void TorcSSDPPriv::ProcessDevice(const QString &USN, const QString &Type, const
     else if (Add)
     {
         m_discoveredDevices.insert(USN, TorcUPNPDescription(USN, Type, Location, Expires));
+        ScheduleExpiry(USN, Expires);
         LOG(VB_NETWORK, LOG_DEBUG, "Added USN: " + USN);
     }
 
@@ -470,6 +1059,25 @@ void TorcSSDPPriv::ProcessDevice(const QString &USN, const QString &Type, const
     }
 }
 
+/*! \brief Add USN to the expiry wheel slot for Expires.
+ *
+ * Expiries beyond the span of the wheel are placed in the furthest slot and rescheduled when that slot
+ * is processed. Stale entries (e.g. after an expiry update) are ignored when their slot is processed, so
+ * there is no need to remove a device from its previous slot.
+*/
+void TorcSSDPPriv::ScheduleExpiry(const QString &USN, qint64 Expires)
+{
+    // the first slot that is processed after Expires
+    qint64 current = m_expiryWheelTime / EXPIRY_WHEEL_INTERVAL;
+    qint64 slot    = qBound(current + 1, (Expires / EXPIRY_WHEEL_INTERVAL) + 1, current + EXPIRY_WHEEL_SIZE);
+    m_expiryWheel[slot % EXPIRY_WHEEL_SIZE].insert(USN);
+}
+
+/*! \brief Advance the expiry wheel and remove any devices that have expired.
+ *
+ * Only the slots that have elapsed since the last refresh are examined, rather than the complete
+ * device table.
+*/
 void TorcSSDPPriv::Refresh(void)
 {
     if (!m_started)
@@ -481,18 +1089,39 @@ void TorcSSDPPriv::Refresh(void)
     // remove stale discovered devices (if still present, they should have notified
     // a refresh)
     QList<TorcUPNPDescription> removed;
-    QMutableHashIterator<QString,TorcUPNPDescription> it(m_discoveredDevices);
-    while (it.hasNext())
+    QStringList reschedule;
+
+    int slots = qMin((qint64)EXPIRY_WHEEL_SIZE, (now / EXPIRY_WHEEL_INTERVAL) - (m_expiryWheelTime / EXPIRY_WHEEL_INTERVAL));
+    qint64 slot = m_expiryWheelTime / EXPIRY_WHEEL_INTERVAL;
+    for (int i = 0; i < slots; ++i)
     {
-        it.next();
-        if (it.value().GetExpiry() < now)
+        QSet<QString> &entries = m_expiryWheel[++slot % EXPIRY_WHEEL_SIZE];
+        foreach (const QString &usn, entries)
         {
-            removed << it.value();
-            it.remove();
-            count++;
+            QHash<QString,TorcUPNPDescription>::iterator it = m_discoveredDevices.find(usn);
+            if (it == m_discoveredDevices.end())
+                continue;
+
+            if (it.value().GetExpiry() < now)
+            {
+                removed << it.value();
+                m_discoveredDevices.erase(it);
+                count++;
+            }
+            else
+            {
+                reschedule << usn;
+            }
         }
+
+        entries.clear();
     }
 
+    m_expiryWheelTime = now;
+    foreach (const QString &usn, reschedule)
+        if (m_discoveredDevices.contains(usn))
+            ScheduleExpiry(usn, m_discoveredDevices.value(usn).GetExpiry());
+
     // notify interested parties that they've been removed
     if (!removed.isEmpty())
     {
@@ -513,7 +1142,8 @@ void TorcSSDPPriv::Refresh(void)
         }
     }
 
-    LOG(VB_NETWORK, LOG_INFO, QString("Removed %1 stale cache entries").arg(count));
+    if (count)
+        LOG(VB_NETWORK, LOG_INFO, QString("Removed %1 stale cache entries").arg(count));
 }
 
 /*! \class TorcSSDP
@@ -524,11 +1154,13 @@ void TorcSSDPPriv::Refresh(void)
 
 TorcSSDP::TorcSSDP()
   : QObject(),
+    m_scheduleTimer(0),
+    m_scheduleTime(0),
     m_priv(new TorcSSDPPriv(this)),
     m_searchTimer(0),
     m_refreshTimer(0)
 {
-    gLocalContext->AddObserver(this);
+    gLocalContext->AddObserver(this, QList<int>() << Torc::NetworkAvailable << Torc::NetworkUnavailable);
 
     if (TorcNetwork::IsAvailable())
     {
@@ -539,9 +1171,8 @@ TorcSSDP::TorcSSDP()
         m_searchTimer = startTimer(3000 + qrand() % 2000, Qt::CoarseTimer);
     }
 
-    // minimum advertisement duration is 30 mins (1800 seconds). Check for expiry
-    // every 5 minutes and flush stale entries
-    m_refreshTimer = startTimer(5 * 60 * 1000, Qt::VeryCoarseTimer);
+    // advance the expiry wheel and flush stale entries
+    m_refreshTimer = startTimer(EXPIRY_WHEEL_INTERVAL, Qt::VeryCoarseTimer);
 }
 
 TorcSSDP::~TorcSSDP()
@@ -552,6 +1183,9 @@ TorcSSDP::~TorcSSDP()
     if (m_refreshTimer)
         killTimer(m_refreshTimer);
 
+    if (m_scheduleTimer)
+        killTimer(m_scheduleTimer);
+
     gLocalContext->RemoveObserver(this);
     delete m_priv;
 }
@@ -659,6 +1293,22 @@ TorcSSDP* TorcSSDP::Create(bool Destroy)
     return NULL;
 }
 
+/// Ensure the announcement/response schedule is processed within Delay milliseconds.
+void TorcSSDP::Schedule(qint64 Delay)
+{
+    qint64 due = QDateTime::currentMSecsSinceEpoch() + qMax((qint64)0, Delay);
+
+    // already scheduled sooner
+    if (m_scheduleTimer && m_scheduleTime <= due)
+        return;
+
+    if (m_scheduleTimer)
+        killTimer(m_scheduleTimer);
+
+    m_scheduleTime  = due;
+    m_scheduleTimer = startTimer(qMax((qint64)0, Delay), Qt::PreciseTimer);
+}
+
 void TorcSSDP::SearchPriv(const QString &Type, QObject *Owner)
 {
     if (m_priv)
@@ -722,6 +1372,13 @@ bool TorcSSDP::event(QEvent *Event)
             {
                 m_priv->Refresh();
             }
+            else if (event->timerId() == m_scheduleTimer)
+            {
+                killTimer(m_scheduleTimer);
+                m_scheduleTimer = 0;
+                if (m_priv)
+                    m_priv->ProcessSchedule();
+            }
         }
     }
 
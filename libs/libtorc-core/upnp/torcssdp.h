@@ -13,6 +13,7 @@ class TorcSSDPPriv;
 class TORC_CORE_PUBLIC TorcSSDP : public QObject
 {
     friend class TorcSSDPThread;
+    friend class TorcSSDPPriv;
 
     Q_OBJECT
 
@@ -27,6 +28,7 @@ class TORC_CORE_PUBLIC TorcSSDP : public QObject
     ~TorcSSDP();
 
     static TorcSSDP* Create             (bool Destroy = false);
+    void             Schedule           (qint64 Delay);
 
   protected slots:
     void             SearchPriv         (const QString &Type, QObject *Owner);
@@ -37,6 +39,9 @@ class TORC_CORE_PUBLIC TorcSSDP : public QObject
     void             Read               (void);
 
   private:
+    // N.B. initialised before m_priv, which may schedule announcements
+    int              m_scheduleTimer;
+    qint64           m_scheduleTime;
     TorcSSDPPriv    *m_priv;
     int              m_searchTimer;
     int              m_refreshTimer;
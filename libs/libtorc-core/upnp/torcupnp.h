@@ -5,6 +5,7 @@
 #include "torclocalcontext.h"
 
 #define TORC_ROOT_UPNP_DEVICE QString("urn:schemas-torcdvr-org:device:TorcClient:1")
+#define TORC_ROOT_UPNP_LOCATION QString("/services/GetDetails")
 
 class TORC_CORE_PUBLIC TorcUPNPDescription
 {
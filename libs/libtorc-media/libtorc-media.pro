@@ -8,11 +8,17 @@ CONFIG += thread dll
 target.path = $${LIBDIR}
 INSTALLS = target
 
+DEPENDPATH  += ../libtorc-audio ../libtorc-av
 INCLUDEPATH += ../libtorc-core ../libtorc-core/platforms
 INCLUDEPATH += ../.. ../
 INCLUDEPATH += $$DEPENDPATH
 
 LIBS += -L../libtorc-core -ltorc-core-$$LIBVERSION
+LIBS += -L../libtorc-audio -ltorc-audio-$$LIBVERSION
+LIBS += -L../libtorc-av/libavformat -ltorc-avformat
+LIBS += -L../libtorc-av/libavcodec -ltorc-avcodec
+LIBS += -L../libtorc-av/libavutil -ltorc-avutil
+LIBS += -L../libtorc-av/libswscale -ltorc-swscale
 
 QMAKE_CLEAN += $(TARGET) $(TARGETA) $(TARGETD) $(TARGET0) $(TARGET1) $(TARGET2)
 
@@ -26,6 +32,10 @@ HEADERS += torcmediamaster.h
 HEADERS += torcmediamasterfilter.h
 HEADERS += torcmediasourcedirectory.h
 HEADERS += torcmediasourcepeer.h
+HEADERS += torcmediaindex.h
+HEADERS += torcmediascanner.h
+HEADERS += torcmediawatcher.h
+HEADERS += torcmetadataextractor.h
 
 SOURCES += torcmedia.cpp
 SOURCES += torcmetadata.cpp
@@ -34,6 +44,10 @@ SOURCES += torcmediamaster.cpp
 SOURCES += torcmediamasterfilter.cpp
 SOURCES += torcmediasourcedirectory.cpp
 SOURCES += torcmediasourcepeer.cpp
+SOURCES += torcmediaindex.cpp
+SOURCES += torcmediascanner.cpp
+SOURCES += torcmediawatcher.cpp
+SOURCES += torcmetadataextractor.cpp
 
 inc.path   = $${PREFIX}/include/$${PROJECTNAME}/
 inc.files  = torcmedia.h
@@ -20,6 +20,12 @@
 * USA.
 */
 
+// Std
+#include <wchar.h>
+
+// Qt
+#include <QVarLengthArray>
+
 // Torc
 #include "torcmedia.h"
 #include "torcmetadata.h"
@@ -83,11 +89,71 @@ TorcMetadata* TorcMedia::GetMetadata(void)
     return metadata;
 }
 
+/*! \brief Return the technical details of this item (duration, codecs, resolution, artwork etc).
+ *
+ * Details are populated asynchronously and may be empty.
+ * \sa TorcMetadataExtractor
+*/
+QVariantMap TorcMedia::GetDetails(void)
+{
+    return details;
+}
+
+/*! \brief Return a locale aware sort key for the name of this item.
+ *
+ * The key is created on first use and cached until the name changes.
+ * \sa CollationKey
+*/
+QByteArray TorcMedia::GetNameSortKey(void)
+{
+    if (nameSortKey.isEmpty() && !name.isEmpty())
+        nameSortKey = CollationKey(name);
+    return nameSortKey;
+}
+
+/// Return a locale aware sort key for the URL of this item.
+QByteArray TorcMedia::GetURLSortKey(void)
+{
+    if (urlSortKey.isEmpty() && !url.isEmpty())
+        urlSortKey = CollationKey(url);
+    return urlSortKey;
+}
+
+/*! \brief Create a sort key for String using the current collation locale.
+ *
+ * Comparing two keys with memcmp (shorter keys first when equal) gives the same ordering as comparing
+ * the original strings with wcscoll, but is considerably cheaper when the same strings are compared repeatedly
+ * (e.g. when sorting).
+*/
+QByteArray TorcMedia::CollationKey(const QString &String)
+{
+    QVarLengthArray<wchar_t, 256> source(String.size() + 1);
+    source[String.toWCharArray(source.data())] = 0;
+
+    size_t length = wcsxfrm(NULL, source.constData(), 0);
+    QVarLengthArray<wchar_t, 512> key(length + 1);
+    wcsxfrm(key.data(), source.constData(), length + 1);
+
+    // store big endian, so that the result can be compared bytewise
+    QByteArray result(length * sizeof(wchar_t), 0);
+    uchar *data = (uchar*)result.data();
+    for (size_t i = 0; i < length; ++i)
+    {
+        quint32 value = (quint32)key[i];
+        for (int j = sizeof(wchar_t) - 1; j >= 0; --j, value >>= 8)
+            data[j] = value & 0xff;
+        data += sizeof(wchar_t);
+    }
+
+    return result;
+}
+
 void TorcMedia::SetName(const QString &Name)
 {
     if (name != Name)
     {
         name = Name;
+        nameSortKey.clear();
         emit nameChanged(name);
     }
 }
@@ -97,6 +163,7 @@ void TorcMedia::SetURL(const QString &URL)
     if (url != URL)
     {
         url = URL;
+        urlSortKey.clear();
         emit urlChanged(url);
     }
 }
@@ -131,6 +198,15 @@ void TorcMedia::SetMetadata(TorcMetadata *Metadata)
     }
 }
 
+void TorcMedia::SetDetails(const QVariantMap &Details)
+{
+    if (details != Details)
+    {
+        details = Details;
+        emit detailsChanged();
+    }
+}
+
 TorcMediaDescription::TorcMediaDescription()
   : name(),
     url(),
@@ -4,6 +4,8 @@
 // Qt
 #include <QObject>
 #include <QMetaType>
+#include <QVariant>
+#include <QByteArray>
 
 // Torc
 #include "torcmediaexport.h"
@@ -62,12 +64,18 @@ class TORC_MEDIA_PUBLIC TorcMedia : public QObject
     Q_PROPERTY (MediaType     type     READ GetMediaType   WRITE SetMediaType   NOTIFY typeChanged)
     Q_PROPERTY (MediaSource   source   READ GetMediaSource WRITE SetMediaSource NOTIFY sourceChanged)
     Q_PROPERTY (TorcMetadata* metadata READ GetMetadata    WRITE SetMetadata    NOTIFY metadataChanged)
+    Q_PROPERTY (QVariantMap   details  READ GetDetails     NOTIFY detailsChanged)
 
     QString           GetName          (void);
     QString           GetURL           (void);
     MediaType         GetMediaType     (void);
     MediaSource       GetMediaSource   (void);
     TorcMetadata*     GetMetadata      (void);
+    QVariantMap       GetDetails       (void);
+    QByteArray        GetNameSortKey   (void);
+    QByteArray        GetURLSortKey    (void);
+
+    static QByteArray CollationKey     (const QString &String);
 
     void              SetValid         (bool Valid);
     void              SetName          (const QString &Name);
@@ -75,6 +83,7 @@ class TORC_MEDIA_PUBLIC TorcMedia : public QObject
     void              SetMediaType     (MediaType Type);
     void              SetMediaSource   (MediaSource Source);
     void              SetMetadata      (TorcMetadata *Metadata);
+    void              SetDetails       (const QVariantMap &Details);
 
   signals:
     void              nameChanged      (const QString&);
@@ -82,6 +91,7 @@ class TORC_MEDIA_PUBLIC TorcMedia : public QObject
     void              typeChanged      (MediaType);
     void              sourceChanged    (MediaSource);
     void              metadataChanged  (TorcMetadata*);
+    void              detailsChanged   (void);
 
   private:
     QString           name;
@@ -89,6 +99,9 @@ class TORC_MEDIA_PUBLIC TorcMedia : public QObject
     MediaType         type;
     MediaSource       source;
     TorcMetadata*     metadata;
+    QVariantMap       details;
+    QByteArray        nameSortKey;
+    QByteArray        urlSortKey;
 };
 
 class TORC_MEDIA_PUBLIC TorcMediaDescription
@@ -103,6 +116,7 @@ class TORC_MEDIA_PUBLIC TorcMediaDescription
     TorcMedia::MediaType    type;
     TorcMedia::MediaSource  source;
     TorcMetadata*           metadata;
+    QVariantMap             details;
 };
 
 Q_DECLARE_METATYPE(TorcMedia*);
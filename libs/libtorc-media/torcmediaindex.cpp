@@ -0,0 +1,425 @@
+/* Class TorcMediaIndex
+*
+* This file is part of the Torc project.
+*
+* Copyright (C) Mark Kendall 2013
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+* USA.
+*/
+
+// Qt
+#include <QtSql>
+#include <QFile>
+#include <QThread>
+#include <QDataStream>
+#include <QCoreApplication>
+
+// Torc
+#include "torclogging.h"
+#include "torcdirectories.h"
+#include "torcmediaindex.h"
+
+#define MEDIA_INDEX_VERSION 2
+
+TorcMediaIndexFile::TorcMediaIndexFile()
+  : m_size(0),
+    m_modified(0),
+    m_type(TorcMedia::UnknownType)
+{
+}
+
+TorcMediaIndexFile::TorcMediaIndexFile(const QString &Path, const QString &Directory, qint64 Size, qint64 Modified, TorcMedia::MediaType Type)
+  : m_path(Path),
+    m_directory(Directory),
+    m_size(Size),
+    m_modified(Modified),
+    m_type(Type)
+{
+}
+
+TorcMediaIndexDirectory::TorcMediaIndexDirectory()
+  : m_modified(0)
+{
+}
+
+/*! \class TorcMediaIndex
+ *  \brief A persistent index of local media files and the directories that contain them.
+ *
+ * The index is stored in its own SQLite database (alongside the settings database, which is
+ * opened exclusively) and records the path, size, modification time and type of each media file
+ * and the modification time of each scanned directory.
+ *
+ * The technical details of each file (see TorcMetadataExtractor) are also stored, and are only returned
+ * if the size and modification time of the file still match.
+ *
+ * It allows TorcMediaSourceDirectory to make the last known state of the library available immediately
+ * on startup and then only rescan directories whose modification time has changed.
+ *
+ * \note A single connection is used and TorcMediaIndex must only be used from the thread that created it.
+ *
+ * \sa TorcMediaSourceDirectory
+*/
+TorcMediaIndex::TorcMediaIndex()
+  : m_valid(false),
+    m_connection(QString("MediaIndex-%1").arg((unsigned long long)QThread::currentThread())),
+    m_setDirectory(NULL),
+    m_removeDirectory(NULL),
+    m_removeDirectoryFiles(NULL),
+    m_addFile(NULL),
+    m_removeFile(NULL),
+    m_getDetails(NULL),
+    m_setDetails(NULL),
+    m_removeDetails(NULL),
+    m_removeDirectoryDetails(NULL),
+    m_getArtwork(NULL),
+    m_getDirectoryArtwork(NULL)
+{
+    m_valid = Open();
+}
+
+TorcMediaIndex::~TorcMediaIndex()
+{
+    delete m_setDirectory;
+    delete m_removeDirectory;
+    delete m_removeDirectoryFiles;
+    delete m_addFile;
+    delete m_removeFile;
+    delete m_getDetails;
+    delete m_setDetails;
+    delete m_removeDetails;
+    delete m_removeDirectoryDetails;
+    delete m_getArtwork;
+    delete m_getDirectoryArtwork;
+
+    {
+        QSqlDatabase db = QSqlDatabase::database(m_connection, false);
+        if (db.isOpen())
+            db.close();
+    }
+
+    QSqlDatabase::removeDatabase(m_connection);
+}
+
+bool TorcMediaIndex::IsValid(void)
+{
+    return m_valid;
+}
+
+bool TorcMediaIndex::Open(void)
+{
+    QString name = GetTorcConfigDir() + "/" + QCoreApplication::applicationName() + "-media.sqlite";
+    LOG(VB_GENERAL, LOG_INFO, QString("Opening media index '%1'").arg(name));
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", m_connection);
+    db.setDatabaseName(name);
+    if (!db.open())
+    {
+        LOG(VB_GENERAL, LOG_ERR, QString("Failed to open media index (%1)").arg(db.lastError().text()));
+        return false;
+    }
+
+    QSqlQuery query(db);
+
+    query.exec("PRAGMA page_size = 4096");
+    query.exec("PRAGMA cache_size = 16384");
+    query.exec("PRAGMA temp_store = MEMORY");
+    query.exec("PRAGMA journal_mode = WAL");
+    query.exec("PRAGMA synchronous = NORMAL");
+
+    // discard an index created by a different version
+    query.exec("CREATE TABLE IF NOT EXISTS version ( version INTEGER NOT NULL );");
+    DebugError(&query);
+    query.exec("SELECT version FROM version;");
+    int version = query.first() ? query.value(0).toInt() : 0;
+
+    if (version != MEDIA_INDEX_VERSION)
+    {
+        if (version)
+            LOG(VB_GENERAL, LOG_INFO, QString("Media index version %1 - recreating").arg(version));
+
+        query.exec("DROP TABLE IF EXISTS directories;");
+        query.exec("DROP TABLE IF EXISTS files;");
+        query.exec("DROP TABLE IF EXISTS details;");
+        query.exec("DELETE FROM version;");
+        query.exec(QString("INSERT INTO version (version) VALUES (%1);").arg(MEDIA_INDEX_VERSION));
+        DebugError(&query);
+    }
+
+    query.exec("CREATE TABLE IF NOT EXISTS directories "
+               "( path TEXT PRIMARY KEY NOT NULL,"
+               "  parent TEXT NOT NULL,"
+               "  modified INTEGER NOT NULL );");
+    if (DebugError(&query))
+        return false;
+
+    query.exec("CREATE TABLE IF NOT EXISTS files "
+               "( path TEXT PRIMARY KEY NOT NULL,"
+               "  directory TEXT NOT NULL,"
+               "  size INTEGER NOT NULL,"
+               "  modified INTEGER NOT NULL,"
+               "  type INTEGER NOT NULL );");
+    if (DebugError(&query))
+        return false;
+
+    query.exec("CREATE INDEX IF NOT EXISTS files_directory ON files (directory);");
+    DebugError(&query);
+
+    query.exec("CREATE TABLE IF NOT EXISTS details "
+               "( path TEXT PRIMARY KEY NOT NULL,"
+               "  size INTEGER NOT NULL,"
+               "  modified INTEGER NOT NULL,"
+               "  details BLOB NOT NULL );");
+    if (DebugError(&query))
+        return false;
+
+    m_setDirectory = new QSqlQuery(db);
+    m_setDirectory->prepare("INSERT OR REPLACE INTO directories (path, parent, modified) VALUES (:PATH, :PARENT, :MODIFIED);");
+    m_removeDirectory = new QSqlQuery(db);
+    m_removeDirectory->prepare("DELETE FROM directories WHERE path=:PATH;");
+    m_removeDirectoryFiles = new QSqlQuery(db);
+    m_removeDirectoryFiles->prepare("DELETE FROM files WHERE directory=:PATH;");
+    m_addFile = new QSqlQuery(db);
+    m_addFile->prepare("INSERT OR REPLACE INTO files (path, directory, size, modified, type) VALUES (:PATH, :DIRECTORY, :SIZE, :MODIFIED, :TYPE);");
+    m_removeFile = new QSqlQuery(db);
+    m_removeFile->prepare("DELETE FROM files WHERE path=:PATH;");
+    m_getDetails = new QSqlQuery(db);
+    m_getDetails->prepare("SELECT details FROM details WHERE path=:PATH AND size=:SIZE AND modified=:MODIFIED;");
+    m_setDetails = new QSqlQuery(db);
+    m_setDetails->prepare("INSERT OR REPLACE INTO details (path, size, modified, details) VALUES (:PATH, :SIZE, :MODIFIED, :DETAILS);");
+    m_removeDetails = new QSqlQuery(db);
+    m_removeDetails->prepare("DELETE FROM details WHERE path=:PATH;");
+    m_removeDirectoryDetails = new QSqlQuery(db);
+    m_removeDirectoryDetails->prepare("DELETE FROM details WHERE path IN (SELECT path FROM files WHERE directory=:PATH);");
+    m_getArtwork = new QSqlQuery(db);
+    m_getArtwork->prepare("SELECT details FROM details WHERE path=:PATH;");
+    m_getDirectoryArtwork = new QSqlQuery(db);
+    m_getDirectoryArtwork->prepare("SELECT details FROM details WHERE path IN (SELECT path FROM files WHERE directory=:PATH);");
+
+    return true;
+}
+
+/*! \brief Load the complete index.
+ *
+ * The file and subdirectory lists of each directory are populated from the files and directories tables.
+*/
+void TorcMediaIndex::Load(QHash<QString,TorcMediaIndexDirectory> &Directories, QHash<QString,TorcMediaIndexFile> &Files)
+{
+    if (!m_valid)
+        return;
+
+    QSqlDatabase db = QSqlDatabase::database(m_connection);
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+
+    query.exec("SELECT path, parent, modified FROM directories;");
+    DebugError(&query);
+    while (query.next())
+    {
+        TorcMediaIndexDirectory &directory = Directories[query.value(0).toString()];
+        directory.m_parent   = query.value(1).toString();
+        directory.m_modified = query.value(2).toLongLong();
+    }
+
+    QList<QPair<QString,QString> > children;
+    QHash<QString,TorcMediaIndexDirectory>::const_iterator it = Directories.constBegin();
+    for ( ; it != Directories.constEnd(); ++it)
+        children.append(qMakePair(it.value().m_parent, it.key()));
+
+    for (int i = 0; i < children.size(); ++i)
+    {
+        QHash<QString,TorcMediaIndexDirectory>::iterator parent = Directories.find(children[i].first);
+        if (parent != Directories.end())
+            parent.value().m_directories.append(children[i].second);
+    }
+
+    query.exec("SELECT path, directory, size, modified, type FROM files;");
+    DebugError(&query);
+    while (query.next())
+    {
+        TorcMediaIndexFile file(query.value(0).toString(), query.value(1).toString(), query.value(2).toLongLong(),
+                                query.value(3).toLongLong(), (TorcMedia::MediaType)query.value(4).toInt());
+        Files.insert(file.m_path, file);
+
+        QHash<QString,TorcMediaIndexDirectory>::iterator directory = Directories.find(file.m_directory);
+        if (directory != Directories.end())
+            directory.value().m_files.append(file.m_path);
+    }
+
+    LOG(VB_GENERAL, LOG_INFO, QString("Loaded %1 directories and %2 files from media index")
+        .arg(Directories.size()).arg(Files.size()));
+}
+
+/*! \brief Start a transaction.
+ *
+ * Updates from a scan should be grouped into a single transaction, which is considerably faster
+ * than committing each change individually.
+*/
+void TorcMediaIndex::Begin(void)
+{
+    if (m_valid)
+        QSqlDatabase::database(m_connection).transaction();
+}
+
+void TorcMediaIndex::Commit(void)
+{
+    if (m_valid)
+        QSqlDatabase::database(m_connection).commit();
+}
+
+void TorcMediaIndex::SetDirectory(const QString &Path, const QString &Parent, qint64 Modified)
+{
+    if (!m_valid)
+        return;
+
+    m_setDirectory->bindValue(":PATH", Path);
+    m_setDirectory->bindValue(":PARENT", Parent);
+    m_setDirectory->bindValue(":MODIFIED", Modified);
+    m_setDirectory->exec();
+    DebugError(m_setDirectory);
+}
+
+/*! \brief Remove a directory and the files it contains.
+ *
+ * Subdirectories are not removed and must be removed individually.
+*/
+void TorcMediaIndex::RemoveDirectory(const QString &Path)
+{
+    if (!m_valid)
+        return;
+
+    m_removeDirectory->bindValue(":PATH", Path);
+    m_removeDirectory->exec();
+    DebugError(m_removeDirectory);
+
+    RemoveArtwork(m_getDirectoryArtwork, Path);
+
+    m_removeDirectoryDetails->bindValue(":PATH", Path);
+    m_removeDirectoryDetails->exec();
+    DebugError(m_removeDirectoryDetails);
+
+    m_removeDirectoryFiles->bindValue(":PATH", Path);
+    m_removeDirectoryFiles->exec();
+    DebugError(m_removeDirectoryFiles);
+}
+
+void TorcMediaIndex::AddFile(const TorcMediaIndexFile &File)
+{
+    if (!m_valid)
+        return;
+
+    m_addFile->bindValue(":PATH", File.m_path);
+    m_addFile->bindValue(":DIRECTORY", File.m_directory);
+    m_addFile->bindValue(":SIZE", File.m_size);
+    m_addFile->bindValue(":MODIFIED", File.m_modified);
+    m_addFile->bindValue(":TYPE", (int)File.m_type);
+    m_addFile->exec();
+    DebugError(m_addFile);
+}
+
+void TorcMediaIndex::RemoveFile(const QString &Path)
+{
+    if (!m_valid)
+        return;
+
+    m_removeFile->bindValue(":PATH", Path);
+    m_removeFile->exec();
+    DebugError(m_removeFile);
+
+    RemoveArtwork(m_getArtwork, Path);
+
+    m_removeDetails->bindValue(":PATH", Path);
+    m_removeDetails->exec();
+    DebugError(m_removeDetails);
+}
+
+/*! \brief Retrieve the cached details for Path.
+ *
+ * \returns False if there are no details or the file has changed since they were stored.
+*/
+bool TorcMediaIndex::GetDetails(const QString &Path, qint64 Size, qint64 Modified, QVariantMap &Details)
+{
+    if (!m_valid)
+        return false;
+
+    m_getDetails->bindValue(":PATH", Path);
+    m_getDetails->bindValue(":SIZE", Size);
+    m_getDetails->bindValue(":MODIFIED", Modified);
+    m_getDetails->exec();
+    if (DebugError(m_getDetails) || !m_getDetails->first())
+        return false;
+
+    QByteArray data = m_getDetails->value(0).toByteArray();
+    m_getDetails->finish();
+
+    QDataStream stream(data);
+    stream >> Details;
+    return stream.status() == QDataStream::Ok;
+}
+
+void TorcMediaIndex::SetDetails(const QString &Path, qint64 Size, qint64 Modified, const QVariantMap &Details)
+{
+    if (!m_valid)
+        return;
+
+    QByteArray data;
+    {
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << Details;
+    }
+
+    m_setDetails->bindValue(":PATH", Path);
+    m_setDetails->bindValue(":SIZE", Size);
+    m_setDetails->bindValue(":MODIFIED", Modified);
+    m_setDetails->bindValue(":DETAILS", data);
+    m_setDetails->exec();
+    DebugError(m_setDetails);
+}
+
+/// Delete any artwork files referenced by the details selected by Query for Path.
+void TorcMediaIndex::RemoveArtwork(QSqlQuery *Query, const QString &Path)
+{
+    Query->bindValue(":PATH", Path);
+    Query->exec();
+    if (DebugError(Query))
+        return;
+
+    while (Query->next())
+    {
+        QVariantMap details;
+        QByteArray data = Query->value(0).toByteArray();
+        QDataStream stream(data);
+        stream >> details;
+
+        QString artwork = details.value("artwork").toString();
+        if (!artwork.isEmpty() && QFile::exists(artwork) && !QFile::remove(artwork))
+            LOG(VB_GENERAL, LOG_WARNING, QString("Failed to remove artwork '%1'").arg(artwork));
+    }
+
+    Query->finish();
+}
+
+bool TorcMediaIndex::DebugError(QSqlQuery *Query)
+{
+    if (!Query)
+        return true;
+
+    QSqlError error = Query->lastError();
+    if (error.type() == QSqlError::NoError)
+        return false;
+
+    LOG(VB_GENERAL, LOG_ERR, QString("Media index error: %1").arg(error.text()));
+    return true;
+}
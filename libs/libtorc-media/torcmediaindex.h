@@ -0,0 +1,79 @@
+#ifndef TORCMEDIAINDEX_H
+#define TORCMEDIAINDEX_H
+
+// Qt
+#include <QHash>
+#include <QString>
+#include <QVariant>
+#include <QStringList>
+
+// Torc
+#include "torcmediaexport.h"
+#include "torcmedia.h"
+
+class QSqlQuery;
+
+class TorcMediaIndexFile
+{
+  public:
+    TorcMediaIndexFile();
+    TorcMediaIndexFile(const QString &Path, const QString &Directory, qint64 Size, qint64 Modified, TorcMedia::MediaType Type);
+
+    QString               m_path;
+    QString               m_directory;
+    qint64                m_size;
+    qint64                m_modified;
+    TorcMedia::MediaType  m_type;
+};
+
+class TorcMediaIndexDirectory
+{
+  public:
+    TorcMediaIndexDirectory();
+
+    QString               m_parent;
+    qint64                m_modified;
+    QStringList           m_files;
+    QStringList           m_directories;
+};
+
+class TORC_MEDIA_PUBLIC TorcMediaIndex
+{
+  public:
+    TorcMediaIndex();
+    ~TorcMediaIndex();
+
+    bool         IsValid            (void);
+    void         Load               (QHash<QString,TorcMediaIndexDirectory> &Directories,
+                                     QHash<QString,TorcMediaIndexFile> &Files);
+    void         Begin              (void);
+    void         Commit             (void);
+    void         SetDirectory       (const QString &Path, const QString &Parent, qint64 Modified);
+    void         RemoveDirectory    (const QString &Path);
+    void         AddFile            (const TorcMediaIndexFile &File);
+    void         RemoveFile         (const QString &Path);
+    bool         GetDetails         (const QString &Path, qint64 Size, qint64 Modified, QVariantMap &Details);
+    void         SetDetails         (const QString &Path, qint64 Size, qint64 Modified, const QVariantMap &Details);
+
+  private:
+    bool         Open               (void);
+    void         RemoveArtwork      (QSqlQuery *Query, const QString &Path);
+    static bool  DebugError         (QSqlQuery *Query);
+
+  private:
+    bool         m_valid;
+    QString      m_connection;
+    QSqlQuery   *m_setDirectory;
+    QSqlQuery   *m_removeDirectory;
+    QSqlQuery   *m_removeDirectoryFiles;
+    QSqlQuery   *m_addFile;
+    QSqlQuery   *m_removeFile;
+    QSqlQuery   *m_getDetails;
+    QSqlQuery   *m_setDetails;
+    QSqlQuery   *m_removeDetails;
+    QSqlQuery   *m_removeDirectoryDetails;
+    QSqlQuery   *m_getArtwork;
+    QSqlQuery   *m_getDirectoryArtwork;
+};
+
+#endif // TORCMEDIAINDEX_H
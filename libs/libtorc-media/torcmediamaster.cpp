@@ -21,13 +21,41 @@
 */
 
 // Qt
+#include <QVector>
+#include <QtAlgorithms>
+
+// Torc
 #include "torclogging.h"
 #include "torclocalcontext.h"
 #include "torcevent.h"
 #include "torcmediamaster.h"
 
+// if removals span more ranges than this, reset the model instead
+#define MAX_REMOVE_RANGES 32
+
 TorcMediaMaster *gTorcMediaMaster = NULL;
 
+/*! \class TorcMediaEvent
+ *  \brief A TorcEvent carrying a list of media descriptions.
+ *
+ * Used to notify TorcMediaMaster of added (Torc::MediaAdded) and removed (Torc::MediaRemoved)
+ * media without wrapping each item in a QVariant.
+*/
+TorcMediaEvent::TorcMediaEvent(int Event, const QList<TorcMediaDescription> &Media)
+  : TorcEvent(Event),
+    m_media(Media)
+{
+}
+
+TorcMediaEvent::~TorcMediaEvent()
+{
+}
+
+QList<TorcMediaDescription>& TorcMediaEvent::Media(void)
+{
+    return m_media;
+}
+
 TorcMediaMaster::TorcMediaMaster()
   : QAbstractListModel()
 {
@@ -46,7 +74,13 @@ QVariant TorcMediaMaster::data(const QModelIndex &Index, int Role) const
 
     int position = Index.row();
 
-    if (position < 0 || position >= m_media.size() || Role != Qt::DisplayRole)
+    if (position < 0 || position >= m_media.size())
+        return QVariant();
+
+    if (Role == DetailsRole)
+        return m_media.at(position)->GetDetails();
+
+    if (Role != Qt::DisplayRole)
         return QVariant();
 
     return QVariant::fromValue(m_media.at(position));
@@ -68,6 +102,7 @@ QHash<int,QByteArray> TorcMediaMaster::roleNames(void) const
     roles.insert(Qt::DisplayRole, "type");
     roles.insert(Qt::DisplayRole, "source");
     roles.insert(Qt::DisplayRole, "metadata");
+    roles.insert(DetailsRole,     "details");
     return roles;
 }
 
@@ -81,63 +116,162 @@ bool TorcMediaMaster::event(QEvent *Event)
     if (Event->type() == TorcEvent::TorcEventType)
     {
         TorcEvent *event = static_cast<TorcEvent*>(Event);
+        int type = event->GetEvent();
 
-        if (event && event->GetEvent() == Torc::MediaAdded)
+        if (type == Torc::MediaAdded || type == Torc::MediaRemoved || type == Torc::MediaChanged)
         {
-            if (event->Data().contains("files"))
+            QList<TorcMediaDescription> media;
+
+            TorcMediaEvent *mediaevent = dynamic_cast<TorcMediaEvent*>(event);
+            if (mediaevent)
             {
-                QVariantList items = static_cast<QVariantList>(event->Data().value("files").toList());
-
-                if (!items.isEmpty())
-                {
-                    QList<TorcMedia*> newfiles;
-
-                    for (int i = 0; i < items.size(); ++i)
-                    {
-                        TorcMediaDescription media = items[i].value<TorcMediaDescription>();
-
-                        if (!m_mediaMap.contains(media.url))
-                        {
-                            TorcMedia* newmedia = new TorcMedia(media.name, media.url, media.type, media.source, media.metadata);
-                            newfiles.append(newmedia);
-                            m_mediaMap.insert(media.url, newmedia);
-                        }
-                    }
-
-                    if (!newfiles.isEmpty())
-                    {
-                        beginInsertRows(QModelIndex(), m_media.size(), m_media.size() + newfiles.size() - 1);
-                        m_media.append(newfiles);
-                        endInsertRows();
-                    }
-                }
+                media.swap(mediaevent->Media());
             }
-        }
-        else if (event && event->GetEvent() == Torc::MediaRemoved)
-        {
-            if (event->Data().contains("files"))
+            else if (event->Data().contains("files"))
             {
                 QVariantList items = event->Data().value("files").toList();
+                media.reserve(items.size());
+                for (int i = 0; i < items.size(); ++i)
+                    media.append(items[i].value<TorcMediaDescription>());
+            }
 
-                if (!items.isEmpty())
-                {
-                    for (int i = 0; i < items.size(); ++i)
-                    {
-                        TorcMediaDescription media = items[i].value<TorcMediaDescription>();
-
-                        if (m_mediaMap.contains(media.url))
-                        {
-                            TorcMedia *oldmedia = m_mediaMap.take(media.url);
-                            int position = m_media.indexOf(oldmedia);
-                            beginRemoveRows(QModelIndex(), position, position);
-                            m_media.removeAt(position);
-                            endRemoveRows();
-                        }
-                    }
-                }
+            if (!media.isEmpty())
+            {
+                if (type == Torc::MediaAdded)
+                    AddMedia(media);
+                else if (type == Torc::MediaRemoved)
+                    RemoveMedia(media);
+                else
+                    UpdateMedia(media);
             }
+
+            return true;
         }
     }
 
-    return false;
+    return QAbstractListModel::event(Event);
+}
+
+/// Append any previously unknown items in Media as a single contiguous insertion.
+void TorcMediaMaster::AddMedia(const QList<TorcMediaDescription> &Media)
+{
+    int first = m_media.size();
+    QList<TorcMedia*> newfiles;
+
+    foreach (const TorcMediaDescription &media, Media)
+    {
+        if (m_rows.contains(media.url))
+            continue;
+
+        m_rows.insert(media.url, first + newfiles.size());
+        TorcMedia *newmedia = new TorcMedia(media.name, media.url, media.type, media.source, media.metadata);
+        if (!media.details.isEmpty())
+            newmedia->SetDetails(media.details);
+        newfiles.append(newmedia);
+    }
+
+    if (newfiles.isEmpty())
+        return;
+
+    beginInsertRows(QModelIndex(), first, first + newfiles.size() - 1);
+    m_media.append(newfiles);
+    endInsertRows();
+}
+
+/*! \brief Remove all known items in Media.
+ *
+ * The rows to be removed are grouped into contiguous ranges, which are removed from the end of the
+ * list first so that the remaining row numbers are unaffected. Items from a single directory are
+ * generally added together and hence are usually removed in a single range. If the removals are
+ * heavily fragmented, the model is reset instead.
+ *
+ * The URL to row map is then updated once for all rows after the first removed.
+*/
+void TorcMediaMaster::RemoveMedia(const QList<TorcMediaDescription> &Media)
+{
+    QList<int> rows;
+    rows.reserve(Media.size());
+
+    foreach (const TorcMediaDescription &media, Media)
+    {
+        QHash<QString,int>::iterator it = m_rows.find(media.url);
+        if (it == m_rows.end())
+            continue;
+
+        rows.append(it.value());
+        m_rows.erase(it);
+    }
+
+    if (rows.isEmpty())
+        return;
+
+    qSort(rows.begin(), rows.end(), qGreater<int>());
+
+    // build contiguous ranges (last, first) in descending order
+    QList<QPair<int,int> > ranges;
+    foreach (int row, rows)
+    {
+        if (!ranges.isEmpty() && ranges.last().second == row + 1)
+            ranges.last().second = row;
+        else
+            ranges.append(qMakePair(row, row));
+    }
+
+    QList<TorcMedia*> removed;
+    removed.reserve(rows.size());
+    bool reset = ranges.size() > MAX_REMOVE_RANGES;
+
+    if (reset)
+        beginResetModel();
+
+    for (int i = 0; i < ranges.size(); ++i)
+    {
+        int last  = ranges[i].first;
+        int first = ranges[i].second;
+
+        if (!reset)
+            beginRemoveRows(QModelIndex(), first, last);
+
+        QList<TorcMedia*>::iterator begin = m_media.begin() + first;
+        QList<TorcMedia*>::iterator end   = m_media.begin() + last + 1;
+        for (QList<TorcMedia*>::iterator it = begin; it != end; ++it)
+            removed.append(*it);
+        m_media.erase(begin, end);
+
+        if (!reset)
+            endRemoveRows();
+    }
+
+    // renumber everything after the first removed row
+    for (int row = ranges.last().second; row < m_media.size(); ++row)
+        m_rows[m_media.at(row)->GetURL()] = row;
+
+    if (reset)
+        endResetModel();
+
+    // N.B. views may still reference removed items until they have processed the removal
+    foreach (TorcMedia *media, removed)
+        media->deleteLater();
+}
+
+/// Update the details of known items in Media, signalling a single change covering all updated rows.
+void TorcMediaMaster::UpdateMedia(const QList<TorcMediaDescription> &Media)
+{
+    int first = m_media.size();
+    int last  = -1;
+
+    foreach (const TorcMediaDescription &media, Media)
+    {
+        QHash<QString,int>::const_iterator it = m_rows.constFind(media.url);
+        if (it == m_rows.constEnd())
+            continue;
+
+        int row = it.value();
+        m_media.at(row)->SetDetails(media.details);
+        first = qMin(first, row);
+        last  = qMax(last, row);
+    }
+
+    if (last >= first)
+        emit dataChanged(index(first), index(last), QVector<int>() << DetailsRole);
 }
@@ -2,16 +2,36 @@
 #define TORCMEDIAMASTER_H
 
 // Qt
+#include <QHash>
 #include <QAbstractListModel>
 
 // Torc
 #include "torcmediaexport.h"
+#include "torcevent.h"
 #include "torcmedia.h"
 
+class TORC_MEDIA_PUBLIC TorcMediaEvent : public TorcEvent
+{
+  public:
+    TorcMediaEvent(int Event, const QList<TorcMediaDescription> &Media);
+    virtual ~TorcMediaEvent();
+
+    QList<TorcMediaDescription>& Media  (void);
+
+  private:
+    QList<TorcMediaDescription>  m_media;
+};
+
 class TORC_MEDIA_PUBLIC TorcMediaMaster : public QAbstractListModel
 {
     Q_OBJECT
 
+  public:
+    enum Roles
+    {
+        DetailsRole = Qt::UserRole + 1
+    };
+
   public:
     // QAbstractListModel
     QVariant                   data             (const QModelIndex &Index, int Role) const;
@@ -26,9 +46,14 @@ class TORC_MEDIA_PUBLIC TorcMediaMaster : public QAbstractListModel
   protected:
     bool                       event            (QEvent *Event);
 
+  private:
+    void                       AddMedia         (const QList<TorcMediaDescription> &Media);
+    void                       RemoveMedia      (const QList<TorcMediaDescription> &Media);
+    void                       UpdateMedia      (const QList<TorcMediaDescription> &Media);
+
   private:
     QList<TorcMedia*>          m_media;
-    QMap<QString,TorcMedia*>   m_mediaMap;
+    QHash<QString,int>         m_rows;
 };
 
 extern TORC_MEDIA_PUBLIC TorcMediaMaster *gTorcMediaMaster;
@@ -20,20 +20,158 @@
 * USA.
 */
 
+// Std
+#include <string.h>
+
 // Qt
+#include <QVector>
+
+// Torc
 #include "torclogging.h"
 #include "torcmediamaster.h"
 #include "torcmediamasterfilter.h"
 
+// filter strings shorter than this are matched by scanning every item
+#define TRIGRAM_LENGTH 3
+
+/*! \class TorcMediaTextIndex
+ *  \brief A trigram index of the names (or URLs) of media items.
+ *
+ * Each distinct trigram maps to a list of item ids. A search for a string of 3 or more characters only needs to
+ * check the items containing its rarest trigram. Removed items are left in the posting lists (their id is
+ * cleared) and the index is rebuilt when more than half of the ids are unused.
+*/
+class TorcMediaTextIndex
+{
+  public:
+    TorcMediaTextIndex()
+      : m_valid(false),
+        m_byName(true),
+        m_unused(0)
+    {
+    }
+
+    void Invalidate(void)
+    {
+        m_valid  = false;
+        m_unused = 0;
+        m_postings.clear();
+        m_items.clear();
+        m_ids.clear();
+    }
+
+    void Build(TorcMediaMaster *Model, bool ByName)
+    {
+        Invalidate();
+        m_byName = ByName;
+        m_valid  = true;
+
+        if (Model)
+            for (int i = 0; i < Model->rowCount(); ++i)
+                Add(Model->GetChildByIndex(i));
+    }
+
+    bool IsValid(bool ByName)
+    {
+        return m_valid && m_byName == ByName;
+    }
+
+    void Add(TorcMedia *Media)
+    {
+        if (!m_valid || !Media || m_ids.contains(Media))
+            return;
+
+        int id = m_items.size();
+        m_items.append(Media);
+        m_ids.insert(Media, id);
+
+        QString text = m_byName ? Media->GetName() : Media->GetURL();
+        QSet<quint64> trigrams;
+        for (int i = 0; i + TRIGRAM_LENGTH <= text.size(); ++i)
+            trigrams.insert(Trigram(text.constData() + i));
+
+        foreach (quint64 trigram, trigrams)
+            m_postings[trigram].append(id);
+    }
+
+    void Remove(TorcMedia *Media)
+    {
+        if (!m_valid)
+            return;
+
+        QHash<TorcMedia*,int>::iterator it = m_ids.find(Media);
+        if (it == m_ids.end())
+            return;
+
+        m_items[it.value()] = NULL;
+        m_ids.erase(it);
+
+        // N.B. rebuilt on next use
+        if (++m_unused > m_items.size() / 2)
+            Invalidate();
+    }
+
+    /// Return all items whose text contains Text, which must be at least TRIGRAM_LENGTH characters.
+    QSet<TorcMedia*> Search(const QString &Text)
+    {
+        QSet<TorcMedia*> result;
+
+        const QVector<int> *smallest = NULL;
+        for (int i = 0; i + TRIGRAM_LENGTH <= Text.size(); ++i)
+        {
+            QHash<quint64,QVector<int> >::const_iterator it = m_postings.constFind(Trigram(Text.constData() + i));
+            if (it == m_postings.constEnd())
+                return result;
+
+            if (!smallest || it.value().size() < smallest->size())
+                smallest = &it.value();
+        }
+
+        if (!smallest)
+            return result;
+
+        foreach (int id, *smallest)
+        {
+            TorcMedia *media = m_items.at(id);
+            if (media && (m_byName ? media->GetName() : media->GetURL()).contains(Text))
+                result.insert(media);
+        }
+
+        return result;
+    }
+
+  private:
+    static quint64 Trigram(const QChar *Text)
+    {
+        return ((quint64)Text[0].unicode() << 32) | ((quint64)Text[1].unicode() << 16) | (quint64)Text[2].unicode();
+    }
+
+  private:
+    bool                           m_valid;
+    bool                           m_byName;
+    int                            m_unused;
+    QHash<quint64,QVector<int> >   m_postings;
+    QVector<TorcMedia*>            m_items;
+    QHash<TorcMedia*,int>          m_ids;
+};
+
 /*! \class TorcMediaMasterFilter
  *  \brief A configurable filter proxy
  *
+ * Sorting uses the cached collation keys of each TorcMedia item rather than comparing strings directly.
+ *
+ * The set of items matching the current text filter is maintained separately, so that filterAcceptsRow
+ * is a simple lookup. When the text filter is extended (e.g. when typing), only the previous matches are
+ * checked. Otherwise, the matches are retrieved from a TorcMediaTextIndex (which is only built once a text
+ * filter is first used).
+ *
  * \todo Filtering is wrong when columns have been rearranged in TableView
 */
 
 TorcMediaMasterFilter::TorcMediaMasterFilter()
   : QSortFilterProxyModel(),
     m_model(NULL),
+    m_textIndex(new TorcMediaTextIndex()),
     m_currentSortColumn(0),
     m_mediaTypeFilter(TorcMedia::AllTypes),
     textFilter(QString()),
@@ -45,6 +183,31 @@ TorcMediaMasterFilter::TorcMediaMasterFilter()
 
 TorcMediaMasterFilter::~TorcMediaMasterFilter()
 {
+    delete m_textIndex;
+}
+
+/*! \brief Set the source model.
+ *
+ * Changes to the source model are connected before QSortFilterProxyModel's own connections,
+ * so that the text matches are up to date before the proxy re-filters.
+*/
+void TorcMediaMasterFilter::setSourceModel(QAbstractItemModel *Model)
+{
+    if (sourceModel())
+        disconnect(sourceModel(), 0, this, 0);
+
+    if (Model)
+    {
+        connect(Model, SIGNAL(rowsInserted(QModelIndex,int,int)),        this, SLOT(SourceRowsInserted(QModelIndex,int,int)));
+        connect(Model, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)), this, SLOT(SourceRowsRemoved(QModelIndex,int,int)));
+        connect(Model, SIGNAL(modelReset()),                              this, SLOT(SourceReset()));
+    }
+
+    m_model = NULL;
+    m_textIndex->Invalidate();
+    m_textMatches.clear();
+
+    QSortFilterProxyModel::setSourceModel(Model);
 }
 
 void TorcMediaMasterFilter::SetSortOrder(Qt::SortOrder Order, int Column)
@@ -80,7 +243,9 @@ void TorcMediaMasterFilter::SetTextFilter(const QString &Text)
 {
     if (Text != textFilter)
     {
+        QString previous = textFilter;
         textFilter = Text;
+        UpdateTextMatches(previous);
         invalidateFilter();
         emit textFilterChanged(textFilter);
     }
@@ -91,6 +256,7 @@ void TorcMediaMasterFilter::SetFilterByName(bool Value)
     if (filterByName != Value)
     {
         filterByName = Value;
+        UpdateTextMatches(QString());
         invalidateFilter();
         emit filterByNameChanged(filterByName);
     }
@@ -99,6 +265,92 @@ void TorcMediaMasterFilter::SetFilterByName(bool Value)
 void TorcMediaMasterFilter::SourceChanged(void)
 {
     m_model = static_cast<TorcMediaMaster*>(sourceModel());
+    UpdateTextMatches(QString());
+}
+
+void TorcMediaMasterFilter::SourceRowsInserted(const QModelIndex &Parent, int First, int Last)
+{
+    (void)Parent;
+
+    if (!m_model)
+        return;
+
+    for (int i = First; i <= Last; ++i)
+    {
+        TorcMedia *media = m_model->GetChildByIndex(i);
+        m_textIndex->Add(media);
+        if (media && !textFilter.isEmpty() && TextMatches(media))
+            m_textMatches.insert(media);
+    }
+}
+
+void TorcMediaMasterFilter::SourceRowsRemoved(const QModelIndex &Parent, int First, int Last)
+{
+    (void)Parent;
+
+    if (!m_model)
+        return;
+
+    for (int i = First; i <= Last; ++i)
+    {
+        TorcMedia *media = m_model->GetChildByIndex(i);
+        m_textIndex->Remove(media);
+        m_textMatches.remove(media);
+    }
+}
+
+void TorcMediaMasterFilter::SourceReset(void)
+{
+    m_textIndex->Invalidate();
+    UpdateTextMatches(QString());
+}
+
+bool TorcMediaMasterFilter::TextMatches(TorcMedia *Media) const
+{
+    return (filterByName ? Media->GetName() : Media->GetURL()).contains(textFilter);
+}
+
+/*! \brief Update the set of items that match the text filter.
+ *
+ * If the new filter contains Previous, only the existing matches can match and only they are checked.
+*/
+void TorcMediaMasterFilter::UpdateTextMatches(const QString &Previous)
+{
+    if (textFilter.isEmpty() || !m_model)
+    {
+        m_textMatches.clear();
+        return;
+    }
+
+    if (!Previous.isEmpty() && textFilter.contains(Previous))
+    {
+        QSet<TorcMedia*>::iterator it = m_textMatches.begin();
+        while (it != m_textMatches.end())
+        {
+            if (TextMatches(*it))
+                ++it;
+            else
+                it = m_textMatches.erase(it);
+        }
+
+        return;
+    }
+
+    if (textFilter.size() >= TRIGRAM_LENGTH)
+    {
+        if (!m_textIndex->IsValid(filterByName))
+            m_textIndex->Build(m_model, filterByName);
+        m_textMatches = m_textIndex->Search(textFilter);
+        return;
+    }
+
+    m_textMatches.clear();
+    for (int i = 0; i < m_model->rowCount(); ++i)
+    {
+        TorcMedia *media = m_model->GetChildByIndex(i);
+        if (media && TextMatches(media))
+            m_textMatches.insert(media);
+    }
 }
 
 /*! \brief Returns the TorcMedia object at the given index.
@@ -122,12 +374,7 @@ bool TorcMediaMasterFilter::filterAcceptsRow(int Row, const QModelIndex &Parent)
                 return false;
 
             if (!textFilter.isEmpty())
-            {
-                if (filterByName)
-                    return item->GetName().contains(textFilter);
-
-                return item->GetURL().contains(textFilter);
-            }
+                return m_textMatches.contains(item);
 
             return true;
         }
@@ -136,6 +383,13 @@ bool TorcMediaMasterFilter::filterAcceptsRow(int Row, const QModelIndex &Parent)
     return false;
 }
 
+/// Compare two collation keys bytewise.
+static inline bool KeyLessThan(const QByteArray &Left, const QByteArray &Right)
+{
+    int result = memcmp(Left.constData(), Right.constData(), qMin(Left.size(), Right.size()));
+    return result < 0 || (result == 0 && Left.size() < Right.size());
+}
+
 bool TorcMediaMasterFilter::lessThan(const QModelIndex &Left, const QModelIndex &Right) const
 {
     if (m_model)
@@ -146,9 +400,9 @@ bool TorcMediaMasterFilter::lessThan(const QModelIndex &Left, const QModelIndex
         if (left && right)
         {
             if (m_currentSortColumn == 0)
-                return QString::localeAwareCompare(left->GetName(), right->GetName()) < 0;
+                return KeyLessThan(left->GetNameSortKey(), right->GetNameSortKey());
             else if (m_currentSortColumn == 1)
-                return QString::localeAwareCompare(left->GetURL(), right->GetURL()) < 0;
+                return KeyLessThan(left->GetURLSortKey(), right->GetURLSortKey());
             else if (m_currentSortColumn == 2)
                 return left->GetMediaType() < right->GetMediaType();
         }
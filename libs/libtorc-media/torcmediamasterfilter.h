@@ -2,12 +2,15 @@
 #define TORCMEDIAMASTERFILTER_H
 
 // Qt
+#include <QSet>
 #include <QSortFilterProxyModel>
 
 // Torc
 #include "torcmediamaster.h"
 #include "torcmediaexport.h"
 
+class TorcMediaTextIndex;
+
 class TORC_MEDIA_PUBLIC TorcMediaMasterFilter : public QSortFilterProxyModel
 {
     Q_OBJECT
@@ -21,6 +24,7 @@ class TORC_MEDIA_PUBLIC TorcMediaMasterFilter : public QSortFilterProxyModel
 
     Q_INVOKABLE void     SetSortOrder        (Qt::SortOrder Order, int Column);
     Q_INVOKABLE void     SetMediaTypeFilter  (TorcMedia::MediaType Type, bool Enabled);
+    void                 setSourceModel      (QAbstractItemModel *Model);
 
   signals:
     void                 textFilterChanged   (const QString &Text);
@@ -34,12 +38,23 @@ class TORC_MEDIA_PUBLIC TorcMediaMasterFilter : public QSortFilterProxyModel
     void                 SourceChanged       (void);
     TorcMedia*           GetChildByIndex     (int Index) const;
 
+  protected slots:
+    void                 SourceRowsInserted  (const QModelIndex &Parent, int First, int Last);
+    void                 SourceRowsRemoved   (const QModelIndex &Parent, int First, int Last);
+    void                 SourceReset         (void);
+
   protected:
     bool                 filterAcceptsRow    (int Row, const QModelIndex &Parent) const;
     bool                 lessThan            (const QModelIndex &Left, const QModelIndex &Right) const;
 
+  private:
+    bool                 TextMatches         (TorcMedia *Media) const;
+    void                 UpdateTextMatches   (const QString &Previous);
+
   private:
     TorcMediaMaster     *m_model;
+    TorcMediaTextIndex  *m_textIndex;
+    QSet<TorcMedia*>     m_textMatches;
     int                  m_currentSortColumn;
     int                  m_mediaTypeFilter;
     QString              textFilter;
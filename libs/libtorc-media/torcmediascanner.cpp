@@ -0,0 +1,336 @@
+/* Class TorcMediaScanner
+*
+* This file is part of the Torc project.
+*
+* Copyright (C) Mark Kendall 2013
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+* USA.
+*/
+
+// Qt
+#include <QFile>
+#include <QThread>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QObject>
+#include <QRunnable>
+#include <QDirIterator>
+
+// Torc
+#include "torclocalcontext.h"
+#include "torclogging.h"
+#include "torcmime.h"
+#include "torcmediascanner.h"
+
+#if defined(Q_OS_UNIX)
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+#if defined(Q_OS_LINUX)
+#include <sys/sysmacros.h>
+#endif
+
+// maximum number of directories scanned concurrently on a single rotational disk
+#define ROTATIONAL_DEVICE_LIMIT 1
+// and for devices of unknown type (e.g. network file systems)
+#define DEFAULT_DEVICE_LIMIT    2
+
+TorcMediaScanResult::TorcMediaScanResult()
+  : m_valid(false),
+    m_modified(0)
+{
+}
+
+/*! \class TorcMediaScanTask
+ *  \brief Scan a single directory from within a QRunnable.
+*/
+class TorcMediaScanTask : public QRunnable
+{
+  public:
+    TorcMediaScanTask(TorcMediaScanner *Parent, quint64 Device, const QString &Path)
+      : QRunnable(),
+        m_parent(Parent),
+        m_device(Device),
+        m_path(Path)
+    {
+    }
+
+    void run(void)
+    {
+        TorcMediaScanResult result;
+        result.m_path = m_path;
+        m_parent->ScanDirectory(result);
+        m_parent->TaskComplete(m_device, result);
+    }
+
+  private:
+    TorcMediaScanner *m_parent;
+    quint64           m_device;
+    QString           m_path;
+};
+
+/*! \class TorcMediaScanner
+ *  \brief Scan media directories in parallel.
+ *
+ * TorcMediaScanner lists the contents of individual directories using a private thread pool
+ * and returns the results to its parent in batches (by invoking ResultsSlot, which should then call TakeResults).
+ * Reconciling the results against what is already known remains the responsibility of the parent.
+ *
+ * The number of directories scanned concurrently on any one device is limited, as parallel directory
+ * walks on a spinning disk are considerably slower than sequential ones. Under Linux, the device type
+ * is determined from sysfs and rotational devices are limited to a single scan. This can be overridden
+ * with the MediaScanDeviceLimit setting (0 for automatic).
+ *
+ * Each directory is only listed once (rather than separately for files and subdirectories) and
+ * Blu-ray and DVD file structures are skipped.
+ *
+ * \note TorcMediaScanner is not a QObject and all public methods, other than GuessFileType,
+ *       must be called from the parent's thread.
+ *
+ * \sa TorcMediaSourceDirectory
+*/
+TorcMediaScanner::TorcMediaScanner(QObject *Parent, const char *ResultsSlot)
+  : m_parent(Parent),
+    m_resultsSlot(ResultsSlot),
+    m_activeTotal(0),
+    m_notified(false),
+    m_directoriesScanned(0),
+    m_filesScanned(0)
+{
+    // N.B. later types take precedence, as per the original filter order
+    foreach (QString extension, TorcMime::ExtensionsForType("video")) { m_extensions.insert(extension.toLower(), TorcMedia::Video); }
+    foreach (QString extension, TorcMime::ExtensionsForType("image")) { m_extensions.insert(extension.toLower(), TorcMedia::Image); }
+    foreach (QString extension, TorcMime::ExtensionsForType("audio")) { m_extensions.insert(extension.toLower(), TorcMedia::Audio); }
+
+    int threads = gLocalContext->GetSetting(TORC_CORE + "MediaScanThreads", (int)qBound(2, QThread::idealThreadCount(), 8));
+    m_pool.setMaxThreadCount(qMax(1, threads));
+    m_pool.setExpiryTimeout(10000);
+
+    LOG(VB_GENERAL, LOG_INFO, QString("Media scanner using up to %1 threads").arg(m_pool.maxThreadCount()));
+}
+
+TorcMediaScanner::~TorcMediaScanner()
+{
+    Stop();
+}
+
+TorcMedia::MediaType TorcMediaScanner::GuessFileType(const QString &Path) const
+{
+    int index = Path.lastIndexOf('.');
+    if (index < 0)
+        return TorcMedia::UnknownType;
+
+    return m_extensions.value(Path.mid(index + 1).toLower(), TorcMedia::UnknownType);
+}
+
+/// Queue Path for scanning. A path that is already queued is ignored.
+void TorcMediaScanner::Scan(const QString &Path)
+{
+    quint64 device = GetDevice(Path);
+
+    QMutexLocker locker(&m_lock);
+
+    if (m_pendingPaths.contains(Path))
+        return;
+
+    if (!m_activeTotal && m_pendingPaths.isEmpty())
+    {
+        m_timer.start();
+        m_directoriesScanned = 0;
+        m_filesScanned = 0;
+    }
+
+    m_pendingPaths.insert(Path);
+    m_pending[device].enqueue(Path);
+    StartTasks(device);
+}
+
+/// Discard any queued scans, wait for those in progress to complete and discard any outstanding results.
+void TorcMediaScanner::Stop(void)
+{
+    {
+        QMutexLocker locker(&m_lock);
+        m_pending.clear();
+        m_pendingPaths.clear();
+    }
+
+    m_pool.waitForDone();
+
+    QMutexLocker locker(&m_lock);
+    m_results.clear();
+    m_notified = false;
+}
+
+/*! \brief Retrieve up to Maximum completed scans.
+ *
+ * If further results remain, the parent will be notified again.
+*/
+QList<TorcMediaScanResult> TorcMediaScanner::TakeResults(int Maximum)
+{
+    QMutexLocker locker(&m_lock);
+
+    QList<TorcMediaScanResult> results;
+    if (m_results.size() <= Maximum)
+    {
+        results.swap(m_results);
+        m_notified = false;
+    }
+    else
+    {
+        results = m_results.mid(0, Maximum);
+        m_results.erase(m_results.begin(), m_results.begin() + Maximum);
+        QMetaObject::invokeMethod(m_parent, m_resultsSlot, Qt::QueuedConnection);
+    }
+
+    return results;
+}
+
+void TorcMediaScanner::ScanDirectory(TorcMediaScanResult &Result) const
+{
+    QFileInfo info(Result.m_path);
+    if (!info.isDir())
+        return;
+
+    // N.B. take the modification time before scanning, so any change during the scan is picked up next time
+    Result.m_modified = info.lastModified().toMSecsSinceEpoch();
+    Result.m_valid    = true;
+
+    QDirIterator it(Result.m_path, QDir::NoDotAndDotDot | QDir::AllDirs | QDir::Files | QDir::Readable);
+    while (it.hasNext())
+    {
+        it.next();
+        QFileInfo file = it.fileInfo();
+        QString name   = it.filePath();
+
+        if (file.isDir())
+        {
+            if (QFile::exists(name + "/BDMV"))
+            {
+                LOG(VB_GENERAL, LOG_INFO, QString("Found BD file structure - ignoring for now ('%1')").arg(name));
+                continue;
+            }
+
+            if (QFile::exists(name + "/VIDEO_TS"))
+            {
+                LOG(VB_GENERAL, LOG_INFO, QString("Found DVD file structure - ignoring for now ('%1')").arg(name));
+                continue;
+            }
+
+            Result.m_directories.append(name);
+            continue;
+        }
+
+        TorcMedia::MediaType type = GuessFileType(name);
+        if (type == TorcMedia::UnknownType)
+            continue;
+
+        Result.m_files.append(TorcMediaIndexFile(name, Result.m_path, file.size(), file.lastModified().toMSecsSinceEpoch(), type));
+    }
+}
+
+void TorcMediaScanner::TaskComplete(quint64 Device, const TorcMediaScanResult &Result)
+{
+    QMutexLocker locker(&m_lock);
+
+    m_active[Device]--;
+    m_activeTotal--;
+    m_directoriesScanned++;
+    m_filesScanned += Result.m_files.size();
+
+    m_results.append(Result);
+    if (!m_notified)
+    {
+        m_notified = true;
+        QMetaObject::invokeMethod(m_parent, m_resultsSlot, Qt::QueuedConnection);
+    }
+
+    StartTasks(Device);
+
+    if (!m_activeTotal && m_pendingPaths.isEmpty())
+    {
+        qint64 elapsed = qMax((qint64)1, m_timer.elapsed());
+        LOG(VB_GENERAL, LOG_INFO, QString("Scanned %1 directories and %2 files in %3ms (%4 files/sec)")
+            .arg(m_directoriesScanned).arg(m_filesScanned).arg(elapsed)
+            .arg((m_filesScanned * 1000) / elapsed));
+    }
+}
+
+/// Start as many queued scans for Device as its limit allows. m_lock must be held.
+void TorcMediaScanner::StartTasks(quint64 Device)
+{
+    QHash<quint64,QQueue<QString> >::iterator it = m_pending.find(Device);
+    if (it == m_pending.end())
+        return;
+
+    int limit = GetDeviceLimit(Device);
+    int &active = m_active[Device];
+
+    while (active < limit && !it.value().isEmpty())
+    {
+        QString path = it.value().dequeue();
+        m_pendingPaths.remove(path);
+        active++;
+        m_activeTotal++;
+        m_pool.start(new TorcMediaScanTask(this, Device, path));
+    }
+
+    if (it.value().isEmpty())
+        m_pending.erase(it);
+}
+
+quint64 TorcMediaScanner::GetDevice(const QString &Path)
+{
+#if defined(Q_OS_UNIX)
+    struct stat buf;
+    if (stat(Path.toLocal8Bit().constData(), &buf) == 0)
+        return (quint64)buf.st_dev;
+#endif
+    return 0;
+}
+
+/// Determine the number of concurrent scans permitted for Device. m_lock must be held.
+int TorcMediaScanner::GetDeviceLimit(quint64 Device)
+{
+    QHash<quint64,int>::const_iterator it = m_deviceLimits.constFind(Device);
+    if (it != m_deviceLimits.constEnd())
+        return it.value();
+
+    int limit = gLocalContext->GetSetting(TORC_CORE + "MediaScanDeviceLimit", (int)0);
+
+    if (limit < 1)
+    {
+        limit = DEFAULT_DEVICE_LIMIT;
+
+#if defined(Q_OS_LINUX)
+        // partitions do not have a queue directory, but their parent block device does
+        QString base = QString("/sys/dev/block/%1:%2").arg(major((dev_t)Device)).arg(minor((dev_t)Device));
+        QFile file(base + "/queue/rotational");
+        if (!file.exists())
+            file.setFileName(base + "/../queue/rotational");
+
+        if (file.open(QIODevice::ReadOnly))
+        {
+            bool rotational = file.readAll().trimmed() != "0";
+            limit = rotational ? ROTATIONAL_DEVICE_LIMIT : m_pool.maxThreadCount();
+            file.close();
+        }
+#endif
+    }
+
+    LOG(VB_GENERAL, LOG_INFO, QString("Scanning up to %1 directories concurrently on device %2").arg(limit).arg(Device));
+    m_deviceLimits.insert(Device, limit);
+    return limit;
+}
@@ -0,0 +1,69 @@
+#ifndef TORCMEDIASCANNER_H
+#define TORCMEDIASCANNER_H
+
+// Qt
+#include <QSet>
+#include <QHash>
+#include <QMutex>
+#include <QQueue>
+#include <QStringList>
+#include <QThreadPool>
+#include <QElapsedTimer>
+
+// Torc
+#include "torcmedia.h"
+#include "torcmediaindex.h"
+
+class TorcMediaScanResult
+{
+  public:
+    TorcMediaScanResult();
+
+    QString                   m_path;
+    bool                      m_valid;
+    qint64                    m_modified;
+    QStringList               m_directories;
+    QList<TorcMediaIndexFile> m_files;
+};
+
+class TorcMediaScanner
+{
+    friend class TorcMediaScanTask;
+
+  public:
+    TorcMediaScanner(QObject *Parent, const char *ResultsSlot);
+    ~TorcMediaScanner();
+
+    TorcMedia::MediaType GuessFileType   (const QString &Path) const;
+    void                 Scan            (const QString &Path);
+    void                 Stop            (void);
+    QList<TorcMediaScanResult> TakeResults (int Maximum);
+
+  private:
+    void                 ScanDirectory   (TorcMediaScanResult &Result) const;
+    void                 TaskComplete    (quint64 Device, const TorcMediaScanResult &Result);
+    void                 StartTasks      (quint64 Device);
+    quint64              GetDevice       (const QString &Path);
+    int                  GetDeviceLimit  (quint64 Device);
+
+  private:
+    QObject             *m_parent;
+    const char          *m_resultsSlot;
+    QThreadPool          m_pool;
+    QHash<QString,TorcMedia::MediaType> m_extensions;
+
+    QMutex               m_lock;
+    QSet<QString>        m_pendingPaths;
+    QHash<quint64,QQueue<QString> > m_pending;
+    QHash<quint64,int>   m_active;
+    QHash<quint64,int>   m_deviceLimits;
+    int                  m_activeTotal;
+    QList<TorcMediaScanResult> m_results;
+    bool                 m_notified;
+
+    QElapsedTimer        m_timer;
+    quint64              m_directoriesScanned;
+    quint64              m_filesScanned;
+};
+
+#endif // TORCMEDIASCANNER_H
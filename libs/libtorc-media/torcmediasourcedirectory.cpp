@@ -22,6 +22,10 @@
 
 // Qt
 #include <QObject>
+#include <QSet>
+#include <QPair>
+#include <QUuid>
+#include <QDateTime>
 #include <QDirIterator>
 #include <QCoreApplication>
 
@@ -31,21 +35,29 @@
 #include "torcmime.h"
 #include "torcmediamaster.h"
 #include "torcmediasource.h"
+#include "torcmediaindex.h"
+#include "torcmediascanner.h"
+#include "torcmetadataextractor.h"
 #include "torcmediasourcedirectory.h"
 
-// process updates every 5 seconds
+// process updates every second
 #define UPDATE_FREQUENCY  1000
+// maximum number of scanned directories to reconcile at once
+#define SCAN_BATCH_SIZE   64
 #define RECURSIVE_PATH    QString("rECuRSiVE")
 #define LOCAL_DIRECTORIES (TORC_CORE + QString("LocalMediaDirectories"))
 
 /*! \class TorcMediaSourceDirectory
  *  \brief A class to monitor file systems for media content.
  *
- * TorcMediaSourceDirectory uses QFileSystemWatcher to monitor local file systems.
- * QFileSystemWatcher will only notify updates for individual directories - and not
+ * TorcMediaSourceDirectory uses TorcMediaWatcher to monitor local file systems.
+ * TorcMediaWatcher will only notify updates for individual directories - and not
  * subdirectories. So if we want to monitor sub-directories as well (i.e. recursively),
  * we need to explicitly watch each individual sub-directory.
  *
+ * Where the watcher reports individual file changes (i.e. inotify under Linux), media items are
+ * added and removed directly without rescanning the directory.
+ *
  * configuredPaths contains a definitive set of paths that have been requested
  * by the user and should match the settings database. Updates should be made
  * using AddPath and RemovePath.
@@ -54,7 +66,14 @@
  * including all sub-directories of paths requested to be monitored recursively.
  *
  * For performance reasons, identified files are currently not interrogated in
- * any way (e.g. actual content, file size, creation date, modification date etc).
+ * any way (e.g. actual content) beyond their size and modification date.
+ *
+ * Scan results are persisted in a TorcMediaIndex. On startup, the last known contents of
+ * each monitored directory are restored from the index (and hence available immediately) and
+ * only those directories whose modification time has changed are rescanned.
+ *
+ * Directory listings are performed in parallel by TorcMediaScanner and the results are
+ * reconciled in batches on the owning thread (see ScanResultsReady).
  *
  * \sa MediaSource
  *
@@ -64,47 +83,180 @@
  * \todo Retrieve media list via HTTP
 */
 
+// the size and modification time of a media file, as stored in the index
+typedef QPair<qint64,qint64> TorcMediaFileState;
+
 class TorcMediaDirectory
 {
   public:
-    TorcMediaDirectory(bool Recursive = false)
-      : m_recursive(Recursive)
+    TorcMediaDirectory(bool Recursive = false, const QString &Parent = QString())
+      : m_recursive(Recursive),
+        m_parent(Parent),
+        m_modified(0)
     {
     }
 
     bool        m_recursive;
-    QStringList m_knownFiles;
+    QString     m_parent;
+    qint64      m_modified;
+    QHash<QString,TorcMediaFileState> m_knownFiles;
     QStringList m_knownDirectories;
 };
 
+// maximum number of changes retained for delta synchronisation
+#define MAX_CHANGE_LOG 20000
+
+/*! \class TorcMediaChangeLog
+ *  \brief A thread safe record of recent changes to the published media list.
+ *
+ * Each change is stored against the (monotonically increasing) version at which it occurred, allowing
+ * peers to request only the changes since the version they last saw. Only the most recent changes are kept.
+ * If the requested version is no longer covered by the log (or the log was created by a previous run,
+ * identified by its epoch) the complete media list is returned instead.
+ *
+ * \sa TorcMediaSourceDirectory::GetMediaChanges
+*/
+class TorcMediaChangeLog
+{
+  public:
+    class Change
+    {
+      public:
+        Change(int Version = 0, bool Added = false, const TorcMediaDescription &Media = TorcMediaDescription())
+          : m_version(Version), m_added(Added), m_media(Media)
+        {
+        }
+
+        int                  m_version;
+        bool                 m_added;
+        TorcMediaDescription m_media;
+    };
+
+    TorcMediaChangeLog()
+      : m_epoch(QUuid::createUuid().toString()),
+        m_version(0),
+        m_base(0)
+    {
+    }
+
+    void Record(const QList<TorcMediaDescription> &Added, const QList<TorcMediaDescription> &Removed)
+    {
+        QMutexLocker locker(&m_lock);
+
+        m_version++;
+
+        foreach (const TorcMediaDescription &media, Removed)
+        {
+            m_published.remove(media.url);
+            m_changes.append(Change(m_version, false, media));
+        }
+
+        foreach (const TorcMediaDescription &media, Added)
+        {
+            m_published.insert(media.url, media);
+            m_changes.append(Change(m_version, true, media));
+        }
+
+        // discard the oldest versions (in their entirety)
+        if (m_changes.size() > MAX_CHANGE_LOG)
+        {
+            m_base = m_changes.at(m_changes.size() - MAX_CHANGE_LOG).m_version;
+            while (!m_changes.isEmpty() && m_changes.first().m_version <= m_base)
+                m_changes.removeFirst();
+        }
+    }
+
+    QVariantMap GetChanges(const QString &Epoch, int Since)
+    {
+        QMutexLocker locker(&m_lock);
+
+        QVariantMap result;
+        QVariantList added;
+        QVariantList removed;
+        bool full = Epoch != m_epoch || Since < m_base || Since > m_version;
+
+        if (!full)
+        {
+            // the last change for each item wins
+            QHash<QString,int> last;
+            int first = m_changes.size();
+            while (first > 0 && m_changes.at(first - 1).m_version > Since)
+                first--;
+
+            for (int i = first; i < m_changes.size(); ++i)
+                last.insert(m_changes.at(i).m_media.url, i);
+
+            // a full listing is cheaper
+            if (last.size() > m_published.size())
+                full = true;
+
+            for (QHash<QString,int>::const_iterator it = last.constBegin(); !full && it != last.constEnd(); ++it)
+            {
+                const Change &change = m_changes.at(it.value());
+                if (change.m_added)
+                    added.append(Serialise(change.m_media));
+                else
+                    removed.append(change.m_media.url);
+            }
+        }
+
+        if (full)
+        {
+            added.clear();
+            removed.clear();
+            QHash<QString,TorcMediaDescription>::const_iterator it = m_published.constBegin();
+            for ( ; it != m_published.constEnd(); ++it)
+                added.append(Serialise(it.value()));
+        }
+
+        result.insert("epoch",   m_epoch);
+        result.insert("version", m_version);
+        result.insert("full",    full);
+        result.insert("added",   added);
+        result.insert("removed", removed);
+        return result;
+    }
+
+  private:
+    static QVariantMap Serialise(const TorcMediaDescription &Media)
+    {
+        QVariantMap map;
+        map.insert("name", Media.name);
+        map.insert("url",  Media.url);
+        map.insert("type", (int)Media.type);
+        return map;
+    }
+
+  private:
+    QMutex                               m_lock;
+    QString                              m_epoch;
+    int                                  m_version;
+    int                                  m_base;
+    QList<Change>                        m_changes;
+    QHash<QString,TorcMediaDescription>  m_published;
+};
+
 #define BLACKLIST QString("SetMediaVersion")
 
 TorcMediaSourceDirectory::TorcMediaSourceDirectory()
   : QObject(),
     TorcHTTPService(this, "files", "files", TorcMediaSourceDirectory::staticMetaObject, BLACKLIST),
+    m_index(new TorcMediaIndex()),
+    m_scanner(new TorcMediaScanner(this, "ScanResultsReady")),
+    m_changeLog(new TorcMediaChangeLog()),
+    m_extractor(new TorcMetadataExtractor(m_index)),
     mediaVersion(1),
     realMediaVersion(1),
     m_enabled(false),
     m_timerId(0),
-    m_fileFilters(QDir::NoDotAndDotDot | QDir::Files | QDir::Readable),
-    m_directoryFilters(QDir::NoDotAndDotDot | QDir::AllDirs | QDir::Readable),
     m_configuredPathsLock(new QMutex()),
     m_addedPathsLock(new QMutex()),
     m_removedPathsLock(new QMutex()),
     m_updatedPathsLock(new QMutex())
 {
-    // name filters
-    m_videoExtensions = TorcMime::ExtensionsForType("video");
-    m_audioExtensions = TorcMime::ExtensionsForType("audio");
-    m_photoExtensions = TorcMime::ExtensionsForType("image");
-
-    foreach (QString extension, m_videoExtensions) { m_fileNameFilters << QString("*." + extension); }
-    foreach (QString extension, m_audioExtensions) { m_fileNameFilters << QString("*." + extension); }
-    foreach (QString extension, m_photoExtensions) { m_fileNameFilters << QString("*." + extension); }
-
-    LOG(VB_GENERAL, LOG_INFO, QString("Video extensions: %1").arg(m_videoExtensions.join(",")));
-    LOG(VB_GENERAL, LOG_INFO, QString("Audio extensions: %1").arg(m_audioExtensions.join(",")));
-    LOG(VB_GENERAL, LOG_INFO, QString("Image extensions: %1").arg(m_photoExtensions.join(",")));
+    LOG(VB_GENERAL, LOG_INFO, QString("Video extensions: %1").arg(TorcMime::ExtensionsForType("video").join(",")));
+    LOG(VB_GENERAL, LOG_INFO, QString("Audio extensions: %1").arg(TorcMime::ExtensionsForType("audio").join(",")));
+    LOG(VB_GENERAL, LOG_INFO, QString("Image extensions: %1").arg(TorcMime::ExtensionsForType("image").join(",")));
 
     // configured directories to monitor
     QString directories = gLocalContext->GetSetting(LOCAL_DIRECTORIES, QString(""));
@@ -116,8 +268,10 @@ TorcMediaSourceDirectory::TorcMediaSourceDirectory()
     }
 
     // connect up the dots
-    connect(&m_watcher, SIGNAL(directoryChanged(QString)), this, SLOT(DirectoryChanged(QString)));
-    gLocalContext->AddObserver(this);
+    connect(&m_watcher, SIGNAL(DirectoryChanged(QString)), this, SLOT(DirectoryChanged(QString)));
+    connect(&m_watcher, SIGNAL(FilesChanged(QStringList,QStringList)), this, SLOT(FilesChanged(QStringList,QStringList)));
+    connect(&m_watcher, SIGNAL(Overflow()), this, SLOT(WatcherOverflow()));
+    gLocalContext->AddObserver(this, QList<int>() << Torc::DisableStorage << Torc::EnableStorage);
 
     // start
     if (gLocalContext->GetSetting(TORC_CORE + "StorageEnabled", (bool)true))
@@ -135,6 +289,19 @@ TorcMediaSourceDirectory::~TorcMediaSourceDirectory()
 
     StopMonitoring();
 
+    delete m_scanner;
+    m_scanner = NULL;
+
+    // N.B. uses m_index
+    delete m_extractor;
+    m_extractor = NULL;
+
+    delete m_index;
+    m_index = NULL;
+
+    delete m_changeLog;
+    m_changeLog = NULL;
+
     delete m_configuredPathsLock;
     delete m_addedPathsLock;
     delete m_removedPathsLock;
@@ -169,6 +336,19 @@ int TorcMediaSourceDirectory::GetMediaVersion(void)
     return realMediaVersion.fetchAndAddOrdered(0);
 }
 
+/*! \brief Return the media changes since version Since of the change log identified by Epoch.
+ *
+ * The result contains the current 'epoch' and 'version', which should be passed to the next call, and lists of
+ * 'added' items and 'removed' URLs. If the changes are not available, 'full' is true and 'added' contains the
+ * complete media list (i.e. any item not listed has been removed).
+ *
+ * \note This is called from multiple threads.
+*/
+QVariantMap TorcMediaSourceDirectory::GetMediaChanges(const QString &Epoch, int Since)
+{
+    return m_changeLog->GetChanges(Epoch, Since);
+}
+
 void TorcMediaSourceDirectory::IncrementVersion(void)
 {
     realMediaVersion.ref();
@@ -187,22 +367,7 @@ void TorcMediaSourceDirectory::DirectoryChanged(const QString &Path)
 
 TorcMedia::MediaType TorcMediaSourceDirectory::GuessFileType(const QString &Path)
 {
-    QStringList list = Path.split(".");
-    if (!list.isEmpty())
-    {
-        QString extension = list.last().toLower();
-
-        if (m_audioExtensions.contains(extension))
-            return TorcMedia::Audio;
-
-        if (m_photoExtensions.contains(extension))
-            return TorcMedia::Image;
-
-        if (m_videoExtensions.contains(extension))
-            return TorcMedia::Video;
-    }
-
-    return TorcMedia::UnknownType;
+    return m_scanner->GuessFileType(Path);
 }
 
 QString TorcMediaSourceDirectory::GetUIName(void)
@@ -238,13 +403,16 @@ void TorcMediaSourceDirectory::timerEvent(QTimerEvent *Event)
     if (Event->timerId() != m_timerId)
         return;
 
+    // group all index updates into one transaction
+    m_index->Begin();
+
     // remove paths removed from configuration
     m_removedPathsLock->lock();
     QStringList removedpaths = m_removedPaths;
     m_removedPaths.clear();
     m_removedPathsLock->unlock();
 
-    RemovePaths(removedpaths);
+    RemovePaths(removedpaths, true);
 
     // add newly configured paths
     QStringList updatedpaths;
@@ -272,7 +440,7 @@ void TorcMediaSourceDirectory::timerEvent(QTimerEvent *Event)
             m_monitoredPaths.insert(path, new TorcMediaDirectory(recursive));
 
             updatedpaths << path; // force a scan
-            m_watcher.addPath(path);
+            m_watcher.AddPath(path);
             LOG(VB_GENERAL, LOG_INFO, QString("Started monitoring '%1' (Recursive: %2)").arg(path).arg(recursive));
         }
     }
@@ -311,126 +479,247 @@ void TorcMediaSourceDirectory::timerEvent(QTimerEvent *Event)
     m_updatedPathsLock->unlock();
 
     if (m_enabled)
-    {
-        // check for new directories first (if recursive)
         foreach (QString path, updatedpaths)
-        {
-            if (!m_monitoredPaths.contains(path))
-                continue;
+            if (m_monitoredPaths.contains(path))
+                m_scanner->Scan(path);
 
-            TorcMediaDirectory *directory = m_monitoredPaths.value(path);
-            if (!directory->m_recursive)
-                continue;
+    m_index->Commit();
+}
 
-            QStringList newdirectories;
-            QStringList olddirectories = directory->m_knownDirectories;
-            directory->m_knownDirectories.clear();
+/*! \brief Reconcile a batch of completed directory scans with the known state.
+ *
+ * Added and removed files and subdirectories are identified using hashed set differences.
+ * Known files whose size or modification time has changed are updated in the index and
+ * queued for metadata extraction.
+ * New subdirectories are recorded in the index immediately (with no modification time, so
+ * they are rescanned if the scan is interrupted) and queued for scanning.
+*/
+void TorcMediaSourceDirectory::ScanResultsReady(void)
+{
+    QList<TorcMediaScanResult> results = m_scanner->TakeResults(SCAN_BATCH_SIZE);
+    if (!m_enabled || results.isEmpty())
+        return;
 
-            QDirIterator it(path, m_directoryNameFilters, m_directoryFilters);
-            while (it.hasNext())
-            {
-                it.next();
-                QString dir = it.filePath();
+    QList<TorcMediaDescription> notifynew;
+    QList<TorcMediaDescription> notifyold;
+    QList<TorcMediaDescription> changed;
 
-                if (QFile::exists(dir + "/BDMV"))
-                {
-                    LOG(VB_GENERAL, LOG_INFO, QString("Found BD file structure - ignoring for now ('%1')").arg(dir));
-                    continue;
-                }
+    m_index->Begin();
 
-                if (QFile::exists(dir + "/VIDEO_TS"))
-                {
-                    LOG(VB_GENERAL, LOG_INFO, QString("Found DVD file structure - ignoring for now ('%1')").arg(dir));
-                    continue;
-                }
+    foreach (const TorcMediaScanResult &result, results)
+    {
+        // may have been removed while scanning
+        TorcMediaDirectory *directory = m_monitoredPaths.value(result.m_path);
+        if (!directory)
+            continue;
 
-                directory->m_knownDirectories << dir;
-                if (olddirectories.contains(dir))
-                    olddirectories.removeAll(dir);
-                else
+        // subdirectories
+        if (directory->m_recursive)
+        {
+            QSet<QString> olddirectories = directory->m_knownDirectories.toSet();
+            QStringList newdirectories;
+
+            foreach (const QString &dir, result.m_directories)
+                if (!olddirectories.remove(dir))
                     newdirectories << dir;
-            }
 
-            // add new directories
-            foreach (QString newdirectory, newdirectories)
+            directory->m_knownDirectories = result.m_directories;
+
+            foreach (const QString &newdirectory, newdirectories)
             {
                 LOG(VB_GENERAL, LOG_DEBUG, QString("Added directory '%1'").arg(newdirectory));
-                m_monitoredPaths.insert(newdirectory, new TorcMediaDirectory(true));
-                m_watcher.addPath(newdirectory);
+                m_monitoredPaths.insert(newdirectory, new TorcMediaDirectory(true, result.m_path));
+                m_watcher.AddPath(newdirectory);
+                m_index->SetDirectory(newdirectory, result.m_path, 0);
+                m_scanner->Scan(newdirectory);
             }
 
-            // new directories will be processed on the next call, which simplifies
-            // the code and adds some inherent rate limiting.
-            m_updatedPathsLock->lock();
-            m_updatedPaths << newdirectories;
-            m_updatedPathsLock->unlock();
-
-            // and remove old
-            RemovePaths(olddirectories);
+            RemovePaths(olddirectories.toList(), true);
         }
 
-        // check for new files
-        QVariantList notifynew;
-        QVariantList notifyold;
+        // files
+        QHash<QString,TorcMediaFileState> oldfiles = directory->m_knownFiles;
+        directory->m_knownFiles.clear();
 
-        foreach (QString path, updatedpaths)
+        foreach (const TorcMediaIndexFile &file, result.m_files)
         {
-            if (!m_monitoredPaths.contains(path))
-                continue;
+            TorcMediaFileState state(file.m_size, file.m_modified);
+            directory->m_knownFiles.insert(file.m_path, state);
 
-            TorcMediaDirectory *directory = m_monitoredPaths.value(path);
-            QStringList oldfiles = directory->m_knownFiles;
-            directory->m_knownFiles.clear();
-
-            QDirIterator it(path, m_fileNameFilters, m_fileFilters);
-            while (it.hasNext())
+            QHash<QString,TorcMediaFileState>::iterator old = oldfiles.find(file.m_path);
+            if (old != oldfiles.end())
             {
-                it.next();
-                QString name = it.filePath();
-                if (!m_mediaItems.contains(name))
-                {
-                    TorcMedia::MediaType type = GuessFileType(name);
-                    TorcMediaDescription *media = new TorcMediaDescription(it.fileName(), name, type,
-                                                                TorcMedia::MediaSourceLocal, NULL);
-                    m_mediaItems.insert(name, media);
-                    notifynew.append(QVariant::fromValue(*media));
+                bool rewritten = old.value() != state;
+                oldfiles.erase(old);
 
-                    LOG(VB_GENERAL, LOG_DEBUG, QString("Added '%1'").arg(name));
+                TorcMediaDescription *media = m_mediaItems.value(file.m_path);
+                if (media)
+                {
+                    if (rewritten)
+                    {
+                        m_index->AddFile(file);
+                        changed.append(*media);
+                        LOG(VB_GENERAL, LOG_DEBUG, QString("Updated '%1'").arg(file.m_path));
+                    }
+                    continue;
                 }
-
-                directory->m_knownFiles << name;
-                oldfiles.removeAll(name);
             }
 
-            // remove old
-            foreach (QString name, oldfiles)
+            TorcMediaDescription *media = new TorcMediaDescription(file.m_path.mid(file.m_path.lastIndexOf('/') + 1), file.m_path,
+                                                                   file.m_type, TorcMedia::MediaSourceLocal, NULL);
+            delete m_mediaItems.value(file.m_path);
+            m_mediaItems.insert(file.m_path, media);
+            notifynew.append(*media);
+            m_index->AddFile(file);
+
+            LOG(VB_GENERAL, LOG_DEBUG, QString("Added '%1'").arg(file.m_path));
+        }
+
+        foreach (const QString &name, oldfiles.keys())
+        {
+            LOG(VB_GENERAL, LOG_INFO, QString("File '%1' no longer available").arg(name));
+            m_index->RemoveFile(name);
+            TorcMediaDescription *media = m_mediaItems.take(name);
+            if (media)
             {
-                LOG(VB_GENERAL, LOG_INFO, QString("File '%1' no longer available").arg(name));
-                TorcMediaDescription *media = m_mediaItems.take(name);
-                notifyold.append(QVariant::fromValue(*media));
+                notifyold.append(*media);
                 delete media;
             }
         }
 
-        if (!notifynew.isEmpty() && gTorcMediaMaster)
+        if (result.m_valid)
+            m_index->SetDirectory(result.m_path, directory->m_parent, result.m_modified);
+        directory->m_modified = result.m_modified;
+
+        // the directory changed during the scan (and individual file updates may have been overwritten)
+        if (result.m_valid && QFileInfo(result.m_path).lastModified().toMSecsSinceEpoch() != result.m_modified)
+            m_scanner->Scan(result.m_path);
+    }
+
+    m_index->Commit();
+
+    Notify(notifynew, notifyold);
+    m_extractor->Queue(changed);
+}
+
+/*! \brief Add and remove individual media files reported by the watcher.
+ *
+ * Added files that are already known (i.e. they have been rewritten) only have their index entry updated
+ * (if their size or modification time has changed) and are queued for metadata extraction.
+ * The modification time of each affected directory is then updated, so that the changes are not treated
+ * as unscanned (and the directory rescanned) after a queue overflow or a restart.
+*/
+void TorcMediaSourceDirectory::FilesChanged(const QStringList &Added, const QStringList &Removed)
+{
+    if (!m_enabled)
+        return;
+
+    QList<TorcMediaDescription> notifynew;
+    QList<TorcMediaDescription> notifyold;
+    QList<TorcMediaDescription> changed;
+    QSet<QString> directories;
+
+    m_index->Begin();
+
+    foreach (const QString &name, Removed)
+    {
+        QString path = name.left(name.lastIndexOf('/'));
+        TorcMediaDirectory *directory = m_monitoredPaths.value(path);
+        if (directory)
+            directories.insert(path);
+
+        TorcMediaDescription *media = m_mediaItems.take(name);
+        if (!media)
+            continue;
+
+        if (directory)
+            directory->m_knownFiles.remove(name);
+
+        LOG(VB_GENERAL, LOG_INFO, QString("File '%1' no longer available").arg(name));
+        m_index->RemoveFile(name);
+        notifyold.append(*media);
+        delete media;
+    }
+
+    foreach (const QString &name, Added)
+    {
+        QString path = name.left(name.lastIndexOf('/'));
+        TorcMediaDirectory *directory = m_monitoredPaths.value(path);
+        if (!directory)
+            continue;
+
+        directories.insert(path);
+
+        TorcMedia::MediaType type = m_scanner->GuessFileType(name);
+        if (type == TorcMedia::UnknownType)
+            continue;
+
+        QFileInfo info(name);
+        if (!info.isFile())
+            continue;
+
+        TorcMediaFileState state(info.size(), info.lastModified().toMSecsSinceEpoch());
+        TorcMediaDescription *media = m_mediaItems.value(name);
+        if (media && directory->m_knownFiles.value(name) == state)
+            continue;
+
+        directory->m_knownFiles.insert(name, state);
+        m_index->AddFile(TorcMediaIndexFile(name, path, state.first, state.second, type));
+
+        if (media)
         {
-            QVariantMap data;
-            data.insert("files", notifynew);
-            TorcEvent *event = new TorcEvent(Torc::MediaAdded, data);
-            QCoreApplication::postEvent(gTorcMediaMaster, event);
+            changed.append(*media);
+            LOG(VB_GENERAL, LOG_DEBUG, QString("Updated '%1'").arg(name));
+            continue;
         }
 
-        if (!notifyold.isEmpty() && gTorcMediaMaster)
+        media = new TorcMediaDescription(info.fileName(), name, type, TorcMedia::MediaSourceLocal, NULL);
+        m_mediaItems.insert(name, media);
+        notifynew.append(*media);
+
+        LOG(VB_GENERAL, LOG_DEBUG, QString("Added '%1'").arg(name));
+    }
+
+    foreach (const QString &path, directories)
+    {
+        QFileInfo info(path);
+        if (!info.exists())
+            continue;
+
+        TorcMediaDirectory *directory = m_monitoredPaths.value(path);
+        directory->m_modified = info.lastModified().toMSecsSinceEpoch();
+        m_index->SetDirectory(path, directory->m_parent, directory->m_modified);
+    }
+
+    m_index->Commit();
+
+    Notify(notifynew, notifyold);
+    m_extractor->Queue(changed);
+}
+
+/*! \brief Rescan any directory that has changed since it was last scanned.
+ *
+ * Watcher events have been lost, so the modification time of each monitored directory is compared
+ * to that of its last scan.
+*/
+void TorcMediaSourceDirectory::WatcherOverflow(void)
+{
+    if (!m_enabled)
+        return;
+
+    int count = 0;
+    QHash<QString,TorcMediaDirectory*>::const_iterator it = m_monitoredPaths.constBegin();
+    for ( ; it != m_monitoredPaths.constEnd(); ++it)
+    {
+        QFileInfo info(it.key());
+        if (!info.exists() || info.lastModified().toMSecsSinceEpoch() != it.value()->m_modified)
         {
-            QVariantMap data;
-            data.insert("files", notifyold);
-            TorcEvent *event = new TorcEvent(Torc::MediaRemoved, data);
-            QCoreApplication::postEvent(gTorcMediaMaster, event);
+            m_scanner->Scan(it.key());
+            count++;
         }
-
-        if (!notifynew.isEmpty() || !notifyold.isEmpty())
-            IncrementVersion();
     }
+
+    LOG(VB_GENERAL, LOG_INFO, QString("Rescanning %1 of %2 directories").arg(count).arg(m_monitoredPaths.size()));
 }
 
 void TorcMediaSourceDirectory::StartMonitoring(void)
@@ -447,17 +736,108 @@ void TorcMediaSourceDirectory::StartMonitoring(void)
 
     foreach (QString path, paths)
     {
-        m_watcher.addPath(path);
+        m_watcher.AddPath(path);
         m_monitoredPaths.insert(path, new TorcMediaDirectory(true));
         LOG(VB_GENERAL, LOG_INFO, QString("Starting to monitor '%1' (Recursive: 1)").arg(path));
     }
 
-    // force refresh
+    // restore the last known state and refresh anything that has changed since
+    QStringList changed = RestoreFromIndex(paths);
+
     m_updatedPathsLock->lock();
-    m_updatedPaths << paths;
+    m_updatedPaths << changed;
     m_updatedPathsLock->unlock();
 }
 
+/*! \brief Restore the known directories and files beneath Roots from the media index.
+ *
+ * Restored files are announced immediately. Only the modification time of each known directory
+ * is checked (rather than listing its contents) and those that have changed, or were never
+ * completely scanned, are returned for rescanning.
+ *
+ * Index entries that are not beneath any of Roots (i.e. paths that have since been removed from
+ * the configuration) are purged.
+*/
+QStringList TorcMediaSourceDirectory::RestoreFromIndex(const QStringList &Roots)
+{
+    if (!m_index->IsValid())
+        return Roots;
+
+    QHash<QString,TorcMediaIndexDirectory> directories;
+    QHash<QString,TorcMediaIndexFile> files;
+    m_index->Load(directories, files);
+
+    QStringList changed;
+    QList<TorcMediaDescription> notifynew;
+    QSet<QString> visited;
+    QStringList pending(Roots);
+
+    while (!pending.isEmpty())
+    {
+        QString path = pending.takeLast();
+        if (visited.contains(path))
+            continue;
+        visited.insert(path);
+
+        QHash<QString,TorcMediaIndexDirectory>::const_iterator it = directories.constFind(path);
+        if (it == directories.constEnd())
+        {
+            changed << path;
+            continue;
+        }
+
+        TorcMediaDirectory *directory = m_monitoredPaths.value(path);
+        if (!directory)
+        {
+            directory = new TorcMediaDirectory(true, it.value().m_parent);
+            m_monitoredPaths.insert(path, directory);
+            m_watcher.AddPath(path);
+        }
+
+        directory->m_knownDirectories = it.value().m_directories;
+        directory->m_modified         = it.value().m_modified;
+        directory->m_knownFiles.clear();
+
+        foreach (const QString &name, it.value().m_files)
+        {
+            const TorcMediaIndexFile &file = files[name];
+            directory->m_knownFiles.insert(name, TorcMediaFileState(file.m_size, file.m_modified));
+
+            if (m_mediaItems.contains(name))
+                continue;
+
+            TorcMediaDescription *media = new TorcMediaDescription(name.mid(name.lastIndexOf('/') + 1), name, file.m_type,
+                                                                   TorcMedia::MediaSourceLocal, NULL);
+            m_mediaItems.insert(name, media);
+            notifynew.append(*media);
+        }
+
+        QFileInfo info(path);
+        if (!info.exists() || info.lastModified().toMSecsSinceEpoch() != it.value().m_modified)
+            changed << path;
+
+        pending << it.value().m_directories;
+    }
+
+    // purge anything no longer monitored
+    if (visited.size() < directories.size())
+    {
+        m_index->Begin();
+        QHash<QString,TorcMediaIndexDirectory>::const_iterator it = directories.constBegin();
+        for ( ; it != directories.constEnd(); ++it)
+            if (!visited.contains(it.key()))
+                m_index->RemoveDirectory(it.key());
+        m_index->Commit();
+    }
+
+    LOG(VB_GENERAL, LOG_INFO, QString("Restored %1 media items from index - %2 directories changed")
+        .arg(notifynew.size()).arg(changed.size()));
+
+    Notify(notifynew, QList<TorcMediaDescription>());
+
+    return changed;
+}
+
 void TorcMediaSourceDirectory::StopMonitoring(void)
 {
     if (!m_enabled)
@@ -465,19 +845,25 @@ void TorcMediaSourceDirectory::StopMonitoring(void)
 
     m_enabled = false;
 
+    // discard any scans in progress
+    m_scanner->Stop();
+
     // stop monitoring everything
     QStringList paths;
     QHash<QString,TorcMediaDirectory*>::iterator it = m_monitoredPaths.begin();
     for ( ; it != m_monitoredPaths.end(); ++it)
         paths << it.key();
 
-    RemovePaths(paths);
+    // N.B. the index is left intact so the current state can be restored when monitoring restarts
+    RemovePaths(paths, false);
 
     // check everthing is cleared
-    if (!m_watcher.directories().isEmpty())
+    QStringList watched = m_watcher.Directories();
+    if (!watched.isEmpty())
     {
-        LOG(VB_GENERAL, LOG_ERR, QString("Qt is still monitoring %1 directories - stopping").arg(m_watcher.directories().size()));
-        m_watcher.removePaths(m_watcher.directories());
+        LOG(VB_GENERAL, LOG_ERR, QString("Still monitoring %1 directories - stopping").arg(watched.size()));
+        foreach (const QString &path, watched)
+            m_watcher.RemovePath(path);
     }
 
     if (!m_mediaItems.isEmpty())
@@ -490,12 +876,21 @@ void TorcMediaSourceDirectory::StopMonitoring(void)
             delete it.value();
             LOG(VB_GENERAL, LOG_INFO, QString("Removed '%1'").arg(it.key()));
         }
+
+        m_mediaItems.clear();
     }
 }
 
-void TorcMediaSourceDirectory::RemovePaths(QStringList &Paths)
+/*! \brief Stop monitoring Paths (and their known subdirectories) and remove their media items.
+ *
+ * If Forget is true, the paths are also removed from the media index (i.e. they have been deleted or
+ * are no longer configured). Otherwise they will be restored when monitoring is restarted.
+ *
+ * \note The known directories and files are used rather than the file system, which may already have changed.
+*/
+void TorcMediaSourceDirectory::RemovePaths(const QStringList &Paths, bool Forget)
 {
-    QVariantList notifyold;
+    QList<TorcMediaDescription> notifyold;
 
     foreach (QString path, Paths)
     {
@@ -506,53 +901,51 @@ void TorcMediaSourceDirectory::RemovePaths(QStringList &Paths)
 
         // remove all directories if recursively monitored
         if (directory->m_recursive)
-        {
-            QStringList paths;
-            QDirIterator it(path, m_directoryNameFilters, m_directoryFilters);
-            while (it.hasNext())
-            {
-                it.next();
-                paths << it.filePath();
-            }
-
-            RemovePaths(paths);
-        }
+            RemovePaths(directory->m_knownDirectories, Forget);
 
         // cleanup
-        QStringList knownpaths = directory->m_knownFiles;
+        QStringList knownpaths = directory->m_knownFiles.keys();
         delete directory;
         m_monitoredPaths.remove(path);
-        m_watcher.removePath(path);
+        m_watcher.RemovePath(path);
+
+        if (Forget)
+            m_index->RemoveDirectory(path);
 
         LOG(VB_GENERAL, LOG_INFO, QString("Stopping monitoring '%1'").arg(path));
 
         // remove items
-        QDirIterator it(path, m_fileNameFilters, m_fileFilters);
-        while (it.hasNext())
+        foreach (QString known, knownpaths)
         {
-            it.next();
-            knownpaths.removeOne(it.filePath());
-            TorcMediaDescription *media = m_mediaItems.take(it.filePath());
-            notifyold.append(QVariant::fromValue(*media));
-            delete media;
+            TorcMediaDescription *media = m_mediaItems.value(known);
+            if (media)
+                notifyold.append(*media);
+            RemoveItem(known);
         }
-
-        foreach (QString leftover, knownpaths)
-            RemoveItem(leftover);
     }
 
-    if (!notifyold.isEmpty())
-    {
-        if (gTorcMediaMaster)
-        {
-            QVariantMap data;
-            data.insert("files", notifyold);
-            TorcEvent *event = new TorcEvent(Torc::MediaRemoved, data);
-            QCoreApplication::postEvent(gTorcMediaMaster, event);
-        }
+    Notify(QList<TorcMediaDescription>(), notifyold);
+}
+
+/// Notify TorcMediaMaster of added and removed media items and update the media version.
+void TorcMediaSourceDirectory::Notify(const QList<TorcMediaDescription> &Added, const QList<TorcMediaDescription> &Removed)
+{
+    if (Added.isEmpty() && Removed.isEmpty())
+        return;
 
-        IncrementVersion();
+    m_changeLog->Record(Added, Removed);
+    m_extractor->Cancel(Removed);
+    m_extractor->Queue(Added);
+
+    if (gTorcMediaMaster)
+    {
+        if (!Removed.isEmpty())
+            QCoreApplication::postEvent(gTorcMediaMaster, new TorcMediaEvent(Torc::MediaRemoved, Removed));
+        if (!Added.isEmpty())
+            QCoreApplication::postEvent(gTorcMediaMaster, new TorcMediaEvent(Torc::MediaAdded, Added));
     }
+
+    IncrementVersion();
 }
 
 void TorcMediaSourceDirectory::RemoveItem(const QString &Path)
@@ -6,15 +6,19 @@
 #include <QHash>
 #include <QMutex>
 #include <QObject>
-#include <QFileSystemWatcher>
 #include <QStringList>
 
 // Torc
 #include "torcmediaexport.h"
 #include "http/torchttpservice.h"
 #include "torcmedia.h"
+#include "torcmediawatcher.h"
 
 class TorcMediaDirectory;
+class TorcMediaIndex;
+class TorcMediaScanner;
+class TorcMediaChangeLog;
+class TorcMetadataExtractor;
 
 class TORC_MEDIA_PUBLIC TorcMediaSourceDirectory : public QObject, public TorcHTTPService
 {
@@ -23,6 +27,7 @@ class TORC_MEDIA_PUBLIC TorcMediaSourceDirectory : public QObject, public TorcHT
     Q_CLASSINFO("AddPath",            "methods=PUT")
     Q_CLASSINFO("RemovePath",         "methods=PUT")
     Q_CLASSINFO("GetConfiguredPaths", "type=paths")
+    Q_CLASSINFO("GetMediaChanges",    "type=changes")
 
   public:
     TorcMediaSourceDirectory();
@@ -38,6 +43,7 @@ class TORC_MEDIA_PUBLIC TorcMediaSourceDirectory : public QObject, public TorcHT
     void            RemovePath              (const QString &Path);
     QStringList     GetConfiguredPaths      (void);
     int             GetMediaVersion         (void);
+    QVariantMap     GetMediaChanges         (const QString &Epoch, int Since);
 
   signals:
     void            mediaVersionChanged     (void);
@@ -48,6 +54,9 @@ class TORC_MEDIA_PUBLIC TorcMediaSourceDirectory : public QObject, public TorcHT
     void            DirectoryChanged        (const QString &Path);
     void            StartMonitoring         (void);
     void            StopMonitoring          (void);
+    void            ScanResultsReady        (void);
+    void            FilesChanged            (const QStringList &Added, const QStringList &Removed);
+    void            WatcherOverflow         (void);
 
   public:
     TorcMedia::MediaType GuessFileType      (const QString &Path);
@@ -58,12 +67,19 @@ class TORC_MEDIA_PUBLIC TorcMediaSourceDirectory : public QObject, public TorcHT
     void            timerEvent              (QTimerEvent *Event);
 
   private:
-    void            RemovePaths             (QStringList &Paths);
+    QStringList     RestoreFromIndex        (const QStringList &Roots);
+    void            RemovePaths             (const QStringList &Paths, bool Forget);
     void            RemoveItem              (const QString &Path);
+    void            Notify                  (const QList<TorcMediaDescription> &Added,
+                                             const QList<TorcMediaDescription> &Removed);
     void            AddDirectories          (const QString &Path, QStringList &Found);
 
   private:
-    QFileSystemWatcher m_watcher;
+    TorcMediaWatcher m_watcher;
+    TorcMediaIndex *m_index;
+    TorcMediaScanner *m_scanner;
+    TorcMediaChangeLog *m_changeLog;
+    TorcMetadataExtractor *m_extractor;
     int             mediaVersion;
     QAtomicInt      realMediaVersion;
     QStringList     configuredPaths;
@@ -71,14 +87,6 @@ class TORC_MEDIA_PUBLIC TorcMediaSourceDirectory : public QObject, public TorcHT
     bool            m_enabled;
     int             m_timerId;
 
-    QDir::Filters   m_fileFilters;
-    QDir::Filters   m_directoryFilters;
-    QStringList     m_audioExtensions;
-    QStringList     m_videoExtensions;
-    QStringList     m_photoExtensions;
-    QStringList     m_fileNameFilters;
-    QStringList     m_directoryNameFilters;
-
     QHash<QString,TorcMediaDirectory*>   m_monitoredPaths;
     QHash<QString,TorcMediaDescription*> m_mediaItems;
 
@@ -20,15 +20,26 @@
 * USA.
 */
 
+// Qt
+#include <QCoreApplication>
+
 // Torc
 #include "torclocalcontext.h"
 #include "torcrpcrequest.h"
 #include "torcnetworkedcontext.h"
+#include "torcmediamaster.h"
 #include "torcmediasource.h"
 #include "torcmediasourcepeer.h"
 
 /*! \class TorcMediaPeer
  *  \brief A simple wrapper around a Torc peer connection.
+ *
+ * The peer's media list is mirrored locally and kept up to date by requesting only the changes
+ * since the last version seen (see TorcMediaSourceDirectory::GetMediaChanges). The peer decides
+ * whether to return a delta or its complete list.
+ *
+ * Mirrored items are published to TorcMediaMaster with a 'torc://<uuid>' prefix, so they cannot collide
+ * with local items.
 */
 class TorcMediaPeer
 {
@@ -37,13 +48,21 @@ class TorcMediaPeer
       : m_parent(Parent),
         m_name(Name),
         m_uuid(UUID),
-        m_currentRequest(NULL)
+        m_currentRequest(NULL),
+        m_changesRequest(NULL),
+        m_changesPending(false),
+        m_version(0)
     {
     }
 
     ~TorcMediaPeer()
     {
         CancelRequest();
+
+        // withdraw everything published for this peer
+        QList<TorcMediaDescription> removed = m_media.values();
+        m_media.clear();
+        Publish(QList<TorcMediaDescription>(), removed);
     }
 
     /*! \brief Begin querying the peer for exported media files.
@@ -55,6 +74,33 @@ class TorcMediaPeer
 
         m_currentRequest = new TorcRPCRequest("/services/files/Subscribe", m_parent);
         TorcNetworkedContext::RemoteRequest(m_uuid, m_currentRequest);
+
+        RequestChanges();
+    }
+
+    /// Request the peer's media changes since the last known version.
+    void RequestChanges(void)
+    {
+        if (!m_parent)
+            return;
+
+        // only one request at a time - and ask again once the current request completes
+        if (m_changesRequest)
+        {
+            m_changesPending = true;
+            return;
+        }
+
+        m_changesPending = false;
+        m_changesRequest = new TorcRPCRequest("/services/files/GetMediaChanges", m_parent);
+        m_changesRequest->AddParameter("Epoch", m_epoch);
+        m_changesRequest->AddParameter("Since", m_version);
+        TorcNetworkedContext::RemoteRequest(m_uuid, m_changesRequest);
+    }
+
+    bool OwnsRequest(TorcRPCRequest *Request)
+    {
+        return Request && (Request == m_currentRequest || Request == m_changesRequest);
     }
 
     void ProcessRequest(TorcRPCRequest *Request)
@@ -64,12 +110,99 @@ class TorcMediaPeer
             m_currentRequest->DownRef();
             m_currentRequest = NULL;
         }
+        else if (m_changesRequest && Request == m_changesRequest)
+        {
+            if (!(Request->GetState() & TorcRPCRequest::Errored) && Request->GetReply().type() == QVariant::Map)
+                ApplyChanges(Request->GetReply().toMap());
+            else
+                LOG(VB_GENERAL, LOG_ERR, QString("Failed to retrieve media changes from '%1'").arg(m_name));
+
+            m_changesRequest->DownRef();
+            m_changesRequest = NULL;
+
+            if (m_changesPending)
+                RequestChanges();
+        }
         else
         {
             LOG(VB_GENERAL, LOG_ERR, "Cannot process unknown request");
         }
     }
 
+    /*! \brief Apply a set of changes (or a complete media list) from the peer.
+    */
+    void ApplyChanges(const QVariantMap &Changes)
+    {
+        QList<TorcMediaDescription> added;
+        QList<TorcMediaDescription> removed;
+        bool full = Changes.value("full").toBool();
+
+        QHash<QString,TorcMediaDescription> previous;
+        if (full)
+            previous.swap(m_media);
+
+        foreach (const QVariant &url, Changes.value("removed").toList())
+        {
+            QHash<QString,TorcMediaDescription>::iterator it = m_media.find(url.toString());
+            if (it != m_media.end())
+            {
+                removed.append(it.value());
+                m_media.erase(it);
+            }
+        }
+
+        foreach (const QVariant &item, Changes.value("added").toList())
+        {
+            QVariantMap map = item.toMap();
+            QString url = map.value("url").toString();
+            if (url.isEmpty())
+                continue;
+
+            TorcMediaDescription media(map.value("name").toString(), url, (TorcMedia::MediaType)map.value("type").toInt(),
+                                       TorcMedia::MediaSourceLAN, NULL);
+
+            if (!previous.remove(url) && !m_media.contains(url))
+                added.append(media);
+            m_media.insert(url, media);
+        }
+
+        // anything not in a complete list has gone
+        removed.append(previous.values());
+
+        m_epoch   = Changes.value("epoch").toString();
+        m_version = Changes.value("version").toInt();
+
+        LOG(VB_GENERAL, LOG_INFO, QString("Peer '%1' media version %2: %3 added, %4 removed%5")
+            .arg(m_name).arg(m_version).arg(added.size()).arg(removed.size()).arg(full ? " (full)" : ""));
+
+        Publish(added, removed);
+    }
+
+    /// Notify TorcMediaMaster of changes to this peer's media.
+    void Publish(const QList<TorcMediaDescription> &Added, const QList<TorcMediaDescription> &Removed)
+    {
+        if (!gTorcMediaMaster)
+            return;
+
+        QString prefix = "torc://" + m_uuid;
+
+        if (!Removed.isEmpty())
+        {
+            QList<TorcMediaDescription> removed(Removed);
+            for (int i = 0; i < removed.size(); ++i)
+                removed[i].url.prepend(prefix);
+            QCoreApplication::postEvent(gTorcMediaMaster, new TorcMediaEvent(Torc::MediaRemoved, removed));
+        }
+
+        if (!Added.isEmpty())
+        {
+            QList<TorcMediaDescription> added(Added);
+            for (int i = 0; i < added.size(); ++i)
+                added[i].url.prepend(prefix);
+            QCoreApplication::postEvent(gTorcMediaMaster, new TorcMediaEvent(Torc::MediaAdded, added));
+        }
+    }
+
     /*! \brief Cancel the current remote request.
      *
      * \note Cancelling a request will involve 3 threads (MediaLoop, MainLoop and WebSocket) and
@@ -89,12 +222,25 @@ class TorcMediaPeer
             m_currentRequest->DownRef();
             m_currentRequest = NULL;
         }
+
+        if (m_changesRequest)
+        {
+            m_changesRequest->SetParent(NULL);
+            TorcNetworkedContext::CancelRequest(m_uuid, m_changesRequest);
+            m_changesRequest->DownRef();
+            m_changesRequest = NULL;
+        }
     }
 
     TorcMediaSourcePeer *m_parent;
     QString              m_name;
     QString              m_uuid;
     TorcRPCRequest      *m_currentRequest;
+    TorcRPCRequest      *m_changesRequest;
+    bool                 m_changesPending;
+    QString              m_epoch;
+    int                  m_version;
+    QHash<QString,TorcMediaDescription> m_media;
 };
 
 /*! \class TorcMediaSourcePeer
@@ -171,7 +317,7 @@ void TorcMediaSourcePeer::RequestReady(TorcRPCRequest *Request)
     QMap<QString,TorcMediaPeer*>::const_iterator it = m_peers.constBegin();
     for ( ; it != m_peers.constEnd(); ++it)
     {
-        if (it.value()->m_currentRequest == Request)
+        if (it.value()->OwnsRequest(Request))
         {
             it.value()->ProcessRequest(Request);
             return;
@@ -179,9 +325,21 @@ void TorcMediaSourcePeer::RequestReady(TorcRPCRequest *Request)
     }
 }
 
+/*! \brief Handle a notification from a subscribed service.
+ *
+ * A change in media version triggers a request for the changes. As the notification does not
+ * identify the peer, all peers are asked - which is cheap when nothing has changed.
+*/
 void TorcMediaSourcePeer::ServiceNotification(QString Method)
 {
-    LOG(VB_GENERAL, LOG_INFO, QString("ServiceNotification: '%1'").arg(Method));
+    LOG(VB_GENERAL, LOG_DEBUG, QString("ServiceNotification: '%1'").arg(Method));
+
+    if (Method.endsWith("mediaVersionChanged"))
+    {
+        QMap<QString,TorcMediaPeer*>::const_iterator it = m_peers.constBegin();
+        for ( ; it != m_peers.constEnd(); ++it)
+            it.value()->RequestChanges();
+    }
 }
 
 /*! \class TorcMediaSourcePeerObject
@@ -0,0 +1,326 @@
+/* Class TorcMediaWatcher
+*
+* This file is part of the Torc project.
+*
+* Copyright (C) Mark Kendall 2013
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+* USA.
+*/
+
+// Qt
+#include <QSet>
+#include <QFile>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QTimerEvent>
+#include <QSocketNotifier>
+#include <QFileSystemWatcher>
+
+// Torc
+#include "torclogging.h"
+#include "torcmediawatcher.h"
+
+#if defined(Q_OS_LINUX)
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#define INOTIFY_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | \
+                      IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#endif
+
+// check polled directories every 30 seconds
+#define POLL_INTERVAL 30000
+
+/*! \class TorcMediaWatcher
+ *  \brief Monitor directories for changes.
+ *
+ * Under Linux, TorcMediaWatcher uses inotify directly rather than QFileSystemWatcher. Individual
+ * file events are then available, so media files that are created, deleted, moved or rewritten are
+ * reported via FilesChanged and their directory does not need to be rescanned.
+ * DirectoryChanged is only emitted for changes that require a rescan (e.g. a subdirectory was
+ * created or removed).
+ *
+ * If the kernel's event queue overflows (IN_Q_OVERFLOW), events have been lost and Overflow is emitted.
+ * The owner should then rescan any directory that may have changed.
+ *
+ * If no more watches are available (i.e. fs.inotify.max_user_watches has been reached), the
+ * directory is instead polled for modification time changes every 30 seconds. Each time the polled
+ * directories are checked, an inotify watch is requested again, so that directories move back to
+ * inotify once watches become available (e.g. other directories were removed or the limit was raised).
+ *
+ * On other platforms QFileSystemWatcher is used and only DirectoryChanged is emitted.
+ *
+ * \note Events for files added by FilesChanged are not filtered by type.
+*/
+TorcMediaWatcher::TorcMediaWatcher()
+  : QObject(),
+    m_watcher(NULL),
+    m_inotify(-1),
+    m_notifier(NULL),
+    m_pollTimer(0)
+{
+#if defined(Q_OS_LINUX)
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify < 0)
+    {
+        LOG(VB_GENERAL, LOG_ERR, QString("Failed to initialise inotify (%1) - polling directories").arg(strerror(errno)));
+    }
+    else
+    {
+        m_notifier = new QSocketNotifier(m_inotify, QSocketNotifier::Read, this);
+        connect(m_notifier, SIGNAL(activated(int)), this, SLOT(ReadEvents()));
+    }
+#else
+    m_watcher = new QFileSystemWatcher(this);
+    connect(m_watcher, SIGNAL(directoryChanged(QString)), this, SIGNAL(DirectoryChanged(QString)));
+#endif
+}
+
+TorcMediaWatcher::~TorcMediaWatcher()
+{
+    if (m_pollTimer)
+        killTimer(m_pollTimer);
+
+    delete m_notifier;
+    delete m_watcher;
+
+#if defined(Q_OS_LINUX)
+    if (m_inotify > -1)
+        close(m_inotify);
+#endif
+}
+
+void TorcMediaWatcher::AddPath(const QString &Path)
+{
+    if (m_paths.contains(Path) || m_polled.contains(Path))
+        return;
+
+    if (m_watcher)
+    {
+        m_watcher->addPath(Path);
+        m_paths.insert(Path, -1);
+        return;
+    }
+
+#if defined(Q_OS_LINUX)
+    if (m_inotify > -1)
+    {
+        int wd = inotify_add_watch(m_inotify, QFile::encodeName(Path).constData(), INOTIFY_MASK);
+        if (wd > -1)
+        {
+            m_watches.insert(wd, Path);
+            m_paths.insert(Path, wd);
+            return;
+        }
+
+        if (errno != ENOSPC)
+        {
+            LOG(VB_GENERAL, LOG_ERR, QString("Failed to watch '%1' (%2)").arg(Path).arg(strerror(errno)));
+            return;
+        }
+
+        if (m_polled.isEmpty())
+            LOG(VB_GENERAL, LOG_WARNING, "No more inotify watches available - polling remaining directories "
+                                         "(consider increasing fs.inotify.max_user_watches)");
+    }
+#endif
+
+    m_polled.insert(Path, QFileInfo(Path).lastModified().toMSecsSinceEpoch());
+    if (!m_pollTimer)
+        m_pollTimer = startTimer(POLL_INTERVAL, Qt::VeryCoarseTimer);
+}
+
+void TorcMediaWatcher::RemovePath(const QString &Path)
+{
+    if (m_polled.remove(Path))
+    {
+        if (m_polled.isEmpty() && m_pollTimer)
+        {
+            killTimer(m_pollTimer);
+            m_pollTimer = 0;
+        }
+
+        return;
+    }
+
+    QHash<QString,int>::iterator it = m_paths.find(Path);
+    if (it == m_paths.end())
+        return;
+
+    int wd = it.value();
+    m_paths.erase(it);
+
+    if (m_watcher)
+    {
+        m_watcher->removePath(Path);
+        return;
+    }
+
+#if defined(Q_OS_LINUX)
+    // N.B. the watch may already have been removed by the kernel
+    if (m_watches.remove(wd))
+        inotify_rm_watch(m_inotify, wd);
+#else
+    (void)wd;
+#endif
+}
+
+QStringList TorcMediaWatcher::Directories(void)
+{
+    return m_paths.keys() + m_polled.keys();
+}
+
+void TorcMediaWatcher::ReadEvents(void)
+{
+#if defined(Q_OS_LINUX)
+    // the last event for each file wins (true for added)
+    QHash<QString,bool> files;
+    QSet<QString> directories;
+    bool overflow = false;
+
+    char buffer[16384] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    forever
+    {
+        ssize_t length = read(m_inotify, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+
+        for (char *ptr = buffer; ptr < buffer + length; )
+        {
+            const struct inotify_event *event = (const struct inotify_event*)ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                overflow = true;
+                continue;
+            }
+
+            QHash<int,QString>::const_iterator it = m_watches.constFind(event->wd);
+            if (it == m_watches.constEnd())
+                continue;
+
+            QString path = it.value();
+
+            // the watch has been removed (directory deleted or unmounted)
+            if (event->mask & IN_IGNORED)
+            {
+                m_watches.remove(event->wd);
+                m_paths.remove(path);
+                continue;
+            }
+
+            // the watched directory itself has gone
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+            {
+                directories.insert(path);
+                continue;
+            }
+
+            if (!event->len)
+                continue;
+
+            QString name = path + "/" + QFile::decodeName(event->name);
+
+            // subdirectories need to be scanned
+            if (event->mask & IN_ISDIR)
+            {
+                directories.insert(path);
+                continue;
+            }
+
+            if (event->mask & (IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE))
+                files.insert(name, true);
+            else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                files.insert(name, false);
+        }
+    }
+
+    if (overflow)
+    {
+        LOG(VB_GENERAL, LOG_WARNING, "inotify queue overflowed - events lost");
+        emit Overflow();
+    }
+
+    if (!files.isEmpty())
+    {
+        QStringList added;
+        QStringList removed;
+        QHash<QString,bool>::const_iterator it = files.constBegin();
+        for ( ; it != files.constEnd(); ++it)
+            (it.value() ? added : removed) << it.key();
+
+        emit FilesChanged(added, removed);
+    }
+
+    foreach (const QString &directory, directories)
+        emit DirectoryChanged(directory);
+#endif
+}
+
+void TorcMediaWatcher::timerEvent(QTimerEvent *Event)
+{
+    if (Event->timerId() != m_pollTimer)
+        return;
+
+    QStringList changed;
+    int watched = 0;
+    QHash<QString,qint64>::iterator it = m_polled.begin();
+    while (it != m_polled.end())
+    {
+        qint64 modified = QFileInfo(it.key()).lastModified().toMSecsSinceEpoch();
+        if (modified != it.value())
+        {
+            it.value() = modified;
+            changed << it.key();
+        }
+
+#if defined(Q_OS_LINUX)
+        if (m_inotify > -1)
+        {
+            int wd = inotify_add_watch(m_inotify, QFile::encodeName(it.key()).constData(), INOTIFY_MASK);
+            if (wd > -1)
+            {
+                m_watches.insert(wd, it.key());
+                m_paths.insert(it.key(), wd);
+                it = m_polled.erase(it);
+                watched++;
+                continue;
+            }
+        }
+#endif
+
+        ++it;
+    }
+
+    if (watched)
+    {
+        LOG(VB_GENERAL, LOG_INFO, QString("Moved %1 polled directories to inotify (%2 still polled)")
+            .arg(watched).arg(m_polled.size()));
+    }
+
+    if (m_polled.isEmpty())
+    {
+        killTimer(m_pollTimer);
+        m_pollTimer = 0;
+    }
+
+    foreach (const QString &directory, changed)
+        emit DirectoryChanged(directory);
+}
@@ -0,0 +1,45 @@
+#ifndef TORCMEDIAWATCHER_H
+#define TORCMEDIAWATCHER_H
+
+// Qt
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+
+class QSocketNotifier;
+class QFileSystemWatcher;
+
+class TorcMediaWatcher : public QObject
+{
+    Q_OBJECT
+
+  public:
+    TorcMediaWatcher();
+    virtual ~TorcMediaWatcher();
+
+    void            AddPath             (const QString &Path);
+    void            RemovePath          (const QString &Path);
+    QStringList     Directories         (void);
+
+  signals:
+    void            DirectoryChanged    (const QString &Path);
+    void            FilesChanged        (const QStringList &Added, const QStringList &Removed);
+    void            Overflow            (void);
+
+  protected slots:
+    void            ReadEvents          (void);
+
+  protected:
+    void            timerEvent          (QTimerEvent *Event);
+
+  private:
+    QFileSystemWatcher  *m_watcher;
+    int                  m_inotify;
+    QSocketNotifier     *m_notifier;
+    QHash<int,QString>   m_watches;
+    QHash<QString,int>   m_paths;
+    QHash<QString,qint64> m_polled;
+    int                  m_pollTimer;
+};
+
+#endif // TORCMEDIAWATCHER_H
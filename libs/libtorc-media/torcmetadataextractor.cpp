@@ -0,0 +1,489 @@
+/* Class TorcMetadataExtractor
+*
+* This file is part of the Torc project.
+*
+* Copyright (C) Mark Kendall 2013
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+* USA.
+*/
+
+// Qt
+#include <QDir>
+#include <QFile>
+#include <QThread>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QTimerEvent>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+
+// Torc
+#include "torclocalcontext.h"
+#include "torcdirectories.h"
+#include "torclogging.h"
+#include "audiodecoder.h"
+#include "torcmediaindex.h"
+#include "torcmediamaster.h"
+#include "torcmetadataextractor.h"
+
+extern "C" {
+#include "libavformat/avformat.h"
+#include "libswscale/swscale.h"
+}
+
+// limit the data read when probing - enough for most headers
+#define PROBE_SIZE             (256 * 1024)
+#define PROBE_ANALYZE_DURATION (AV_TIME_BASE / 2)
+// number of queued items checked against the cache per event loop iteration
+#define QUEUE_SLICE            200
+// deliver updates at most every 500ms
+#define FLUSH_INTERVAL         500
+// maximum width and height of saved artwork
+#define ARTWORK_SIZE           320
+
+static int ProbeInterrupt(void *Object)
+{
+    QAtomicInt *abort = (QAtomicInt*)Object;
+    return (abort && abort->fetchAndAddOrdered(0)) ? 1 : 0;
+}
+
+/*! \brief Decode the picture attached to Stream and return it as a JPEG no larger than ARTWORK_SIZE.
+ *
+ * The aspect ratio is preserved and smaller pictures are not enlarged. Returns an empty array on failure.
+*/
+static QByteArray CreateThumbnail(AVStream *Stream)
+{
+    QByteArray result;
+
+    AVCodecContext *codec = Stream->codec;
+    AVCodec *decoder = avcodec_find_decoder(codec->codec_id);
+    if (!decoder || avcodec_open2(codec, decoder, NULL) < 0)
+        return result;
+
+    AVFrame *frame = avcodec_alloc_frame();
+    int gotframe = 0;
+
+    if (frame && avcodec_decode_video2(codec, frame, &gotframe, &Stream->attached_pic) >= 0 &&
+        gotframe && codec->width > 0 && codec->height > 0)
+    {
+        int width  = codec->width;
+        int height = codec->height;
+        if (width > ARTWORK_SIZE || height > ARTWORK_SIZE)
+        {
+            if (width > height)
+            {
+                height = qMax(1, (int)((qint64)height * ARTWORK_SIZE / width));
+                width  = ARTWORK_SIZE;
+            }
+            else
+            {
+                width  = qMax(1, (int)((qint64)width * ARTWORK_SIZE / height));
+                height = ARTWORK_SIZE;
+            }
+        }
+
+        AVCodec *encoder         = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+        AVCodecContext *context  = encoder ? avcodec_alloc_context3(encoder) : NULL;
+        SwsContext *scaler       = sws_getContext(codec->width, codec->height, codec->pix_fmt, width, height,
+                                                  AV_PIX_FMT_YUVJ420P, SWS_BICUBIC, NULL, NULL, NULL);
+        AVFrame *scaled          = avcodec_alloc_frame();
+        AVPicture picture;
+        bool allocated = avpicture_alloc(&picture, AV_PIX_FMT_YUVJ420P, width, height) == 0;
+
+        if (context && scaler && scaled && allocated)
+        {
+            context->width         = width;
+            context->height        = height;
+            context->pix_fmt       = AV_PIX_FMT_YUVJ420P;
+            context->time_base.num = 1;
+            context->time_base.den = 25;
+            context->flags        |= CODEC_FLAG_QSCALE;
+            context->global_quality = FF_QP2LAMBDA * 3;
+
+            if (avcodec_open2(context, encoder, NULL) == 0)
+            {
+                sws_scale(scaler, frame->data, frame->linesize, 0, codec->height, picture.data, picture.linesize);
+
+                for (int i = 0; i < 4; ++i)
+                {
+                    scaled->data[i]     = picture.data[i];
+                    scaled->linesize[i] = picture.linesize[i];
+                }
+                scaled->width   = width;
+                scaled->height  = height;
+                scaled->format  = AV_PIX_FMT_YUVJ420P;
+                scaled->quality = context->global_quality;
+                scaled->pts     = 0;
+
+                AVPacket packet;
+                av_init_packet(&packet);
+                packet.data = NULL;
+                packet.size = 0;
+                int gotpacket = 0;
+                if (avcodec_encode_video2(context, &packet, scaled, &gotpacket) == 0 && gotpacket)
+                    result = QByteArray((const char*)packet.data, packet.size);
+                av_free_packet(&packet);
+
+                avcodec_close(context);
+            }
+        }
+
+        if (allocated)
+            avpicture_free(&picture);
+        avcodec_free_frame(&scaled);
+        sws_freeContext(scaler);
+        av_free(context);
+    }
+
+    avcodec_free_frame(&frame);
+    avcodec_close(codec);
+    return result;
+}
+
+/*! \class TorcMetadataProbe
+ *  \brief Probe a single file from within a low priority QRunnable.
+*/
+class TorcMetadataProbe : public QRunnable
+{
+  public:
+    TorcMetadataProbe(TorcMetadataExtractor *Parent, const QString &Path, qint64 Size, qint64 Modified)
+      : QRunnable(),
+        m_parent(Parent),
+        m_path(Path),
+        m_size(Size),
+        m_modified(Modified)
+    {
+    }
+
+    void run(void)
+    {
+        QThread::currentThread()->setPriority(QThread::IdlePriority);
+
+        QVariantMap details = TorcMetadataExtractor::Probe(m_path, &m_parent->m_abort);
+
+        QMetaObject::invokeMethod(m_parent, "ProbeComplete", Qt::QueuedConnection,
+                                  Q_ARG(QString, m_path), Q_ARG(qint64, m_size),
+                                  Q_ARG(qint64, m_modified), Q_ARG(QVariantMap, details));
+    }
+
+  private:
+    TorcMetadataExtractor *m_parent;
+    QString                m_path;
+    qint64                 m_size;
+    qint64                 m_modified;
+};
+
+/*! \class TorcMetadataExtractor
+ *  \brief Extract technical details from local media files in the background.
+ *
+ * Queued files are first checked against the details stored in the media index (keyed by path, size
+ * and modification time). Anything else is probed with libavformat, using tight probe limits, on a small
+ * pool of idle priority threads and the results are stored in the index.
+ *
+ * Details are delivered to TorcMediaMaster (as Torc::MediaChanged) in batches and made available
+ * via TorcMedia::GetDetails. Embedded artwork is scaled to a JPEG thumbnail (no larger than
+ * ARTWORK_SIZE), saved to the 'artwork' directory within the configuration directory and referenced
+ * by the 'artwork' detail.
+ *
+ * Only successful probes are stored. A file that fails to probe is remembered for the current session
+ * only and is probed again once it changes (e.g. it was still being written) or Torc is restarted.
+ * Artwork is deleted by TorcMediaIndex when the file's details are removed.
+ *
+ * The number of probes queued with the thread pool is limited, so that cancelled items are dropped
+ * cheaply and shutdown is quick.
+ *
+ * \note TorcMetadataExtractor must be used from the thread that owns the TorcMediaIndex.
+ *
+ * \sa TorcMediaSourceDirectory
+ * \sa TorcMediaIndex
+*/
+TorcMetadataExtractor::TorcMetadataExtractor(TorcMediaIndex *Index)
+  : QObject(),
+    m_index(Index),
+    m_abort(0),
+    m_inFlight(0),
+    m_queueTimer(0),
+    m_flushTimer(0)
+{
+    AudioDecoder::InitialiseLibav();
+
+    m_pool.setMaxThreadCount(qMax(1, gLocalContext->GetSetting(TORC_CORE + "MetadataThreads", (int)2)));
+    QDir().mkpath(GetTorcConfigDir() + "/artwork");
+}
+
+TorcMetadataExtractor::~TorcMetadataExtractor()
+{
+    if (m_queueTimer)
+        killTimer(m_queueTimer);
+    if (m_flushTimer)
+        killTimer(m_flushTimer);
+
+    m_abort.fetchAndStoreOrdered(1);
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+/// Queue local media items for extraction.
+void TorcMetadataExtractor::Queue(const QList<TorcMediaDescription> &Media)
+{
+    foreach (const TorcMediaDescription &media, Media)
+    {
+        if (media.source != TorcMedia::MediaSourceLocal || m_queued.contains(media.url))
+            continue;
+
+        m_queued.insert(media.url);
+        m_queue.append(media.url);
+    }
+
+    if (!m_queue.isEmpty() && !m_queueTimer)
+        m_queueTimer = startTimer(0);
+}
+
+/// Discard any outstanding extraction for Media (which has been removed).
+void TorcMetadataExtractor::Cancel(const QList<TorcMediaDescription> &Media)
+{
+    foreach (const TorcMediaDescription &media, Media)
+    {
+        m_queued.remove(media.url);
+        m_failed.remove(media.url);
+    }
+}
+
+void TorcMetadataExtractor::timerEvent(QTimerEvent *Event)
+{
+    if (Event->timerId() == m_queueTimer)
+        ProcessQueue();
+    else if (Event->timerId() == m_flushTimer)
+        Flush();
+}
+
+/*! \brief Check the next slice of queued items against the cache and start probes for the rest.
+ *
+ * Only a few probes are handed to the thread pool at a time and processing resumes when they complete.
+*/
+void TorcMetadataExtractor::ProcessQueue(void)
+{
+    int maxinflight = m_pool.maxThreadCount() * 2;
+    int checked = 0;
+
+    while (!m_queue.isEmpty() && checked < QUEUE_SLICE && m_inFlight < maxinflight)
+    {
+        QString path = m_queue.takeFirst();
+
+        // cancelled
+        if (!m_queued.contains(path))
+            continue;
+
+        checked++;
+
+        QFileInfo info(path);
+        if (!info.isFile())
+        {
+            m_queued.remove(path);
+            continue;
+        }
+
+        qint64 size     = info.size();
+        qint64 modified = info.lastModified().toMSecsSinceEpoch();
+
+        // failed earlier and unchanged
+        QHash<QString,QPair<qint64,qint64> >::iterator failed = m_failed.find(path);
+        if (failed != m_failed.end())
+        {
+            if (failed.value() == qMakePair(size, modified))
+            {
+                m_queued.remove(path);
+                continue;
+            }
+
+            m_failed.erase(failed);
+        }
+
+        QVariantMap details;
+        if (m_index->GetDetails(path, size, modified, details))
+        {
+            m_queued.remove(path);
+            TorcMediaDescription media;
+            media.url     = path;
+            media.details = details;
+            m_ready.append(media);
+            continue;
+        }
+
+        m_inFlight++;
+        m_pool.start(new TorcMetadataProbe(this, path, size, modified));
+    }
+
+    if (!m_ready.isEmpty() && !m_flushTimer)
+        m_flushTimer = startTimer(FLUSH_INTERVAL);
+
+    // wait for a probe to complete if the pool is full
+    if (m_queueTimer && (m_queue.isEmpty() || m_inFlight >= maxinflight))
+    {
+        killTimer(m_queueTimer);
+        m_queueTimer = 0;
+    }
+}
+
+void TorcMetadataExtractor::ProbeComplete(const QString &Path, qint64 Size, qint64 Modified, const QVariantMap &Details)
+{
+    m_inFlight--;
+
+    // cancelled (the file has been removed) or aborted
+    if (!m_queued.remove(Path) || m_abort.fetchAndAddOrdered(0))
+    {
+        if (!m_queue.isEmpty() && !m_queueTimer)
+            m_queueTimer = startTimer(0);
+        return;
+    }
+
+    // N.B. failures are not stored - they may be transient
+    if (Details.isEmpty())
+    {
+        m_failed.insert(Path, qMakePair(Size, Modified));
+    }
+    else
+    {
+        m_index->SetDetails(Path, Size, Modified, Details);
+
+        TorcMediaDescription media;
+        media.url     = Path;
+        media.details = Details;
+        m_ready.append(media);
+
+        if (!m_flushTimer)
+            m_flushTimer = startTimer(FLUSH_INTERVAL);
+    }
+
+    if (!m_queue.isEmpty() && !m_queueTimer)
+        m_queueTimer = startTimer(0);
+}
+
+void TorcMetadataExtractor::Flush(void)
+{
+    if (m_flushTimer)
+        killTimer(m_flushTimer);
+    m_flushTimer = 0;
+
+    if (m_ready.isEmpty())
+        return;
+
+    LOG(VB_GENERAL, LOG_DEBUG, QString("Delivering details for %1 items").arg(m_ready.size()));
+
+    if (gTorcMediaMaster)
+        QCoreApplication::postEvent(gTorcMediaMaster, new TorcMediaEvent(Torc::MediaChanged, m_ready));
+    m_ready.clear();
+}
+
+/*! \brief Open Path with libavformat and return its technical details.
+ *
+ * \note This is called from the thread pool.
+*/
+QVariantMap TorcMetadataExtractor::Probe(const QString &Path, QAtomicInt *Abort)
+{
+    QVariantMap details;
+
+    AVFormatContext *context = avformat_alloc_context();
+    if (!context)
+        return details;
+
+    context->probesize                   = PROBE_SIZE;
+    context->max_analyze_duration        = PROBE_ANALYZE_DURATION;
+    context->interrupt_callback.callback = ProbeInterrupt;
+    context->interrupt_callback.opaque   = (void*)Abort;
+
+    // N.B. avformat_open_input frees the context on failure
+    if (avformat_open_input(&context, QFile::encodeName(Path).constData(), NULL, NULL) < 0)
+    {
+        LOG(VB_GENERAL, LOG_DEBUG, QString("Failed to open '%1' for probing").arg(Path));
+        return details;
+    }
+
+    if (avformat_find_stream_info(context, NULL) < 0)
+    {
+        LOG(VB_GENERAL, LOG_DEBUG, QString("Failed to find stream info for '%1'").arg(Path));
+        avformat_close_input(&context);
+        return details;
+    }
+
+    if (context->iformat && context->iformat->name)
+        details.insert("format", QString(context->iformat->name));
+    if (context->duration != (int64_t)AV_NOPTS_VALUE && context->duration > 0)
+        details.insert("duration", (double)context->duration / AV_TIME_BASE);
+    if (context->bit_rate > 0)
+        details.insert("bitrate", context->bit_rate);
+
+    static const char* tags[] = { "title", "artist", "album", "date", "track", NULL };
+    for (int i = 0; tags[i]; ++i)
+    {
+        AVDictionaryEntry *entry = av_dict_get(context->metadata, tags[i], NULL, 0);
+        if (entry && entry->value)
+            details.insert(tags[i], QString::fromUtf8(entry->value));
+    }
+
+    for (uint i = 0; i < context->nb_streams; ++i)
+    {
+        AVStream *stream = context->streams[i];
+        AVCodecContext *codec = stream->codec;
+        const AVCodecDescriptor *descriptor = avcodec_descriptor_get(codec->codec_id);
+        QString codecname = descriptor ? QString(descriptor->name) : QString();
+
+        if (stream->disposition & AV_DISPOSITION_ATTACHED_PIC)
+        {
+            if (details.contains("artwork") || stream->attached_pic.size < 1)
+                continue;
+
+            QByteArray picture = CreateThumbnail(stream);
+            if (picture.isEmpty())
+            {
+                LOG(VB_GENERAL, LOG_DEBUG, QString("Failed to create thumbnail for '%1'").arg(Path));
+                continue;
+            }
+
+            QString name = GetTorcConfigDir() + "/artwork/" +
+                           QCryptographicHash::hash(QFile::encodeName(Path), QCryptographicHash::Sha1).toHex() + ".jpg";
+
+            QFile file(name);
+            if (file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            {
+                file.write(picture);
+                file.close();
+                details.insert("artwork", name);
+            }
+
+            continue;
+        }
+
+        if (codec->codec_type == AVMEDIA_TYPE_VIDEO && !details.contains("videoCodec"))
+        {
+            details.insert("videoCodec", codecname);
+            details.insert("width",      codec->width);
+            details.insert("height",     codec->height);
+            if (stream->avg_frame_rate.num && stream->avg_frame_rate.den)
+                details.insert("frameRate", av_q2d(stream->avg_frame_rate));
+        }
+        else if (codec->codec_type == AVMEDIA_TYPE_AUDIO && !details.contains("audioCodec"))
+        {
+            details.insert("audioCodec", codecname);
+            details.insert("channels",   codec->channels);
+            details.insert("sampleRate", codec->sample_rate);
+        }
+    }
+
+    avformat_close_input(&context);
+    return details;
+}
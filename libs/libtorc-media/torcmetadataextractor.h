@@ -0,0 +1,55 @@
+#ifndef TORCMETADATAEXTRACTOR_H
+#define TORCMETADATAEXTRACTOR_H
+
+// Qt
+#include <QSet>
+#include <QHash>
+#include <QPair>
+#include <QObject>
+#include <QVariant>
+#include <QStringList>
+#include <QThreadPool>
+
+// Torc
+#include "torcmedia.h"
+
+class TorcMediaIndex;
+
+class TorcMetadataExtractor : public QObject
+{
+    Q_OBJECT
+
+    friend class TorcMetadataProbe;
+
+  public:
+    TorcMetadataExtractor(TorcMediaIndex *Index);
+    virtual ~TorcMetadataExtractor();
+
+    void                 Queue            (const QList<TorcMediaDescription> &Media);
+    void                 Cancel           (const QList<TorcMediaDescription> &Media);
+
+  protected slots:
+    void                 ProbeComplete    (const QString &Path, qint64 Size, qint64 Modified, const QVariantMap &Details);
+
+  protected:
+    void                 timerEvent       (QTimerEvent *Event);
+
+  private:
+    void                 ProcessQueue     (void);
+    void                 Flush            (void);
+    static QVariantMap   Probe            (const QString &Path, QAtomicInt *Abort);
+
+  private:
+    TorcMediaIndex      *m_index;
+    QThreadPool          m_pool;
+    QAtomicInt           m_abort;
+    QStringList          m_queue;
+    QSet<QString>        m_queued;
+    QHash<QString,QPair<qint64,qint64> > m_failed;
+    int                  m_inFlight;
+    int                  m_queueTimer;
+    int                  m_flushTimer;
+    QList<TorcMediaDescription> m_ready;
+};
+
+#endif // TORCMETADATAEXTRACTOR_H
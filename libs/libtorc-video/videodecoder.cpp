@@ -449,10 +449,14 @@ void VideoDecoder::ProcessVideoPacket(AVFormatContext *Context, AVStream *Stream
     frame->m_invertForDisplay = 0;
     frame->m_field            = VideoFrame::Frame;
 
-    m_videoParent->GetBuffers()->ReleaseFrameFromDecoding(frame);
-
     if (m_firstVideoTimecode == (qint64)AV_NOPTS_VALUE)
         m_firstVideoTimecode = frame->m_pts;
+
+    m_videoParent->GetBuffers()->ReleaseFrameFromDecoding(frame);
+
+    // there is no display when benchmarking
+    if (m_videoParent->GetPlayerFlags() & TorcPlayer::Benchmark)
+        m_videoParent->ReleaseReadyFrames();
 }
 
 AVCodec* VideoDecoder::PreInitVideoDecoder(AVFormatContext *Context, AVStream *Stream)
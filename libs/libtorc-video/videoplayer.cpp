@@ -123,7 +123,8 @@ VideoPlayer::VideoPlayer(QObject *Parent, int PlaybackFlags, int DecodeFlags)
   : TorcPlayer(Parent, PlaybackFlags, DecodeFlags),
     TorcVideoOverlay(),
     m_audioWrapper(new AudioWrapper(this)),
-    m_reset(false)
+    m_reset(false),
+    m_framesDisplayed(0)
 {
     setObjectName("Player");
     m_buffers.SetDisplayFormat(AV_PIX_FMT_YUV420P);
@@ -146,11 +147,30 @@ bool VideoPlayer::Refresh(quint64 TimeNow, const QSizeF &Size, bool Visible)
 {
     VideoFrame *frame = m_buffers.GetFrameForDisplaying();
     if (frame)
+    {
         m_buffers.ReleaseFrameFromDisplaying(frame, false);
+        m_framesDisplayed.ref();
+    }
 
     return TorcPlayer::Refresh(TimeNow, Size, Visible);
 }
 
+/*! \brief Release every frame that is ready for display without displaying it.
+ *
+ * Used when benchmarking, where it is called from the video decoder thread as each frame is decoded,
+ * so that decoding is never throttled by the display (or refresh) rate.
+*/
+void VideoPlayer::ReleaseReadyFrames(void)
+{
+    VideoFrame *frame = m_buffers.GetFrameForDisplaying();
+    while (frame)
+    {
+        m_buffers.ReleaseFrameFromDisplaying(frame, false);
+        m_framesDisplayed.ref();
+        frame = m_buffers.GetFrameForDisplaying();
+    }
+}
+
 void VideoPlayer::Render(quint64 TimeNow)
 {
     (void)TimeNow;
@@ -186,6 +206,13 @@ void VideoPlayer::SetProperty(PlayerProperty Property, QVariant Value)
     TorcPlayer::SetProperty(Property, Value);
 }
 
+QVariantMap VideoPlayer::GetStatistics(void)
+{
+    QVariantMap result = TorcPlayer::GetStatistics();
+    result.insert("videoFrames", m_framesDisplayed.load());
+    return result;
+}
+
 class VideoPlayerFactory : public PlayerFactory
 {
     void Score(QObject *Parent, int PlaybackFlags, int DecoderFlags, int &Score)
@@ -3,6 +3,7 @@
 
 // Qt
 #include <QObject>
+#include <QAtomicInt>
 
 // Torc
 #include "torcsetting.h"
@@ -31,9 +32,11 @@ class VideoPlayer : public TorcPlayer, public TorcVideoOverlay
     virtual void    Reset              (void);
     virtual QVariant GetProperty       (PlayerProperty Property);
     virtual void    SetProperty        (PlayerProperty Property, QVariant Value);
+    virtual QVariantMap GetStatistics  (void);
 
     void*           GetAudio           (void);
     VideoBuffers*   GetBuffers         (void);
+    void            ReleaseReadyFrames (void);
 
   protected:
     virtual void    Teardown           (void);
@@ -42,6 +45,7 @@ class VideoPlayer : public TorcPlayer, public TorcVideoOverlay
     AudioWrapper   *m_audioWrapper;
     VideoBuffers    m_buffers;
     bool            m_reset;
+    QAtomicInt      m_framesDisplayed;
 };
 
 #endif // TORCVIDEOINTERFACE_H
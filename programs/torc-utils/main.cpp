@@ -26,6 +26,10 @@ int main(int argc, char **argv)
 
         cmdline->Add("probe", QVariant(), "Probe the given URI for media content (audio, video and still images).", TorcCommandLine::None);
         cmdline->Add("play",  QVariant(), "Play the given URI.", TorcCommandLine::None);
+        cmdline->Add("benchmark", QVariant(), "Decode the given URI as fast as possible, without audio or video output, and print performance statistics as JSON.", TorcCommandLine::None);
+        cmdline->Add("encoderbenchmark", QVariant(), "Measure the CPU cost of encoding 5.1 audio to AC-3 for S/PDIF output and print the result as JSON.", TorcCommandLine::None);
+        cmdline->Add("raopjitterbuffer", QVariant(), "Feed the RAOP jitter buffer a simulated stream with packet loss and reordering and print the result as JSON.", TorcCommandLine::None);
+        cmdline->Add("rpcbatch", QVariant(), "Send a batch of JSON-RPC requests through the peer request handling and print the result as JSON.", TorcCommandLine::None);
 
         bool justexit = false;
         ret = cmdline->Evaluate(argc, argv, justexit);
@@ -41,12 +45,20 @@ int main(int argc, char **argv)
 
         QString uri = cmdline->GetValue("f").toString();
 
-        if (!uri.isEmpty())
+        if (cmdline.data()->GetValue("encoderbenchmark").isValid())
+            ret = TorcUtils::EncoderBenchmark();
+        else if (cmdline.data()->GetValue("raopjitterbuffer").isValid())
+            ret = TorcUtils::RAOPJitterBuffer();
+        else if (cmdline.data()->GetValue("rpcbatch").isValid())
+            ret = TorcUtils::RPCBatch();
+        else if (!uri.isEmpty())
         {
             if (cmdline.data()->GetValue("probe").isValid())
                 ret = TorcUtils::Probe(uri);
             else if (cmdline.data()->GetValue("play").isValid())
                 ret = TorcUtils::Play(uri);
+            else if (cmdline.data()->GetValue("benchmark").isValid())
+                ret = TorcUtils::Benchmark(uri);
         }
     }
 
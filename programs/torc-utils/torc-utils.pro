@@ -12,12 +12,15 @@ QT -= gui
 
 DEPENDPATH  += ../../libs/libtorc-core
 DEPENDPATH  += ../../libs/libtorc-audio
+DEPENDPATH  += ../../libs/libtorc-audio/raop
+DEPENDPATH  += ../../libs/libtorc-video
 DEPENDPATH  += ../../libs/libtorc-av
 INCLUDEPATH += ../.. ../
 INCLUDEPATH += $$DEPENDPATH
 
 LIBS += -L../../libs/libtorc-core             -ltorc-core-$$LIBVERSION
 LIBS += -L../../libs/libtorc-audio            -ltorc-audio-$$LIBVERSION
+LIBS += -L../../libs/libtorc-video            -ltorc-video-$$LIBVERSION
 LIBS += -L../../libs/libtorc-av/libavformat   -ltorc-avformat
 LIBS += -L../../libs/libtorc-av/libavcodec    -ltorc-avcodec
 LIBS += -L../../libs/libtorc-av/libavutil     -ltorc-avutil
@@ -1,13 +1,32 @@
 // Qt
 #include <QCoreApplication>
+#include <QEventLoop>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMultiMap>
+#include <QThread>
+#include <QVector>
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
 
 // Torc
 #include "torcexitcodes.h"
+#include "torclogging.h"
 #include "torccoreutils.h"
 #include "torcdecoder.h"
 #include "torcplayer.h"
 #include "audiointerface.h"
 #include "audiooutput.h"
+#include "audiooutputdigitalencoder.h"
+#include "torcraopjitterbuffer.h"
+#include "torcrpcrequest.h"
 #include "torcutils.h"
 
 int TorcUtils::Probe(const QString &URI)
@@ -42,3 +61,453 @@ int TorcUtils::Play(const QString &URI)
     delete interface;
     return result;
 }
+
+#define BENCHMARK_REFRESH_INTERVAL 10 // ms
+
+/*! \brief Decode the given URI as fast as possible and print performance statistics as JSON.
+ *
+ * Audio is consumed by the NULL audio device (and hence is not paced in real time) and every
+ * decoded video frame is released by the video decoder thread as soon as it is decoded, so the result
+ * reflects demux and decode throughput only. The player's refresh timer only drives its state machine.
+ * Times are in microseconds.
+*/
+int TorcUtils::Benchmark(const QString &URI)
+{
+    TorcPlayer *player = TorcPlayer::Create(NULL, TorcPlayer::AudioDummy | TorcPlayer::Benchmark,
+                                            TorcDecoder::DecodeAudio | TorcDecoder::DecodeVideo);
+    if (!player)
+        return GENERIC_EXIT_NOT_OK;
+
+    player->StartRefreshTimer(BENCHMARK_REFRESH_INTERVAL);
+
+    if (!player->PlayMedia(URI, false))
+    {
+        delete player;
+        return GENERIC_EXIT_NOT_OK;
+    }
+
+    QEventLoop loop;
+    QObject::connect(player, SIGNAL(StateChanged(TorcPlayer::PlayerState)), &loop, SLOT(quit()));
+
+    TorcPlayer::PlayerState state = player->GetState();
+    while (state != TorcPlayer::Stopped && state != TorcPlayer::Errored)
+    {
+        loop.exec();
+        state = player->GetState();
+    }
+
+    QVariantMap statistics = player->GetStatistics();
+    delete player;
+
+    qint64 wall = statistics.value("wallTime").toLongLong();
+    if (wall > 0)
+    {
+        double seconds = (double)wall / 1000000.0;
+        statistics.insert("audioFramesPerSecond", statistics.value("audioFrames").toLongLong() / seconds);
+        statistics.insert("videoFramesPerSecond", statistics.value("videoFrames").toLongLong() / seconds);
+    }
+
+#if defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        // kilobytes on linux, bytes on OS X
+#if defined(Q_OS_MAC)
+        statistics.insert("peakMemory", (qint64)usage.ru_maxrss);
+#else
+        statistics.insert("peakMemory", (qint64)usage.ru_maxrss * 1024);
+#endif
+    }
+#endif
+
+    statistics.insert("result", TorcPlayer::StateToString(state));
+
+    QByteArray json = QJsonDocument(QJsonObject::fromVariantMap(statistics)).toJson();
+    fprintf(stdout, "%s", json.constData());
+    fflush(stdout);
+
+    return state == TorcPlayer::Errored ? GENERIC_EXIT_NOT_OK : GENERIC_EXIT_OK;
+}
+
+#define ENCODER_BENCHMARK_SECONDS  60
+#define ENCODER_BENCHMARK_CHANNELS 6
+#define ENCODER_BENCHMARK_RATE     48000
+#define ENCODER_BENCHMARK_BITRATE  448000
+#define ENCODER_BENCHMARK_CHUNK    1024
+
+static qint64 ProcessCPUTime(void)
+{
+#if defined(CLOCK_PROCESS_CPUTIME_ID)
+    struct timespec time;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) == 0)
+        return ((qint64)time.tv_sec * 1000000) + (time.tv_nsec / 1000);
+#endif
+    return -1;
+}
+
+/*! \brief Measure the cost of transcoding multichannel PCM to AC-3 for S/PDIF passthrough.
+ *
+ * Encodes a fixed duration of synthetic 5.1 float audio, in chunks similar to those passed by AudioOutput,
+ * and prints the CPU (and wall) time in microseconds per second of audio as JSON.
+*/
+int TorcUtils::EncoderBenchmark(void)
+{
+    AudioOutputDigitalEncoder encoder;
+    if (!encoder.Init(AV_CODEC_ID_AC3, ENCODER_BENCHMARK_BITRATE, ENCODER_BENCHMARK_RATE, ENCODER_BENCHMARK_CHANNELS))
+        return GENERIC_EXIT_NOT_OK;
+
+    int samples = ENCODER_BENCHMARK_CHUNK * ENCODER_BENCHMARK_CHANNELS;
+    QVector<float> input(samples);
+    QByteArray output(OUTBUFSIZE, 0);
+
+    qint64 frames   = 0;
+    qint64 total    = (qint64)ENCODER_BENCHMARK_SECONDS * ENCODER_BENCHMARK_RATE;
+    qint64 produced = 0;
+    qint64 cpu      = ProcessCPUTime();
+    quint64 wall    = TorcCoreUtils::GetMicrosecondCount();
+
+    while (frames < total)
+    {
+        // a different tone per channel
+        for (int i = 0; i < ENCODER_BENCHMARK_CHUNK; ++i)
+            for (int j = 0; j < ENCODER_BENCHMARK_CHANNELS; ++j)
+                input[i * ENCODER_BENCHMARK_CHANNELS + j] = 0.5f * sinf((frames + i) * (j + 1) * 440.0f * 2.0f * (float)M_PI / ENCODER_BENCHMARK_RATE);
+
+        size_t available = encoder.Encode(input.data(), samples * sizeof(float), FORMAT_FLT);
+        if (available > 0)
+            produced += encoder.GetFrames(output.data(), std::min((int)available, output.size()));
+
+        frames += ENCODER_BENCHMARK_CHUNK;
+    }
+
+    wall = TorcCoreUtils::GetMicrosecondCount() - wall;
+    if (cpu >= 0)
+        cpu = ProcessCPUTime() - cpu;
+
+    QVariantMap statistics;
+    statistics.insert("channels",            ENCODER_BENCHMARK_CHANNELS);
+    statistics.insert("sampleRate",          ENCODER_BENCHMARK_RATE);
+    statistics.insert("bitrate",             ENCODER_BENCHMARK_BITRATE);
+    statistics.insert("audioSeconds",        ENCODER_BENCHMARK_SECONDS);
+    statistics.insert("outputBytes",         produced);
+    statistics.insert("wallTime",            (qint64)wall);
+    statistics.insert("wallTimePerSecond",   (double)wall / ENCODER_BENCHMARK_SECONDS);
+    statistics.insert("cpuTime",             cpu);
+    statistics.insert("cpuTimePerSecond",    cpu >= 0 ? (double)cpu / ENCODER_BENCHMARK_SECONDS : -1.0);
+
+    QByteArray json = QJsonDocument(QJsonObject::fromVariantMap(statistics)).toJson();
+    fprintf(stdout, "%s", json.constData());
+    fflush(stdout);
+
+    return GENERIC_EXIT_OK;
+}
+
+#define JITTER_PACKETS      20000
+#define JITTER_FIRSTSEQUENCE 60000 // wraps during the run
+#define JITTER_PACKETMS     8      // 352 samples at 44.1kHz
+#define JITTER_NETWORKMS    2
+#define JITTER_RTT          20
+#define JITTER_RESENDMS     (RAOP_RESENDRETRY / 4)
+#define JITTER_LOSS         5      // percent, also applied to resent packets
+#define JITTER_REORDER      3      // percent, delayed by up to 3 packets
+#define JITTER_STALLSTART   8000   // packet at which the reader stalls
+#define JITTER_STALLLENGTH  600    // packets - longer than the ring
+
+class JitterPacket
+{
+  public:
+    JitterPacket()
+      : m_index(0), m_resend(false)
+    {
+    }
+
+    JitterPacket(int Index, bool Resend)
+      : m_index(Index), m_resend(Resend)
+    {
+    }
+
+    int  m_index;
+    bool m_resend;
+};
+
+/*! \brief Drive TorcRAOPJitterBuffer with a simulated stream and print the result as JSON.
+ *
+ * Packets are sent every JITTER_PACKETMS with random loss and reordering (using a fixed seed, so runs
+ * are repeatable). Resend requests are answered after JITTER_RTT and may themselves be lost. Part way
+ * through, the reader stalls for longer than the ring can hold, which exercises the overflow path.
+ *
+ * Fails if packets are played out of order, if a resend is rejected while its packet is still waiting
+ * in the ring, if the buffer's accounting does not add up or if the residual loss (after resends)
+ * exceeds 0.5% of the packets sent.
+*/
+int TorcUtils::RAOPJitterBuffer(void)
+{
+    TorcRAOPJitterBuffer buffer(0);
+    QMultiMap<int,JitterPacket> network;
+    QVector<bool> filled(JITTER_PACKETS, false);
+    quint8 output[RAOP_MAXPACKETSIZE];
+
+    qsrand(1);
+
+    int  sent         = 0;
+    int  networkLost  = 0;
+    int  reordered    = 0;
+    int  requested    = 0;
+    int  played       = 0;
+    int  lastPlayed   = -1;
+    int  orderErrors  = 0;
+    int  rejected     = 0;
+    int  firstWritten = -1;
+    int  now          = 0;
+    int  end          = JITTER_PACKETS * JITTER_PACKETMS + 5000;
+
+    for ( ; now < end; ++now)
+    {
+        // send
+        if (now % JITTER_PACKETMS == 0 && sent < JITTER_PACKETS)
+        {
+            if (qrand() % 100 < JITTER_LOSS)
+            {
+                networkLost++;
+            }
+            else
+            {
+                int delay = JITTER_NETWORKMS;
+                if (qrand() % 100 < JITTER_REORDER)
+                {
+                    delay += JITTER_PACKETMS * (1 + qrand() % 3);
+                    reordered++;
+                }
+                network.insert(now + delay, JitterPacket(sent, false));
+            }
+            sent++;
+        }
+
+        // receive
+        while (!network.isEmpty() && network.begin().key() <= now)
+        {
+            JitterPacket received = network.take(network.begin().key());
+            uint16_t sequence = (uint16_t)(JITTER_FIRSTSEQUENCE + received.m_index);
+            bool wanted = buffer.m_started && !filled[received.m_index] &&
+                          (int16_t)(sequence - buffer.m_readSequence) >= 0 &&
+                          (int16_t)(buffer.m_writeSequence - sequence) > 0;
+            TorcRAOPPacket *packet = received.m_resend ? buffer.Claim(sequence) : buffer.Reserve(sequence);
+
+            // a resend for a packet that is still waiting in the ring must be accepted
+            if (received.m_resend && wanted && !packet)
+                rejected++;
+
+            if (firstWritten < 0)
+                firstWritten = received.m_index;
+
+            if (packet)
+            {
+                memcpy(packet->m_data, &received.m_index, sizeof(int));
+                packet->m_size  = sizeof(int);
+                packet->m_state = TorcRAOPPacket::Filled;
+                buffer.m_received++;
+                filled[received.m_index] = true;
+            }
+        }
+
+        // request resends - new gaps are requested immediately, retries on the resend timer
+        if (now % JITTER_RESENDMS == 0)
+            buffer.RetryResends(now);
+
+        QVector<QPair<uint16_t,uint16_t> > resends = buffer.TakeResends(now);
+        for (int i = 0; i < resends.size(); ++i)
+        {
+            for (uint16_t j = 0; j < resends[i].second; ++j)
+            {
+                requested++;
+                if (qrand() % 100 >= JITTER_LOSS)
+                {
+                    int index = (uint16_t)(resends[i].first + j - JITTER_FIRSTSEQUENCE);
+                    network.insert(now + JITTER_RTT, JitterPacket(index, true));
+                }
+            }
+        }
+
+        // play
+        bool stalled = sent >= JITTER_STALLSTART && sent < JITTER_STALLSTART + JITTER_STALLLENGTH;
+        if (!stalled && now % JITTER_PACKETMS == JITTER_PACKETMS / 2)
+        {
+            if (buffer.Read(output, sizeof(output)) == sizeof(int))
+            {
+                int index = 0;
+                memcpy(&index, output, sizeof(int));
+                if (index <= lastPlayed)
+                    orderErrors++;
+                lastPlayed = index;
+                played++;
+            }
+        }
+    }
+
+    int remaining = (uint16_t)(buffer.m_writeSequence - buffer.m_readSequence);
+    int written   = firstWritten < 0 ? 0 : (uint16_t)(buffer.m_writeSequence - (uint16_t)(JITTER_FIRSTSEQUENCE + firstWritten));
+    bool accounted = (quint64)written == played + buffer.m_lost + buffer.m_dropped + remaining;
+    bool residual  = buffer.m_lost * 200 <= (quint64)sent;
+    bool passed    = orderErrors == 0 && rejected == 0 && accounted && residual;
+
+    QVariantMap statistics;
+    statistics.insert("packetsSent",      sent);
+    statistics.insert("networkLost",      networkLost);
+    statistics.insert("reordered",        reordered);
+    statistics.insert("resendsRequested", requested);
+    statistics.insert("received",         buffer.m_received);
+    statistics.insert("played",           played);
+    statistics.insert("lost",             buffer.m_lost);
+    statistics.insert("late",             buffer.m_late);
+    statistics.insert("dropped",          buffer.m_dropped);
+    statistics.insert("underruns",        buffer.m_underruns);
+    statistics.insert("remaining",        remaining);
+    statistics.insert("playoutDelay",     buffer.m_playoutDelay);
+    statistics.insert("orderErrors",      orderErrors);
+    statistics.insert("rejectedResends",  rejected);
+    statistics.insert("accounted",        accounted);
+    statistics.insert("result",           passed ? "passed" : "failed");
+
+    QByteArray json = QJsonDocument(QJsonObject::fromVariantMap(statistics)).toJson();
+    fprintf(stdout, "%s", json.constData());
+    fflush(stdout);
+
+    return passed ? GENERIC_EXIT_OK : GENERIC_EXIT_NOT_OK;
+}
+
+/*! \class TorcRPCBatchService
+ *  \brief A minimal service used to verify batched JSON-RPC requests.
+*/
+TorcRPCBatchService::TorcRPCBatchService()
+  : QObject(),
+    TorcHTTPService(this, "rpcbatch", "rpcbatch", TorcRPCBatchService::staticMetaObject),
+    value(0)
+{
+}
+
+void TorcRPCBatchService::SubscriberDeleted(QObject *Subscriber)
+{
+    TorcHTTPService::HandleSubscriberDeleted(Subscriber);
+}
+
+int TorcRPCBatchService::GetValue(void)
+{
+    return value;
+}
+
+void TorcRPCBatchService::SetValue(int Value)
+{
+    value = Value;
+    emit ValueChanged();
+}
+
+/*! \class TorcRPCBatchConnection
+ *  \brief Stands in for the TorcWebSocket a batch is received on.
+*/
+TorcRPCBatchConnection::TorcRPCBatchConnection()
+  : QObject(),
+    m_changes(0)
+{
+}
+
+void TorcRPCBatchConnection::PropertyChanged(void)
+{
+    m_changes++;
+}
+
+bool TorcRPCBatchConnection::HandleNotification(const QString&)
+{
+    return false;
+}
+
+void TorcRPCBatchConnection::RequestReady(TorcRPCRequest*)
+{
+}
+
+/*! \brief Send a JSON-RPC batch through the receiving peer's request handling and check the responses.
+ *
+ * A notification (SetValue), a call (GetValue) and a subscription are serialised and combined into a
+ * single batch, as TorcWebSocket::SendBatch does for requests made within one event loop iteration. The
+ * batch is then processed as a peer would process it (see TorcWebSocket::ProcessPayload) and the batched
+ * responses matched by id.
+ *
+ * Fails unless the notification was delivered before the call, both responses are results (rather than
+ * errors) and the subscription was registered against the connection the batch was received on.
+*/
+int TorcUtils::RPCBatch(void)
+{
+    TorcRPCBatchService service;
+    TorcRPCBatchConnection connection;
+    TorcRPCBatchConnection requestor;
+
+    TorcRPCRequest *notification = new TorcRPCRequest(SERVICES_DIRECTORY + "rpcbatch/SetValue");
+    notification->AddParameter("Value", 42);
+    TorcRPCRequest *get = new TorcRPCRequest(SERVICES_DIRECTORY + "rpcbatch/GetValue", &requestor);
+    get->SetID(1);
+    TorcRPCRequest *subscribe = new TorcRPCRequest(SERVICES_DIRECTORY + "rpcbatch/Subscribe", &requestor);
+    subscribe->SetID(2);
+
+    QByteArray batch("[");
+    batch.append(notification->SerialiseRequest(TorcWebSocket::SubProtocolJSONRPC));
+    batch.append(',');
+    batch.append(get->SerialiseRequest(TorcWebSocket::SubProtocolJSONRPC));
+    batch.append(',');
+    batch.append(subscribe->SerialiseRequest(TorcWebSocket::SubProtocolJSONRPC));
+    batch.append(']');
+
+    notification->DownRef();
+    get->DownRef();
+    subscribe->DownRef();
+
+    // the receiving peer
+    TorcRPCRequest *received = new TorcRPCRequest(TorcWebSocket::SubProtocolJSONRPC, batch, &connection);
+    QByteArray reply = received->GetData();
+    received->DownRef();
+
+    // and the responses back at the sender
+    int results = 0;
+    int errors  = 0;
+    QVariant value;
+    QVariant properties;
+
+    QJsonDocument doc = QJsonDocument::fromJson(reply);
+    QJsonArray responses = doc.array();
+    QJsonArray::const_iterator it = responses.begin();
+    for ( ; it != responses.end(); ++it)
+    {
+        QJsonObject response = (*it).toObject();
+        if (!response.contains("result"))
+        {
+            errors++;
+            continue;
+        }
+
+        results++;
+        int id = (int)response.value("id").toDouble();
+        if (id == 1)
+            value = response.value("result").toVariant();
+        else if (id == 2)
+            properties = response.value("result").toVariant().toMap().value("properties");
+    }
+
+    // the subscription belongs to the receiving connection, so property changes are delivered to it
+    service.SetValue(43);
+
+    bool passed = doc.isArray() && responses.size() == 2 && results == 2 && errors == 0 &&
+                  value.toInt() == 42 && properties.toMap().size() == 1 && connection.m_changes == 1;
+
+    QVariantMap statistics;
+    statistics.insert("responses",     responses.size());
+    statistics.insert("results",       results);
+    statistics.insert("errors",        errors);
+    statistics.insert("value",         value);
+    statistics.insert("subscriptions", properties.toMap().size());
+    statistics.insert("changes",       connection.m_changes);
+    statistics.insert("result",        passed ? "passed" : "failed");
+
+    QByteArray json = QJsonDocument(QJsonObject::fromVariantMap(statistics)).toJson();
+    fprintf(stdout, "%s", json.constData());
+    fflush(stdout);
+
+    return passed ? GENERIC_EXIT_OK : GENERIC_EXIT_NOT_OK;
+}
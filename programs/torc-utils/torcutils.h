@@ -1,11 +1,59 @@
 #ifndef TORCUTILS_H
 #define TORCUTILS_H
 
+// Qt
+#include <QObject>
+
+// Torc
+#include "http/torchttpservice.h"
+
+class TorcRPCRequest;
+
 class TorcUtils
 {
   public:
     static int Probe (const QString &URI);
     static int Play  (const QString &URI);
+    static int Benchmark (const QString &URI);
+    static int EncoderBenchmark (void);
+    static int RAOPJitterBuffer (void);
+    static int RPCBatch  (void);
+};
+
+class TorcRPCBatchService : public QObject, public TorcHTTPService
+{
+    Q_OBJECT
+    Q_CLASSINFO("Version", "1.0.0")
+    Q_PROPERTY(int value READ GetValue NOTIFY ValueChanged)
+
+  public:
+    TorcRPCBatchService();
+
+  signals:
+    void ValueChanged      (void);
+
+  public slots:
+    void SubscriberDeleted (QObject *Subscriber);
+    int  GetValue          (void);
+    void SetValue          (int Value);
+
+  private:
+    int  value;
+};
+
+class TorcRPCBatchConnection : public QObject
+{
+    Q_OBJECT
+
+  public:
+    TorcRPCBatchConnection();
+
+    int  m_changes;
+
+  public slots:
+    void PropertyChanged   (void);
+    bool HandleNotification(const QString &Method);
+    void RequestReady      (TorcRPCRequest *Request);
 };
 
 #endif // TORCUTILS_H